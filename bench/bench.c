@@ -0,0 +1,440 @@
+/**
+ * This module benchmarks the measurement pipeline and the output
+ * formatters against the simulated edge source in sim_gpiod.c.
+ *
+ * The pipeline benchmark runs the production measurement path
+ * (measurement_create_threads() with either engine) for a range of fan
+ * counts and reports delivered edge events per second, CPU per fan and
+ * the RPM error against the simulated ground truth.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <getopt.h>
+#include <pthread.h>
+#include "measurement_common.h"
+#include "format.h"
+#include "stats.h"
+#include "sim_gpiod.h"
+
+#define BENCH_MAX_FANS 64
+#define BENCH_FORMAT_ITERATIONS_DEFAULT 200000
+
+// Globals expected by the measurement code (normally defined in main.c)
+volatile sig_atomic_t stop = 0;
+pthread_mutex_t print_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Benchmark options
+ */
+typedef struct {
+    size_t fans[16];           /**< Fan counts to run */
+    size_t nfans;              /**< Number of entries in fans */
+    double rate;               /**< Edges per second per fan */
+    double jitter;             /**< Relative period jitter */
+    double glitch;             /**< Glitch probability per edge */
+    int64_t duration_ns;       /**< Measurement duration per run */
+    int64_t debounce_ns;       /**< Software glitch filter period (0 = off) */
+    int engines;               /**< Bit 0: epoll, bit 1: threads */
+    rpm_method_t method;       /**< Measurement method */
+    int pulses;                /**< Pulses per revolution */
+    long iterations;           /**< Formatter iterations */
+} bench_options_t;
+
+/**
+ * Result of one pipeline run
+ */
+typedef struct {
+    double wall_s;             /**< Wall time of the run */
+    double cpu_s;              /**< Measurement CPU time (generators excluded) */
+    double max_error;          /**< Largest relative RPM error */
+    int missing;               /**< Fans without a result */
+    sim_stats_t sim;           /**< Simulator counters */
+} pipeline_result_t;
+
+static int64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [OPTIONS]\n\n", prog);
+    printf("Benchmark the measurement pipeline and formatters on simulated GPIO lines.\n\n");
+    printf("Options:\n");
+    printf("  -f, --fans=LIST       Comma separated fan counts (default: 1,4,16,64)\n");
+    printf("  -r, --rate=HZ         Edges per second per fan (default: 400)\n");
+    printf("  -j, --jitter=FRACTION Random period jitter, e.g. 0.01 (default: 0)\n");
+    printf("  -d, --duration=SEC    Measurement duration per run (default: 1)\n");
+    printf("  -g, --glitch=P        Inject a glitch after an edge with probability P (default: 0)\n");
+    printf("  -b, --debounce=US     Glitch filter period in microseconds (default: off)\n");
+    printf("  -e, --engine=ENGINE   epoll, threads or both (default: both)\n");
+    printf("  -m, --method=METHOD   count, period or adaptive (default: count)\n");
+    printf("  -p, --pulses=N        Pulses per revolution (default: 4)\n");
+    printf("  -n, --iterations=N    Formatter iterations (default: %d)\n", BENCH_FORMAT_ITERATIONS_DEFAULT);
+    printf("  -h, --help            Show this help\n");
+}
+
+static int parse_fans(const char *arg, bench_options_t *opts) {
+    opts->nfans = 0;
+    const char *p = arg;
+    while (*p) {
+        char *end;
+        long n = strtol(p, &end, 10);
+        if (end == p || n < 1 || n > BENCH_MAX_FANS) return -1;
+        if (opts->nfans == sizeof(opts->fans) / sizeof(opts->fans[0])) return -1;
+        opts->fans[opts->nfans++] = (size_t)n;
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        p = end;
+    }
+    return opts->nfans > 0 ? 0 : -1;
+}
+
+static int parse_options(int argc, char **argv, bench_options_t *opts) {
+    static struct option long_options[] = {
+        {"fans", required_argument, 0, 'f'},
+        {"rate", required_argument, 0, 'r'},
+        {"jitter", required_argument, 0, 'j'},
+        {"duration", required_argument, 0, 'd'},
+        {"glitch", required_argument, 0, 'g'},
+        {"debounce", required_argument, 0, 'b'},
+        {"engine", required_argument, 0, 'e'},
+        {"method", required_argument, 0, 'm'},
+        {"pulses", required_argument, 0, 'p'},
+        {"iterations", required_argument, 0, 'n'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:r:j:g:d:b:e:m:p:n:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'f':
+                if (parse_fans(optarg, opts) < 0) {
+                    fprintf(stderr, "\nError: invalid fan list '%s' (1-%d each)\n\n", optarg, BENCH_MAX_FANS);
+                    return -1;
+                }
+                break;
+            case 'r':
+                opts->rate = strtod(optarg, NULL);
+                if (opts->rate <= 0.0) {
+                    fprintf(stderr, "\nError: rate must be positive\n\n");
+                    return -1;
+                }
+                break;
+            case 'j':
+                opts->jitter = strtod(optarg, NULL);
+                if (opts->jitter < 0.0 || opts->jitter >= 1.0) {
+                    fprintf(stderr, "\nError: jitter must be in [0, 1)\n\n");
+                    return -1;
+                }
+                break;
+            case 'g':
+                opts->glitch = strtod(optarg, NULL);
+                if (opts->glitch < 0.0 || opts->glitch > 1.0) {
+                    fprintf(stderr, "\nError: glitch probability must be in [0, 1]\n\n");
+                    return -1;
+                }
+                break;
+            case 'd': {
+                double seconds = strtod(optarg, NULL);
+                if (seconds < 0.1 || seconds > 60.0) {
+                    fprintf(stderr, "\nError: duration must be between 0.1 and 60 seconds\n\n");
+                    return -1;
+                }
+                opts->duration_ns = (int64_t)(seconds * NSEC_PER_SEC);
+                break;
+            }
+            case 'b': {
+                double us = strtod(optarg, NULL);
+                if (us < 0.0 || us * NSEC_PER_USEC > GPIO_DEBOUNCE_MAX_NS) {
+                    fprintf(stderr, "\nError: debounce must be between 0 and %lld us\n\n",
+                            GPIO_DEBOUNCE_MAX_NS / NSEC_PER_USEC);
+                    return -1;
+                }
+                opts->debounce_ns = (int64_t)(us * NSEC_PER_USEC);
+                break;
+            }
+            case 'e':
+                if (strcmp(optarg, "epoll") == 0) opts->engines = 1;
+                else if (strcmp(optarg, "threads") == 0) opts->engines = 2;
+                else if (strcmp(optarg, "both") == 0) opts->engines = 3;
+                else {
+                    fprintf(stderr, "\nError: engine must be 'epoll', 'threads' or 'both'\n\n");
+                    return -1;
+                }
+                break;
+            case 'm':
+                if (strcmp(optarg, "count") == 0) opts->method = METHOD_COUNT;
+                else if (strcmp(optarg, "period") == 0) opts->method = METHOD_PERIOD;
+                else if (strcmp(optarg, "adaptive") == 0) opts->method = METHOD_ADAPTIVE;
+                else {
+                    fprintf(stderr, "\nError: method must be 'count', 'period' or 'adaptive'\n\n");
+                    return -1;
+                }
+                break;
+            case 'p':
+                opts->pulses = atoi(optarg);
+                if (opts->pulses < 1) {
+                    fprintf(stderr, "\nError: pulses must be positive\n\n");
+                    return -1;
+                }
+                break;
+            case 'n':
+                opts->iterations = atol(optarg);
+                if (opts->iterations < 1) {
+                    fprintf(stderr, "\nError: iterations must be positive\n\n");
+                    return -1;
+                }
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                exit(0);
+            default:
+                fprintf(stderr, "Try: %s --help\n\n", argv[0]);
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Run one single measurement of nfans simulated fans
+ */
+static int run_pipeline(const bench_options_t *opts, engine_type_t engine, size_t nfans,
+                        pipeline_result_t *result) {
+    int gpios[BENCH_MAX_FANS];
+    for (size_t i = 0; i < nfans; i++) {
+        gpios[i] = (int)i;
+    }
+
+    measurement_params_t params = {
+        .gpios = gpios,
+        .ngpio = nfans,
+        .duration_ns = opts->duration_ns,
+        .pulses = opts->pulses,
+        .warmup_ns = opts->duration_ns / 10,
+        .edge = EDGE_BOTH,
+        .event_batch = GPIO_EVENT_BATCH_DEFAULT,
+        .debounce_ns = opts->debounce_ns,
+        .method = opts->method,
+        .periods = RPM_PERIODS_DEFAULT,
+        .target_pulses = RPM_TARGET_PULSES_DEFAULT,
+        .interval_ns = NSEC_PER_SEC,
+        .mode = MODE_DEFAULT,
+        .engine = engine
+    };
+
+    sim_stats_t discard;
+    sim_take_stats(&discard);
+
+    int64_t wall0 = clock_ns(CLOCK_MONOTONIC);
+    int64_t cpu0 = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+
+    measurement_ctx_t ctx;
+    char chipname[] = "gpiochip0";
+    if (measurement_ctx_init(&ctx, gpios, nfans, chipname) < 0) {
+        return -1;
+    }
+    if (measurement_create_threads(&ctx, &params) < 0) {
+        measurement_ctx_cleanup(&ctx);
+        return -1;
+    }
+    measurement_join_threads(&ctx);
+    measurement_collect_results(&ctx);
+
+    int64_t cpu1 = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    int64_t wall1 = clock_ns(CLOCK_MONOTONIC);
+
+    result->max_error = 0.0;
+    result->missing = 0;
+    for (size_t i = 0; i < nfans; i++) {
+        double truth = sim_line_rate((unsigned int)i) * 60.0 / opts->pulses;
+        double rpm = (double)ctx.results[i] / RPM_SCALE;
+        if (rpm <= 0.0) {
+            result->missing++;
+            continue;
+        }
+        double error = fabs(rpm - truth) / truth;
+        if (error > result->max_error) result->max_error = error;
+    }
+    measurement_ctx_cleanup(&ctx);
+
+    // Generator threads have all exited once their requests are released
+    sim_take_stats(&result->sim);
+    result->wall_s = (double)(wall1 - wall0) / NSEC_PER_SEC;
+    result->cpu_s = (double)(cpu1 - cpu0 - result->sim.generator_cpu_ns) / NSEC_PER_SEC;
+    if (result->cpu_s < 0.0) result->cpu_s = 0.0;
+
+    return 0;
+}
+
+static int bench_pipeline(const bench_options_t *opts) {
+    printf("Pipeline: %.0f edges/s per fan, %.2f s per run, method %s, jitter %.3f, glitch %.3f, "
+           "debounce %.0f us\n\n",
+           opts->rate, (double)opts->duration_ns / NSEC_PER_SEC,
+           opts->method == METHOD_PERIOD ? "period" :
+           opts->method == METHOD_ADAPTIVE ? "adaptive" : "count", opts->jitter, opts->glitch,
+           (double)opts->debounce_ns / NSEC_PER_USEC);
+    printf("%-8s %5s %12s %10s %10s %10s %8s %8s\n",
+           "engine", "fans", "events/s", "cpu/fan", "ns/event", "max err", "dropped", "missing");
+
+    for (int e = 0; e < 2; e++) {
+        if (!(opts->engines & (1 << e))) continue;
+        engine_type_t engine = e == 0 ? ENGINE_EPOLL : ENGINE_THREADS;
+
+        for (size_t f = 0; f < opts->nfans; f++) {
+            size_t nfans = opts->fans[f];
+            pipeline_result_t r;
+            if (run_pipeline(opts, engine, nfans, &r) < 0) {
+                fprintf(stderr, "Error: pipeline run with %zu fans failed\n", nfans);
+                return -1;
+            }
+
+            double events_per_s = r.wall_s > 0.0 ? (double)r.sim.read / r.wall_s : 0.0;
+            double cpu_per_fan = r.wall_s > 0.0 ? r.cpu_s / r.wall_s / (double)nfans * 100.0 : 0.0;
+            double ns_per_event = r.sim.read > 0 ? r.cpu_s * 1e9 / (double)r.sim.read : 0.0;
+
+            printf("%-8s %5zu %12.0f %9.3f%% %10.1f %9.4f%% %8llu %8d\n",
+                   e == 0 ? "epoll" : "threads", nfans, events_per_s, cpu_per_fan, ns_per_event,
+                   r.max_error * 100.0, (unsigned long long)r.sim.dropped, r.missing);
+        }
+    }
+    printf("\n");
+    return 0;
+}
+
+static void print_format_result(const char *name, long iterations, int64_t elapsed_ns) {
+    printf("%-28s %10.1f ns/op\n", name, (double)elapsed_ns / (double)iterations);
+}
+
+static void bench_formatters(const bench_options_t *opts) {
+    static const struct {
+        const char *name;
+        output_mode_t mode;
+    } modes[] = {
+        {"default", MODE_DEFAULT},
+        {"numeric", MODE_NUMERIC},
+        {"json", MODE_JSON},
+        {"collectd", MODE_COLLECTD}
+    };
+
+    format_fan_t fans[BENCH_MAX_FANS] = {0};
+    rpm_value_t results[BENCH_MAX_FANS];
+    rpm_summary_t stats[BENCH_MAX_FANS];
+    for (size_t i = 0; i < BENCH_MAX_FANS; i++) {
+        fans[i].gpio = (int)i;
+        fans[i].pulses = opts->pulses;
+        results[i] = (rpm_value_t)(1234.5 * RPM_SCALE) + RPM_VALUE(i);
+        rpm_stats_t totals;
+        stats_init(&totals);
+        stats_update(&totals, results[i] - RPM_VALUE(10));
+        stats_update(&totals, results[i] + RPM_VALUE(10));
+        stats_summarize(&totals, &stats[i]);
+    }
+
+    long n = opts->iterations;
+    char buf[256];
+    int64_t now = clock_ns(CLOCK_REALTIME);
+    volatile size_t sink = 0;  // Keeps the loops from being optimized away
+
+    printf("Formatters: %ld iterations\n\n", n);
+
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        char name[64];
+        int64_t t0 = clock_ns(CLOCK_MONOTONIC);
+        for (long i = 0; i < n; i++) {
+            char *s = format_output(17, results[0], &stats[0], modes[m].mode, NSEC_PER_SEC);
+            sink += s ? (size_t)s[0] : 0;
+            free(s);
+        }
+        snprintf(name, sizeof(name), "format_output %s", modes[m].name);
+        print_format_result(name, n, clock_ns(CLOCK_MONOTONIC) - t0);
+
+        t0 = clock_ns(CLOCK_MONOTONIC);
+        for (long i = 0; i < n; i++) {
+            int len = format_output_into(buf, sizeof(buf), &fans[17], results[0], &stats[0], NULL,
+                                         modes[m].mode, NSEC_PER_SEC, now);
+            sink += (size_t)len;
+        }
+        snprintf(name, sizeof(name), "format_output_into %s", modes[m].name);
+        print_format_result(name, n, clock_ns(CLOCK_MONOTONIC) - t0);
+    }
+
+    int64_t t0 = clock_ns(CLOCK_MONOTONIC);
+    for (long i = 0; i < n; i++) {
+        int len = format_binary_into((unsigned char *)buf, sizeof(buf), 17, results[0], 1234, 0,
+                                     NSEC_PER_SEC, t0);
+        sink += (size_t)len;
+    }
+    print_format_result("format_binary_into", n, clock_ns(CLOCK_MONOTONIC) - t0);
+
+    for (size_t f = 0; f < opts->nfans; f++) {
+        size_t nfans = opts->fans[f];
+        if (nfans < 2) continue;  // A single fan is never printed as an array
+
+        // Scale the iterations so every row takes about the same time
+        long iters = n / (long)nfans > 0 ? n / (long)nfans : 1;
+        char name[64];
+        int64_t t0 = clock_ns(CLOCK_MONOTONIC);
+        for (long i = 0; i < iters; i++) {
+            char *s = format_json_array(fans, results, stats, nfans);
+            sink += s ? (size_t)s[0] : 0;
+            free(s);
+        }
+        snprintf(name, sizeof(name), "format_json_array %zu", nfans);
+        print_format_result(name, iters, clock_ns(CLOCK_MONOTONIC) - t0);
+
+        format_buffer_t out;
+        if (format_buffer_init(&out, 256 * nfans) < 0) continue;
+        t0 = clock_ns(CLOCK_MONOTONIC);
+        for (long i = 0; i < iters; i++) {
+            out.len = 0;
+            format_buffer_append_json_array(&out, fans, results, stats, NULL, nfans);
+            sink += out.len;
+        }
+        snprintf(name, sizeof(name), "format_buffer json_array %zu", nfans);
+        print_format_result(name, iters, clock_ns(CLOCK_MONOTONIC) - t0);
+        format_buffer_free(&out);
+    }
+    printf("\n");
+    (void)sink;
+}
+
+int main(int argc, char **argv) {
+    bench_options_t opts = {
+        .fans = {1, 4, 16, 64},
+        .nfans = 4,
+        .rate = 400.0,
+        .jitter = 0.0,
+        .glitch = 0.0,
+        .duration_ns = 1 * NSEC_PER_SEC,
+        .engines = 3,
+        .method = METHOD_COUNT,
+        .pulses = 4,
+        .iterations = BENCH_FORMAT_ITERATIONS_DEFAULT
+    };
+
+    if (parse_options(argc, argv, &opts) < 0) {
+        return 1;
+    }
+
+    sim_set_rate(opts.rate);
+    sim_set_jitter(opts.jitter);
+    sim_set_glitch(opts.glitch);
+
+    if (bench_pipeline(&opts) < 0) {
+        return 1;
+    }
+    bench_formatters(&opts);
+
+    return 0;
+}
@@ -0,0 +1,460 @@
+/**
+ * This module simulates the libgpiod v2 edge event API for benchmarks.
+ *
+ * Every line request gets a pipe and a generator thread that writes
+ * synthetic edge events at a configurable rate, so the production read
+ * path (poll, gpiod_line_request_read_edge_events, event buffer) runs
+ * unchanged without GPIO hardware.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#define _GNU_SOURCE  // For F_SETPIPE_SZ
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <gpiod.h>
+#include "sim_gpiod.h"
+
+#define SIM_TICK_NS 1000000LL          // Generator wakeup period
+#define SIM_WRITE_BATCH 256            // Events per write() (4 KiB, atomic for pipes)
+#define SIM_PIPE_SIZE (1024 * 1024)    // Pipe capacity while the reader lags
+#define SIM_GLITCH_NS 2000LL           // Width of an injected glitch pulse
+
+/**
+ * Event record as written to the pipe
+ */
+struct gpiod_edge_event {
+    uint64_t timestamp_ns;
+    uint32_t offset;
+    uint32_t type;
+    unsigned long global_seqno;
+    unsigned long line_seqno;
+};
+
+struct gpiod_edge_event_buffer {
+    size_t capacity;
+    size_t num_events;
+    struct gpiod_edge_event *events;
+};
+
+struct gpiod_chip {
+    char path[64];
+};
+
+struct gpiod_chip_info {
+    char name[32];
+};
+
+struct gpiod_line_info {
+    unsigned int offset;
+};
+
+struct gpiod_line_settings {
+    enum gpiod_line_edge edge;
+};
+
+struct gpiod_line_config {
+    unsigned int offsets[SIM_NUM_LINES];
+    size_t num_offsets;
+    enum gpiod_line_edge edge;
+};
+
+struct gpiod_request_config {
+    size_t event_buffer_size;
+};
+
+/**
+ * Per-line generator state
+ */
+typedef struct {
+    unsigned int offset;
+    int64_t period_ns;
+    int64_t next_ns;
+    int level;
+    unsigned long seqno;
+} sim_line_t;
+
+struct gpiod_line_request {
+    int rfd;
+    int wfd;
+    pthread_t thread;
+    atomic_int quit;
+    sim_line_t *lines;
+    size_t num_lines;
+    enum gpiod_line_edge edge;
+    unsigned int seed;
+};
+
+static double sim_rate = 400.0;
+static double sim_rates[SIM_NUM_LINES];
+static double sim_jitter = 0.0;
+static double sim_glitch = 0.0;
+static atomic_ulong sim_global_seqno;
+static atomic_uint_fast64_t sim_generated;
+static atomic_uint_fast64_t sim_dropped;
+static atomic_uint_fast64_t sim_read;
+static atomic_int_fast64_t sim_generator_cpu;
+
+void sim_set_rate(double hz) {
+    sim_rate = hz;
+}
+
+void sim_set_line_rate(unsigned int offset, double hz) {
+    if (offset < SIM_NUM_LINES) sim_rates[offset] = hz;
+}
+
+void sim_set_jitter(double fraction) {
+    sim_jitter = fraction;
+}
+
+void sim_set_glitch(double probability) {
+    sim_glitch = probability;
+}
+
+double sim_line_rate(unsigned int offset) {
+    if (offset < SIM_NUM_LINES && sim_rates[offset] > 0.0) return sim_rates[offset];
+    return sim_rate;
+}
+
+void sim_take_stats(sim_stats_t *stats) {
+    if (!stats) return;
+    stats->generated = atomic_exchange(&sim_generated, 0);
+    stats->dropped = atomic_exchange(&sim_dropped, 0);
+    stats->read = atomic_exchange(&sim_read, 0);
+    stats->generator_cpu_ns = atomic_exchange(&sim_generator_cpu, 0);
+}
+
+static int64_t sim_clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int64_t sim_next_period(struct gpiod_line_request *req, const sim_line_t *line) {
+    if (sim_jitter <= 0.0) return line->period_ns;
+    double r = (double)rand_r(&req->seed) / RAND_MAX * 2.0 - 1.0;
+    return line->period_ns + (int64_t)(r * sim_jitter * (double)line->period_ns);
+}
+
+static void sim_flush(struct gpiod_line_request *req, struct gpiod_edge_event *batch, size_t n) {
+    if (n == 0) return;
+    ssize_t w = write(req->wfd, batch, n * sizeof(*batch));
+    size_t written = w > 0 ? (size_t)w / sizeof(*batch) : 0;
+    atomic_fetch_add(&sim_generated, n);
+    if (written < n) {
+        atomic_fetch_add(&sim_dropped, n - written);
+    }
+}
+
+/**
+ * Queue one edge for writing unless the request filters its type
+ */
+static void sim_emit(struct gpiod_line_request *req, struct gpiod_edge_event *batch, size_t *n,
+                     sim_line_t *line, int64_t timestamp_ns, int rising) {
+    if ((req->edge == GPIOD_LINE_EDGE_RISING && !rising) ||
+        (req->edge == GPIOD_LINE_EDGE_FALLING && rising)) {
+        return;
+    }
+
+    struct gpiod_edge_event *ev = &batch[(*n)++];
+    ev->timestamp_ns = (uint64_t)timestamp_ns;
+    ev->offset = line->offset;
+    ev->type = rising ? GPIOD_EDGE_EVENT_RISING_EDGE : GPIOD_EDGE_EVENT_FALLING_EDGE;
+    ev->global_seqno = atomic_fetch_add(&sim_global_seqno, 1) + 1;
+    ev->line_seqno = ++line->seqno;
+    if (*n == SIM_WRITE_BATCH) {
+        sim_flush(req, batch, *n);
+        *n = 0;
+    }
+}
+
+static void* sim_generator_fn(void *arg) {
+    struct gpiod_line_request *req = arg;
+    struct gpiod_edge_event batch[SIM_WRITE_BATCH];
+
+    int64_t tick = sim_clock_ns(CLOCK_MONOTONIC);
+    while (!atomic_load(&req->quit)) {
+        tick += SIM_TICK_NS;
+        struct timespec ts = { .tv_sec = tick / 1000000000LL, .tv_nsec = tick % 1000000000LL };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+        int64_t now = sim_clock_ns(CLOCK_MONOTONIC);
+        size_t n = 0;
+        for (size_t i = 0; i < req->num_lines; i++) {
+            sim_line_t *line = &req->lines[i];
+            while (line->next_ns <= now) {
+                int64_t edge_ns = line->next_ns;
+                line->level = !line->level;
+                line->next_ns += sim_next_period(req, line);
+                sim_emit(req, batch, &n, line, edge_ns, line->level);
+
+                // Ringing after the edge: a short pulse back to the old level
+                if (sim_glitch > 0.0 && (double)rand_r(&req->seed) / RAND_MAX < sim_glitch) {
+                    sim_emit(req, batch, &n, line, edge_ns + SIM_GLITCH_NS, !line->level);
+                    sim_emit(req, batch, &n, line, edge_ns + 2 * SIM_GLITCH_NS, line->level);
+                }
+            }
+        }
+        sim_flush(req, batch, n);
+    }
+
+    atomic_fetch_add(&sim_generator_cpu, sim_clock_ns(CLOCK_THREAD_CPUTIME_ID));
+    return NULL;
+}
+
+bool gpiod_is_gpiochip_device(const char *path) {
+    return path && strcmp(path, "/dev/gpiochip0") == 0;
+}
+
+struct gpiod_chip *gpiod_chip_open(const char *path) {
+    // Only the first chip exists
+    if (!path || strcmp(path, "/dev/gpiochip0") != 0) {
+        errno = ENOENT;
+        return NULL;
+    }
+    struct gpiod_chip *chip = calloc(1, sizeof(*chip));
+    if (chip) snprintf(chip->path, sizeof(chip->path), "%s", path);
+    return chip;
+}
+
+void gpiod_chip_close(struct gpiod_chip *chip) {
+    free(chip);
+}
+
+struct gpiod_chip_info *gpiod_chip_get_info(struct gpiod_chip *chip) {
+    if (!chip) return NULL;
+    struct gpiod_chip_info *info = calloc(1, sizeof(*info));
+    if (info) snprintf(info->name, sizeof(info->name), "gpiochip0");
+    return info;
+}
+
+void gpiod_chip_info_free(struct gpiod_chip_info *info) {
+    free(info);
+}
+
+const char *gpiod_chip_info_get_name(struct gpiod_chip_info *info) {
+    return info ? info->name : NULL;
+}
+
+const char *gpiod_chip_info_get_label(struct gpiod_chip_info *info) {
+    return info ? "gpio-sim" : NULL;
+}
+
+size_t gpiod_chip_info_get_num_lines(struct gpiod_chip_info *info) {
+    return info ? SIM_NUM_LINES : 0;
+}
+
+struct gpiod_line_info *gpiod_chip_get_line_info(struct gpiod_chip *chip, unsigned int offset) {
+    if (!chip || offset >= SIM_NUM_LINES) return NULL;
+    struct gpiod_line_info *info = calloc(1, sizeof(*info));
+    if (info) info->offset = offset;
+    return info;
+}
+
+void gpiod_line_info_free(struct gpiod_line_info *info) {
+    free(info);
+}
+
+unsigned long gpiod_line_info_get_debounce_period_us(struct gpiod_line_info *info) {
+    (void)info;
+    return 0;  // No hardware debounce, exercises the software glitch filter
+}
+
+struct gpiod_line_settings *gpiod_line_settings_new(void) {
+    struct gpiod_line_settings *settings = calloc(1, sizeof(*settings));
+    if (settings) settings->edge = GPIOD_LINE_EDGE_NONE;
+    return settings;
+}
+
+void gpiod_line_settings_free(struct gpiod_line_settings *settings) {
+    free(settings);
+}
+
+int gpiod_line_settings_set_direction(struct gpiod_line_settings *settings,
+                                      enum gpiod_line_direction direction) {
+    (void)direction;
+    return settings ? 0 : -1;
+}
+
+void gpiod_line_settings_set_debounce_period_us(struct gpiod_line_settings *settings,
+                                                unsigned long period) {
+    (void)settings;
+    (void)period;
+}
+
+int gpiod_line_settings_set_edge_detection(struct gpiod_line_settings *settings,
+                                           enum gpiod_line_edge edge) {
+    if (!settings) return -1;
+    settings->edge = edge;
+    return 0;
+}
+
+struct gpiod_line_config *gpiod_line_config_new(void) {
+    return calloc(1, sizeof(struct gpiod_line_config));
+}
+
+void gpiod_line_config_free(struct gpiod_line_config *config) {
+    free(config);
+}
+
+int gpiod_line_config_add_line_settings(struct gpiod_line_config *config, const unsigned int *offsets,
+                                        size_t num_offsets, struct gpiod_line_settings *settings) {
+    if (!config || !offsets || !settings) return -1;
+    for (size_t i = 0; i < num_offsets; i++) {
+        if (offsets[i] >= SIM_NUM_LINES || config->num_offsets >= SIM_NUM_LINES) {
+            errno = EINVAL;
+            return -1;
+        }
+        config->offsets[config->num_offsets++] = offsets[i];
+    }
+    config->edge = settings->edge;
+    return 0;
+}
+
+struct gpiod_request_config *gpiod_request_config_new(void) {
+    return calloc(1, sizeof(struct gpiod_request_config));
+}
+
+void gpiod_request_config_free(struct gpiod_request_config *config) {
+    free(config);
+}
+
+void gpiod_request_config_set_consumer(struct gpiod_request_config *config, const char *consumer) {
+    (void)config;
+    (void)consumer;
+}
+
+void gpiod_request_config_set_event_buffer_size(struct gpiod_request_config *config,
+                                                size_t event_buffer_size) {
+    if (config) config->event_buffer_size = event_buffer_size;
+}
+
+struct gpiod_line_request *gpiod_chip_request_lines(struct gpiod_chip *chip,
+                                                    struct gpiod_request_config *req_cfg,
+                                                    struct gpiod_line_config *line_cfg) {
+    (void)req_cfg;
+    if (!chip || !line_cfg || line_cfg->num_offsets == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct gpiod_line_request *req = calloc(1, sizeof(*req));
+    if (!req) return NULL;
+    req->lines = calloc(line_cfg->num_offsets, sizeof(*req->lines));
+    int fds[2];
+    if (!req->lines || pipe2(fds, O_CLOEXEC) < 0) {
+        free(req->lines);
+        free(req);
+        return NULL;
+    }
+    req->rfd = fds[0];
+    req->wfd = fds[1];
+    fcntl(req->wfd, F_SETFL, O_NONBLOCK);
+    fcntl(req->wfd, F_SETPIPE_SZ, SIM_PIPE_SIZE);
+
+    req->num_lines = line_cfg->num_offsets;
+    req->edge = line_cfg->edge;
+    req->seed = (unsigned int)line_cfg->offsets[0] + 1;
+    atomic_init(&req->quit, 0);
+
+    int64_t now = sim_clock_ns(CLOCK_MONOTONIC);
+    for (size_t i = 0; i < req->num_lines; i++) {
+        sim_line_t *line = &req->lines[i];
+        double hz = sim_line_rate(line_cfg->offsets[i]);
+        line->offset = line_cfg->offsets[i];
+        // period_ns is the time between two edges (half a square wave)
+        line->period_ns = hz > 0.0 ? (int64_t)(1e9 / hz) : INT64_MAX / 4;
+        // Spread the phases of the lines over one period
+        line->next_ns = now + line->period_ns * (int64_t)i / (int64_t)req->num_lines;
+    }
+
+    if (pthread_create(&req->thread, NULL, sim_generator_fn, req) != 0) {
+        close(req->rfd);
+        close(req->wfd);
+        free(req->lines);
+        free(req);
+        return NULL;
+    }
+
+    return req;
+}
+
+void gpiod_line_request_release(struct gpiod_line_request *request) {
+    if (!request) return;
+    atomic_store(&request->quit, 1);
+    pthread_join(request->thread, NULL);
+    close(request->rfd);
+    close(request->wfd);
+    free(request->lines);
+    free(request);
+}
+
+int gpiod_line_request_get_fd(struct gpiod_line_request *request) {
+    return request ? request->rfd : -1;
+}
+
+int gpiod_line_request_read_edge_events(struct gpiod_line_request *request,
+                                        struct gpiod_edge_event_buffer *buffer, size_t max_events) {
+    if (!request || !buffer) return -1;
+    if (max_events > buffer->capacity) max_events = buffer->capacity;
+
+    ssize_t n = read(request->rfd, buffer->events, max_events * sizeof(*buffer->events));
+    if (n < 0) return -1;
+
+    buffer->num_events = (size_t)n / sizeof(*buffer->events);
+    atomic_fetch_add(&sim_read, buffer->num_events);
+    return (int)buffer->num_events;
+}
+
+struct gpiod_edge_event_buffer *gpiod_edge_event_buffer_new(size_t capacity) {
+    struct gpiod_edge_event_buffer *buffer = calloc(1, sizeof(*buffer));
+    if (!buffer) return NULL;
+    buffer->capacity = capacity ? capacity : 64;
+    buffer->events = calloc(buffer->capacity, sizeof(*buffer->events));
+    if (!buffer->events) {
+        free(buffer);
+        return NULL;
+    }
+    return buffer;
+}
+
+void gpiod_edge_event_buffer_free(struct gpiod_edge_event_buffer *buffer) {
+    if (!buffer) return;
+    free(buffer->events);
+    free(buffer);
+}
+
+struct gpiod_edge_event *gpiod_edge_event_buffer_get_event(struct gpiod_edge_event_buffer *buffer,
+                                                           unsigned long index) {
+    if (!buffer || index >= buffer->num_events) return NULL;
+    return &buffer->events[index];
+}
+
+enum gpiod_edge_event_type gpiod_edge_event_get_event_type(struct gpiod_edge_event *event) {
+    return (enum gpiod_edge_event_type)event->type;
+}
+
+uint64_t gpiod_edge_event_get_timestamp_ns(struct gpiod_edge_event *event) {
+    return event->timestamp_ns;
+}
+
+unsigned int gpiod_edge_event_get_line_offset(struct gpiod_edge_event *event) {
+    return event->offset;
+}
+
+unsigned long gpiod_edge_event_get_global_seqno(struct gpiod_edge_event *event) {
+    return event->global_seqno;
+}
+
+unsigned long gpiod_edge_event_get_line_seqno(struct gpiod_edge_event *event) {
+    return event->line_seqno;
+}
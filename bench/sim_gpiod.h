@@ -0,0 +1,91 @@
+/**
+ * This module simulates the libgpiod v2 edge event API for benchmarks.
+ *
+ * Every line request gets a pipe and a generator thread that writes
+ * synthetic edge events at a configurable rate, so the production read
+ * path (poll, gpiod_line_request_read_edge_events, event buffer) runs
+ * unchanged without GPIO hardware.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef SIM_GPIOD_H
+#define SIM_GPIOD_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Highest simulated line offset + 1 (reported as the chip's line count)
+ */
+#define SIM_NUM_LINES 1024
+
+/**
+ * Simulator counters
+ */
+typedef struct {
+    uint64_t generated;        /**< Edges produced by the generators */
+    uint64_t dropped;          /**< Edges lost because a pipe was full (kfifo overflow) */
+    uint64_t read;             /**< Edges returned by read_edge_events */
+    int64_t generator_cpu_ns;  /**< CPU time used by finished generator threads */
+} sim_stats_t;
+
+/**
+ * Set the edge rate of all lines
+ *
+ * Applies to line requests made afterwards.
+ *
+ * @param hz Edges per second
+ */
+void sim_set_rate(double hz);
+
+/**
+ * Set the edge rate of one line (overrides sim_set_rate())
+ *
+ * @param offset Line offset
+ * @param hz Edges per second (0 to use the global rate)
+ */
+void sim_set_line_rate(unsigned int offset, double hz);
+
+/**
+ * Set random period jitter
+ *
+ * @param fraction Maximum deviation of each period (e.g. 0.01 for 1%)
+ */
+void sim_set_jitter(double fraction);
+
+/**
+ * Inject glitches
+ *
+ * After each edge, with the given probability, the line briefly returns
+ * to its old level (two extra edges 2 us apart), as ringing on a long tach
+ * cable does. Glitch edges are not part of the ground truth rate.
+ *
+ * @param probability Chance per edge (0 to disable)
+ */
+void sim_set_glitch(double probability);
+
+/**
+ * Get the edge rate of a line
+ *
+ * @param offset Line offset
+ * @return double Edges per second
+ */
+double sim_line_rate(unsigned int offset);
+
+/**
+ * Read and reset the simulator counters
+ *
+ * @param stats Output counters
+ */
+void sim_take_stats(sim_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SIM_GPIOD_H
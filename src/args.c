@@ -12,9 +12,14 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <errno.h>
-#include <limits.h>
 #include "args.h"
 #include "line.h"  // For edge_type_t
+#include "prometheus.h"
+#include "query.h"
+#include "chipmap.h"
+#include "rtsched.h"
+#include "sink.h"
+#include "config.h"
 
 #ifndef PKG_TAG
 #define PKG_TAG_STR "unknown"
@@ -29,32 +34,77 @@
 #endif
 
 /**
- * Safely convert string to integer with error checking
- * 
- * @param str String to convert
+ * Parse a bounded integer option value
+ *
+ * @param name Option name for error messages (e.g., "--periods")
+ * @param arg Option argument
+ * @param min Minimum accepted value
+ * @param max Maximum accepted value
  * @param result Pointer to store result
+ * @param prog Program name for error messages
  * @return int 0 on success, -1 on error
  */
-static int safe_str_to_int(const char *str, int *result) {
-    if (!str || !result) return -1;
+static int parse_int_arg(const char *name, const char *arg, int min, int max, int *result, const char *prog) {
+    if (!arg || *arg == '\0') {
+        fprintf(stderr, "\nError: %s requires a number\n\n", name);
+        fprintf(stderr, "Try: %s --help\n\n", prog);
+        return -1;
+    }
+
+    int val;
+    if (config_parse_int(arg, &val) != 0) {
+        fprintf(stderr, "\nError: %s must be a valid number, got '%s'\n\n", name, arg);
+        fprintf(stderr, "Try: %s --help\n\n", prog);
+        return -1;
+    }
+    if (val < min || val > max) {
+        fprintf(stderr, "\nError: %s must be between %d and %d\n\n", name, min, max);
+        fprintf(stderr, "Try: %s --help\n\n", prog);
+        return -1;
+    }
 
-    char *endptr;
-    errno = 0;
-    long val = strtol(str, &endptr, 10);
+    *result = val;
+    return 0;
+}
 
-    // Check for various error conditions
-    if (errno == ERANGE || val > INT_MAX || val < INT_MIN) {
-        return -1; // Overflow/underflow
+/**
+ * Parse a bounded time option value
+ *
+ * @param name Option name for error messages (e.g., "--duration")
+ * @param arg Option argument
+ * @param min_ns Minimum accepted value in nanoseconds
+ * @param max_ns Maximum accepted value in nanoseconds
+ * @param result_ns Pointer to store result in nanoseconds
+ * @param prog Program name for error messages
+ * @return int 0 on success, -1 on error
+ */
+static int parse_time_arg(const char *name, const char *arg, int64_t min_ns, int64_t max_ns,
+                          int64_t *result_ns, const char *prog) {
+    if (!arg || *arg == '\0') {
+        fprintf(stderr, "\nError: %s requires a time value\n\n", name);
+        fprintf(stderr, "Try: %s --help\n\n", prog);
+        return -1;
+    }
+
+    int64_t val;
+    if (config_parse_time(arg, &val) != 0) {
+        fprintf(stderr, "\nError: %s must be a valid time (e.g., 2, 0.5, 250ms), got '%s'\n\n",
+                name, arg);
+        fprintf(stderr, "Try: %s --help\n\n", prog);
+        return -1;
     }
-    if (endptr == str || *endptr != '\0') {
-        return -1; // No conversion or trailing characters
+    if (val < min_ns || val > max_ns) {
+        fprintf(stderr, "\nError: %s must be between %gs and %gs\n\n", name,
+                (double)min_ns / 1e9, (double)max_ns / 1e9);
+        fprintf(stderr, "Try: %s --help\n\n", prog);
+        return -1;
     }
 
-    *result = (int)val;
+    *result_ns = val;
     return 0;
 }
 
-int load_defaults(int *duration, int *pulses, int *warmup) {
+int load_defaults(int64_t *duration_ns, int *pulses, int64_t *warmup_ns) {
     // Check environment variables first (highest precedence)
     const char *env_duration = getenv("GPIO_FAN_RPM_DURATION");
     const char *env_pulses = getenv("GPIO_FAN_RPM_PULSES");
@@ -62,25 +112,25 @@ int load_defaults(int *duration, int *pulses, int *warmup) {
     const char *env_debug = getenv("DEBUG");
 
     if (env_duration) {
-        int temp;
-        if (safe_str_to_int(env_duration, &temp) == 0) {
-            *duration = temp;
+        int64_t temp;
+        if (config_parse_time(env_duration, &temp) == 0) {
+            *duration_ns = temp;
         }
         // Silently ignore invalid env values
     }
 
     if (env_pulses) {
         int temp;
-        if (safe_str_to_int(env_pulses, &temp) == 0) {
+        if (config_parse_int(env_pulses, &temp) == 0) {
             *pulses = temp;
         }
         // Silently ignore invalid env values
     }
 
     if (env_warmup) {
-        int temp;
-        if (safe_str_to_int(env_warmup, &temp) == 0) {
-            *warmup = temp;
+        int64_t temp;
+        if (config_parse_time(env_warmup, &temp) == 0) {
+            *warmup_ns = temp;
         }
         // Silently ignore invalid env values
     }
@@ -95,65 +145,232 @@ int load_defaults(int *duration, int *pulses, int *warmup) {
 
 void print_usage(const char *prog) {
     printf("\n");
-    printf("Usage: %s [OPTIONS] --gpio=N [--gpio=N...]\n\n", prog);
+    printf("Usage: %s [OPTIONS] --gpio=LINE [--gpio=LINE...]\n", prog);
+    printf("       %s [OPTIONS] --config=FILE\n\n", prog);
     printf("Measure fan RPM using GPIO edge detection.\n\n");
     
     printf("Required:\n");
-    printf("  -g, --gpio=N           GPIO pin number to measure (can be repeated)\n\n");
+    printf("  -g, --gpio=LINE        GPIO line number or name to measure (can be repeated)\n");
+    printf("  --config=FILE          Or measure the fans described in FILE\n\n");
     
     printf("Options:\n");
-    printf("  -c, --chip=NAME        GPIO chip name (default: auto-detect)\n");
-    printf("  -d, --duration=SEC     Measurement duration in seconds (default: 2)\n");
+    printf("  -c, --chip=NAME        GPIO chip name or label (default: auto-detect)\n");
+    printf("  -d, --duration=TIME    Measurement duration (default: 2s)\n");
     printf("  -p, --pulses=N         Pulses per revolution (default: 4)\n");
-    printf("  --warmup=SEC           Warmup duration in seconds (default: 1, max: 60)\n");
+    printf("  --warmup=TIME          Warmup duration (default: 1s, max: 60s)\n");
     printf("  -e, --edge=TYPE        Edge detection: rising, falling, both (default: both)\n");
+    printf("  --engine=TYPE          Measurement engine: epoll, threads (default: epoll)\n");
+    printf("  --method=TYPE          Measurement method: count, period, sliding, adaptive\n");
+    printf("                         (default: count)\n");
+    printf("  --periods=N            Periods captured by --method=period (default: %d)\n",
+           RPM_PERIODS_DEFAULT);
+    printf("  --target-pulses=N      Pulses timed by --method=adaptive (default: %d)\n",
+           RPM_TARGET_PULSES_DEFAULT);
+    printf("  --target-error=E       Or the relative error to reach, e.g. 0.5%% or 0.005\n");
+    printf("  --window=TIME          Sliding window length (default: duration - warmup)\n");
+    printf("  --interval=TIME        Sliding window report interval (default: 1s)\n");
+    printf("  --event-batch=N        Edge events drained per read (default: %d, max: %d)\n",
+           GPIO_EVENT_BATCH_DEFAULT, GPIO_EVENT_BATCH_MAX);
+    printf("  --debounce=TIME        Ignore edges closer than TIME, e.g. 100us (default: off)\n");
+    printf("  --stall-rpm=RPM        Report a stall as soon as no edge arrives in time for\n");
+    printf("                         RPM (default: off)\n");
     printf("  -w, --watch            Continuous monitoring mode\n");
+    printf("  --publish=MODE         Watch output: tick, immediate (default: tick)\n");
+    printf("  --stagger              Spread the windows of all GPIOs over one round\n");
+    printf("  --listen=[HOST]:PORT   Serve Prometheus metrics on /metrics (implies --watch)\n");
+    printf("  --daemon[=SOCKET]      Measure continuously and answer queries on a Unix\n");
+    printf("                         socket (default: %s)\n", QUERY_DEFAULT_SOCKET);
+    printf("  --query[=SOCKET]       Print the latest results of a running daemon\n");
+    printf("  --capture=FILE         Record the raw edge events to FILE\n");
+    printf("  --replay=FILE          Measure the edges recorded in FILE (no hardware)\n");
+    printf("  --rt-priority=N        Run measurement threads SCHED_FIFO at priority N (%d-%d)\n",
+           RTSCHED_PRIORITY_MIN, RTSCHED_PRIORITY_MAX);
+    printf("  --cpu=LIST             Pin measurement threads to CPUs, e.g. 3 or 2,3 or 2-3\n");
+    printf("  --mlock                Lock all memory to avoid page faults while measuring\n");
     printf("  -n, --numeric          Output RPM as numeric value only\n");
     printf("  -j, --json             Output as JSON object/array\n");
     printf("  --collectd             Output in collectd PUTVAL format\n");
-    printf("  --debug                Show detailed measurement information\n");
+    printf("  --influx               Output in InfluxDB line protocol\n");
+    printf("  --format=FORMAT        Output format: default, numeric, json, collectd, binary,\n");
+    printf("                         influx, collectd-net\n");
+    printf("  --output=SPEC          Write results to SPEC instead of stdout (repeatable)\n");
+    printf("  --debug                Show detailed measurement information and counters\n");
     printf("  -h, --help             Show this help message\n");
     printf("  -v, --version          Show version information\n\n");
 
+    printf("Chip Discovery:\n");
+    printf("  Without --chip, all chips are probed for the requested lines and the\n");
+    printf("  result is kept in %s (%s to override,\n", CHIPMAP_DEFAULT_CACHE, CHIPMAP_CACHE_ENV);
+    printf("  empty to disable). Name lines, e.g. --gpio=FAN1, on boards with\n");
+    printf("  several GPIO expanders; numbers use the first chip with enough lines.\n\n");
+
     printf("Edge Detection:\n");
     printf("  Using 'rising' or 'falling' counts half the pulses of 'both'.\n");
     printf("  Adjust --pulses accordingly (e.g., use --pulses=2 instead of 4).\n\n");
     
+    printf("Debounce:\n");
+    printf("  --debounce is applied by the GPIO chip where supported; otherwise\n");
+    printf("  edges are filtered in software on the kernel timestamps. Keep it\n");
+    printf("  well below the shortest tach pulse (60 / (RPM * pulses) seconds).\n\n");
+
+    printf("Time Values:\n");
+    printf("  TIME is a number with an optional unit: s, ms, us (default: s).\n");
+    printf("  Examples: 2, 0.5, 250ms, 500us.\n\n");
+
+    printf("Measurement Methods:\n");
+    printf("  'count' counts edges over the measurement window.\n");
+    printf("  'period' uses the median interval between kernel edge timestamps and\n");
+    printf("  returns as soon as --periods periods are captured; the measurement\n");
+    printf("  window (duration - warmup) is only an upper bound.\n");
+    printf("  'sliding' warms up once, then counts edges continuously and reports\n");
+    printf("  every --interval over the last --window (for --watch).\n");
+    printf("  'adaptive' times each fan from its first edge until --target-pulses\n");
+    printf("  pulses (1 / --target-error) have passed, so slow fans measure longer\n");
+    printf("  and fast fans report early; duration - warmup is the upper bound.\n\n");
+
+    printf("Stall Detection:\n");
+    printf("  With --stall-rpm a fan counts as stalled once no edge arrived for %d\n", RPM_STALL_EDGES);
+    printf("  edge intervals at RPM, i.e. %d * 60 / (RPM * pulses) seconds. The stall is\n",
+           RPM_STALL_EDGES);
+    printf("  published right away with RPM 0 (JSON \"stalled\":true) instead of at the\n");
+    printf("  end of the window. A single measurement then exits with status 2.\n");
+    printf("  Needs --engine=epoll.\n\n");
+
+    printf("Engines:\n");
+    printf("  'epoll' measures all GPIOs in one thread with a single event loop.\n");
+    printf("  'threads' starts one measurement thread per GPIO (fallback).\n\n");
+
+    printf("Config File:\n");
+    printf("  One fan per line: a name, then KEY=VALUE settings (# starts a comment):\n");
+    printf("    cpu   chip=gpiochip0 offset=17 pulses=2 edge=falling window=1s\n");
+    printf("    case  offset=18\n");
+    printf("  offset is required; chip, pulses, edge and window (the --duration of\n");
+    printf("  the fan, or its --window with --method=sliding) default to the options.\n");
+    printf("  In watch mode SIGHUP or saving the file reloads it: only added, removed\n");
+    printf("  or changed fans are requested, released or restarted, all other fans\n");
+    printf("  keep measuring and keep their statistics. Needs --engine=epoll.\n\n");
+
     printf("Watch Mode:\n");
     printf("  In watch mode, press 'q' to quit gracefully or Ctrl+C to interrupt.\n");
+    printf("  'tick' prints the latest result of all GPIOs in order on a wall-clock\n");
+    printf("  tick (every duration, or every --interval for sliding windows).\n");
+    printf("  'immediate' prints each GPIO as soon as its measurement completes.\n");
+    printf("  --stagger delays the first window of the n-th of N GPIOs by n/N of a\n");
+    printf("  round (duration, or interval for sliding windows), so results and\n");
+    printf("  wakeups are spread evenly instead of all GPIOs finishing at once. Give\n");
+    printf("  fans their own rate with window= in a --config file.\n");
     printf("\n");
 
+    printf("Binary Output:\n");
+    printf("  --format=binary writes one %d-byte little-endian record per GPIO and\n",
+           FORMAT_BINARY_RECORD_SIZE);
+    printf("  report: u16 length, u8 version (%d), u8 flags, i32 gpio,\n", FORMAT_BINARY_VERSION);
+    printf("  u64 timestamp_ns (wall clock), u64 interval_ns, f64 rpm, u32 pulses,\n");
+    printf("  u32 reserved. Readers should skip 'length' bytes per record.\n\n");
+
+    printf("Outputs:\n");
+    printf("  SPEC is stdout (or -), file:PATH (appended), udp:HOST:PORT or\n");
+    printf("  unix:PATH (stream or datagram socket, reconnected when the receiver\n");
+    printf("  restarts), optionally followed by ,FORMAT, e.g.\n");
+    printf("  --output=udp:10.0.0.5:8089,influx. UDP packs whole records into\n");
+    printf("  datagrams of up to %d bytes; collectd-net is collectd's binary network\n", SINK_DATAGRAM_MAX);
+    printf("  protocol (port 25826), so the whole round usually fits one packet.\n");
+    printf("  Every output has its own writer thread and %d KiB queue; a slow\n", SINK_RING_SIZE / 1024);
+    printf("  output drops its oldest reports instead of delaying the measurement\n");
+    printf("  or the other outputs.\n\n");
+
+    printf("Capture and Replay:\n");
+    printf("  --capture records every edge (before --debounce) with its kernel\n");
+    printf("  timestamp. --replay runs the measurement on the recorded timeline as\n");
+    printf("  fast as possible: --gpio selects lines (default: all recorded lines),\n");
+    printf("  --edge, --debounce, --method etc. apply as if measured live. With\n");
+    printf("  --watch every result is printed (--publish=immediate) and the replay\n");
+    printf("  ends with the capture. Records carry no chip, so with --config all\n");
+    printf("  fans must be on one chip.\n\n");
+
+    printf("Real-Time Scheduling:\n");
+    printf("  --rt-priority and --cpu apply to the measurement threads only (the\n");
+    printf("  epoll engine uses all listed CPUs, --engine=threads assigns them in\n");
+    printf("  turn per GPIO). Output stays on the CPUs the program was started on,\n");
+    printf("  e.g. 'taskset -c 0 %s --cpu=3'. SCHED_FIFO and --mlock need\n", prog);
+    printf("  CAP_SYS_NICE and CAP_IPC_LOCK (or root).\n\n");
+
+    printf("Daemon Mode:\n");
+    printf("  --daemon runs watch mode in the foreground (e.g. as a systemd service)\n");
+    printf("  without printing results (only to outputs given with --output). Each\n");
+    printf("  connection to the socket may send a format name (default, numeric,\n");
+    printf("  json, collectd) and receives the latest results of all GPIOs;\n");
+    printf("  --query with --json etc. does this for you.\n");
+    printf("  Answers are empty until the first measurement completes.\n\n");
+
     printf("Examples:\n");
     printf("  %s --gpio=17                    # Basic measurement\n", prog);
     printf("  %s --gpio=17 --pulses=4         # 4-pulse fan\n", prog);
     printf("  %s --gpio=17 --duration=4 --watch # Continuous monitoring\n", prog);
+    printf("  %s --gpio=17 --duration=250ms --warmup=100ms # Fast measurement\n", prog);
     printf("  %s --gpio=17 --json             # JSON output\n", prog);
+    printf("  %s --gpio=FAN1 --chip=pca9555   # Line and chip by name\n", prog);
+    printf("  %s --gpio=17 --listen=:%d     # Prometheus exporter\n", prog, PROMETHEUS_DEFAULT_PORT);
     printf("  %s --gpio=17 --gpio=18 --json   # Multiple fans\n", prog);
+    printf("  %s --config=/etc/fans.conf --watch # Fans from a file, reload with SIGHUP\n", prog);
+    printf("  %s --gpio=17 --daemon=/tmp/fan.sock # Daemon\n", prog);
+    printf("  %s --query=/tmp/fan.sock --json # Query the daemon\n", prog);
+    printf("  %s --gpio=17 --watch --output=- --output=udp:db:8089,influx # Two outputs\n", prog);
+    printf("  %s --gpio=17 --watch --capture=fan.cap # Record the pulse train\n", prog);
+    printf("  %s --replay=fan.cap --watch --method=period # Re-measure it offline\n", prog);
     printf("  RPM=$(%s --gpio=17 --numeric)   # Capture in variable\n", prog);
     printf("\n");
 }
 
-int parse_arguments(int argc, char **argv, int **gpios, size_t *ngpio,
-                   char **chipname, int *duration, int *pulses, int *warmup,
-                   edge_type_t *edge, int *debug, int *watch, output_mode_t *mode) {
+int parse_arguments(int argc, char **argv, measurement_params_t *params, char **chipname) {
     int opt;
+    int **gpios = &params->gpios;
+    char ***names = &params->gpio_names;
+    size_t *ngpio = &params->ngpio;
+    int64_t *duration_ns = &params->duration_ns;
+    int *pulses = &params->pulses;
+    int64_t *warmup_ns = &params->warmup_ns;
 
     // Load defaults first
-    int env_debug = load_defaults(duration, pulses, warmup);
+    int env_debug = load_defaults(duration_ns, pulses, warmup_ns);
     if (env_debug > 0) {
-        *debug = 1;
+        params->debug = 1;
     }
 
     struct option longopts[] = {
         {"gpio", required_argument, 0, 'g'},
+        {"config", required_argument, 0, 'G'},
         {"chip", required_argument, 0, 'c'},
         {"duration", required_argument, 0, 'd'},
         {"pulses", required_argument, 0, 'p'},
         {"warmup", required_argument, 0, 'W'},
         {"edge", required_argument, 0, 'e'},
+        {"engine", required_argument, 0, 'E'},
+        {"event-batch", required_argument, 0, 'B'},
+        {"debounce", required_argument, 0, 'T'},
+        {"method", required_argument, 0, 'M'},
+        {"periods", required_argument, 0, 'P'},
+        {"target-pulses", required_argument, 0, 'N'},
+        {"target-error", required_argument, 0, 'R'},
+        {"window", required_argument, 0, 'L'},
+        {"interval", required_argument, 0, 'I'},
+        {"publish", required_argument, 0, 'U'},
+        {"stagger", no_argument, 0, 'J'},
+        {"listen", required_argument, 0, 'H'},
+        {"daemon", optional_argument, 0, 'S'},
+        {"query", optional_argument, 0, 'Q'},
+        {"capture", required_argument, 0, 'X'},
+        {"replay", required_argument, 0, 'Y'},
+        {"rt-priority", required_argument, 0, 'O'},
+        {"cpu", required_argument, 0, 'A'},
+        {"mlock", no_argument, 0, 'K'},
+        {"stall-rpm", required_argument, 0, 'Z'},
         {"numeric", no_argument, 0, 'n'},
         {"json", no_argument, 0, 'j'},
         {"collectd", no_argument, 0, 'C'},
+        {"influx", no_argument, 0, 'i'},
+        {"output", required_argument, 0, 'o'},
+        {"format", required_argument, 0, 'F'},
         {"debug", no_argument, 0, 'D'},
         {"watch", no_argument, 0, 'w'},
         {"help", no_argument, 0, 'h'},
@@ -171,101 +388,280 @@ int parse_arguments(int argc, char **argv, int **gpios, size_t *ngpio,
             }
 
             // Check GPIO count limit before allocating
-            if (*ngpio >= 10) {
-                fprintf(stderr, "\nError: too many GPIOs specified (max 10)\n\n");
+            if (*ngpio >= MAX_GPIOS) {
+                fprintf(stderr, "\nError: too many GPIOs specified (max %d)\n\n", MAX_GPIOS);
                 fprintf(stderr, "Try: %s --help\n\n", argv[0]);
                 return -1;
             }
 
-            int gpio_val;
-            if (safe_str_to_int(optarg, &gpio_val) != 0) {
-                fprintf(stderr, "\nError: GPIO pin must be a valid number, got '%s'\n\n", optarg);
-                fprintf(stderr, "Try: %s --help\n\n", argv[0]);
-                return -1;
-            }
-            if (gpio_val < 0 || gpio_val > 999) {
-                fprintf(stderr, "\nError: GPIO pin %d is out of valid range (0-999)\n\n", gpio_val);
-                fprintf(stderr, "Try: %s --help\n\n", argv[0]);
-                return -1;
+            // Anything not starting like a number is a line name
+            int gpio_val = -1;
+            char *line_name = NULL;
+            if ((*optarg >= '0' && *optarg <= '9') || *optarg == '-' || *optarg == '+') {
+                if (config_parse_int(optarg, &gpio_val) != 0) {
+                    fprintf(stderr, "\nError: GPIO pin must be a valid number, got '%s'\n\n", optarg);
+                    fprintf(stderr, "Try: %s --help\n\n", argv[0]);
+                    return -1;
+                }
+                if (gpio_val < 0 || gpio_val > 999) {
+                    fprintf(stderr, "\nError: GPIO pin %d is out of valid range (0-999)\n\n", gpio_val);
+                    fprintf(stderr, "Try: %s --help\n\n", argv[0]);
+                    return -1;
+                }
+            } else {
+                if (strlen(optarg) >= CHIPMAP_LINE_MAX) {
+                    fprintf(stderr, "\nError: GPIO line name '%s' is too long (max %d characters)\n\n",
+                            optarg, CHIPMAP_LINE_MAX - 1);
+                    fprintf(stderr, "Try: %s --help\n\n", argv[0]);
+                    return -1;
+                }
+                line_name = strdup(optarg);
+                if (!line_name) {
+                    fprintf(stderr, "\nError: memory allocation failed\n\n");
+                    return -1;
+                }
             }
 
             int *temp = realloc(*gpios, (*ngpio + 1) * sizeof(**gpios));
-            if (!temp) {
+            if (temp) *gpios = temp;
+            char **temp_names = temp ? realloc(*names, (*ngpio + 1) * sizeof(**names)) : NULL;
+            if (!temp_names) {
                 fprintf(stderr, "\nError: memory allocation failed\n\n");
-                free(*gpios);
-                *gpios = NULL;
+                free(line_name);
                 return -1;
             }
-            *gpios = temp;
+            *names = temp_names;
             (*gpios)[*ngpio] = gpio_val;
+            (*names)[*ngpio] = line_name;
             (*ngpio)++;
             break;
+        case 'G':
+            if (!optarg || *optarg == '\0') {
+                fprintf(stderr, "\nError: --config requires a file name\n\n");
+                fprintf(stderr, "Try: %s --help\n\n", argv[0]);
+                return -1;
+            }
+            params->config_path = optarg;
+            break;
         case 'c':
+            free(*chipname);
             *chipname = strdup(optarg);
             if (!*chipname) {
                 fprintf(stderr, "\nError: memory allocation failed\n\n");
-                free(*gpios);
-                *gpios = NULL;
                 return -1;
             }
             break;
         case 'd':
+            if (parse_time_arg("--duration", optarg, NSEC_PER_MSEC, 3600 * NSEC_PER_SEC,
+                               duration_ns, argv[0]) != 0) {
+                return -1;
+            }
+            break;
+        case 'W':
+            if (parse_time_arg("--warmup", optarg, 0, 60 * NSEC_PER_SEC, warmup_ns, argv[0]) != 0) {
+                return -1;
+            }
+            break;
+        case 'e':
             if (!optarg || *optarg == '\0') {
-                fprintf(stderr, "\nError: --duration requires a number\n\n");
+                fprintf(stderr, "\nError: --edge requires a value (rising, falling, or both)\n\n");
                 fprintf(stderr, "Try: %s --help\n\n", argv[0]);
                 return -1;
             }
-            if (safe_str_to_int(optarg, duration) != 0) {
-                fprintf(stderr, "\nError: --duration must be a valid number, got '%s'\n\n", optarg);
+            if (strcmp(optarg, "rising") == 0) {
+                params->edge = EDGE_RISING;
+            } else if (strcmp(optarg, "falling") == 0) {
+                params->edge = EDGE_FALLING;
+            } else if (strcmp(optarg, "both") == 0) {
+                params->edge = EDGE_BOTH;
+            } else {
+                fprintf(stderr, "\nError: invalid edge type '%s'\n", optarg);
+                fprintf(stderr, "  Valid values: rising, falling, both\n\n");
                 fprintf(stderr, "Try: %s --help\n\n", argv[0]);
                 return -1;
             }
-            if (*duration > 3600) {
-                fprintf(stderr, "\nError: duration must be at most 3600 seconds\n\n");
+            break;
+        case 'E':
+            if (!optarg || *optarg == '\0') {
+                fprintf(stderr, "\nError: --engine requires a value (epoll or threads)\n\n");
                 fprintf(stderr, "Try: %s --help\n\n", argv[0]);
                 return -1;
             }
-            if (*duration < 1) {
-                fprintf(stderr, "\nError: duration must be at least 1 second\n\n");
+            if (strcmp(optarg, "epoll") == 0) {
+                params->engine = ENGINE_EPOLL;
+            } else if (strcmp(optarg, "threads") == 0) {
+                params->engine = ENGINE_THREADS;
+            } else {
+                fprintf(stderr, "\nError: invalid engine '%s'\n", optarg);
+                fprintf(stderr, "  Valid values: epoll, threads\n\n");
                 fprintf(stderr, "Try: %s --help\n\n", argv[0]);
                 return -1;
             }
             break;
-        case 'W':
+        case 'B': {
+            int batch;
+            if (parse_int_arg("--event-batch", optarg, 1, GPIO_EVENT_BATCH_MAX, &batch, argv[0]) != 0) {
+                return -1;
+            }
+            params->event_batch = (size_t)batch;
+            break;
+        }
+        case 'T':
+            if (parse_time_arg("--debounce", optarg, 0, GPIO_DEBOUNCE_MAX_NS,
+                               &params->debounce_ns, argv[0]) != 0) {
+                return -1;
+            }
+            break;
+        case 'M':
             if (!optarg || *optarg == '\0') {
-                fprintf(stderr, "\nError: --warmup requires a number\n\n");
+                fprintf(stderr, "\nError: --method requires a value (count, period, sliding or adaptive)\n\n");
                 fprintf(stderr, "Try: %s --help\n\n", argv[0]);
                 return -1;
             }
-            if (safe_str_to_int(optarg, warmup) != 0) {
-                fprintf(stderr, "\nError: --warmup must be a valid number, got '%s'\n\n", optarg);
+            if (strcmp(optarg, "count") == 0) {
+                params->method = METHOD_COUNT;
+            } else if (strcmp(optarg, "period") == 0) {
+                params->method = METHOD_PERIOD;
+            } else if (strcmp(optarg, "sliding") == 0) {
+                params->method = METHOD_SLIDING;
+            } else if (strcmp(optarg, "adaptive") == 0) {
+                params->method = METHOD_ADAPTIVE;
+            } else {
+                fprintf(stderr, "\nError: invalid method '%s'\n", optarg);
+                fprintf(stderr, "  Valid values: count, period, sliding, adaptive\n\n");
                 fprintf(stderr, "Try: %s --help\n\n", argv[0]);
                 return -1;
             }
-            if (*warmup < 0 || *warmup > 60) {
-                fprintf(stderr, "\nError: warmup must be between 0 and 60 seconds\n\n");
+            break;
+        case 'P': {
+            int periods;
+            if (parse_int_arg("--periods", optarg, 1, RPM_PERIODS_MAX, &periods, argv[0]) != 0) {
+                return -1;
+            }
+            params->periods = (size_t)periods;
+            break;
+        }
+        case 'N': {
+            int target;
+            if (parse_int_arg("--target-pulses", optarg, 2, RPM_TARGET_PULSES_MAX, &target, argv[0]) != 0) {
+                return -1;
+            }
+            params->target_pulses = (unsigned int)target;
+            break;
+        }
+        case 'R': {
+            // Fraction or percentage (0.01 or 1%)
+            char *end;
+            errno = 0;
+            double error = optarg ? strtod(optarg, &end) : 0.0;
+            int valid = optarg && end != optarg && errno == 0;
+            if (valid && *end == '%') {
+                error /= 100.0;
+                end++;
+            }
+            if (!valid || *end != '\0' || !(error >= 0.0001 && error <= 0.5)) {
+                fprintf(stderr, "\nError: --target-error must be between 0.01%% and 50%%, got '%s'\n\n",
+                        optarg ? optarg : "");
                 fprintf(stderr, "Try: %s --help\n\n", argv[0]);
                 return -1;
             }
+            params->target_pulses = rpm_target_from_error(error);
             break;
-        case 'e':
+        }
+        case 'L':
+            if (parse_time_arg("--window", optarg, NSEC_PER_MSEC, 3600 * NSEC_PER_SEC,
+                               &params->window_ns, argv[0]) != 0) {
+                return -1;
+            }
+            break;
+        case 'I':
+            if (parse_time_arg("--interval", optarg, NSEC_PER_MSEC, 3600 * NSEC_PER_SEC,
+                               &params->interval_ns, argv[0]) != 0) {
+                return -1;
+            }
+            break;
+        case 'U':
             if (!optarg || *optarg == '\0') {
-                fprintf(stderr, "\nError: --edge requires a value (rising, falling, or both)\n\n");
+                fprintf(stderr, "\nError: --publish requires a value (tick or immediate)\n\n");
                 fprintf(stderr, "Try: %s --help\n\n", argv[0]);
                 return -1;
             }
-            if (strcmp(optarg, "rising") == 0) {
-                *edge = EDGE_RISING;
-            } else if (strcmp(optarg, "falling") == 0) {
-                *edge = EDGE_FALLING;
-            } else if (strcmp(optarg, "both") == 0) {
-                *edge = EDGE_BOTH;
+            if (strcmp(optarg, "tick") == 0) {
+                params->publish = PUBLISH_TICK;
+            } else if (strcmp(optarg, "immediate") == 0) {
+                params->publish = PUBLISH_IMMEDIATE;
             } else {
-                fprintf(stderr, "\nError: invalid edge type '%s'\n", optarg);
-                fprintf(stderr, "  Valid values: rising, falling, both\n\n");
+                fprintf(stderr, "\nError: invalid publish mode '%s'\n", optarg);
+                fprintf(stderr, "  Valid values: tick, immediate\n\n");
+                fprintf(stderr, "Try: %s --help\n\n", argv[0]);
+                return -1;
+            }
+            break;
+        case 'J':
+            params->stagger = 1;
+            break;
+        case 'H':
+            if (prometheus_parse_listen(optarg) != 0) {
+                fprintf(stderr, "\nError: --listen must be [HOST]:PORT (e.g., :%d), got '%s'\n\n",
+                        PROMETHEUS_DEFAULT_PORT, optarg ? optarg : "");
+                fprintf(stderr, "Try: %s --help\n\n", argv[0]);
+                return -1;
+            }
+            params->listen = optarg;
+            params->watch = 1;  // The exporter runs on top of watch mode
+            break;
+        case 'S':
+        case 'Q': {
+            const char *path = optarg ? optarg : QUERY_DEFAULT_SOCKET;
+            if (query_parse_path(path) != 0) {
+                fprintf(stderr, "\nError: --%s socket path must be 1-107 characters, got '%s'\n\n",
+                        opt == 'S' ? "daemon" : "query", path);
                 fprintf(stderr, "Try: %s --help\n\n", argv[0]);
                 return -1;
             }
+            if (opt == 'S') {
+                params->daemon_socket = path;
+                params->watch = 1;  // The daemon measures continuously
+            } else {
+                params->query_socket = path;
+            }
+            break;
+        }
+        case 'X':
+        case 'Y':
+            if (!optarg || *optarg == '\0') {
+                fprintf(stderr, "\nError: --%s requires a file name\n\n", opt == 'X' ? "capture" : "replay");
+                fprintf(stderr, "Try: %s --help\n\n", argv[0]);
+                return -1;
+            }
+            if (opt == 'X') {
+                params->capture_path = optarg;
+            } else {
+                params->replay_path = optarg;
+            }
+            break;
+        case 'O':
+            if (parse_int_arg("--rt-priority", optarg, RTSCHED_PRIORITY_MIN, RTSCHED_PRIORITY_MAX,
+                              &params->rt_priority, argv[0]) != 0) {
+                return -1;
+            }
+            break;
+        case 'A':
+            if (rtsched_parse_cpus(optarg, NULL, 0) <= 0) {
+                fprintf(stderr, "\nError: --cpu must be a list of at most %d CPUs 0-%d like 3, 2,3 or 2-3, got '%s'\n\n",
+                        RTSCHED_CPUS_MAX, RTSCHED_CPU_MAX, optarg);
+                fprintf(stderr, "Try: %s --help\n\n", argv[0]);
+                return -1;
+            }
+            params->cpu_list = optarg;
+            break;
+        case 'K':
+            params->mlock = 1;
+            break;
+        case 'Z':
+            if (parse_int_arg("--stall-rpm", optarg, 1, RPM_STALL_MAX, &params->stall_rpm, argv[0]) != 0) {
+                return -1;
+            }
             break;
         case 'p':
             if (!optarg || *optarg == '\0') {
@@ -273,7 +669,7 @@ int parse_arguments(int argc, char **argv, int **gpios, size_t *ngpio,
                 fprintf(stderr, "Try: %s --help\n\n", argv[0]);
                 return -1;
             }
-            if (safe_str_to_int(optarg, pulses) != 0) {
+            if (config_parse_int(optarg, pulses) != 0) {
                 fprintf(stderr, "\nError: --pulses must be a valid number, got '%s'\n\n", optarg);
                 fprintf(stderr, "Try: %s --help\n\n", argv[0]);
                 return -1;
@@ -285,19 +681,46 @@ int parse_arguments(int argc, char **argv, int **gpios, size_t *ngpio,
             }
             break;
         case 'n': 
-            *mode = MODE_NUMERIC; 
+            params->mode = MODE_NUMERIC; 
             break;
         case 'j': 
-            *mode = MODE_JSON; 
+            params->mode = MODE_JSON; 
             break;
         case 'C': 
-            *mode = MODE_COLLECTD; 
+            params->mode = MODE_COLLECTD; 
+            break;
+        case 'i':
+            params->mode = MODE_INFLUX;
+            break;
+        case 'o':
+            if (params->noutputs == SINK_MAX) {
+                fprintf(stderr, "\nError: at most %d --output options\n\n", SINK_MAX);
+                fprintf(stderr, "Try: %s --help\n\n", argv[0]);
+                return -1;
+            }
+            if (sink_parse(optarg, NULL) != 0) {
+                fprintf(stderr, "\nError: invalid output '%s'\n", optarg);
+                fprintf(stderr, "  Valid values: stdout, file:PATH, udp:HOST:PORT, unix:PATH,\n");
+                fprintf(stderr, "  each optionally followed by ,FORMAT\n\n");
+                fprintf(stderr, "Try: %s --help\n\n", argv[0]);
+                return -1;
+            }
+            params->outputs[params->noutputs++] = optarg;
+            break;
+        case 'F':
+            if (format_parse_mode(optarg, &params->mode) != 0) {
+                fprintf(stderr, "\nError: invalid format '%s'\n", optarg);
+                fprintf(stderr, "  Valid values: default, numeric, json, collectd, binary, influx,\n");
+                fprintf(stderr, "  collectd-net\n\n");
+                fprintf(stderr, "Try: %s --help\n\n", argv[0]);
+                return -1;
+            }
             break;
         case 'D': 
-            *debug = 1; 
+            params->debug = 1;
             break;
         case 'w': 
-            *watch = 1; 
+            params->watch = 1;
             break;
         case 'h': 
             print_usage(argv[0]); 
@@ -315,18 +738,39 @@ int parse_arguments(int argc, char **argv, int **gpios, size_t *ngpio,
         }
     }
 
+    // Sliding window defaults to the measurement window
+    if (params->window_ns == 0) {
+        params->window_ns = *duration_ns - *warmup_ns;
+    }
+
+    // A replay runs faster than any wall-clock tick, print every result
+    if (params->replay_path && params->watch) {
+        params->publish = PUBLISH_IMMEDIATE;
+    }
+
     return 0;
 }
 
-int validate_arguments(int *gpios, size_t ngpio, int duration, int warmup, const char *prog) {
+int validate_arguments(const measurement_params_t *params, const char *prog) {
+    const int *gpios = params->gpios;
+    size_t ngpio = params->ngpio;
+    double duration = (double)params->duration_ns / 1e9;
+    double warmup = (double)params->warmup_ns / 1e9;
+
     if (ngpio == 0) {
         fprintf(stderr, "\nError: at least one --gpio required\n\n");
         fprintf(stderr, "Try: %s --help\n\n", prog);
         return -1;
     }
 
-    // Check for duplicate GPIOs
-    for (size_t i = 0; i < ngpio; i++) {
+    if (params->config_path && params->engine == ENGINE_THREADS) {
+        fprintf(stderr, "\nError: --config requires --engine=epoll\n\n");
+        fprintf(stderr, "Try: %s --help\n\n", prog);
+        return -1;
+    }
+
+    // Check for duplicate GPIOs (the config file checks its own, per chip)
+    for (size_t i = 0; !params->config && i < ngpio; i++) {
         for (size_t j = i + 1; j < ngpio; j++) {
             if (gpios[i] == gpios[j]) {
                 fprintf(stderr, "\nError: GPIO pin %d specified multiple times\n\n", gpios[i]);
@@ -336,14 +780,64 @@ int validate_arguments(int *gpios, size_t ngpio, int duration, int warmup, const
         }
     }
 
+    if (params->replay_path) {
+        if (params->capture_path) {
+            fprintf(stderr, "\nError: --capture cannot be combined with --replay\n\n");
+            fprintf(stderr, "Try: %s --help\n\n", prog);
+            return -1;
+        }
+        if (params->engine == ENGINE_THREADS) {
+            fprintf(stderr, "\nError: --replay requires --engine=epoll\n\n");
+            fprintf(stderr, "Try: %s --help\n\n", prog);
+            return -1;
+        }
+    }
+
+    if (params->stagger && !params->watch) {
+        fprintf(stderr, "\nError: --stagger requires --watch\n\n");
+        fprintf(stderr, "Try: %s --help\n\n", prog);
+        return -1;
+    }
+
+    if (params->stall_rpm > 0 && params->engine == ENGINE_THREADS) {
+        fprintf(stderr, "\nError: --stall-rpm requires --engine=epoll\n\n");
+        fprintf(stderr, "Try: %s --help\n\n", prog);
+        return -1;
+    }
+
     // Validate duration vs warmup relationship
-    if (duration < warmup + 1) {
-        fprintf(stderr, "\nError: duration (%d) must be at least warmup + 1 second (%d)\n", duration, warmup + 1);
-        fprintf(stderr, "  Current: %ds warmup + %ds measurement = %ds minimum duration\n",
-                warmup, 1, warmup + 1);
-        fprintf(stderr, "  Try: %s --duration=%d or --warmup=%d\n\n", prog, warmup + 1, duration - 1);
+    if (params->duration_ns < params->warmup_ns + NSEC_PER_MSEC) {
+        fprintf(stderr, "\nError: duration (%gs) must be at least warmup + 1ms (%gs)\n",
+                duration, warmup + 0.001);
+        fprintf(stderr, "  Current: %gs warmup + 1ms measurement = %gs minimum duration\n",
+                warmup, warmup + 0.001);
+        fprintf(stderr, "  Try: %s --duration=%g or --warmup=0\n\n", prog, warmup + 1);
         return -1;
     }
 
+    // Validate sliding window geometry
+    if (params->method == METHOD_SLIDING) {
+        if (params->window_ns < params->interval_ns ||
+            params->window_ns % params->interval_ns != 0) {
+            fprintf(stderr, "\nError: window (%gs) must be a multiple of interval (%gs)\n",
+                    (double)params->window_ns / 1e9, (double)params->interval_ns / 1e9);
+            fprintf(stderr, "  Try: %s --window=%g\n\n", prog, (double)params->interval_ns / 1e9);
+            return -1;
+        }
+    }
+
     return 0;
 }
+
+void free_arguments(measurement_params_t *params) {
+    if (params->gpio_names) {
+        for (size_t i = 0; i < params->ngpio; i++) {
+            free(params->gpio_names[i]);
+        }
+        free(params->gpio_names);
+        params->gpio_names = NULL;
+    }
+    free(params->gpios);
+    params->gpios = NULL;
+    params->ngpio = 0;
+}
@@ -0,0 +1,24 @@
+/**
+ * This module provides cache line aligned allocation for per-fan and
+ * per-thread state written by different threads.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cacheline.h"
+
+void* rpm_aligned_calloc(size_t count, size_t size) {
+    if (count == 0 || size == 0 || count > SIZE_MAX / size) return NULL;
+
+    // aligned_alloc() requires a multiple of the alignment
+    size_t bytes = count * size;
+    bytes = (bytes + RPM_CACHE_LINE - 1) & ~(size_t)(RPM_CACHE_LINE - 1);
+
+    void *ptr = aligned_alloc(RPM_CACHE_LINE, bytes);
+    if (ptr) memset(ptr, 0, bytes);
+    return ptr;
+}
@@ -0,0 +1,299 @@
+/**
+ * This module records the raw edge events of a measurement to a file and
+ * loads such a capture for replay through the measurement engine.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "capture.h"
+
+struct capture {
+    int fd;                      /**< Capture file (O_APPEND) */
+    pthread_mutex_t lock;        /**< Serializes the batch buffer */
+    unsigned char *batch;        /**< Encoded records not yet written */
+    size_t used;                 /**< Records in batch */
+    int64_t flushed_ns;          /**< Timestamp of the last write */
+    int failed;                  /**< A write failed, later records are dropped */
+};
+
+static void put_le(unsigned char *p, uint64_t v, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint64_t get_le(const unsigned char *p, size_t bytes) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+/**
+ * Add one record to the batch (caller holds the lock and ensures space)
+ */
+static void capture_put(capture_t *cap, uint64_t timestamp_ns, unsigned int offset, unsigned int type) {
+    unsigned char *rec = cap->batch + cap->used * CAPTURE_RECORD_SIZE;
+
+    memset(rec, 0, CAPTURE_RECORD_SIZE);
+    put_le(rec, timestamp_ns, 8);
+    put_le(rec + 8, offset, 4);
+    rec[12] = (unsigned char)type;
+    cap->used++;
+}
+
+/**
+ * Write the batch with a single append (caller holds the lock)
+ */
+static void capture_flush(capture_t *cap, int64_t now) {
+    size_t len = cap->used * CAPTURE_RECORD_SIZE;
+    size_t done = 0;
+
+    while (!cap->failed && done < len) {
+        ssize_t n = write(cap->fd, cap->batch + done, len - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error: cannot write capture: %s\n", strerror(errno));
+            cap->failed = 1;
+            break;
+        }
+        done += (size_t)n;
+    }
+
+    cap->used = 0;
+    cap->flushed_ns = now;
+}
+
+capture_t* capture_open(const char *path) {
+    if (!path) return NULL;
+
+    capture_t *cap = calloc(1, sizeof(*cap));
+    if (!cap) return NULL;
+
+    cap->batch = malloc(CAPTURE_BATCH_RECORDS * CAPTURE_RECORD_SIZE);
+    if (!cap->batch) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        free(cap);
+        return NULL;
+    }
+
+    // Appends keep each batch contiguous even with several writer threads
+    cap->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (cap->fd < 0) {
+        fprintf(stderr, "Error: cannot create capture '%s': %s\n", path, strerror(errno));
+        free(cap->batch);
+        free(cap);
+        return NULL;
+    }
+
+    unsigned char header[CAPTURE_HEADER_SIZE] = {0};
+    memcpy(header, CAPTURE_MAGIC, 8);
+    put_le(header + 8, CAPTURE_VERSION, 2);
+    put_le(header + 10, CAPTURE_RECORD_SIZE, 2);
+    if (write(cap->fd, header, sizeof(header)) != (ssize_t)sizeof(header)) {
+        fprintf(stderr, "Error: cannot write capture '%s': %s\n", path, strerror(errno));
+        close(cap->fd);
+        free(cap->batch);
+        free(cap);
+        return NULL;
+    }
+
+    pthread_mutex_init(&cap->lock, NULL);
+    cap->flushed_ns = gpio_monotonic_ns();
+    capture_put(cap, (uint64_t)cap->flushed_ns, 0, CAPTURE_START);
+
+    return cap;
+}
+
+void capture_edges(capture_t *cap, const gpio_edge_t *edges, size_t count) {
+    if (!cap || !edges || count == 0) return;
+
+    pthread_mutex_lock(&cap->lock);
+
+    for (size_t i = 0; i < count; i++) {
+        capture_put(cap, edges[i].timestamp_ns, edges[i].offset,
+                    edges[i].rising ? CAPTURE_RISING : CAPTURE_FALLING);
+        if (cap->used == CAPTURE_BATCH_RECORDS) {
+            capture_flush(cap, (int64_t)edges[i].timestamp_ns);
+        }
+    }
+
+    // Slow fans fill a batch only rarely, keep the file close to live
+    int64_t last = (int64_t)edges[count - 1].timestamp_ns;
+    if (cap->used > 0 && last - cap->flushed_ns >= CAPTURE_FLUSH_NS) {
+        capture_flush(cap, last);
+    }
+
+    pthread_mutex_unlock(&cap->lock);
+}
+
+int capture_close(capture_t *cap) {
+    if (!cap) return 0;
+
+    int64_t now = gpio_monotonic_ns();
+    if (cap->used == CAPTURE_BATCH_RECORDS) {
+        capture_flush(cap, now);
+    }
+    capture_put(cap, (uint64_t)now, 0, CAPTURE_STOP);
+    capture_flush(cap, now);
+
+    int ret = cap->failed ? -1 : 0;
+    if (close(cap->fd) < 0) ret = -1;
+
+    pthread_mutex_destroy(&cap->lock);
+    free(cap->batch);
+    free(cap);
+    return ret;
+}
+
+/**
+ * Stable merge sort of edges by timestamp (keeps the order of each line)
+ */
+static int sort_edges(gpio_edge_t *edges, size_t count) {
+    size_t i = 1;
+    while (i < count && edges[i - 1].timestamp_ns <= edges[i].timestamp_ns) i++;
+    if (i >= count) return 0;  // Already in order (the usual case)
+
+    gpio_edge_t *tmp = malloc(count * sizeof(*tmp));
+    if (!tmp) return -1;
+
+    for (size_t width = 1; width < count; width *= 2) {
+        for (size_t lo = 0; lo < count; lo += 2 * width) {
+            size_t mid = lo + width < count ? lo + width : count;
+            size_t hi = lo + 2 * width < count ? lo + 2 * width : count;
+            size_t a = lo, b = mid, k = lo;
+            while (a < mid && b < hi) {
+                tmp[k++] = edges[b].timestamp_ns < edges[a].timestamp_ns ? edges[b++] : edges[a++];
+            }
+            while (a < mid) tmp[k++] = edges[a++];
+            while (b < hi) tmp[k++] = edges[b++];
+        }
+        memcpy(edges, tmp, count * sizeof(*edges));
+    }
+
+    free(tmp);
+    return 0;
+}
+
+int capture_load(const char *path, capture_replay_t *replay) {
+    if (!path || !replay) return -1;
+
+    memset(replay, 0, sizeof(*replay));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot open capture '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < CAPTURE_HEADER_SIZE) {
+        fprintf(stderr, "Error: '%s' is not a capture file\n", path);
+        close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    const unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error: cannot map capture '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (memcmp(data, CAPTURE_MAGIC, 8) != 0 || get_le(data + 8, 2) != CAPTURE_VERSION ||
+        get_le(data + 10, 2) != CAPTURE_RECORD_SIZE) {
+        fprintf(stderr, "Error: '%s' is not a capture file (or an unsupported version)\n", path);
+        munmap((void *)data, size);
+        return -1;
+    }
+
+    size_t nrecords = (size - CAPTURE_HEADER_SIZE) / CAPTURE_RECORD_SIZE;
+    if ((size - CAPTURE_HEADER_SIZE) % CAPTURE_RECORD_SIZE != 0) {
+        fprintf(stderr, "Warning: capture '%s' ends with a partial record\n", path);
+    }
+
+    replay->edges = malloc((nrecords > 0 ? nrecords : 1) * sizeof(*replay->edges));
+    if (!replay->edges) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        munmap((void *)data, size);
+        return -1;
+    }
+
+    for (size_t i = 0; i < nrecords; i++) {
+        const unsigned char *rec = data + CAPTURE_HEADER_SIZE + i * CAPTURE_RECORD_SIZE;
+        uint64_t timestamp_ns = get_le(rec, 8);
+        unsigned int type = rec[12];
+
+        if (type == CAPTURE_START) {
+            replay->start_ns = (int64_t)timestamp_ns;
+        } else if (type == CAPTURE_STOP) {
+            replay->stop_ns = (int64_t)timestamp_ns;
+        } else if (type == CAPTURE_RISING || type == CAPTURE_FALLING) {
+            gpio_edge_t *edge = &replay->edges[replay->count++];
+            edge->timestamp_ns = timestamp_ns;
+            edge->offset = (unsigned int)get_le(rec + 8, 4);
+            edge->rising = type == CAPTURE_RISING;
+        }
+    }
+    munmap((void *)data, size);
+
+    if (sort_edges(replay->edges, replay->count) < 0) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        capture_replay_free(replay);
+        return -1;
+    }
+
+    // Captures cut short (killed, disk full) lack the markers
+    if (replay->count > 0) {
+        int64_t first = (int64_t)replay->edges[0].timestamp_ns;
+        int64_t last = (int64_t)replay->edges[replay->count - 1].timestamp_ns;
+        if (replay->start_ns == 0 || replay->start_ns > first) replay->start_ns = first;
+        if (replay->stop_ns < last) replay->stop_ns = last;
+    } else if (replay->stop_ns < replay->start_ns) {
+        replay->stop_ns = replay->start_ns;
+    }
+
+    return 0;
+}
+
+size_t capture_offsets(const capture_replay_t *replay, int *gpios, size_t max) {
+    if (!replay || !gpios) return 0;
+
+    size_t n = 0;
+    for (size_t i = 0; i < replay->count; i++) {
+        int offset = (int)replay->edges[i].offset;
+
+        // Insert in ascending order, skipping offsets already seen
+        size_t pos = 0;
+        while (pos < n && gpios[pos] < offset) pos++;
+        if (pos < n && gpios[pos] == offset) continue;
+        if (n == max) {
+            if (pos == n) continue;
+            n--;  // Keep the lowest offsets
+        }
+        memmove(&gpios[pos + 1], &gpios[pos], (n - pos) * sizeof(*gpios));
+        gpios[pos] = offset;
+        n++;
+    }
+
+    return n;
+}
+
+void capture_replay_free(capture_replay_t *replay) {
+    if (!replay) return;
+
+    free(replay->edges);
+    memset(replay, 0, sizeof(*replay));
+}
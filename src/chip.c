@@ -8,8 +8,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <dirent.h>
 #include "chip.h"
 
+#define CHIP_DEV_DIR "/dev"
+#define CHIP_PREFIX "gpiochip"
+
 struct gpiod_chip* chip_open_by_name(const char *name) {
     if (!name) return NULL;
 
@@ -27,42 +31,90 @@ void chip_close(struct gpiod_chip *chip) {
     }
 }
 
+static int compare_chip_names(const void *a, const void *b) {
+    const char *na = *(const char *const *)a + strlen(CHIP_PREFIX);
+    const char *nb = *(const char *const *)b + strlen(CHIP_PREFIX);
+    long ia = strtol(na, NULL, 10);
+    long ib = strtol(nb, NULL, 10);
+    if (ia != ib) return ia < ib ? -1 : 1;
+    return strcmp(na, nb);
+}
+
+void chip_list_free(char **names, size_t count) {
+    if (!names) return;
+    for (size_t i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+int chip_list(char ***names_out) {
+    if (!names_out) return -1;
+    *names_out = NULL;
+
+    DIR *dir = opendir(CHIP_DEV_DIR);
+    if (!dir) return -1;
+
+    char **names = NULL;
+    size_t count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, CHIP_PREFIX, strlen(CHIP_PREFIX)) != 0) continue;
+
+        char path[64];
+        int n = snprintf(path, sizeof(path), CHIP_DEV_DIR "/%s", entry->d_name);
+        if (n < 0 || n >= (int)sizeof(path)) continue;
+        if (!gpiod_is_gpiochip_device(path)) continue;
+
+        char **temp = realloc(names, (count + 1) * sizeof(*names));
+        char *name = strdup(entry->d_name);
+        if (!temp || !name) {
+            free(name);
+            chip_list_free(temp ? temp : names, count);
+            closedir(dir);
+            return -1;
+        }
+        names = temp;
+        names[count++] = name;
+    }
+    closedir(dir);
+
+    // gpiochip2 before gpiochip10
+    if (count > 1) {
+        qsort(names, count, sizeof(*names), compare_chip_names);
+    }
+
+    *names_out = names;
+    return (int)count;
+}
+
 struct gpiod_chip* chip_auto_detect(int gpio, char **chipname_out) {
     if (!chipname_out) return NULL;
     *chipname_out = NULL;
-    
-    char name[16];
-    
-    // Try gpiochip0 through gpiochip9
-    for (int i = 0; i < 10; i++) {
-        int n = snprintf(name, sizeof(name), "gpiochip%d", i);
-        if (n < 0 || n >= (int)sizeof(name)) {
-            continue; // Skip if name was truncated
-        }
 
-        struct gpiod_chip *chip = chip_open_by_name(name);
+    char **names;
+    int count = chip_list(&names);
+    if (count <= 0) return NULL;
+
+    struct gpiod_chip *found = NULL;
+    for (int i = 0; i < count && !found; i++) {
+        struct gpiod_chip *chip = chip_open_by_name(names[i]);
         if (!chip) continue;
-        
+
         // Check if this chip has enough lines
-        struct gpiod_chip_info *info = chip_get_info(chip);
-        if (info) {
-            size_t num_lines = gpiod_chip_info_get_num_lines(info);
-            gpiod_chip_info_free(info);
-
-            if (gpio < (int)num_lines) {
-                *chipname_out = strdup(name);
-                if (!*chipname_out) {
-                    chip_close(chip);
-                    return NULL;
-                }
-                return chip;
+        if (gpio < (int)chip_get_num_lines(chip)) {
+            *chipname_out = strdup(names[i]);
+            if (*chipname_out) {
+                found = chip;
+                continue;
             }
         }
-    
+
         chip_close(chip);
     }
-    
-    return NULL;
+
+    chip_list_free(names, (size_t)count);
+    return found;
 }
 
 int chip_auto_detect_for_name(int gpio, char **chipname_out) {
@@ -94,3 +146,25 @@ size_t chip_get_num_lines(struct gpiod_chip *chip) {
     
     return num_lines;
 }
+
+char* chip_get_name(struct gpiod_chip *chip) {
+    struct gpiod_chip_info *info = chip_get_info(chip);
+    if (!info) return NULL;
+
+    const char *name = gpiod_chip_info_get_name(info);
+    char *copy = name ? strdup(name) : NULL;
+    gpiod_chip_info_free(info);
+
+    return copy;
+}
+
+char* chip_get_label(struct gpiod_chip *chip) {
+    struct gpiod_chip_info *info = chip_get_info(chip);
+    if (!info) return NULL;
+
+    const char *label = gpiod_chip_info_get_label(info);
+    char *copy = label ? strdup(label) : NULL;
+    gpiod_chip_info_free(info);
+
+    return copy;
+}
@@ -0,0 +1,445 @@
+/**
+ * This module maps the requested GPIO lines to a chip: it probes all
+ * chips in /dev in parallel, resolves line names and remembers the result
+ * in a small on-disk index keyed by chip label, so later runs only have
+ * to confirm the cached entry.
+ *
+ * The index is a text file with one record per line, fields separated by
+ * tabs:
+ *
+ *   chip <label> <name> <num_lines>
+ *   line <label> <line name> <offset>
+ *
+ * Chip names change when expanders probe in a different order, labels do
+ * not, so a cached entry is only trusted after the chip it names reports
+ * the same label and line count and each cached line its expected name.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <gpiod.h>
+#include "chipmap.h"
+#include "chip.h"
+
+#define CHIPMAP_NAME_MAX 32
+#define CHIPMAP_LABEL_MAX 64
+#define CHIPMAP_RECORD_MAX 256
+
+/**
+ * One chip of the index
+ */
+typedef struct {
+    char name[CHIPMAP_NAME_MAX];    /**< Chip name in /dev (e.g., "gpiochip2") */
+    char label[CHIPMAP_LABEL_MAX];  /**< Chip label (stable across boots) */
+    size_t num_lines;               /**< Number of lines */
+} chipmap_chip_t;
+
+/**
+ * One resolved line name of the index
+ */
+typedef struct {
+    char label[CHIPMAP_LABEL_MAX];  /**< Label of the chip holding the line */
+    char name[CHIPMAP_LINE_MAX];    /**< Line name */
+    int offset;                     /**< Line offset on the chip */
+} chipmap_line_t;
+
+/**
+ * Chip index, either loaded from disk or freshly discovered
+ */
+typedef struct {
+    chipmap_chip_t *chips;          /**< Chips */
+    size_t nchips;                  /**< Number of chips */
+    chipmap_line_t *lines;          /**< Resolved line names */
+    size_t nlines;                  /**< Number of resolved line names */
+} chipmap_t;
+
+/**
+ * Probe of one chip, run on its own thread during discovery
+ */
+typedef struct {
+    const char *name;               /**< Chip name to probe */
+    char *const *names;             /**< Requested line names (may be NULL) */
+    size_t ngpio;                   /**< Number of requested lines */
+    chipmap_chip_t chip;            /**< Probed chip */
+    int *offsets;                   /**< Offset per requested name (-1: not on this chip) */
+    int ok;                         /**< Whether the chip could be probed */
+    pthread_t thread;               /**< Probe thread */
+    int thread_started;             /**< Whether thread must be joined */
+} chipmap_probe_t;
+
+static void chipmap_free(chipmap_t *map) {
+    free(map->chips);
+    free(map->lines);
+    memset(map, 0, sizeof(*map));
+}
+
+static int chipmap_add_chip(chipmap_t *map, const chipmap_chip_t *chip) {
+    chipmap_chip_t *temp = realloc(map->chips, (map->nchips + 1) * sizeof(*temp));
+    if (!temp) return -1;
+    map->chips = temp;
+    map->chips[map->nchips++] = *chip;
+    return 0;
+}
+
+static const chipmap_line_t* chipmap_find_line(const chipmap_t *map, const char *label,
+                                               const char *name) {
+    for (size_t i = 0; i < map->nlines; i++) {
+        if (strcmp(map->lines[i].label, label) == 0 && strcmp(map->lines[i].name, name) == 0) {
+            return &map->lines[i];
+        }
+    }
+    return NULL;
+}
+
+static int chipmap_add_line(chipmap_t *map, const char *label, const char *name, int offset) {
+    if (chipmap_find_line(map, label, name)) return 0;
+    if (strlen(label) >= CHIPMAP_LABEL_MAX || strlen(name) >= CHIPMAP_LINE_MAX) return 0;
+
+    chipmap_line_t *temp = realloc(map->lines, (map->nlines + 1) * sizeof(*temp));
+    if (!temp) return -1;
+    map->lines = temp;
+
+    chipmap_line_t *line = &map->lines[map->nlines++];
+    strcpy(line->label, label);
+    strcpy(line->name, name);
+    line->offset = offset;
+    return 0;
+}
+
+/**
+ * Whether a string can be stored in a tab separated record
+ */
+static int chipmap_field_ok(const char *s) {
+    return *s != '\0' && strpbrk(s, "\t\r\n") == NULL;
+}
+
+static void chipmap_load(const char *path, chipmap_t *map) {
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+
+    char record[CHIPMAP_RECORD_MAX];
+    while (fgets(record, sizeof(record), f)) {
+        record[strcspn(record, "\r\n")] = '\0';
+
+        char *save = NULL;
+        char *type = strtok_r(record, "\t", &save);
+        char *label = strtok_r(NULL, "\t", &save);
+        char *name = strtok_r(NULL, "\t", &save);
+        char *value = strtok_r(NULL, "\t", &save);
+        if (!type || !label || !name || !value) continue;
+
+        char *end;
+        long n = strtol(value, &end, 10);
+        if (*end != '\0' || n < 0 || n > 65535) continue;
+
+        if (strcmp(type, "chip") == 0) {
+            if (strlen(label) >= CHIPMAP_LABEL_MAX || strlen(name) >= CHIPMAP_NAME_MAX) continue;
+            chipmap_chip_t chip = { .num_lines = (size_t)n };
+            strcpy(chip.label, label);
+            strcpy(chip.name, name);
+            if (chipmap_add_chip(map, &chip) < 0) break;
+        } else if (strcmp(type, "line") == 0) {
+            if (chipmap_add_line(map, label, name, (int)n) < 0) break;
+        }
+    }
+
+    fclose(f);
+}
+
+/**
+ * Write the index, keeping line names of earlier runs for chips still present
+ */
+static int chipmap_save(const char *path, const chipmap_t *map, const chipmap_t *previous) {
+    char tmp[4096];
+    int n = snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+    if (n < 0 || n >= (int)sizeof(tmp)) return -1;
+
+    FILE *f = fopen(tmp, "w");
+    if (!f) return -1;
+
+    fprintf(f, "# gpio-fan-rpm chip index\n");
+    for (size_t i = 0; i < map->nchips; i++) {
+        const chipmap_chip_t *chip = &map->chips[i];
+        if (!chipmap_field_ok(chip->label)) continue;
+        fprintf(f, "chip\t%s\t%s\t%zu\n", chip->label, chip->name, chip->num_lines);
+    }
+    for (size_t i = 0; i < map->nlines; i++) {
+        const chipmap_line_t *line = &map->lines[i];
+        if (!chipmap_field_ok(line->label) || !chipmap_field_ok(line->name)) continue;
+        fprintf(f, "line\t%s\t%s\t%d\n", line->label, line->name, line->offset);
+    }
+    for (size_t i = 0; i < previous->nlines; i++) {
+        const chipmap_line_t *line = &previous->lines[i];
+        if (chipmap_find_line(map, line->label, line->name)) continue;
+        for (size_t c = 0; c < map->nchips; c++) {
+            if (strcmp(map->chips[c].label, line->label) == 0) {
+                fprintf(f, "line\t%s\t%s\t%d\n", line->label, line->name, line->offset);
+                break;
+            }
+        }
+    }
+
+    if (fclose(f) != 0 || rename(tmp, path) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static void* chipmap_probe_fn(void *arg) {
+    chipmap_probe_t *probe = arg;
+
+    struct gpiod_chip *chip = chip_open_by_name(probe->name);
+    if (!chip) return NULL;
+
+    struct gpiod_chip_info *info = chip_get_info(chip);
+    if (info) {
+        const char *label = gpiod_chip_info_get_label(info);
+        snprintf(probe->chip.name, sizeof(probe->chip.name), "%s", probe->name);
+        snprintf(probe->chip.label, sizeof(probe->chip.label), "%s", label ? label : "");
+        probe->chip.num_lines = gpiod_chip_info_get_num_lines(info);
+        gpiod_chip_info_free(info);
+
+        // Each lookup reads the info of every line, the slow part of probing
+        for (size_t i = 0; i < probe->ngpio; i++) {
+            if (probe->names && probe->names[i]) {
+                probe->offsets[i] = gpiod_chip_get_line_offset_from_name(chip, probe->names[i]);
+            }
+        }
+        probe->ok = 1;
+    }
+
+    chip_close(chip);
+    return NULL;
+}
+
+/**
+ * Probe all chips in parallel and collect them with the requested names
+ */
+static int chipmap_discover(char *const *names, size_t ngpio, chipmap_t *map) {
+    char **chips;
+    int count = chip_list(&chips);
+    if (count < 0) return -1;
+
+    chipmap_probe_t *probes = calloc((size_t)count + 1, sizeof(*probes));
+    int *offsets = malloc(((size_t)count + 1) * ngpio * sizeof(*offsets));
+    if (!probes || !offsets) {
+        free(probes);
+        free(offsets);
+        chip_list_free(chips, (size_t)count);
+        return -1;
+    }
+
+    for (int c = 0; c < count; c++) {
+        chipmap_probe_t *probe = &probes[c];
+        probe->name = chips[c];
+        probe->names = names;
+        probe->ngpio = ngpio;
+        probe->offsets = &offsets[(size_t)c * ngpio];
+        for (size_t i = 0; i < ngpio; i++) probe->offsets[i] = -1;
+
+        // Probe inline if no thread is available
+        if (pthread_create(&probe->thread, NULL, chipmap_probe_fn, probe) == 0) {
+            probe->thread_started = 1;
+        } else {
+            chipmap_probe_fn(probe);
+        }
+    }
+
+    int ret = 0;
+    for (int c = 0; c < count; c++) {
+        chipmap_probe_t *probe = &probes[c];
+        if (probe->thread_started) {
+            pthread_join(probe->thread, NULL);
+        }
+        if (!probe->ok || ret < 0) continue;
+
+        if (chipmap_add_chip(map, &probe->chip) < 0) ret = -1;
+        for (size_t i = 0; i < ngpio && ret == 0; i++) {
+            if (probe->offsets[i] < 0) continue;
+            if (chipmap_add_line(map, probe->chip.label, names[i], probe->offsets[i]) < 0) ret = -1;
+        }
+    }
+
+    free(offsets);
+    free(probes);
+    chip_list_free(chips, (size_t)count);
+    return ret;
+}
+
+/**
+ * Find the first chip holding every requested line
+ *
+ * @return int Chip index or -1, offsets holds the line offsets on success
+ */
+static int chipmap_select(const chipmap_t *map, char *const *names, const int *gpios,
+                          size_t ngpio, const char *want, int *offsets) {
+    for (size_t c = 0; c < map->nchips; c++) {
+        const chipmap_chip_t *chip = &map->chips[c];
+        if (want && strcmp(want, chip->name) != 0 && strcmp(want, chip->label) != 0) continue;
+
+        size_t i;
+        for (i = 0; i < ngpio; i++) {
+            if (names && names[i]) {
+                const chipmap_line_t *line = chipmap_find_line(map, chip->label, names[i]);
+                if (!line) break;
+                offsets[i] = line->offset;
+            } else {
+                offsets[i] = gpios[i];
+            }
+            if (offsets[i] < 0 || (size_t)offsets[i] >= chip->num_lines) break;
+        }
+        if (i == ngpio) return (int)c;
+    }
+    return -1;
+}
+
+/**
+ * Confirm a cached entry against the chip it names
+ */
+static int chipmap_verify(const chipmap_chip_t *cached, char *const *names, const int *offsets,
+                          size_t ngpio) {
+    struct gpiod_chip *chip = chip_open_by_name(cached->name);
+    if (!chip) return -1;
+
+    int ret = -1;
+    struct gpiod_chip_info *info = chip_get_info(chip);
+    if (info) {
+        const char *label = gpiod_chip_info_get_label(info);
+        if (label && strcmp(label, cached->label) == 0 &&
+            gpiod_chip_info_get_num_lines(info) == cached->num_lines) {
+            ret = 0;
+        }
+        gpiod_chip_info_free(info);
+    }
+
+    // One line info per named line instead of a scan of the whole chip
+    for (size_t i = 0; i < ngpio && ret == 0; i++) {
+        if (!names || !names[i]) continue;
+
+        struct gpiod_line_info *line = gpiod_chip_get_line_info(chip, (unsigned int)offsets[i]);
+        const char *name = line ? gpiod_line_info_get_name(line) : NULL;
+        if (!name || strcmp(name, names[i]) != 0) ret = -1;
+        if (line) gpiod_line_info_free(line);
+    }
+
+    chip_close(chip);
+    return ret;
+}
+
+static void chipmap_report_missing(const chipmap_t *map, char *const *names, const int *gpios,
+                                   size_t ngpio, const char *want) {
+    if (want) {
+        fprintf(stderr, "Error: chip '%s' not found or missing requested lines\n", want);
+        return;
+    }
+
+    for (size_t i = 0; i < ngpio; i++) {
+        if (!names || !names[i]) continue;
+
+        int found = 0;
+        for (size_t c = 0; c < map->nchips && !found; c++) {
+            found = chipmap_find_line(map, map->chips[c].label, names[i]) != NULL;
+        }
+        if (!found) {
+            fprintf(stderr, "Error: GPIO line '%s' not found on any chip\n", names[i]);
+            return;
+        }
+    }
+
+    int gpio = -1;
+    for (size_t i = 0; i < ngpio; i++) {
+        if ((!names || !names[i]) && gpios[i] > gpio) gpio = gpios[i];
+    }
+    if (gpio >= 0) {
+        fprintf(stderr, "Error: cannot find suitable chip for GPIO %d\n", gpio);
+    } else {
+        fprintf(stderr, "Error: no GPIO chip holds all requested lines\n");
+    }
+}
+
+int chipmap_resolve(char *const *names, int *gpios, size_t ngpio, char **chipname, int debug) {
+    if (!gpios || ngpio == 0 || !chipname) return -1;
+
+    int named = 0;
+    for (size_t i = 0; names && i < ngpio; i++) {
+        if (names[i]) named = 1;
+    }
+
+    // A chip given by name with numbered lines needs no lookup at all
+    const char *want = *chipname;
+    if (want && !named) {
+        char path[64];
+        int n = snprintf(path, sizeof(path), "/dev/%s", want);
+        if (n > 0 && n < (int)sizeof(path) && access(path, F_OK) == 0) return 0;
+    }
+
+    const char *cache = getenv(CHIPMAP_CACHE_ENV);
+    if (!cache) cache = CHIPMAP_DEFAULT_CACHE;
+    if (*cache == '\0') cache = NULL;
+
+    int *offsets = malloc(ngpio * sizeof(*offsets));
+    if (!offsets) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        return -1;
+    }
+
+    chipmap_t cached = {0};
+    chipmap_t found = {0};
+    const chipmap_chip_t *chip = NULL;
+
+    if (cache) {
+        chipmap_load(cache, &cached);
+        int c = chipmap_select(&cached, names, gpios, ngpio, want, offsets);
+        if (c >= 0 && chipmap_verify(&cached.chips[c], names, offsets, ngpio) == 0) {
+            chip = &cached.chips[c];
+            if (debug) {
+                fprintf(stderr, "Using cached chip %s (%s) from %s\n", chip->name, chip->label, cache);
+            }
+        }
+    }
+
+    if (!chip) {
+        if (chipmap_discover(names, ngpio, &found) < 0) {
+            fprintf(stderr, "Error: cannot scan for GPIO chips\n");
+        } else {
+            int c = chipmap_select(&found, names, gpios, ngpio, want, offsets);
+            if (c >= 0) {
+                chip = &found.chips[c];
+                if (debug) {
+                    fprintf(stderr, "Discovered %zu chip(s), using %s (%s)\n",
+                            found.nchips, chip->name, chip->label);
+                }
+                if (cache && chipmap_save(cache, &found, &cached) < 0 && debug) {
+                    fprintf(stderr, "Warning: cannot write chip index %s\n", cache);
+                }
+            } else {
+                chipmap_report_missing(&found, names, gpios, ngpio, want);
+            }
+        }
+    }
+
+    int ret = -1;
+    char *name = chip ? strdup(chip->name) : NULL;
+    if (name) {
+        for (size_t i = 0; i < ngpio; i++) {
+            gpios[i] = offsets[i];
+        }
+        free(*chipname);
+        *chipname = name;
+        ret = 0;
+    } else if (chip) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+    }
+
+    chipmap_free(&cached);
+    chipmap_free(&found);
+    free(offsets);
+    return ret;
+}
@@ -0,0 +1,428 @@
+/**
+ * This module reads the fan configuration file and watches it for
+ * changes, so a running watch mode can apply a new fan set without a
+ * restart.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <libgen.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include "config.h"
+
+// Characters of a fan name
+#define CONFIG_NAME_CHARS "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_-."
+
+struct config_watch {
+    int epfd;            /**< epoll set of the SIGHUP eventfd and the inotify fd */
+    int inotify_fd;      /**< Watches the config file's directory (-1: none) */
+    char *name;          /**< Base name of the config file */
+};
+
+// Signalled by SIGHUP, shared by all watchers
+static int hup_eventfd = -1;
+
+/**
+ * Signal handler turning SIGHUP into a reload request
+ * @param sig Signal number
+ */
+static void hup_signal_handler(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+
+    if (hup_eventfd >= 0) {
+        uint64_t one = 1;
+        ssize_t n = write(hup_eventfd, &one, sizeof(one));
+        (void)n;  // EAGAIN only means already signalled
+    }
+
+    errno = saved_errno;
+}
+
+int config_parse_int(const char *str, int *result) {
+    if (!str || !result) return -1;
+
+    char *endptr;
+    errno = 0;
+    long val = strtol(str, &endptr, 10);
+
+    // Check for various error conditions
+    if (errno == ERANGE || val > INT_MAX || val < INT_MIN) {
+        return -1; // Overflow/underflow
+    }
+    if (endptr == str || *endptr != '\0') {
+        return -1; // No conversion or trailing characters
+    }
+
+    *result = (int)val;
+    return 0;
+}
+
+int config_parse_time(const char *str, int64_t *result_ns) {
+    if (!str || !result_ns) return -1;
+
+    char *endptr;
+    errno = 0;
+    double val = strtod(str, &endptr);
+
+    if (errno == ERANGE || endptr == str || val < 0.0) {
+        return -1;
+    }
+
+    double scale;
+    if (*endptr == '\0' || strcmp(endptr, "s") == 0) {
+        scale = 1e9;
+    } else if (strcmp(endptr, "ms") == 0) {
+        scale = 1e6;
+    } else if (strcmp(endptr, "us") == 0) {
+        scale = 1e3;
+    } else if (strcmp(endptr, "ns") == 0) {
+        scale = 1.0;
+    } else {
+        return -1; // Unknown unit or trailing characters
+    }
+
+    // Reject NaN and values beyond any sensible duration
+    if (!(val * scale <= 1e18)) {
+        return -1;
+    }
+
+    *result_ns = (int64_t)(val * scale + 0.5);
+    return 0;
+}
+
+/**
+ * Apply one KEY=VALUE setting to a fan
+ *
+ * @return int 0 on success, -1 on error (reported)
+ */
+static int parse_setting(fan_config_t *fan, char *setting, const char *path, unsigned int lineno) {
+    char *value = strchr(setting, '=');
+    if (!value || value == setting || value[1] == '\0') {
+        fprintf(stderr, "Error: %s:%u: expected KEY=VALUE, got '%s'\n", path, lineno, setting);
+        return -1;
+    }
+    *value++ = '\0';
+
+    if (strcmp(setting, "chip") == 0) {
+        if (strlen(value) >= sizeof(fan->chip)) {
+            fprintf(stderr, "Error: %s:%u: chip name '%s' is too long\n", path, lineno, value);
+            return -1;
+        }
+        strcpy(fan->chip, value);
+    } else if (strcmp(setting, "offset") == 0) {
+        if (config_parse_int(value, &fan->offset) != 0 || fan->offset < 0 || fan->offset > 999) {
+            fprintf(stderr, "Error: %s:%u: offset must be between 0 and 999, got '%s'\n", path, lineno, value);
+            return -1;
+        }
+    } else if (strcmp(setting, "pulses") == 0) {
+        if (config_parse_int(value, &fan->pulses) != 0 || fan->pulses < 1 || fan->pulses > 100) {
+            fprintf(stderr, "Error: %s:%u: pulses must be between 1 and 100, got '%s'\n", path, lineno, value);
+            return -1;
+        }
+    } else if (strcmp(setting, "edge") == 0) {
+        if (strcmp(value, "rising") == 0) {
+            fan->edge = EDGE_RISING;
+        } else if (strcmp(value, "falling") == 0) {
+            fan->edge = EDGE_FALLING;
+        } else if (strcmp(value, "both") == 0) {
+            fan->edge = EDGE_BOTH;
+        } else {
+            fprintf(stderr, "Error: %s:%u: edge must be rising, falling or both, got '%s'\n",
+                    path, lineno, value);
+            return -1;
+        }
+    } else if (strcmp(setting, "window") == 0) {
+        if (config_parse_time(value, &fan->window_ns) != 0 || fan->window_ns < NSEC_PER_MSEC ||
+            fan->window_ns > 3600 * NSEC_PER_SEC) {
+            fprintf(stderr, "Error: %s:%u: window must be a time between 1ms and 3600s, got '%s'\n",
+                    path, lineno, value);
+            return -1;
+        }
+    } else {
+        fprintf(stderr, "Error: %s:%u: unknown setting '%s'\n", path, lineno, setting);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Check a fan's window against the measurement options
+ *
+ * @return int 0 on success, -1 on error (reported)
+ */
+static int check_window(const fan_config_t *fan, const measurement_params_t *params, const char *path,
+                        unsigned int lineno) {
+    if (params->method == METHOD_SLIDING) {
+        if (fan->window_ns < params->interval_ns || fan->window_ns % params->interval_ns != 0) {
+            fprintf(stderr, "Error: %s:%u: window (%gs) must be a multiple of interval (%gs)\n", path, lineno,
+                    (double)fan->window_ns / 1e9, (double)params->interval_ns / 1e9);
+            return -1;
+        }
+    } else if (fan->window_ns < params->warmup_ns + NSEC_PER_MSEC) {
+        fprintf(stderr, "Error: %s:%u: window (%gs) must be at least warmup + 1ms (%gs)\n", path, lineno,
+                (double)fan->window_ns / 1e9, (double)params->warmup_ns / 1e9 + 0.001);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Parse one config line into a fan
+ *
+ * @return int 1 if the line describes a fan, 0 if it is empty, -1 on error
+ */
+static int parse_line(char *text, fan_config_t *fan, const measurement_params_t *params, const char *path,
+                      unsigned int lineno) {
+    char *comment = strchr(text, '#');
+    if (comment) *comment = '\0';
+
+    char *save = NULL;
+    char *name = strtok_r(text, " \t\r\n", &save);
+    if (!name) return 0;
+
+    if (strchr(name, '=')) {
+        fprintf(stderr, "Error: %s:%u: fan name missing before '%s'\n", path, lineno, name);
+        return -1;
+    }
+    if (strlen(name) >= sizeof(fan->name)) {
+        fprintf(stderr, "Error: %s:%u: fan name '%s' is too long (max %d characters)\n", path, lineno, name,
+                CONFIG_NAME_MAX - 1);
+        return -1;
+    }
+    // Names are labels in every output format, none of which may need escaping
+    if (name[strspn(name, CONFIG_NAME_CHARS)] != '\0') {
+        fprintf(stderr, "Error: %s:%u: fan name '%s' may only contain letters, digits, '_', '-' and '.'\n",
+                path, lineno, name);
+        return -1;
+    }
+
+    memset(fan, 0, sizeof(*fan));
+    strcpy(fan->name, name);
+    fan->offset = -1;
+    fan->pulses = params->pulses;
+    fan->edge = params->edge;
+    fan->window_ns = params->method == METHOD_SLIDING ? params->window_ns : params->duration_ns;
+
+    char *setting;
+    while ((setting = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+        if (parse_setting(fan, setting, path, lineno) < 0) return -1;
+    }
+
+    if (fan->offset < 0) {
+        fprintf(stderr, "Error: %s:%u: fan '%s' has no offset\n", path, lineno, fan->name);
+        return -1;
+    }
+    if (check_window(fan, params, path, lineno) < 0) return -1;
+
+    return 1;
+}
+
+int config_load(const char *path, const measurement_params_t *params, fan_config_list_t *list) {
+    if (!path || !params || !list) return -1;
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Error: cannot open config '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    list->count = 0;
+    char text[CONFIG_LINE_MAX];
+    unsigned int lineno = 0;
+    int ret = 0;
+
+    while (ret == 0 && fgets(text, sizeof(text), file)) {
+        lineno++;
+        if (!strchr(text, '\n') && !feof(file)) {
+            fprintf(stderr, "Error: %s:%u: line is too long (max %d characters)\n", path, lineno,
+                    CONFIG_LINE_MAX - 2);
+            ret = -1;
+            break;
+        }
+
+        fan_config_t fan;
+        int found = parse_line(text, &fan, params, path, lineno);
+        if (found < 0) {
+            ret = -1;
+        } else if (found > 0) {
+            if (list->count == CONFIG_MAX_FANS) {
+                fprintf(stderr, "Error: %s:%u: too many fans (max %d)\n", path, lineno, CONFIG_MAX_FANS);
+                ret = -1;
+                break;
+            }
+            for (size_t i = 0; i < list->count; i++) {
+                if (strcmp(list->fans[i].name, fan.name) == 0) {
+                    fprintf(stderr, "Error: %s:%u: fan '%s' is defined twice\n", path, lineno, fan.name);
+                    ret = -1;
+                }
+            }
+            list->fans[list->count++] = fan;
+        }
+    }
+
+    if (ret == 0 && ferror(file)) {
+        fprintf(stderr, "Error: cannot read config '%s'\n", path);
+        ret = -1;
+    }
+    fclose(file);
+    return ret;
+}
+
+int config_resolve_chips(fan_config_list_t *list, const char *chipname, const char *path) {
+    if (!list) return -1;
+
+    if (chipname && strlen(chipname) >= CONFIG_CHIP_MAX) {
+        fprintf(stderr, "Error: chip name '%s' is too long for config '%s'\n", chipname, path);
+        return -1;
+    }
+    for (size_t i = 0; chipname && i < list->count; i++) {
+        if (list->fans[i].chip[0] == '\0') strcpy(list->fans[i].chip, chipname);
+    }
+
+    for (size_t i = 0; i < list->count; i++) {
+        for (size_t j = 0; j < i; j++) {
+            const fan_config_t *a = &list->fans[j];
+            const fan_config_t *b = &list->fans[i];
+            if (a->offset == b->offset && strcmp(a->chip, b->chip) == 0) {
+                fprintf(stderr, "Error: %s: fans '%s' and '%s' use the same line (%s offset %d)\n", path,
+                        a->name, b->name, a->chip[0] ? a->chip : "default chip", a->offset);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int config_check_single_chip(const fan_config_list_t *list, const char *path) {
+    if (!list) return -1;
+
+    for (size_t i = 1; i < list->count; i++) {
+        const fan_config_t *a = &list->fans[0];
+        const fan_config_t *b = &list->fans[i];
+        if (strcmp(a->chip, b->chip) != 0) {
+            fprintf(stderr, "Error: %s: --capture records line offsets only, but fans '%s' and '%s' "
+                    "are on different chips (%s, %s)\n", path, a->name, b->name,
+                    a->chip[0] ? a->chip : "default chip", b->chip[0] ? b->chip : "default chip");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int config_fan_same(const fan_config_t *a, const fan_config_t *b) {
+    return strcmp(a->chip, b->chip) == 0 && a->offset == b->offset && a->pulses == b->pulses &&
+           a->edge == b->edge && a->window_ns == b->window_ns;
+}
+
+config_watch_t* config_watch_start(const char *path) {
+    if (!path) return NULL;
+
+    config_watch_t *watch = calloc(1, sizeof(*watch));
+    char *dir_copy = strdup(path);
+    char *name_copy = strdup(path);
+    if (!watch || !dir_copy || !name_copy) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        free(watch);
+        free(dir_copy);
+        free(name_copy);
+        return NULL;
+    }
+    watch->inotify_fd = -1;
+    watch->name = strdup(basename(name_copy));
+    free(name_copy);
+
+    watch->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (hup_eventfd < 0) {
+        hup_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    if (!watch->name || watch->epfd < 0 || hup_eventfd < 0) {
+        fprintf(stderr, "Error: cannot watch config '%s': %s\n", path, strerror(errno));
+        free(dir_copy);
+        config_watch_stop(watch);
+        return NULL;
+    }
+
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    if (epoll_ctl(watch->epfd, EPOLL_CTL_ADD, hup_eventfd, &ev) < 0) {
+        fprintf(stderr, "Error: cannot watch config '%s': %s\n", path, strerror(errno));
+        free(dir_copy);
+        config_watch_stop(watch);
+        return NULL;
+    }
+
+    // A reload must not interrupt blocking calls in the other threads
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = hup_signal_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGHUP, &sa, NULL) < 0) {
+        fprintf(stderr, "Warning: failed to set up SIGHUP handler\n");
+    }
+
+    // Editors replace the file (rename) as often as they rewrite it, so
+    // the directory is watched instead of the file itself
+    watch->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->inotify_fd < 0 ||
+        inotify_add_watch(watch->inotify_fd, dirname(dir_copy), IN_CLOSE_WRITE | IN_MOVED_TO) < 0 ||
+        epoll_ctl(watch->epfd, EPOLL_CTL_ADD, watch->inotify_fd, &ev) < 0) {
+        fprintf(stderr, "Warning: cannot watch config '%s' for changes (%s), reload with SIGHUP\n",
+                path, strerror(errno));
+        if (watch->inotify_fd >= 0) close(watch->inotify_fd);
+        watch->inotify_fd = -1;
+    }
+
+    free(dir_copy);
+    return watch;
+}
+
+int config_watch_fd(const config_watch_t *watch) {
+    return watch ? watch->epfd : -1;
+}
+
+int config_watch_check(config_watch_t *watch) {
+    if (!watch) return 0;
+
+    int due = 0;
+    uint64_t pending;
+    if (read(hup_eventfd, &pending, sizeof(pending)) == (ssize_t)sizeof(pending)) {
+        due = 1;
+    }
+
+    // Changes to other files in the directory are ignored
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while (watch->inotify_fd >= 0 && (len = read(watch->inotify_fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t pos = 0; pos < len;) {
+            const struct inotify_event *event = (const struct inotify_event *)(buf + pos);
+            if (event->len > 0 && strcmp(event->name, watch->name) == 0) {
+                due = 1;
+            }
+            pos += (ssize_t)(sizeof(*event) + event->len);
+        }
+    }
+
+    return due;
+}
+
+void config_watch_stop(config_watch_t *watch) {
+    if (!watch) return;
+
+    if (watch->inotify_fd >= 0) close(watch->inotify_fd);
+    if (watch->epfd >= 0) close(watch->epfd);
+    free(watch->name);
+    free(watch);
+}
@@ -0,0 +1,1178 @@
+/**
+ * This module implements the single-threaded measurement engine that
+ * multiplexes all GPIO lines and one shared timer in a single epoll set.
+ *
+ * Every line runs the same warmup/measurement cycle as gpio_measure_rpm(),
+ * gpio_measure_rpm_period(), gpio_measure_rpm_adaptive() or
+ * gpio_measure_rpm_sliding(), but as a
+ * per-line state machine driven by one event loop. The shared
+ * timerfd is always armed to the earliest pending line deadline.
+ *
+ * All lines of a chip with the same edge type are requested in one line
+ * request, so the loop watches a single event fd per request and
+ * demultiplexes edges by line offset.
+ *
+ * With --stall-rpm every line also has a stall deadline a stall timeout
+ * after its latest edge; a line reaching it publishes a stalled result at
+ * once instead of at the end of its window.
+ *
+ * With --stagger the first round of every line is held back by its share
+ * of one round, so the lines fall due one after another: every wakeup
+ * completes a single line instead of all lines at once.
+ *
+ * With --config and --watch the engine has one slot per possible fan and
+ * applies a reloaded config file between two event batches: only added,
+ * removed or changed fans are requested, released or restarted.
+ *
+ * A replay runs the same state machines on the timeline of a capture
+ * file: time advances from deadline to deadline and edge to edge as fast
+ * as the results are consumed, without a chip or a timer.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "engine.h"
+#include "gpio.h"
+#include "capture.h"
+#include "stop.h"
+#include "rtsched.h"
+#include "config.h"
+
+#define ENGINE_MAX_EVENTS 64
+
+/**
+ * Per-line measurement state
+ */
+typedef enum {
+    LINE_STATE_WARMUP,    /**< Counting is disabled until warmup ends */
+    LINE_STATE_MEASURE,   /**< Counting edges for the measurement window */
+    LINE_STATE_DONE       /**< No further measurements for this line */
+} line_state_t;
+
+typedef struct engine_request engine_request_t;
+
+/**
+ * Per-line engine state
+ */
+typedef struct {
+    int gpio;                /**< GPIO number (-1: unused slot) */
+    size_t index;            /**< Index into the results array */
+    fan_config_t fan;        /**< Pulses, edge type and window of the fan */
+    unsigned int generation; /**< Fan generation of the slot (see snapshot_reset()) */
+    int64_t stall_ns;        /**< Stall timeout (0: no stall detection) */
+    line_state_t state;      /**< Current state */
+    unsigned int count;      /**< Edges counted in the measurement phase */
+    period_tracker_t tracker; /**< Period tracker for METHOD_PERIOD */
+    adaptive_tracker_t adaptive; /**< Edge interval tracker for METHOD_ADAPTIVE */
+    sliding_window_t window; /**< Bucket ring for METHOD_SLIDING */
+    unsigned int *bucket_counts; /**< Bucket storage for METHOD_SLIDING */
+    int64_t *bucket_starts;  /**< Bucket start times for METHOD_SLIDING */
+    int discard;             /**< Do not publish the result of this round */
+    int64_t phase_start_ns;  /**< Monotonic start time of the current phase */
+    int64_t deadline_ns;     /**< Monotonic end time of the current phase */
+    engine_request_t *request; /**< Line request reading this line (NULL: not requested) */
+    size_t request_line;     /**< Index of the line in the request */
+    int pending;             /**< Waiting to be requested by engine_request_pending() */
+    unsigned long overruns;  /**< Windows that ended a whole window or more late */
+    int64_t last_edge_ns;    /**< Timestamp of the latest edge (or of the engine start) */
+    int stalled;             /**< No edge within the stall timeout since last_edge_ns */
+    unsigned long stalls;    /**< Stalls detected */
+} engine_line_t;
+
+/**
+ * Line request with its lookup of lines by offset
+ */
+struct engine_request {
+    gpio_context_t *gpio;          /**< Requested lines and their event buffer */
+    char chip[CONFIG_CHIP_MAX];    /**< Chip the lines were requested for (empty: the context's) */
+    engine_line_t **by_offset;     /**< Line lookup by offset for demultiplexing (NULL: edges dropped) */
+    unsigned int max_offset;       /**< Highest requested offset */
+    size_t bound;                  /**< Lines measured through this request */
+};
+
+/**
+ * Engine state owned by the engine thread
+ */
+typedef struct {
+    measurement_ctx_t *ctx;        /**< Shared measurement context */
+    measurement_params_t params;   /**< Measurement parameters */
+    engine_line_t *lines;          /**< Per-line state */
+    size_t nlines;                 /**< Number of lines */
+    engine_request_t **requests;   /**< Line requests (one per chip and edge type unless one failed) */
+    size_t nrequests;              /**< Number of line requests */
+    int *group;                    /**< Offsets of the request being made */
+    char consumer[32];             /**< Consumer name of the line requests */
+    int epfd;                      /**< epoll instance */
+    int timerfd;                   /**< Shared phase timer */
+    int64_t armed_ns;              /**< Deadline the timer is armed to, 0 if disarmed */
+    int armed_stall;               /**< armed_ns is a stall deadline */
+    uint64_t *periods;             /**< Period storage for all lines (METHOD_PERIOD) */
+    capture_replay_t replay;       /**< Edges of the replayed capture (replay only) */
+    config_watch_t *watch;         /**< Reload requests of the config file (NULL: no reload) */
+    fan_config_list_t reload;      /**< Fans of the config file being applied */
+    unsigned long wakeups;         /**< epoll_wait() returns */
+} engine_t;
+
+/**
+ * Publish a result of a line together with its counters
+ */
+static void engine_publish(engine_t *eng, const engine_line_t *line, rpm_value_t rpm, unsigned long pulses,
+                           int64_t span_ns) {
+    rpm_counters_t counters = {0};
+    if (line->request) {
+        gpio_counters(line->request->gpio, line->request_line, &counters);
+    }
+    counters.wakeups = eng->wakeups;
+    counters.overruns = line->overruns;
+    counters.stalls = line->stalls;
+    counters.stalled = line->stalled;
+
+    measurement_publish(eng->ctx, line->index, rpm, pulses, span_ns, &counters);
+}
+
+/**
+ * Time a line counts as stalled unless another edge arrives
+ *
+ * @return int64_t Stall deadline, 0 if the line cannot stall (again)
+ */
+static int64_t engine_stall_deadline(const engine_line_t *line) {
+    if (line->stall_ns == 0 || line->stalled || line->state == LINE_STATE_DONE) return 0;
+    return line->last_edge_ns + line->stall_ns;
+}
+
+/**
+ * Publish a stalled result without waiting for the end of the window
+ *
+ * The window in progress goes on, so a fan that starts again reports its
+ * speed as usual; its first edge clears the stall. A single measurement
+ * ends with the stall.
+ */
+static void engine_stall(engine_t *eng, engine_line_t *line, int64_t now) {
+    line->stalled = 1;
+    line->stalls++;
+
+    if (eng->params.debug) {
+        fprintf(stderr, "GPIO%d: no edge for %.3f s, stalled\n", line->gpio,
+                (double)(now - line->last_edge_ns) / 1e9);
+    }
+
+    engine_publish(eng, line, 0, 0, now - line->last_edge_ns);
+    if (!eng->params.watch) {
+        line->state = LINE_STATE_DONE;
+    }
+}
+
+static void engine_begin_round(engine_t *eng, engine_line_t *line, int64_t now) {
+    line->count = 0;
+    line->phase_start_ns = now;
+    period_reset(&line->tracker);
+    adaptive_reset(&line->adaptive);
+
+    if (eng->params.warmup_ns > 0) {
+        line->state = LINE_STATE_WARMUP;
+        line->deadline_ns = now + eng->params.warmup_ns;
+    } else if (eng->params.method == METHOD_SLIDING) {
+        line->state = LINE_STATE_MEASURE;
+        sliding_reset(&line->window, now);
+        line->deadline_ns = now + eng->params.interval_ns;
+    } else {
+        line->state = LINE_STATE_MEASURE;
+        line->deadline_ns = now + line->fan.window_ns;
+    }
+}
+
+/**
+ * Begin the first round of all lines, staggered with --stagger
+ *
+ * A staggered line starts with a longer warmup, so it counts no edge
+ * before its phase offset. Its later rounds keep the offset.
+ */
+static void engine_begin_all(engine_t *eng, int64_t now) {
+    size_t count = 0;
+    for (size_t i = 0; i < eng->nlines; i++) {
+        if (eng->lines[i].request) count++;
+    }
+
+    size_t k = 0;
+    for (size_t i = 0; i < eng->nlines; i++) {
+        engine_line_t *line = &eng->lines[i];
+        if (!line->request) continue;
+
+        // Warmup once for watch mode (sliding windows warm up only once anyway)
+        line->discard = eng->params.watch && eng->params.method != METHOD_SLIDING;
+        line->last_edge_ns = now;
+        engine_begin_round(eng, line, now);
+        if (!eng->params.stagger) continue;
+
+        int64_t round_ns = eng->params.method == METHOD_SLIDING ? eng->params.interval_ns : line->fan.window_ns;
+        int64_t offset_ns = rpm_stagger_ns(round_ns, k++, count);
+        if (offset_ns == 0) continue;
+        if (line->state != LINE_STATE_WARMUP) {
+            line->state = LINE_STATE_WARMUP;
+            line->deadline_ns = now;
+        }
+        line->deadline_ns += offset_ns;
+    }
+}
+
+/**
+ * Complete one sliding window bucket and report the window RPM
+ */
+static void engine_rotate_window(engine_t *eng, engine_line_t *line, int64_t now) {
+    const measurement_params_t *p = &eng->params;
+
+    sliding_add(&line->window, line->count);
+    line->count = 0;
+    rpm_value_t rpm = sliding_rotate(&line->window, now, line->fan.pulses);
+
+    if (p->debug) {
+        fprintf(stderr, "GPIO%d: %lu pulses in %zu/%zu buckets, RPM=%lld\n",
+                line->gpio, line->window.sum, line->window.filled,
+                line->window.nbuckets, rpm_round(rpm));
+    }
+
+    // Stay phase-locked to the interval schedule unless we fell behind
+    int64_t interval_ns = p->interval_ns;
+    line->deadline_ns += interval_ns;
+    if (line->deadline_ns <= now) {
+        line->deadline_ns = now + interval_ns;
+        line->overruns++;
+    }
+
+    unsigned long pulses = line->window.sum;
+    int64_t span_ns = sliding_span_ns(&line->window);
+
+    if (p->watch) {
+        engine_publish(eng, line, rpm, pulses, span_ns);
+    } else if (line->window.filled == line->window.nbuckets) {
+        // A single sliding measurement reports once the window is full
+        engine_publish(eng, line, rpm, pulses, span_ns);
+        line->state = LINE_STATE_DONE;
+    }
+}
+
+/**
+ * Advance a line whose phase deadline has passed
+ */
+static void engine_advance(engine_t *eng, engine_line_t *line, int64_t now) {
+    const measurement_params_t *p = &eng->params;
+
+    if (line->state == LINE_STATE_WARMUP) {
+        line->state = LINE_STATE_MEASURE;
+        line->count = 0;
+        line->phase_start_ns = now;
+        if (p->method == METHOD_SLIDING) {
+            sliding_reset(&line->window, now);
+            line->deadline_ns = now + p->interval_ns;
+        } else {
+            line->deadline_ns = now + (line->fan.window_ns - p->warmup_ns);
+        }
+        return;
+    }
+
+    if (line->state != LINE_STATE_MEASURE) return;
+
+    if (p->method == METHOD_SLIDING) {
+        engine_rotate_window(eng, line, now);
+        return;
+    }
+
+    // Processed a whole window or more after its deadline (0: ended early)
+    if (line->deadline_ns != 0 && now - line->deadline_ns >= line->deadline_ns - line->phase_start_ns) {
+        line->overruns++;
+    }
+
+    rpm_value_t rpm;
+    unsigned long pulses = line->count;
+    int64_t phase_ns = now - line->phase_start_ns;
+    int64_t span_ns = phase_ns;
+
+    if (p->method == METHOD_PERIOD) {
+        size_t captured = line->tracker.count;
+        rpm = period_rpm(&line->tracker, line->fan.pulses);
+        if (p->debug) {
+            fprintf(stderr, "GPIO%d: captured %zu/%zu periods in %.3f s, RPM=%lld%s\n",
+                    line->gpio, captured, line->tracker.capacity, (double)phase_ns / 1e9, rpm_round(rpm),
+                    line->discard ? " (warmup round, discarded)" : "");
+        }
+        period_reset(&line->tracker);
+    } else if (p->method == METHOD_ADAPTIVE) {
+        // Report the edges and span actually timed, not the whole phase
+        rpm = adaptive_rpm(&line->adaptive, line->fan.pulses);
+        pulses = line->adaptive.complete;
+        span_ns = adaptive_span_ns(&line->adaptive);
+        if (p->debug) {
+            fprintf(stderr, "GPIO%d: timed %lu/%u pulses over %.3f s in %.3f s, RPM=%lld%s\n",
+                    line->gpio, pulses, line->adaptive.target, (double)span_ns / 1e9,
+                    (double)phase_ns / 1e9, rpm_round(rpm), line->discard ? " (warmup round, discarded)" : "");
+        }
+        adaptive_reset(&line->adaptive);
+    } else {
+        rpm = rpm_from_count(line->count, line->fan.pulses, phase_ns);
+        if (p->debug) {
+            fprintf(stderr, "GPIO%d: counted %u pulses in %.3f s, RPM=%lld%s\n",
+                    line->gpio, line->count, (double)phase_ns / 1e9, rpm_round(rpm),
+                    line->discard ? " (warmup round, discarded)" : "");
+        }
+    }
+
+    if (!line->discard) {
+        engine_publish(eng, line, rpm, pulses, span_ns);
+    }
+    line->discard = 0;
+
+    if (p->watch) {
+        engine_begin_round(eng, line, now);
+    } else {
+        line->state = LINE_STATE_DONE;
+    }
+}
+
+/**
+ * Arm the shared timer to the earliest pending deadline
+ *
+ * @return size_t Number of lines still active
+ */
+static size_t engine_arm_timer(engine_t *eng) {
+    int64_t next = 0;
+    int stall = 0;
+    size_t active = 0;
+
+    for (size_t i = 0; i < eng->nlines; i++) {
+        engine_line_t *line = &eng->lines[i];
+        if (line->state == LINE_STATE_DONE) continue;
+        active++;
+        if (next == 0 || line->deadline_ns < next) {
+            next = line->deadline_ns;
+            stall = 0;
+        }
+        int64_t stall_at = engine_stall_deadline(line);
+        if (stall_at != 0 && stall_at < next) {
+            next = stall_at;
+            stall = 1;
+        }
+    }
+
+    // Every edge moves its stall deadline; an earlier stall timer only
+    // costs one wakeup, re-arming it on every read would cost a syscall
+    if (stall && eng->armed_stall && eng->armed_ns != 0 && eng->armed_ns < next) {
+        return active;
+    }
+
+    if (next != 0 && next != eng->armed_ns) {
+        struct itimerspec spec = {0};
+        spec.it_value.tv_sec = next / NSEC_PER_SEC;
+        spec.it_value.tv_nsec = next % NSEC_PER_SEC;
+        if (timerfd_settime(eng->timerfd, TFD_TIMER_ABSTIME, &spec, NULL) == 0) {
+            eng->armed_ns = next;
+            eng->armed_stall = stall;
+        } else if (eng->params.debug) {
+            fprintf(stderr, "Warning: failed to arm engine timer: %s\n", strerror(errno));
+        }
+    }
+
+    return active;
+}
+
+static void engine_request_free(engine_request_t *request) {
+    if (!request) return;
+
+    gpio_cleanup(request->gpio);
+    free(request->by_offset);
+    free(request);
+}
+
+static void engine_destroy(engine_t *eng) {
+    if (!eng) return;
+
+    for (size_t i = 0; i < eng->nrequests; i++) {
+        engine_request_free(eng->requests[i]);
+    }
+    free(eng->requests);
+    for (size_t i = 0; eng->lines && i < eng->nlines; i++) {
+        free(eng->lines[i].bucket_counts);
+        free(eng->lines[i].bucket_starts);
+    }
+    free(eng->lines);
+    free(eng->group);
+    free(eng->periods);
+    capture_replay_free(&eng->replay);
+    config_watch_stop(eng->watch);
+
+    if (eng->timerfd >= 0) close(eng->timerfd);
+    if (eng->epfd >= 0) close(eng->epfd);
+
+    free(eng);
+}
+
+/**
+ * Count one edge on its line
+ */
+static void engine_dispatch_edge(engine_t *eng, const engine_request_t *request, const gpio_edge_t *edge) {
+    if (edge->offset > request->max_offset) return;
+
+    engine_line_t *line = request->by_offset[edge->offset];
+    if (!line) return;
+
+    // Edges in warmup count as signs of life too
+    line->last_edge_ns = (int64_t)edge->timestamp_ns;
+    if (line->stalled) {
+        line->stalled = 0;
+        if (eng->params.debug) {
+            fprintf(stderr, "GPIO%d: edges again, no longer stalled\n", line->gpio);
+        }
+    }
+
+    if (line->state != LINE_STATE_MEASURE) return;
+
+    line->count++;
+    if (eng->params.method == METHOD_PERIOD && line->deadline_ns != 0) {
+        if (period_add(&line->tracker, edge->timestamp_ns)) {
+            // Enough periods captured, finish without waiting for the timer
+            line->deadline_ns = 0;
+        }
+    } else if (eng->params.method == METHOD_ADAPTIVE && line->deadline_ns != 0) {
+        if (adaptive_add(&line->adaptive, edge->timestamp_ns)) {
+            // Target reached, this line's window ends here
+            line->deadline_ns = 0;
+        }
+    }
+}
+
+/**
+ * Dispatch the edges of the last read to their lines by offset
+ */
+static void engine_dispatch(engine_t *eng, const engine_request_t *request, int nread) {
+    for (int e = 0; e < nread; e++) {
+        engine_dispatch_edge(eng, request, &request->gpio->edges[e]);
+    }
+}
+
+/**
+ * Wrap a line request for the engine
+ *
+ * @return engine_request_t* Request without bound lines, NULL on error
+ */
+static engine_request_t* engine_request_new(gpio_context_t *gpio, const char *chip) {
+    engine_request_t *request = calloc(1, sizeof(*request));
+    if (!request) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        return NULL;
+    }
+
+    for (size_t i = 0; i < gpio->num_lines; i++) {
+        if (gpio->offsets[i] > request->max_offset) {
+            request->max_offset = gpio->offsets[i];
+        }
+    }
+    request->by_offset = calloc(request->max_offset + 1, sizeof(*request->by_offset));
+    if (!request->by_offset) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        free(request);
+        return NULL;
+    }
+    request->gpio = gpio;
+    snprintf(request->chip, sizeof(request->chip), "%s", chip);
+
+    return request;
+}
+
+/**
+ * Route the edges of a requested line to its state
+ */
+static void engine_bind(engine_line_t *line, engine_request_t *request, size_t request_line) {
+    line->request = request;
+    line->request_line = request_line;
+    line->pending = 0;
+    request->by_offset[line->gpio] = line;
+    request->bound++;
+}
+
+/**
+ * Release a line request
+ *
+ * Lines still measured through it become pending, so the next
+ * engine_request_pending() requests them again.
+ */
+static void engine_release(engine_t *eng, engine_request_t *request) {
+    for (size_t i = 0; i < request->gpio->num_lines; i++) {
+        engine_line_t *line = request->by_offset[request->gpio->offsets[i]];
+        if (!line) continue;
+        line->request = NULL;
+        line->pending = 1;
+    }
+
+    if (eng->epfd >= 0) {
+        epoll_ctl(eng->epfd, EPOLL_CTL_DEL, request->gpio->event_fd, NULL);
+    }
+    for (size_t i = 0; i < eng->nrequests; i++) {
+        if (eng->requests[i] == request) {
+            eng->requests[i] = eng->requests[--eng->nrequests];
+            break;
+        }
+    }
+    engine_request_free(request);
+}
+
+/**
+ * Stop routing the edges of a line to its state
+ *
+ * The last line of a request releases it. A line sharing its request
+ * with lines still measured stays requested; its edges are dropped.
+ */
+static void engine_unbind(engine_t *eng, engine_line_t *line) {
+    engine_request_t *request = line->request;
+    if (!request) return;
+
+    request->by_offset[line->gpio] = NULL;
+    line->request = NULL;
+    if (--request->bound == 0) {
+        engine_release(eng, request);
+    }
+}
+
+/**
+ * Empty a slot: its line is released and it drops out of the outputs
+ */
+static void engine_free_slot(engine_t *eng, engine_line_t *line) {
+    engine_unbind(eng, line);
+    line->gpio = -1;
+    line->state = LINE_STATE_DONE;
+    line->pending = 0;
+    line->generation++;
+    snapshot_reset(&eng->ctx->snapshots[line->index], NULL, line->generation);
+}
+
+/**
+ * Start the slot's snapshot over with a new generation of its fan
+ */
+static void engine_new_generation(engine_t *eng, engine_line_t *line) {
+    format_fan_t fan = { .gpio = line->gpio, .pulses = line->fan.pulses };
+    memcpy(fan.name, line->fan.name, sizeof(fan.name));
+
+    line->generation++;
+    snapshot_reset(&eng->ctx->snapshots[line->index], &fan, line->generation);
+}
+
+/**
+ * Prepare a slot to measure a fan (pending until requested)
+ *
+ * @return int 0 on success, -1 on error
+ */
+static int engine_line_setup(engine_t *eng, engine_line_t *line, const fan_config_t *fan) {
+    const measurement_params_t *p = &eng->params;
+
+    if (p->method == METHOD_SLIDING) {
+        size_t nbuckets = (size_t)(fan->window_ns / p->interval_ns);
+        if (!line->bucket_counts || nbuckets != line->window.nbuckets) {
+            unsigned int *counts = calloc(nbuckets, sizeof(*counts));
+            int64_t *starts = calloc(nbuckets, sizeof(*starts));
+            if (!counts || !starts) {
+                fprintf(stderr, "Error: memory allocation failed\n");
+                free(counts);
+                free(starts);
+                return -1;
+            }
+            free(line->bucket_counts);
+            free(line->bucket_starts);
+            line->bucket_counts = counts;
+            line->bucket_starts = starts;
+        }
+        sliding_init(&line->window, line->bucket_counts, line->bucket_starts, nbuckets);
+    }
+    if (p->method == METHOD_PERIOD) {
+        period_init(&line->tracker, eng->periods + line->index * p->periods, p->periods, fan->edge);
+    }
+    if (p->method == METHOD_ADAPTIVE) {
+        adaptive_init(&line->adaptive, p->target_pulses, fan->edge);
+    }
+
+    line->fan = *fan;
+    line->gpio = fan->offset;
+    line->stall_ns = rpm_stall_timeout_ns(p->stall_rpm, fan->pulses);
+    line->pending = 1;
+    return 0;
+}
+
+/**
+ * Start measuring a new or changed fan in its slot
+ *
+ * The slot's snapshot starts over with a new generation, so the outputs
+ * drop the results and statistics of the fan measured before.
+ */
+static void engine_restart(engine_t *eng, engine_line_t *line, int64_t now) {
+    engine_new_generation(eng, line);
+
+    line->overruns = 0;
+    line->stalls = 0;
+    line->stalled = 0;
+    line->discard = eng->params.watch && eng->params.method != METHOD_SLIDING;
+    line->last_edge_ns = now;
+    engine_begin_round(eng, line, now);
+}
+
+/**
+ * Chip to request a fan from (NULL: auto-detect)
+ */
+static const char* engine_chip(const engine_t *eng, const fan_config_t *fan) {
+    return fan->chip[0] != '\0' ? fan->chip : eng->ctx->chipname;
+}
+
+/**
+ * Request a set of lines and add the request to the epoll set
+ *
+ * @return engine_request_t* Request without bound lines, NULL on error
+ */
+static engine_request_t* engine_add_request(engine_t *eng, const fan_config_t *fan, const int *gpios,
+                                            size_t ngpio) {
+    const measurement_params_t *p = &eng->params;
+
+    gpio_context_t *gpio = gpio_init_lines(gpios, ngpio, engine_chip(eng, fan));
+    if (!gpio) return NULL;
+    gpio->capture = eng->ctx->capture;
+
+    if (gpio_request_events(gpio, eng->consumer, fan->edge, p->event_batch, p->debounce_ns) < 0) {
+        gpio_cleanup(gpio);
+        return NULL;
+    }
+    if (p->debug && gpio->debounce_ns > 0) {
+        fprintf(stderr, "GPIO%d: no hardware debounce, using software glitch filter (%.0f us)\n",
+                gpio->gpio, (double)gpio->debounce_ns / NSEC_PER_USEC);
+    }
+
+    engine_request_t *request = engine_request_new(gpio, fan->chip);
+    if (!request) {
+        gpio_cleanup(gpio);
+        return NULL;
+    }
+
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = request;
+    if (epoll_ctl(eng->epfd, EPOLL_CTL_ADD, gpio->event_fd, &ev) < 0) {
+        if (p->debug) {
+            fprintf(stderr, "Warning: cannot watch line request: %s\n", strerror(errno));
+        }
+        engine_request_free(request);
+        return NULL;
+    }
+
+    eng->requests[eng->nrequests++] = request;
+    return request;
+}
+
+/**
+ * Find the request a line is still requested in (NULL: none)
+ */
+static engine_request_t* engine_holder(const engine_t *eng, const engine_line_t *line, size_t *request_line) {
+    for (size_t r = 0; r < eng->nrequests; r++) {
+        engine_request_t *request = eng->requests[r];
+        if (strcmp(request->chip, line->fan.chip) != 0) continue;
+        for (size_t i = 0; i < request->gpio->num_lines; i++) {
+            if (request->gpio->offsets[i] == (unsigned int)line->gpio) {
+                *request_line = i;
+                return request;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Request all pending lines, one request per chip and edge type
+ *
+ * A line still requested from before it was removed is bound to that
+ * request again if the edge types match. Otherwise that request is
+ * released and its other lines are requested anew as well. A line that
+ * cannot be requested frees its slot.
+ */
+static void engine_request_pending(engine_t *eng) {
+    for (size_t i = 0; i < eng->nlines; i++) {
+        engine_line_t *line = &eng->lines[i];
+        if (!line->pending) continue;
+
+        size_t request_line;
+        engine_request_t *held = engine_holder(eng, line, &request_line);
+        if (!held) continue;
+        if (held->gpio->edge == line->fan.edge) {
+            engine_bind(line, held, request_line);
+        } else {
+            engine_release(eng, held);
+        }
+    }
+
+    for (size_t i = 0; i < eng->nlines; i++) {
+        const engine_line_t *first = &eng->lines[i];
+        if (!first->pending) continue;
+
+        size_t n = 0;
+        for (size_t j = i; j < eng->nlines; j++) {
+            const engine_line_t *line = &eng->lines[j];
+            if (line->pending && line->fan.edge == first->fan.edge &&
+                strcmp(line->fan.chip, first->fan.chip) == 0) {
+                eng->group[n++] = line->gpio;
+            }
+        }
+
+        fan_config_t fan = first->fan;
+        engine_request_t *request = engine_add_request(eng, &fan, eng->group, n);
+        for (size_t j = i, k = 0; k < n; j++) {
+            engine_line_t *line = &eng->lines[j];
+            if (!line->pending || line->fan.edge != fan.edge || strcmp(line->fan.chip, fan.chip) != 0) continue;
+
+            if (request) {
+                engine_bind(line, request, k);
+            } else if (n == 1) {
+                fprintf(stderr, "Error: cannot request events for GPIO %d\n", line->gpio);
+                engine_free_slot(eng, line);
+            } else {
+                // One unavailable line fails the whole request; retry line by line
+                // so the remaining lines are still measured
+                line->pending = 0;
+                engine_request_t *single = engine_add_request(eng, &line->fan, &line->gpio, 1);
+                if (single) {
+                    engine_bind(line, single, 0);
+                } else {
+                    fprintf(stderr, "Error: cannot request events for GPIO %d\n", line->gpio);
+                    engine_free_slot(eng, line);
+                }
+            }
+            k++;
+        }
+        if (!request && n > 1 && eng->params.debug) {
+            fprintf(stderr, "Warning: cannot request all lines at once, requested each line\n");
+        }
+    }
+}
+
+/**
+ * Apply the reloaded config file to the running measurement
+ *
+ * Fans are matched by chip and offset. Unchanged fans keep their line
+ * request, measurement state and statistics; a renamed fan keeps
+ * measuring, but its results and statistics start over under the new
+ * name. A fan with another edge type, pulses or window restarts in its
+ * slot (another edge type also needs another request); removed fans free
+ * their slot and line, and added fans are requested in free slots.
+ */
+static void engine_reload(engine_t *eng) {
+    const measurement_params_t *p = &eng->params;
+    fan_config_list_t *next = &eng->reload;
+
+    if (config_load(p->config_path, p, next) < 0 ||
+        config_resolve_chips(next, eng->ctx->chipname, p->config_path) < 0 ||
+        (p->capture_path && config_check_single_chip(next, p->config_path) < 0)) {
+        fprintf(stderr, "Warning: config '%s' not applied, keeping the current fans\n", p->config_path);
+        return;
+    }
+
+    int64_t now = gpio_monotonic_ns();
+    int matched[CONFIG_MAX_FANS] = {0};
+    size_t kept = 0, changed = 0, added = 0, removed = 0;
+
+    for (size_t i = 0; i < eng->nlines; i++) {
+        engine_line_t *line = &eng->lines[i];
+        if (line->gpio < 0) continue;
+
+        size_t f = 0;
+        while (f < next->count && (next->fans[f].offset != line->fan.offset ||
+                                   strcmp(next->fans[f].chip, line->fan.chip) != 0)) {
+            f++;
+        }
+        if (f == next->count) {
+            engine_free_slot(eng, line);
+            removed++;
+            continue;
+        }
+        matched[f] = 1;
+
+        const fan_config_t *fan = &next->fans[f];
+        if (config_fan_same(fan, &line->fan)) {
+            if (strcmp(fan->name, line->fan.name) != 0) {
+                // Another name is another series in the outputs
+                memcpy(line->fan.name, fan->name, sizeof(line->fan.name));
+                engine_new_generation(eng, line);
+            }
+            kept++;
+            continue;
+        }
+
+        if (fan->edge != line->fan.edge) {
+            engine_unbind(eng, line);
+        }
+        if (engine_line_setup(eng, line, fan) < 0) {
+            engine_free_slot(eng, line);
+            continue;
+        }
+        if (line->request) {
+            line->pending = 0;
+        }
+        engine_restart(eng, line, now);
+        changed++;
+    }
+
+    for (size_t f = 0; f < next->count; f++) {
+        if (matched[f]) continue;
+
+        engine_line_t *line = NULL;
+        for (size_t i = 0; i < eng->nlines && !line; i++) {
+            if (eng->lines[i].gpio < 0) line = &eng->lines[i];
+        }
+        if (!line || engine_line_setup(eng, line, &next->fans[f]) < 0) {
+            fprintf(stderr, "Error: no slot for fan '%s'\n", next->fans[f].name);
+            continue;
+        }
+        engine_restart(eng, line, now);
+        added++;
+    }
+
+    engine_request_pending(eng);
+
+    fprintf(stderr, "Config '%s' reloaded: %zu fans kept, %zu changed, %zu added, %zu removed\n",
+            p->config_path, kept, changed, added, removed);
+}
+
+static void* engine_thread_fn(void *arg) {
+    engine_t *eng = arg;
+    struct epoll_event events[ENGINE_MAX_EVENTS];
+
+    int64_t now = gpio_monotonic_ns();
+    engine_begin_all(eng, now);
+
+    // A reloadable config keeps the engine running without any fan
+    while (!stop && (engine_arm_timer(eng) > 0 || eng->watch)) {
+        int n = epoll_wait(eng->epfd, events, ENGINE_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (eng->params.debug) {
+                fprintf(stderr, "Warning: epoll_wait failed: %s\n", strerror(errno));
+            }
+            break;
+        }
+        eng->wakeups++;
+
+        int reload = 0;
+        for (int i = 0; i < n; i++) {
+            engine_request_t *request = events[i].data.ptr;
+
+            if (events[i].data.ptr == eng) {
+                // Shutdown requested, the loop condition ends the engine
+                continue;
+            }
+            if (eng->watch && events[i].data.ptr == eng->watch) {
+                // Applied after this batch, which may still hold requests it releases
+                reload |= config_watch_check(eng->watch);
+                continue;
+            }
+            if (!request) {
+                // Shared timer expired, deadlines are checked below
+                uint64_t expirations;
+                ssize_t r = read(eng->timerfd, &expirations, sizeof(expirations));
+                (void)r;  // Intentionally ignoring read result (just consuming timer)
+                eng->armed_ns = 0;
+                continue;
+            }
+
+            int ret = gpio_read_event(request->gpio);
+            if (ret < 0) {
+                if (eng->params.debug) {
+                    fprintf(stderr, "Warning: error reading events on GPIO %d\n", request->gpio->gpio);
+                }
+                continue;
+            }
+            engine_dispatch(eng, request, ret);
+        }
+
+        now = gpio_monotonic_ns();
+        for (size_t i = 0; i < eng->nlines; i++) {
+            engine_line_t *line = &eng->lines[i];
+            if (line->state == LINE_STATE_DONE) continue;
+            int64_t stall_at = engine_stall_deadline(line);
+            if (stall_at != 0 && stall_at <= now) {
+                engine_stall(eng, line, now);
+                if (line->state == LINE_STATE_DONE) continue;
+            }
+            if (line->deadline_ns <= now) {
+                engine_advance(eng, line, now);
+            }
+        }
+
+        if (reload) {
+            engine_reload(eng);
+        }
+    }
+
+    engine_destroy(eng);
+    return NULL;
+}
+
+/**
+ * Wait until the consumer has room for another result of a line
+ *
+ * A replay produces results faster than real time; without queues only
+ * the latest result is kept anyway.
+ */
+static void engine_replay_wait(engine_t *eng, const engine_line_t *line) {
+    if (!eng->ctx->queues) return;
+
+    const struct timespec pause = { .tv_sec = 0, .tv_nsec = 50 * NSEC_PER_USEC };
+    while (!stop && rpm_queue_full(&eng->ctx->queues[line->index])) {
+        nanosleep(&pause, NULL);
+    }
+}
+
+/**
+ * Advance the lines through all phase deadlines up to a replay time
+ *
+ * Deadlines are visited in order, each line advancing (or stalling) at its
+ * own deadline as if the timer had fired exactly then. Lines finished
+ * early (deadline 0) advance at the current replay time.
+ *
+ * @return int64_t The new replay time
+ */
+static int64_t engine_replay_until(engine_t *eng, int64_t now, int64_t until) {
+    while (!stop) {
+        engine_line_t *next = NULL;
+        int64_t next_ns = 0;
+        int stall = 0;
+        for (size_t i = 0; i < eng->nlines; i++) {
+            engine_line_t *line = &eng->lines[i];
+            if (line->state == LINE_STATE_DONE) continue;
+            int64_t due = line->deadline_ns;
+            int64_t stall_at = engine_stall_deadline(line);
+            int line_stall = stall_at != 0 && stall_at < due;
+            if (line_stall) due = stall_at;
+            if (due > until) continue;
+            if (!next || due < next_ns) {
+                next = line;
+                next_ns = due;
+                stall = line_stall;
+            }
+        }
+        if (!next) break;
+
+        if (next_ns > now) now = next_ns;
+        engine_replay_wait(eng, next);
+        if (stall) {
+            engine_stall(eng, next, now);
+        } else {
+            engine_advance(eng, next, now);
+        }
+    }
+
+    return now;
+}
+
+static void* engine_replay_fn(void *arg) {
+    engine_t *eng = arg;
+    engine_request_t *request = eng->requests[0];
+    gpio_context_t *gpio = request->gpio;
+
+    int64_t now = eng->replay.start_ns;
+    engine_begin_all(eng, now);
+
+    int ret;
+    while (!stop && (ret = gpio_read_event(gpio)) > 0) {
+        for (int e = 0; e < ret && !stop; e++) {
+            const gpio_edge_t *edge = &gpio->edges[e];
+            now = engine_replay_until(eng, now, (int64_t)edge->timestamp_ns - 1);
+            if ((int64_t)edge->timestamp_ns > now) now = (int64_t)edge->timestamp_ns;
+            engine_dispatch_edge(eng, request, edge);
+            // Windows completed by this edge end at it
+            now = engine_replay_until(eng, now, 0);
+        }
+    }
+
+    // The capture stopped after its last edge: run out the remaining time
+    now = engine_replay_until(eng, now, eng->replay.stop_ns);
+
+    if (eng->params.debug) {
+        for (size_t i = 0; i < eng->nlines; i++) {
+            if (eng->lines[i].state != LINE_STATE_DONE && !eng->params.watch) {
+                fprintf(stderr, "GPIO%d: capture ended before the measurement did\n", eng->lines[i].gpio);
+            }
+        }
+        fprintf(stderr, "Replayed %zu edges over %.3f s (%lu filtered)\n", gpio->replay_pos,
+                (double)(now - eng->replay.start_ns) / 1e9, gpio->filtered);
+    }
+
+    // Watch mode ends with the capture
+    if (eng->params.watch) {
+        stop_request();
+    }
+
+    engine_destroy(eng);
+    return NULL;
+}
+
+/**
+ * Load the capture and set up a replay of it for all lines
+ *
+ * @return int 0 on success, -1 on error
+ */
+static int engine_start_replay(engine_t *eng) {
+    const measurement_params_t *p = &eng->params;
+
+    if (capture_load(p->replay_path, &eng->replay) < 0) return -1;
+
+    gpio_context_t *gpio = gpio_init_replay(p->gpios, eng->nlines, eng->replay.edges, eng->replay.count,
+                                            p->edge, p->event_batch, p->debounce_ns);
+    if (!gpio) return -1;
+
+    engine_request_t *request = engine_request_new(gpio, "");
+    if (!request) {
+        gpio_cleanup(gpio);
+        return -1;
+    }
+
+    eng->requests[eng->nrequests++] = request;
+    for (size_t i = 0; i < eng->nlines; i++) {
+        engine_bind(&eng->lines[i], request, i);
+    }
+
+    if (p->debug) {
+        fprintf(stderr, "Replaying %zu edges (%.3f s) from %s\n", eng->replay.count,
+                (double)(eng->replay.stop_ns - eng->replay.start_ns) / 1e9, p->replay_path);
+    }
+    return 0;
+}
+
+/**
+ * Create the epoll set and shared timer and request all lines
+ *
+ * @return int 0 on success, -1 on error
+ */
+static int engine_start_live(engine_t *eng) {
+    const measurement_params_t *p = &eng->params;
+
+    eng->epfd = epoll_create1(EPOLL_CLOEXEC);
+    eng->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (eng->epfd < 0 || eng->timerfd < 0) {
+        if (p->debug) {
+            fprintf(stderr, "Warning: cannot create engine epoll/timer: %s\n", strerror(errno));
+        }
+        return -1;
+    }
+
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;  // NULL marks the shared timer
+    if (epoll_ctl(eng->epfd, EPOLL_CTL_ADD, eng->timerfd, &ev) < 0) {
+        return -1;
+    }
+
+    // Wake up on shutdown instead of polling the stop flag
+    if (stop_fd() >= 0) {
+        ev.data.ptr = eng;  // The engine itself marks the shutdown eventfd
+        if (epoll_ctl(eng->epfd, EPOLL_CTL_ADD, stop_fd(), &ev) < 0) {
+            return -1;
+        }
+    }
+
+    // Reload the config file on SIGHUP or when it is saved
+    if (p->watch && p->config) {
+        eng->watch = config_watch_start(p->config_path);
+        if (!eng->watch) return -1;
+        ev.data.ptr = eng->watch;  // The watcher marks its own descriptor
+        if (epoll_ctl(eng->epfd, EPOLL_CTL_ADD, config_watch_fd(eng->watch), &ev) < 0) {
+            return -1;
+        }
+    }
+
+    // Request edge events (include PID for unique identification)
+    snprintf(eng->consumer, sizeof(eng->consumer), "gpio-fan-rpm-%d", (int)getpid());
+    engine_request_pending(eng);
+
+    return 0;
+}
+
+int engine_start(measurement_ctx_t *ctx, const measurement_params_t *params) {
+    if (!ctx || !params || ctx->ngpio == 0) return -1;
+
+    // Fans from the config file, or every --gpio with the global options
+    size_t nfans = params->config ? params->config->count : params->ngpio;
+    if (nfans > ctx->ngpio) return -1;
+
+    engine_t *eng = calloc(1, sizeof(*eng));
+    if (!eng) return -1;
+
+    eng->ctx = ctx;
+    eng->params = *params;
+    eng->epfd = -1;
+    eng->timerfd = -1;
+
+    eng->lines = calloc(ctx->ngpio, sizeof(*eng->lines));
+    eng->requests = calloc(ctx->ngpio, sizeof(*eng->requests));
+    eng->group = calloc(ctx->ngpio, sizeof(*eng->group));
+    if (!eng->lines || !eng->requests || !eng->group) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        engine_destroy(eng);
+        return -1;
+    }
+    eng->nlines = ctx->ngpio;
+
+    if (params->method == METHOD_PERIOD) {
+        eng->periods = calloc(ctx->ngpio * params->periods, sizeof(*eng->periods));
+        if (!eng->periods) {
+            fprintf(stderr, "Error: memory allocation failed\n");
+            engine_destroy(eng);
+            return -1;
+        }
+    }
+
+    for (size_t i = 0; i < eng->nlines; i++) {
+        engine_line_t *line = &eng->lines[i];
+        line->gpio = -1;
+        line->index = i;
+        line->state = LINE_STATE_DONE;
+        if (i >= nfans) continue;
+
+        fan_config_t fan;
+        if (params->config) {
+            fan = params->config->fans[i];
+        } else {
+            memset(&fan, 0, sizeof(fan));
+            fan.offset = params->gpios[i];
+            fan.pulses = params->pulses;
+            fan.edge = params->edge;
+            fan.window_ns = params->method == METHOD_SLIDING ? params->window_ns : params->duration_ns;
+        }
+        if (engine_line_setup(eng, line, &fan) < 0) {
+            engine_destroy(eng);
+            return -1;
+        }
+    }
+
+    void *(*thread_fn)(void *) = engine_thread_fn;
+    if (params->replay_path) {
+        if (engine_start_replay(eng) < 0) {
+            engine_destroy(eng);
+            return -1;
+        }
+        thread_fn = engine_replay_fn;
+    } else if (engine_start_live(eng) < 0) {
+        engine_destroy(eng);
+        return -1;
+    }
+
+    int ret = pthread_create(&ctx->threads[0], NULL, thread_fn, eng);
+    if (ret) {
+        fprintf(stderr, "Error: cannot create engine thread: %s\n", strerror(ret));
+        ctx->threads[0] = 0;
+        engine_destroy(eng);
+        return -1;
+    }
+    rtsched_thread(ctx->threads[0], "fan-engine", params->rt_priority, params->cpu_list, -1, params->debug);
+
+    return 0;
+}
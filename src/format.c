@@ -1,6 +1,8 @@
 /**
  * This module provides functions to format RPM measurements in various
- * output formats including human-readable, JSON, numeric, and collectd.
+ * output formats including human-readable, JSON, numeric, collectd (text
+ * and network protocol), InfluxDB line protocol and a fixed-size binary
+ * record stream, and packs formatted rounds into datagrams.
  * 
  * @author  CSoellinger
  * @license LGPL-3.0-or-later
@@ -10,46 +12,499 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <math.h>
+#include <errno.h>
 #include <time.h>
+#include <pthread.h>
 #include "format.h"
 
 // Buffer size constants
 #define NUMERIC_BUFFER_SIZE 32
 #define HUMAN_BUFFER_SIZE 128
-#define JSON_BUFFER_SIZE 128
+#define JSON_BUFFER_SIZE 512
 #define HOSTNAME_BUFFER_SIZE 256
 #define COLLECTD_BUFFER_SIZE 512
 
-char* format_numeric(double rpm) {
-    char *buf = malloc(NUMERIC_BUFFER_SIZE);
-    if (!buf) return NULL;
+// Longest JSON array entry including the separator (every value INT_MIN)
+#define JSON_ENTRY_MAX 40
+#define JSON_STATS_ENTRY_MAX 224
+#define JSON_COUNTERS_MAX 262
+#define JSON_NAME_MAX (10 + FORMAT_NAME_MAX - 1)  // ,"name":"..."
 
-    if (snprintf(buf, NUMERIC_BUFFER_SIZE, "%.0f\n", rpm) >= NUMERIC_BUFFER_SIZE) {
-        free(buf);
-        return NULL;
+// Largest output buffer a round may grow to
+#define FORMAT_BUFFER_MAX (1024 * 1024)
+
+// Hostname is resolved once per process
+static char cached_host[HOSTNAME_BUFFER_SIZE];
+static pthread_once_t host_once = PTHREAD_ONCE_INIT;
+
+static void resolve_hostname(void) {
+    if (gethostname(cached_host, sizeof(cached_host) - 1) < 0) {
+        strncpy(cached_host, "unknown", sizeof(cached_host) - 1);
     }
+    cached_host[sizeof(cached_host) - 1] = '\0';
+}
 
-    return buf;
+/**
+ * Check an snprintf result against the buffer capacity
+ *
+ * @return int Length written, -1 if truncated or on error
+ */
+static int fit(int written, size_t cap) {
+    if (written < 0 || (size_t)written >= cap) return -1;
+    return written;
 }
 
-char* format_json(int gpio, double rpm, const rpm_stats_t *stats) {
-    char *buf = malloc(JSON_BUFFER_SIZE);
-    if (!buf) return NULL;
+// Names of output_mode_t values, in enum order
+static const char *const mode_names[] = {
+    "default", "numeric", "json", "collectd", "binary", "influx", "collectd-net"
+};
 
-    int written;
+int format_parse_mode(const char *name, output_mode_t *mode) {
+    if (!name || !mode) return -1;
+
+    for (size_t m = 0; m < sizeof(mode_names) / sizeof(mode_names[0]); m++) {
+        if (strcmp(name, mode_names[m]) == 0) {
+            *mode = (output_mode_t)m;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int format_numeric_into(char *buf, size_t cap, rpm_value_t rpm) {
+    if (!buf) return -1;
+    return fit(snprintf(buf, cap, "%lld\n", rpm_round(rpm)), cap);
+}
+
+int format_decimal_into(char *buf, size_t cap, int64_t value, unsigned int digits) {
+    if (!buf || digits > 18) return -1;
+
+    uint64_t scale = 1;
+    for (unsigned int i = 0; i < digits; i++) scale *= 10;
+
+    uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+    uint64_t frac = magnitude % scale;
+    int len = snprintf(buf, cap, "%s%llu", value < 0 ? "-" : "", (unsigned long long)(magnitude / scale));
+    if (fit(len, cap) < 0 || frac == 0) return fit(len, cap);
+
+    while (frac % 10 == 0) {
+        frac /= 10;
+        digits--;
+    }
+    int n = snprintf(buf + len, cap - (size_t)len, ".%0*llu", (int)digits, (unsigned long long)frac);
+    if (fit(n, cap - (size_t)len) < 0) return -1;
+    return len + n;
+}
+
+/**
+ * Write one JSON object (without a trailing newline)
+ *
+ * @return int Length written, -1 if it does not fit
+ */
+static int json_object(char *buf, size_t cap, const format_fan_t *fan, rpm_value_t rpm,
+                       const rpm_summary_t *stats, const rpm_counters_t *counters) {
+    // The config file only accepts names that need no escaping
+    char name[JSON_NAME_MAX + 1] = "";
+    if (fan->name[0] != '\0') snprintf(name, sizeof(name), ",\"name\":\"%s\"", fan->name);
+
+    int len;
     if (stats) {
-        double avg = stats_avg(stats);
-        written = snprintf(buf, JSON_BUFFER_SIZE,
-            "{\"gpio\":%d,\"rpm\":%d,\"min\":%d,\"max\":%d,\"avg\":%d}\n",
-            gpio, (int)round(rpm), (int)round(stats->min),
-            (int)round(stats->max), (int)round(avg));
+        len = snprintf(buf, cap,
+            "{\"gpio\":%d%s,\"rpm\":%d,\"min\":%d,\"max\":%d,\"avg\":%d,\"ewma\":%d,"
+            "\"p50\":%d,\"p95\":%d,\"p99\":%d,\"window_min\":%d,\"window_max\":%d",
+            fan->gpio, name, (int)rpm_round(rpm), (int)rpm_round(stats->min), (int)rpm_round(stats->max),
+            (int)rpm_round(stats->avg), (int)rpm_round(stats->ewma),
+            (int)rpm_round(stats->p50), (int)rpm_round(stats->p95),
+            (int)rpm_round(stats->p99), (int)rpm_round(stats->window_min),
+            (int)rpm_round(stats->window_max));
+    } else {
+        len = snprintf(buf, cap, "{\"gpio\":%d%s,\"rpm\":%d", fan->gpio, name, (int)rpm_round(rpm));
+    }
+    if (fit(len, cap) < 0) return -1;
+
+    if (counters) {
+        int n = snprintf(buf + len, cap - (size_t)len,
+            "%s,\"counters\":{\"events\":%lu,\"reads\":%lu,\"max_batch\":%lu,\"wakeups\":%lu,"
+            "\"lost\":%lu,\"overruns\":%lu,\"dropped\":%lu,\"stalls\":%lu}",
+            counters->stalled ? ",\"stalled\":true" : "",
+            counters->events, counters->reads, counters->max_batch, counters->wakeups,
+            counters->lost, counters->overruns, counters->dropped, counters->stalls);
+        if (fit(n, cap - (size_t)len) < 0) return -1;
+        len += n;
+    }
+
+    if ((size_t)len + 1 >= cap) return -1;
+    buf[len++] = '}';
+    buf[len] = '\0';
+    return len;
+}
+
+int format_label_into(char *buf, size_t cap, const format_fan_t *fan) {
+    if (!buf || !fan) return -1;
+
+    if (fan->name[0] != '\0') {
+        return fit(snprintf(buf, cap, "%s (GPIO%d)", fan->name, fan->gpio), cap);
+    }
+    return fit(snprintf(buf, cap, "GPIO%d", fan->gpio), cap);
+}
+
+int format_json_into(char *buf, size_t cap, const format_fan_t *fan, rpm_value_t rpm, const rpm_summary_t *stats,
+                     const rpm_counters_t *counters) {
+    if (!buf || !fan) return -1;
+
+    int len = json_object(buf, cap, fan, rpm, stats, counters);
+    if (len < 0 || (size_t)len + 1 >= cap) return -1;
+
+    buf[len++] = '\n';
+    buf[len] = '\0';
+    return len;
+}
+
+/**
+ * Write the collectd plugin instance of a fan: its name, or its GPIO
+ */
+static void collectd_instance(char *buf, size_t cap, const format_fan_t *fan) {
+    if (fan->name[0] != '\0') {
+        snprintf(buf, cap, "%s", fan->name);
     } else {
-        written = snprintf(buf, JSON_BUFFER_SIZE,
-            "{\"gpio\":%d,\"rpm\":%d}\n", gpio, (int)round(rpm));
+        snprintf(buf, cap, "%d", fan->gpio);
+    }
+}
+
+int format_collectd_into(char *buf, size_t cap, const format_fan_t *fan, rpm_value_t rpm, int64_t interval_ns,
+                         time_t now) {
+    if (!buf || !fan) return -1;
+
+    pthread_once(&host_once, resolve_hostname);
+
+    char interval[32];
+    if (format_decimal_into(interval, sizeof(interval), interval_ns, 9) < 0) return -1;
+
+    char instance[FORMAT_NAME_MAX];
+    collectd_instance(instance, sizeof(instance), fan);
+
+    return fit(snprintf(buf, cap,
+        "PUTVAL \"%s/gpio-fan-%s/gauge-rpm\" interval=%s %ld:%lld\n",
+        cached_host, instance, interval, (long)now, rpm_round(rpm)), cap);
+}
+
+int format_influx_into(char *buf, size_t cap, const format_fan_t *fan, rpm_value_t rpm,
+                       const rpm_counters_t *counters, int64_t now_ns) {
+    if (!buf || !fan) return -1;
+
+    pthread_once(&host_once, resolve_hostname);
+
+    // Hostnames and fan names never contain the characters line protocol needs escaped
+    int named = fan->name[0] != '\0';
+    return fit(snprintf(buf, cap, "gpio_fan,host=%s,gpio=%d%s%s rpm=%lld%s %lld\n",
+                        cached_host, fan->gpio, named ? ",fan=" : "", named ? fan->name : "", rpm_round(rpm),
+                        counters ? (counters->stalled ? ",stalled=true" : ",stalled=false") : "",
+                        (long long)now_ns), cap);
+}
+
+int format_human_readable_into(char *buf, size_t cap, const format_fan_t *fan, rpm_value_t rpm,
+                               const rpm_summary_t *stats) {
+    if (!buf) return -1;
+
+    char label[FORMAT_LABEL_MAX];
+    if (format_label_into(label, sizeof(label), fan) < 0) return -1;
+
+    if (stats) {
+        return fit(snprintf(buf, cap,
+            "%s: RPM: %lld (min: %lld, max: %lld, avg: %lld)\n",
+            label, rpm_round(rpm), rpm_round(stats->min), rpm_round(stats->max),
+            rpm_round(stats->avg)), cap);
+    }
+
+    return fit(snprintf(buf, cap, "%s: RPM: %lld\n", label, rpm_round(rpm)), cap);
+}
+
+int format_output_into(char *buf, size_t cap, const format_fan_t *fan, rpm_value_t rpm, const rpm_summary_t *stats,
+                       const rpm_counters_t *counters, output_mode_t mode, int64_t interval_ns,
+                       int64_t now_ns) {
+    switch (mode) {
+        case MODE_NUMERIC:
+            return format_numeric_into(buf, cap, rpm);
+        case MODE_JSON:
+            return format_json_into(buf, cap, fan, rpm, stats, counters);
+        case MODE_COLLECTD:
+            return format_collectd_into(buf, cap, fan, rpm, interval_ns, (time_t)(now_ns / 1000000000LL));
+        case MODE_INFLUX:
+            return format_influx_into(buf, cap, fan, rpm, counters, now_ns);
+        case MODE_COLLECTD_NET:
+            return format_collectd_net_into((unsigned char *)buf, cap, fan, rpm, interval_ns, now_ns);
+        case MODE_DEFAULT:
+        default:
+            if (counters && counters->stalled) {
+                char label[FORMAT_LABEL_MAX];
+                if (format_label_into(label, sizeof(label), fan) < 0) return -1;
+                return fit(snprintf(buf, cap, "%s: RPM: 0 (stalled)\n", label), cap);
+            }
+            return format_human_readable_into(buf, cap, fan, rpm, stats);
+    }
+}
+
+static void put_le(unsigned char *p, uint64_t v, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+int format_binary_into(unsigned char *buf, size_t cap, int gpio, rpm_value_t rpm, unsigned long pulses,
+                       unsigned int flags, int64_t interval_ns, int64_t timestamp_ns) {
+    if (!buf || cap < FORMAT_BINARY_RECORD_SIZE) return -1;
+
+    put_le(buf, FORMAT_BINARY_RECORD_SIZE, 2);
+    buf[2] = FORMAT_BINARY_VERSION;
+    buf[3] = (unsigned char)flags;
+    put_le(buf + 4, (uint32_t)gpio, 4);
+    put_le(buf + 8, (uint64_t)timestamp_ns, 8);
+    put_le(buf + 16, (uint64_t)interval_ns, 8);
+    put_le(buf + 24, rpm_f64_bits(rpm), 8);
+    put_le(buf + 32, pulses > UINT32_MAX ? UINT32_MAX : pulses, 4);
+    put_le(buf + 36, 0, 4);
+
+    return FORMAT_BINARY_RECORD_SIZE;
+}
+
+// collectd network protocol part types
+#define COLLECTD_PART_HOST 0x0000
+#define COLLECTD_PART_PLUGIN 0x0002
+#define COLLECTD_PART_PLUGIN_INSTANCE 0x0003
+#define COLLECTD_PART_TYPE 0x0004
+#define COLLECTD_PART_TYPE_INSTANCE 0x0005
+#define COLLECTD_PART_VALUES 0x0006
+#define COLLECTD_PART_TIME_HR 0x0008
+#define COLLECTD_PART_INTERVAL_HR 0x0009
+#define COLLECTD_PART_HEADER 4
+#define COLLECTD_VALUE_GAUGE 1
+
+static void put_be(unsigned char *p, uint64_t v, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        p[i] = (unsigned char)(v >> (8 * (bytes - 1 - i)));
+    }
+}
+
+static uint64_t get_be(const unsigned char *p, size_t bytes) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+/**
+ * Append a string part (NUL-terminated)
+ *
+ * @return size_t Offset after the part, 0 if it does not fit
+ */
+static size_t collectd_string(unsigned char *buf, size_t cap, size_t pos, unsigned int type, const char *str) {
+    size_t len = COLLECTD_PART_HEADER + strlen(str) + 1;
+    if (cap - pos < len) return 0;
+
+    put_be(buf + pos, type, 2);
+    put_be(buf + pos + 2, len, 2);
+    memcpy(buf + pos + COLLECTD_PART_HEADER, str, len - COLLECTD_PART_HEADER);
+    return pos + len;
+}
+
+/**
+ * Append a high-resolution time part (2^-30 s units)
+ *
+ * @return size_t Offset after the part, 0 if it does not fit
+ */
+static size_t collectd_time(unsigned char *buf, size_t cap, size_t pos, unsigned int type, int64_t ns) {
+    if (cap - pos < COLLECTD_PART_HEADER + 8) return 0;
+
+    uint64_t sec = (uint64_t)(ns / 1000000000LL);
+    uint64_t frac = ((uint64_t)(ns % 1000000000LL) << 30) / 1000000000ULL;
+    put_be(buf + pos, type, 2);
+    put_be(buf + pos + 2, COLLECTD_PART_HEADER + 8, 2);
+    put_be(buf + pos + COLLECTD_PART_HEADER, (sec << 30) | frac, 8);
+    return pos + COLLECTD_PART_HEADER + 8;
+}
+
+int format_collectd_net_into(unsigned char *buf, size_t cap, const format_fan_t *fan, rpm_value_t rpm,
+                             int64_t interval_ns, int64_t now_ns) {
+    if (!buf || !fan) return -1;
+
+    pthread_once(&host_once, resolve_hostname);
+
+    char instance[FORMAT_NAME_MAX];
+    collectd_instance(instance, sizeof(instance), fan);
+
+    size_t pos = 0;
+    if (!(pos = collectd_string(buf, cap, pos, COLLECTD_PART_HOST, cached_host)) ||
+        !(pos = collectd_time(buf, cap, pos, COLLECTD_PART_TIME_HR, now_ns)) ||
+        !(pos = collectd_time(buf, cap, pos, COLLECTD_PART_INTERVAL_HR, interval_ns)) ||
+        !(pos = collectd_string(buf, cap, pos, COLLECTD_PART_PLUGIN, "gpio-fan")) ||
+        !(pos = collectd_string(buf, cap, pos, COLLECTD_PART_PLUGIN_INSTANCE, instance)) ||
+        !(pos = collectd_string(buf, cap, pos, COLLECTD_PART_TYPE, "gauge")) ||
+        !(pos = collectd_string(buf, cap, pos, COLLECTD_PART_TYPE_INSTANCE, "rpm"))) {
+        return -1;
+    }
+
+    // Values part: u16 count, one type byte per value, then the values
+    // (gauges are little-endian doubles, unlike the rest of the protocol)
+    size_t len = COLLECTD_PART_HEADER + 2 + 1 + 8;
+    if (cap - pos < len) return -1;
+
+    put_be(buf + pos, COLLECTD_PART_VALUES, 2);
+    put_be(buf + pos + 2, len, 2);
+    put_be(buf + pos + 4, 1, 2);
+    buf[pos + 6] = COLLECTD_VALUE_GAUGE;
+    put_le(buf + pos + 7, rpm_f64_bits(rpm), 8);
+
+    return (int)(pos + len);
+}
+
+void format_packer_init(format_packer_t *packer, output_mode_t mode, const void *data, size_t len) {
+    memset(packer, 0, sizeof(*packer));
+    packer->mode = mode;
+    packer->data = data;
+    packer->len = len;
+}
+
+/**
+ * Length of the record at the packer position (0: truncated round)
+ */
+static size_t packer_record(const format_packer_t *packer) {
+    const unsigned char *p = packer->data + packer->pos;
+    size_t left = packer->len - packer->pos;
+
+    if (packer->mode == MODE_BINARY) {
+        size_t len = left >= 2 ? (size_t)p[0] | (size_t)p[1] << 8 : 0;
+        return len >= 2 && len <= left ? len : 0;
+    }
+
+    const unsigned char *nl = memchr(p, '\n', left);
+    return nl ? (size_t)(nl - p) + 1 : left;
+}
+
+static size_t part_len(const unsigned char *part) {
+    return (size_t)get_be(part + 2, 2);
+}
+
+static int part_equal(const unsigned char *a, const unsigned char *b) {
+    return a && b && part_len(a) == part_len(b) && memcmp(a, b, part_len(a)) == 0;
+}
+
+/**
+ * Pack collectd value lists, leaving out parts the packet already carries
+ */
+static size_t packer_collectd(format_packer_t *packer, unsigned char *dgram, size_t max) {
+    const unsigned char *sent[FORMAT_COLLECTD_NET_PARTS] = {0};
+    size_t used = 0;
+
+    while (packer->pos + COLLECTD_PART_HEADER <= packer->len) {
+        const unsigned char *part = packer->data + packer->pos;
+        unsigned int type = (unsigned int)get_be(part, 2);
+        size_t len = part_len(part);
+        if (len < COLLECTD_PART_HEADER || len > packer->len - packer->pos) {
+            packer->pos = packer->len;  // Corrupt round, drop the rest
+            break;
+        }
+
+        if (type != COLLECTD_PART_VALUES) {
+            if (type < FORMAT_COLLECTD_NET_PARTS) packer->parts[type] = part;
+            packer->pos += len;
+            continue;
+        }
+
+        // The value list needs every part that differs from the packet state
+        size_t need = len;
+        for (int t = 0; t < FORMAT_COLLECTD_NET_PARTS; t++) {
+            const unsigned char *p = packer->parts[t];
+            if (p && !part_equal(sent[t], p)) need += part_len(p);
+        }
+        if (used + need > max) {
+            if (used > 0) break;  // The next packet starts over with the full state
+            packer->pos += len;   // Cannot fit any packet
+            continue;
+        }
+
+        for (int t = 0; t < FORMAT_COLLECTD_NET_PARTS; t++) {
+            const unsigned char *p = packer->parts[t];
+            if (!p || part_equal(sent[t], p)) continue;
+            memcpy(dgram + used, p, part_len(p));
+            used += part_len(p);
+            sent[t] = p;
+        }
+        memcpy(dgram + used, part, len);
+        used += len;
+        packer->pos += len;
+    }
+
+    return used;
+}
+
+size_t format_packer_next(format_packer_t *packer, unsigned char *dgram, size_t max,
+                          const unsigned char **out) {
+    if (!packer || !dgram || !out || packer->pos >= packer->len) return 0;
+
+    *out = dgram;
+    if (packer->mode == MODE_COLLECTD_NET) {
+        return packer_collectd(packer, dgram, max);
+    }
+
+    size_t used = 0;
+    while (packer->pos < packer->len) {
+        size_t len = packer_record(packer);
+        if (len == 0) {
+            packer->pos = packer->len;  // Truncated record, drop it
+            break;
+        }
+        if (used + len > max) {
+            if (used > 0) break;
+            // Larger than a packet on its own (e.g. a JSON array), send it as is
+            *out = packer->data + packer->pos;
+            packer->pos += len;
+            return len;
+        }
+        memcpy(dgram + used, packer->data + packer->pos, len);
+        used += len;
+        packer->pos += len;
+    }
+    return used;
+}
+
+int format_json_array_into(char *buf, size_t cap, const format_fan_t *fans, const rpm_value_t *results,
+                           const rpm_summary_t *stats, const rpm_counters_t *counters, size_t ngpio) {
+    if (!buf || !fans || !results || ngpio == 0 || cap < 3) return -1;
+
+    size_t pos = 0;
+    buf[pos++] = '[';
+
+    int first = 1;
+    for (size_t i = 0; i < ngpio; i++) {
+        // Skip interrupted measurements (negative values indicate interruption)
+        if (results[i] < 0) continue;
+
+        if (!first) {
+            if (pos + 1 >= cap) return -1;
+            buf[pos++] = ',';
+        }
+        first = 0;
+
+        int written = json_object(buf + pos, cap - pos, &fans[i], results[i], stats ? &stats[i] : NULL,
+                                  counters ? &counters[i] : NULL);
+        if (written < 0) return -1;
+        pos += written;
     }
 
-    if (written < 0 || written >= JSON_BUFFER_SIZE) {
+    if (pos + 2 >= cap) return -1;
+    buf[pos++] = ']';
+    buf[pos++] = '\n';
+    buf[pos] = '\0';
+
+    return (int)pos;
+}
+
+char* format_numeric(rpm_value_t rpm) {
+    char *buf = malloc(NUMERIC_BUFFER_SIZE);
+    if (!buf) return NULL;
+
+    if (format_numeric_into(buf, NUMERIC_BUFFER_SIZE, rpm) < 0) {
         free(buf);
         return NULL;
     }
@@ -57,24 +512,25 @@ char* format_json(int gpio, double rpm, const rpm_stats_t *stats) {
     return buf;
 }
 
-char* format_collectd(int gpio, double rpm, int duration) {
-    char host[HOSTNAME_BUFFER_SIZE] = {0};
+char* format_json(int gpio, rpm_value_t rpm, const rpm_summary_t *stats) {
+    char *buf = malloc(JSON_BUFFER_SIZE);
+    if (!buf) return NULL;
 
-    if (gethostname(host, sizeof(host) - 1) < 0) {
-        strncpy(host, "unknown", sizeof(host) - 1);
-        host[sizeof(host) - 1] = '\0';
+    format_fan_t fan = { .gpio = gpio };
+    if (format_json_into(buf, JSON_BUFFER_SIZE, &fan, rpm, stats, NULL) < 0) {
+        free(buf);
+        return NULL;
     }
 
-    time_t now = time(NULL);
+    return buf;
+}
 
+char* format_collectd(int gpio, rpm_value_t rpm, int64_t interval_ns) {
     char *buf = malloc(COLLECTD_BUFFER_SIZE);
     if (!buf) return NULL;
 
-    int written = snprintf(buf, COLLECTD_BUFFER_SIZE,
-        "PUTVAL \"%s/gpio-fan-%d/gauge-rpm\" interval=%d %ld:%.0f\n",
-        host, gpio, duration, (long)now, rpm);
-
-    if (written < 0 || written >= COLLECTD_BUFFER_SIZE) {
+    format_fan_t fan = { .gpio = gpio };
+    if (format_collectd_into(buf, COLLECTD_BUFFER_SIZE, &fan, rpm, interval_ns, time(NULL)) < 0) {
         free(buf);
         return NULL;
     }
@@ -82,22 +538,12 @@ char* format_collectd(int gpio, double rpm, int duration) {
     return buf;
 }
 
-char* format_human_readable(int gpio, double rpm, const rpm_stats_t *stats) {
+char* format_human_readable(int gpio, rpm_value_t rpm, const rpm_summary_t *stats) {
     char *buf = malloc(HUMAN_BUFFER_SIZE);
     if (!buf) return NULL;
 
-    int written;
-    if (stats) {
-        double avg = stats_avg(stats);
-        written = snprintf(buf, HUMAN_BUFFER_SIZE,
-            "GPIO%d: RPM: %.0f (min: %.0f, max: %.0f, avg: %.0f)\n",
-            gpio, rpm, stats->min, stats->max, avg);
-    } else {
-        written = snprintf(buf, HUMAN_BUFFER_SIZE,
-            "GPIO%d: RPM: %.0f\n", gpio, rpm);
-    }
-
-    if (written < 0 || written >= HUMAN_BUFFER_SIZE) {
+    format_fan_t fan = { .gpio = gpio };
+    if (format_human_readable_into(buf, HUMAN_BUFFER_SIZE, &fan, rpm, stats) < 0) {
         free(buf);
         return NULL;
     }
@@ -105,69 +551,167 @@ char* format_human_readable(int gpio, double rpm, const rpm_stats_t *stats) {
     return buf;
 }
 
-char* format_output(int gpio, double rpm, const rpm_stats_t *stats, output_mode_t mode, int duration) {
+char* format_output(int gpio, rpm_value_t rpm, const rpm_summary_t *stats, output_mode_t mode, int64_t interval_ns) {
     switch (mode) {
         case MODE_NUMERIC:
             return format_numeric(rpm);
         case MODE_JSON:
             return format_json(gpio, rpm, stats);
         case MODE_COLLECTD:
-            return format_collectd(gpio, rpm, duration);
+            return format_collectd(gpio, rpm, interval_ns);
         case MODE_DEFAULT:
         default:
             return format_human_readable(gpio, rpm, stats);
     }
 }
 
-char* format_json_array(const int *gpios, const double *results, const rpm_stats_t *stats, size_t ngpio) {
-    if (!gpios || !results || ngpio == 0) return NULL;
+char* format_json_array(const format_fan_t *fans, const rpm_value_t *results, const rpm_summary_t *stats,
+                        size_t ngpio) {
+    if (!fans || !results || ngpio == 0) return NULL;
 
-    // Estimate buffer size: ~80 chars per entry with stats, ~40 without
-    size_t buf_size = (stats ? 80 : 40) * ngpio + 16;
+    // Worst-case entry sizes, plus brackets, newline and NUL
+    size_t buf_size = ((stats ? JSON_STATS_ENTRY_MAX : JSON_ENTRY_MAX) + JSON_NAME_MAX) * ngpio + 16;
     char *buf = malloc(buf_size);
     if (!buf) return NULL;
 
-    size_t pos = 0;
-    buf[pos++] = '[';
+    if (format_json_array_into(buf, buf_size, fans, results, stats, NULL, ngpio) < 0) {
+        free(buf);
+        return NULL;
+    }
 
-    int first = 1;
-    for (size_t i = 0; i < ngpio; i++) {
-        // Skip interrupted measurements (negative values indicate interruption)
-        if (results[i] < 0.0) continue;
+    return buf;
+}
 
-        if (!first) {
-            buf[pos++] = ',';
-        }
-        first = 0;
+int format_buffer_init(format_buffer_t *out, size_t cap) {
+    if (!out || cap == 0) return -1;
+
+    out->data = malloc(cap);
+    if (!out->data) return -1;
+    out->len = 0;
+    out->cap = cap;
+    out->now_ns = 0;
+    out->realtime_offset_ns = 0;
+
+    return 0;
+}
+
+void format_buffer_free(format_buffer_t *out) {
+    if (!out) return;
+
+    free(out->data);
+    out->data = NULL;
+    out->len = 0;
+    out->cap = 0;
+}
+
+void format_buffer_reset(format_buffer_t *out) {
+    if (!out) return;
+
+    out->len = 0;
+
+    struct timespec real_ts, mono_ts;
+    clock_gettime(CLOCK_REALTIME, &real_ts);
+    clock_gettime(CLOCK_MONOTONIC, &mono_ts);
+    out->now_ns = (int64_t)real_ts.tv_sec * 1000000000LL + real_ts.tv_nsec;
+    out->realtime_offset_ns = ((int64_t)real_ts.tv_sec - mono_ts.tv_sec) * 1000000000LL +
+                              (real_ts.tv_nsec - mono_ts.tv_nsec);
+}
+
+/**
+ * Double the buffer capacity after an append did not fit
+ *
+ * @return int 0 on success, -1 if the buffer cannot grow
+ */
+static int format_buffer_grow(format_buffer_t *out) {
+    if (out->cap >= FORMAT_BUFFER_MAX) return -1;
+
+    char *data = realloc(out->data, out->cap * 2);
+    if (!data) return -1;
+    out->data = data;
+    out->cap *= 2;
+
+    return 0;
+}
+
+int format_buffer_append_output(format_buffer_t *out, const format_fan_t *fan, rpm_value_t rpm,
+                                const rpm_summary_t *stats, const rpm_counters_t *counters, output_mode_t mode,
+                                int64_t interval_ns) {
+    if (!out || !out->data || !fan) return -1;
+
+    if (mode == MODE_BINARY) {
+        // Without a sample the record reports the round time and no pulses
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        unsigned int flags = counters && counters->stalled ? FORMAT_BINARY_FLAG_STALLED : 0;
+        return format_buffer_append_binary(out, fan->gpio, rpm, 0, flags, interval_ns,
+                                           (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec);
+    }
 
-        int written;
-        if (stats) {
-            double avg = stats_avg(&stats[i]);
-            written = snprintf(buf + pos, buf_size - pos,
-                "{\"gpio\":%d,\"rpm\":%d,\"min\":%d,\"max\":%d,\"avg\":%d}",
-                gpios[i], (int)round(results[i]),
-                (int)round(stats[i].min), (int)round(stats[i].max),
-                (int)round(avg));
-        } else {
-            written = snprintf(buf + pos, buf_size - pos,
-                "{\"gpio\":%d,\"rpm\":%d}",
-                gpios[i], (int)round(results[i]));
+    for (;;) {
+        int n = format_output_into(out->data + out->len, out->cap - out->len,
+                                   fan, rpm, stats, counters, mode, interval_ns, out->now_ns);
+        if (n >= 0) {
+            out->len += (size_t)n;
+            return 0;
         }
+        if (format_buffer_grow(out) < 0) return -1;
+    }
+}
+
+int format_buffer_append_binary(format_buffer_t *out, int gpio, rpm_value_t rpm, unsigned long pulses,
+                                unsigned int flags, int64_t interval_ns, int64_t published_ns) {
+    if (!out || !out->data) return -1;
+
+    while (out->cap - out->len < FORMAT_BINARY_RECORD_SIZE) {
+        if (format_buffer_grow(out) < 0) return -1;
+    }
+    format_binary_into((unsigned char *)out->data + out->len, out->cap - out->len, gpio, rpm,
+                       pulses, flags, interval_ns, published_ns + out->realtime_offset_ns);
+    out->len += FORMAT_BINARY_RECORD_SIZE;
+    return 0;
+}
+
+int format_buffer_append_sample(format_buffer_t *out, const format_fan_t *fan, const rpm_sample_t *sample,
+                                const rpm_summary_t *stats, const rpm_counters_t *counters,
+                                output_mode_t mode, int64_t interval_ns) {
+    if (!sample || !fan) return -1;
 
-        if (written < 0 || (size_t)written >= buf_size - pos) {
-            free(buf);
-            return NULL;
+    if (mode == MODE_BINARY) {
+        return format_buffer_append_binary(out, fan->gpio, sample->rpm, sample->pulses,
+                                           sample->stalled ? FORMAT_BINARY_FLAG_STALLED : 0,
+                                           sample->elapsed_ns, sample->timestamp_ns);
+    }
+    return format_buffer_append_output(out, fan, sample->rpm, stats, counters, mode, interval_ns);
+}
+
+int format_buffer_append_json_array(format_buffer_t *out, const format_fan_t *fans, const rpm_value_t *results,
+                                    const rpm_summary_t *stats, const rpm_counters_t *counters, size_t ngpio) {
+    if (!out || !out->data) return -1;
+
+    for (;;) {
+        int n = format_json_array_into(out->data + out->len, out->cap - out->len,
+                                       fans, results, stats, counters, ngpio);
+        if (n >= 0) {
+            out->len += (size_t)n;
+            return 0;
         }
-        pos += written;
+        if (format_buffer_grow(out) < 0) return -1;
     }
+}
 
-    if (pos + 2 >= buf_size) {
-        free(buf);
-        return NULL;
+int format_buffer_write(format_buffer_t *out, int fd) {
+    if (!out || !out->data) return -1;
+
+    size_t done = 0;
+    while (done < out->len) {
+        ssize_t n = write(fd, out->data + done, out->len - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        done += (size_t)n;
     }
-    buf[pos++] = ']';
-    buf[pos++] = '\n';
-    buf[pos] = '\0';
+    out->len = 0;
 
-    return buf;
+    return 0;
 }
@@ -20,6 +20,9 @@
 #include "line.h"
 #include "format.h"
 #include "measurement_common.h"
+#include "capture.h"
+#include "stop.h"
+#include "cacheline.h"
 
 // Global variables (extern declaration - defined in main.c)
 // Note: sig_atomic_t is included via gpio.h -> signal.h
@@ -35,111 +38,270 @@ typedef enum {
     TIMED_LOOP_ERROR = -1       /**< Error occurred */
 } timed_loop_result_t;
 
+/**
+ * Feed the edges of the last read into a period or adaptive tracker
+ *
+ * @return int 1 if the tracker is full, 0 otherwise
+ */
+static int track_edges(gpio_context_t *ctx, period_tracker_t *tracker, adaptive_tracker_t *adaptive,
+                       int nread) {
+    for (int i = 0; i < nread; i++) {
+        if (tracker && period_add(tracker, ctx->edges[i].timestamp_ns)) {
+            return 1;
+        }
+        if (adaptive && adaptive_add(adaptive, ctx->edges[i].timestamp_ns)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Index of a line offset in ctx->offsets (the last line if not found)
+ */
+static size_t line_index(const gpio_context_t *ctx, unsigned int offset) {
+    size_t line = 0;
+    while (line < ctx->num_lines - 1 && ctx->offsets[line] != offset) {
+        line++;
+    }
+    return line;
+}
+
+/**
+ * Drop glitches from the edges of the last read
+ *
+ * An edge is accepted if it is at least ctx->debounce_ns after the last
+ * accepted edge of its line. With both edges requested the accepted edges
+ * must also alternate, so a glitch pair (rise and fall) on a level counts
+ * at most once.
+ *
+ * @return int Number of edges kept (compacted to the front of ctx->edges)
+ */
+static int filter_edges(gpio_context_t *ctx, int nread) {
+    uint64_t period = (uint64_t)ctx->debounce_ns;
+    int kept = 0;
+
+    for (int i = 0; i < nread; i++) {
+        const gpio_edge_t *edge = &ctx->edges[i];
+
+        gpio_filter_t *f = &ctx->filter[line_index(ctx, edge->offset)];
+
+        if (f->valid && (edge->timestamp_ns - f->last_ns < period ||
+                         (ctx->edge == EDGE_BOTH && edge->rising == f->last_rising))) {
+            ctx->filtered++;
+            continue;
+        }
+
+        f->last_ns = edge->timestamp_ns;
+        f->last_rising = edge->rising;
+        f->valid = 1;
+        ctx->edges[kept++] = *edge;
+    }
+
+    return kept;
+}
+
+/**
+ * Arm the timer of the context for the next phase
+ *
+ * Phases follow a monotonic schedule: a phase starts at the deadline of
+ * the previous one, unless that phase ended early (tracker full,
+ * interrupted) or lies a whole phase or more in the past. The timer
+ * repeats with it_interval, so back-to-back phases of equal length run
+ * without re-arming.
+ *
+ * @return int 0 on success, -1 on error
+ */
+static int phase_timer_arm(gpio_context_t *ctx, int64_t duration_ns) {
+    int64_t now = gpio_monotonic_ns();
+    int64_t start = ctx->phase_end_ns;
+
+    if (start != 0 && now - start >= duration_ns) {
+        ctx->overruns++;
+    }
+    if (start == 0 || now - start >= duration_ns) {
+        start = now;  // Not chained, or fell behind: restart the schedule
+    }
+    ctx->phase_start_ns = start;
+    ctx->phase_deadline_ns = start + duration_ns;
+
+    // A repeating timer already expires at the deadline
+    if (start == ctx->phase_end_ns && ctx->timer_interval_ns == duration_ns) {
+        return 0;
+    }
+
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = (time_t)(ctx->phase_deadline_ns / NSEC_PER_SEC);
+    spec.it_value.tv_nsec = (long)(ctx->phase_deadline_ns % NSEC_PER_SEC);
+    spec.it_interval.tv_sec = (time_t)(duration_ns / NSEC_PER_SEC);
+    spec.it_interval.tv_nsec = (long)(duration_ns % NSEC_PER_SEC);
+    if (timerfd_settime(ctx->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        ctx->timer_interval_ns = 0;
+        return -1;
+    }
+    ctx->timer_interval_ns = duration_ns;
+    return 0;
+}
+
 /**
  * Run a timed event loop that counts GPIO edge events
  *
+ * The timer and poll set are created on first use and kept in the
+ * context for all later phases. On completion by the timer,
+ * ctx->phase_start_ns and ctx->phase_end_ns hold the scheduled window;
+ * phase_end_ns is 0 if the phase ended otherwise.
+ *
  * @param ctx GPIO context
- * @param duration_sec Duration in seconds
+ * @param duration_ns Duration in nanoseconds
  * @param count Pointer to store event count (only updated if not NULL)
+ * @param tracker Period tracker fed with edge timestamps (NULL to skip);
+ *                the loop completes early once the tracker is full
+ * @param adaptive Adaptive tracker fed with edge timestamps (NULL to skip);
+ *                 the loop completes early once its target is reached
  * @param debug Enable debug output
  * @param phase_name Name for debug output (e.g., "Warmup", "Measurement")
  * @return timed_loop_result_t Result code
  */
-static timed_loop_result_t timed_event_loop(gpio_context_t *ctx, int duration_sec,
-                                            unsigned int *count, int debug,
-                                            const char *phase_name) {
+static timed_loop_result_t timed_event_loop(gpio_context_t *ctx, int64_t duration_ns,
+                                            unsigned int *count, period_tracker_t *tracker,
+                                            adaptive_tracker_t *adaptive,
+                                            int debug, const char *phase_name) {
     if (debug && phase_name) {
-        fprintf(stderr, "%s phase: %d seconds\n", phase_name, duration_sec);
+        fprintf(stderr, "%s phase: %.3f seconds\n", phase_name, (double)duration_ns / 1e9);
     }
 
-    struct timespec start_ts;
-    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    if (ctx->timer_fd < 0) {
+        ctx->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (ctx->timer_fd >= 0) {
+            // Poll set: GPIO events, phase timer, shutdown eventfd
+            ctx->pfds[0].fd = ctx->event_fd;
+            ctx->pfds[0].events = POLLIN;
+            ctx->pfds[1].fd = ctx->timer_fd;
+            ctx->pfds[1].events = POLLIN;
+            ctx->pfds[2].fd = stop_fd();
+            ctx->pfds[2].events = POLLIN;
+        }
+    }
 
-    int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
-    if (timerfd < 0) {
+    if (ctx->timer_fd < 0) {
         if (debug) fprintf(stderr, "Warning: failed to create %s timer, using fallback\n",
                           phase_name ? phase_name : "");
         // Fallback to polling method
-        struct timespec end_ts = start_ts;
-        end_ts.tv_sec += duration_sec;
+        int64_t start_ns = gpio_monotonic_ns();
+        int64_t end_ns = start_ns + duration_ns;
+        ctx->phase_start_ns = start_ns;
+        ctx->phase_end_ns = 0;
 
         while (!stop) {
-            struct timespec current_ts;
-            clock_gettime(CLOCK_MONOTONIC, &current_ts);
-            if (current_ts.tv_sec >= end_ts.tv_sec) {
+            int64_t remaining_ns = end_ns - gpio_monotonic_ns();
+            if (remaining_ns <= 0) {
+                ctx->phase_end_ns = end_ns;
                 return TIMED_LOOP_COMPLETED;
             }
-            int wait_result = gpio_wait_event(ctx, 100000000LL);
+            // A shutdown request ends the wait early
+            int wait_result = gpio_wait_event(ctx, remaining_ns);
             if (wait_result > 0) {
-                if (gpio_read_event(ctx) < 0) {
+                int nread = gpio_read_event(ctx);
+                if (nread < 0) {
                     if (debug) fprintf(stderr, "Warning: error reading event\n");
-                    break;
+                    return TIMED_LOOP_ERROR;
+                }
+                if (count) *count += (unsigned int)nread;
+                if ((tracker || adaptive) && track_edges(ctx, tracker, adaptive, nread)) {
+                    return TIMED_LOOP_COMPLETED;
                 }
-                if (count) (*count)++;
             }
         }
         return stop ? TIMED_LOOP_INTERRUPTED : TIMED_LOOP_COMPLETED;
     }
 
-    // Set timer to expire after duration_sec seconds
-    struct itimerspec timer_spec = {0};
-    timer_spec.it_value.tv_sec = duration_sec;
-    if (timerfd_settime(timerfd, 0, &timer_spec, NULL) < 0) {
+    if (phase_timer_arm(ctx, duration_ns) < 0) {
         if (debug) fprintf(stderr, "Warning: failed to arm %s timer\n",
                           phase_name ? phase_name : "");
-        close(timerfd);
+        ctx->phase_end_ns = 0;
         return TIMED_LOOP_ERROR;
     }
-
-    // Use poll() on both GPIO event_fd and timerfd
-    struct pollfd pfds[2];
-    pfds[0].fd = ctx->event_fd;
-    pfds[0].events = POLLIN;
-    pfds[1].fd = timerfd;
-    pfds[1].events = POLLIN;
+    ctx->phase_end_ns = 0;
 
     timed_loop_result_t result = TIMED_LOOP_INTERRUPTED;
     while (!stop) {
-        int ret = poll(pfds, 2, 100);  // 100ms timeout for stop check
+        int ret = poll(ctx->pfds, 3, -1);
         if (ret < 0) {
             if (errno == EINTR) continue;
             break;
         }
+        ctx->wakeups++;
 
         // Check if timer expired
-        if (pfds[1].revents & POLLIN) {
-            uint64_t expirations;
-            ssize_t n = read(timerfd, &expirations, sizeof(expirations));
-            (void)n;  // Intentionally ignoring read result (just consuming timer)
+        if (ctx->pfds[1].revents & POLLIN) {
+            uint64_t expirations = 0;
+            if (read(ctx->timer_fd, &expirations, sizeof(expirations)) != (ssize_t)sizeof(expirations)) {
+                continue;  // Spurious wakeup, not expired yet
+            }
+            // Late by whole phases: keep the schedule of the last expiration
+            if (expirations > 1) ctx->overruns++;
+            ctx->phase_end_ns = ctx->phase_deadline_ns + (int64_t)(expirations - 1) * duration_ns;
             result = TIMED_LOOP_COMPLETED;
             break;
         }
 
         // Read GPIO events if available
-        if (pfds[0].revents & POLLIN) {
-            if (gpio_read_event(ctx) < 0) {
+        if (ctx->pfds[0].revents & POLLIN) {
+            int nread = gpio_read_event(ctx);
+            if (nread < 0) {
                 if (debug) fprintf(stderr, "Warning: error reading event\n");
                 break;
             }
-            if (count) (*count)++;
+            if (count) *count += (unsigned int)nread;
+            if ((tracker || adaptive) && track_edges(ctx, tracker, adaptive, nread)) {
+                result = TIMED_LOOP_COMPLETED;
+                break;
+            }
         }
     }
 
-    close(timerfd);
     return result;
 }
 
 gpio_context_t* gpio_init(int gpio, const char *chipname) {
-    gpio_context_t *ctx = calloc(1, sizeof(*ctx));
+    return gpio_init_lines(&gpio, 1, chipname);
+}
+
+gpio_context_t* gpio_init_lines(const int *gpios, size_t ngpio, const char *chipname) {
+    if (!gpios || ngpio == 0) return NULL;
+
+    // Each thread writes its own context, keep it off shared cache lines
+    gpio_context_t *ctx = rpm_aligned_calloc(1, sizeof(*ctx));
     if (!ctx) return NULL;
-    
-    ctx->gpio = gpio;
-    
+
+    ctx->offsets = calloc(ngpio, sizeof(*ctx->offsets));
+    ctx->line_counters = rpm_aligned_calloc(ngpio, sizeof(*ctx->line_counters));
+    if (!ctx->offsets || !ctx->line_counters) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        free(ctx->offsets);
+        free(ctx->line_counters);
+        free(ctx);
+        return NULL;
+    }
+
+    // The chip must hold the highest requested line
+    int gpio = gpios[0];
+    for (size_t i = 0; i < ngpio; i++) {
+        ctx->offsets[i] = (unsigned int)gpios[i];
+        if (gpios[i] > gpio) gpio = gpios[i];
+    }
+    ctx->num_lines = ngpio;
+    ctx->gpio = gpios[0];
+    ctx->event_fd = -1;
+    ctx->timer_fd = -1;
+
     if (chipname) {
         // Use specified chip
         ctx->chip = chip_open_by_name(chipname);
         if (!ctx->chip) {
             fprintf(stderr, "Error: cannot open chip '%s'\n", chipname);
+            free(ctx->offsets);
+            free(ctx->line_counters);
             free(ctx);
             return NULL;
         }
@@ -147,6 +309,8 @@ gpio_context_t* gpio_init(int gpio, const char *chipname) {
         if (!ctx->chipname) {
             fprintf(stderr, "Error: memory allocation failed\n");
             chip_close(ctx->chip);
+            free(ctx->offsets);
+            free(ctx->line_counters);
             free(ctx);
             return NULL;
         }
@@ -155,6 +319,8 @@ gpio_context_t* gpio_init(int gpio, const char *chipname) {
         ctx->chip = chip_auto_detect(gpio, &ctx->chipname);
         if (!ctx->chip) {
             fprintf(stderr, "Error: cannot find suitable chip for GPIO %d\n", gpio);
+            free(ctx->offsets);
+            free(ctx->line_counters);
             free(ctx);
             return NULL;
         }
@@ -163,6 +329,74 @@ gpio_context_t* gpio_init(int gpio, const char *chipname) {
     return ctx;
 }
 
+gpio_context_t* gpio_init_replay(const int *gpios, size_t ngpio, const gpio_edge_t *edges, size_t count,
+                                 edge_type_t edge, size_t event_batch, int64_t debounce_ns) {
+    if (!gpios || ngpio == 0 || (!edges && count > 0)) return NULL;
+
+    if (event_batch == 0) event_batch = GPIO_EVENT_BATCH_DEFAULT;
+    if (event_batch > GPIO_EVENT_BATCH_MAX) event_batch = GPIO_EVENT_BATCH_MAX;
+
+    gpio_context_t *ctx = rpm_aligned_calloc(1, sizeof(*ctx));
+    if (!ctx) return NULL;
+
+    ctx->offsets = calloc(ngpio, sizeof(*ctx->offsets));
+    ctx->line_counters = rpm_aligned_calloc(ngpio, sizeof(*ctx->line_counters));
+    ctx->edges = rpm_aligned_calloc(event_batch, sizeof(*ctx->edges));
+    if (debounce_ns > 0) {
+        ctx->filter = rpm_aligned_calloc(ngpio, sizeof(*ctx->filter));
+    }
+    if (!ctx->offsets || !ctx->line_counters || !ctx->edges || (debounce_ns > 0 && !ctx->filter)) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        free(ctx->offsets);
+        free(ctx->line_counters);
+        free(ctx->edges);
+        free(ctx->filter);
+        free(ctx);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < ngpio; i++) {
+        ctx->offsets[i] = (unsigned int)gpios[i];
+    }
+    ctx->num_lines = ngpio;
+    ctx->gpio = gpios[0];
+    ctx->event_fd = -1;
+    ctx->timer_fd = -1;
+    ctx->event_batch = event_batch;
+    ctx->edge = edge;
+    ctx->debounce_ns = debounce_ns > 0 ? debounce_ns : 0;
+    ctx->replay = edges;
+    ctx->replay_count = count;
+
+    return ctx;
+}
+
+/**
+ * Copy the next recorded edges of the context's lines into ctx->edges
+ *
+ * @return int Number of edges copied, 0 at the end of the recording
+ */
+static int replay_edges(gpio_context_t *ctx) {
+    int n = 0;
+
+    while (ctx->replay_pos < ctx->replay_count && (size_t)n < ctx->event_batch) {
+        const gpio_edge_t *edge = &ctx->replay[ctx->replay_pos++];
+
+        if ((ctx->edge == EDGE_RISING && !edge->rising) || (ctx->edge == EDGE_FALLING && edge->rising)) {
+            continue;
+        }
+        for (size_t i = 0; i < ctx->num_lines; i++) {
+            if (ctx->offsets[i] == edge->offset) {
+                ctx->edges[n++] = *edge;
+                ctx->line_counters[i].events++;
+                break;
+            }
+        }
+    }
+
+    return n;
+}
+
 void gpio_cleanup(gpio_context_t *ctx) {
     if (!ctx) return;
 
@@ -170,6 +404,10 @@ void gpio_cleanup(gpio_context_t *ctx) {
         gpiod_edge_event_buffer_free(ctx->event_buffer);
         ctx->event_buffer = NULL;
     }
+    free(ctx->edges);
+    ctx->edges = NULL;
+    free(ctx->filter);
+    ctx->filter = NULL;
 
     if (ctx->request) {
         gpiod_line_request_release(ctx->request);
@@ -177,6 +415,11 @@ void gpio_cleanup(gpio_context_t *ctx) {
     }
     ctx->event_fd = -1;
 
+    if (ctx->timer_fd >= 0) {
+        close(ctx->timer_fd);
+        ctx->timer_fd = -1;
+    }
+
     if (ctx->chip) {
         chip_close(ctx->chip);
         ctx->chip = NULL;
@@ -187,14 +430,23 @@ void gpio_cleanup(gpio_context_t *ctx) {
         ctx->chipname = NULL;
     }
 
+    free(ctx->offsets);
+    free(ctx->line_counters);
     free(ctx);
 }
 
-int gpio_request_events(gpio_context_t *ctx, const char *consumer, edge_type_t edge) {
+int gpio_request_events(gpio_context_t *ctx, const char *consumer, edge_type_t edge, size_t event_batch,
+                        int64_t debounce_ns) {
     if (!ctx || !ctx->chip) return -1;
 
-    // Use the line module to request events
-    line_request_t *line_req = line_request_events(ctx->chip, ctx->gpio, consumer, edge);
+    if (event_batch == 0) event_batch = GPIO_EVENT_BATCH_DEFAULT;
+    if (event_batch > GPIO_EVENT_BATCH_MAX) event_batch = GPIO_EVENT_BATCH_MAX;
+
+    // Use the line module to request events; the kernel buffer holds one
+    // full read batch per line
+    unsigned long debounce_us = (unsigned long)((debounce_ns + NSEC_PER_USEC - 1) / NSEC_PER_USEC);
+    line_request_t *line_req = line_request_events(ctx->chip, ctx->offsets, ctx->num_lines, consumer,
+                                                   edge, event_batch * ctx->num_lines, debounce_us);
     if (!line_req) return -1;
 
     ctx->request = line_req->request;
@@ -204,14 +456,44 @@ int gpio_request_events(gpio_context_t *ctx, const char *consumer, edge_type_t e
     free(line_req);
 
     // Allocate reusable event buffer
-    ctx->event_buffer = gpiod_edge_event_buffer_new(1);
-    if (!ctx->event_buffer) {
+    ctx->event_buffer = gpiod_edge_event_buffer_new(event_batch);
+    ctx->edges = rpm_aligned_calloc(event_batch, sizeof(*ctx->edges));
+    ctx->event_batch = event_batch;
+    ctx->edge = edge;
+    if (!ctx->event_buffer || !ctx->edges) {
+        if (ctx->event_buffer) gpiod_edge_event_buffer_free(ctx->event_buffer);
+        free(ctx->edges);
+        ctx->event_buffer = NULL;
+        ctx->edges = NULL;
         gpiod_line_request_release(ctx->request);
         ctx->request = NULL;
         ctx->event_fd = -1;
         return -1;
     }
 
+    // Fall back to the software filter unless every line is debounced in hardware
+    int hardware = 1;
+    for (size_t i = 0; debounce_us > 0 && i < ctx->num_lines; i++) {
+        if (line_debounce_us(ctx->chip, ctx->offsets[i]) < debounce_us) {
+            hardware = 0;
+            break;
+        }
+    }
+    if (!hardware) {
+        ctx->filter = rpm_aligned_calloc(ctx->num_lines, sizeof(*ctx->filter));
+        if (!ctx->filter) {
+            gpiod_edge_event_buffer_free(ctx->event_buffer);
+            free(ctx->edges);
+            ctx->event_buffer = NULL;
+            ctx->edges = NULL;
+            gpiod_line_request_release(ctx->request);
+            ctx->request = NULL;
+            ctx->event_fd = -1;
+            return -1;
+        }
+        ctx->debounce_ns = debounce_ns;
+    }
+
     return 0;
 }
 
@@ -220,26 +502,82 @@ int gpio_wait_event(gpio_context_t *ctx, int64_t timeout_ns) {
     
     if (ctx->event_fd < 0) return -1;
     
-    struct pollfd pfd;
-    pfd.fd = ctx->event_fd;
-    pfd.events = POLLIN;
+    struct pollfd pfds[2];
+    pfds[0].fd = ctx->event_fd;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = stop_fd();
+    pfds[1].events = POLLIN;
     
-    int timeout_ms = (timeout_ns >= 0) ? (timeout_ns / 1000000LL) : -1;
-    int ret = poll(&pfd, 1, timeout_ms);
+    // Round up so a sub-millisecond remainder does not spin
+    int timeout_ms = (timeout_ns >= 0) ? (int)((timeout_ns + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC) : -1;
+    int ret = poll(pfds, 2, timeout_ms);
     
     if (ret < 0) return -1;  // Error
-    if (ret == 0) return 0;  // Timeout
+    ctx->wakeups++;
+    if (!(pfds[0].revents & POLLIN)) return 0;  // Timeout or shutdown
     return 1;  // Event available
 }
 
+/**
+ * Account one read in the event counters (line events are counted by the caller)
+ */
+static void count_read(gpio_context_t *ctx, int nread) {
+    if (nread <= 0) return;
+
+    ctx->reads++;
+    if ((unsigned long)nread > ctx->max_batch) ctx->max_batch = (unsigned long)nread;
+}
+
 int gpio_read_event(gpio_context_t *ctx) {
     if (!ctx) return -1;
 
+    int ret;
+    if (ctx->replay) {
+        // Keep reading until an edge survives the filter or the recording ends
+        do {
+            ret = replay_edges(ctx);
+            count_read(ctx, ret);
+            if (ret > 0 && ctx->filter) {
+                ret = filter_edges(ctx, ret);
+            }
+        } while (ret == 0 && ctx->replay_pos < ctx->replay_count);
+        return ret;
+    }
+
     if (!ctx->request || !ctx->event_buffer) return -1;
 
-    int ret = gpiod_line_request_read_edge_events(ctx->request, ctx->event_buffer, 1);
-    // Note: We don't need to process the event details, just count it
-    // The buffer is reused across calls for efficiency
+    ret = gpiod_line_request_read_edge_events(ctx->request, ctx->event_buffer, ctx->event_batch);
+    if (ret <= 0) return ret;
+
+    // Copy out the event details; the buffer is reused across calls
+    for (int i = 0; i < ret; i++) {
+        struct gpiod_edge_event *ev = gpiod_edge_event_buffer_get_event(ctx->event_buffer, (unsigned long)i);
+        if (!ev) {
+            ret = i;
+            break;
+        }
+        ctx->edges[i].timestamp_ns = gpiod_edge_event_get_timestamp_ns(ev);
+        ctx->edges[i].offset = gpiod_edge_event_get_line_offset(ev);
+        ctx->edges[i].rising = gpiod_edge_event_get_event_type(ev) == GPIOD_EDGE_EVENT_RISING_EDGE;
+
+        // A gap in the line sequence numbers means the kernel buffer overflowed
+        gpio_line_counters_t *lc = &ctx->line_counters[line_index(ctx, ctx->edges[i].offset)];
+        unsigned long seqno = gpiod_edge_event_get_line_seqno(ev);
+        if (lc->seqno != 0 && seqno > lc->seqno + 1) {
+            lc->lost += seqno - lc->seqno - 1;
+        }
+        lc->seqno = seqno;
+        lc->events++;
+    }
+    count_read(ctx, ret);
+
+    // Record the raw edges, glitches included
+    capture_edges(ctx->capture, ctx->edges, (size_t)ret);
+
+    if (ctx->filter) {
+        ret = filter_edges(ctx, ret);
+    }
+
     return ret;
 }
 
@@ -248,73 +586,194 @@ int gpio_read_event(gpio_context_t *ctx) {
  *
  * This function performs a two-phase measurement:
  * 1. Warmup phase: configurable duration for fan stabilization
- * 2. Measurement phase: (duration - warmup) seconds for actual RPM calculation
+ * 2. Measurement phase: (duration - warmup) for actual RPM calculation
  *
  * @param ctx GPIO context
  * @param pulses_per_rev Pulses per revolution
- * @param duration Total measurement duration
- * @param warmup Warmup duration
+ * @param duration_ns Total measurement duration in nanoseconds
+ * @param warmup_ns Warmup duration in nanoseconds
  * @param debug Enable debug output
- * @return double RPM value, -1.0 if interrupted, 0.0 if no pulses
+ * @return rpm_value_t RPM value, -1 if interrupted, 0 if no pulses
  */
-double gpio_measure_rpm(gpio_context_t *ctx, int pulses_per_rev, int duration, int warmup, int debug) {
-    if (!ctx) return 0.0;
+rpm_value_t gpio_measure_rpm(gpio_context_t *ctx, int pulses_per_rev, int64_t duration_ns, int64_t warmup_ns,
+                             int debug) {
+    if (!ctx) return 0;
 
-    int measurement_duration = duration - warmup;
+    int64_t measurement_ns = duration_ns - warmup_ns;
 
     // Warmup phase (skip if warmup is 0)
-    if (warmup > 0) {
-        timed_loop_result_t warmup_result = timed_event_loop(ctx, warmup, NULL, debug, "Warmup");
+    if (warmup_ns > 0) {
+        timed_loop_result_t warmup_result = timed_event_loop(ctx, warmup_ns, NULL, NULL, NULL, debug, "Warmup");
         if (warmup_result == TIMED_LOOP_INTERRUPTED) {
-            return -1.0;
+            return -1;
         }
         if (warmup_result == TIMED_LOOP_ERROR) {
-            return -1.0;
+            return -1;
         }
     }
 
     // Measurement phase - run for full measurement duration
-    struct timespec start_ts;
-    clock_gettime(CLOCK_MONOTONIC, &start_ts);
-
     unsigned int count = 0;
-    timed_loop_result_t measure_result = timed_event_loop(ctx, measurement_duration, &count, debug, "Measurement");
+    timed_loop_result_t measure_result = timed_event_loop(ctx, measurement_ns, &count, NULL, NULL, debug, "Measurement");
 
     if (measure_result == TIMED_LOOP_INTERRUPTED) {
-        return -1.0;
+        return -1;
     }
     if (measure_result == TIMED_LOOP_ERROR) {
-        return -1.0;
+        return -1;
     }
 
-    // Get current time for elapsed calculation
-    struct timespec current_ts;
-    clock_gettime(CLOCK_MONOTONIC, &current_ts);
+    // The window is the scheduled phase, not the time the loop happened to run
+    int64_t elapsed_ns = ctx->phase_end_ns - ctx->phase_start_ns;
 
-    double elapsed = (current_ts.tv_sec - start_ts.tv_sec) +
-                     (current_ts.tv_nsec - start_ts.tv_nsec) / 1e9;
+    ctx->last_pulses = count;
+    ctx->last_elapsed_ns = elapsed_ns;
 
-    if (elapsed <= 0.0) return 0.0;
+    if (elapsed_ns <= 0) return 0;
 
-    // Calculate RPM: (pulses / pulses_per_rev) / time * 60
-    // This is equivalent to: frequency(Hz) * 60 / pulses_per_rev
-    double revs = (double)count / pulses_per_rev;
-    double rpm = revs / elapsed * 60.0;
+    rpm_value_t rpm = rpm_from_count(count, pulses_per_rev, elapsed_ns);
 
     if (debug) {
-        fprintf(stderr, "Counted %u pulses in %.3f s, RPM=%.1f\n",
-                count, elapsed, rpm);
+        double elapsed = (double)elapsed_ns / 1e9;
+        fprintf(stderr, "Counted %u pulses in %.3f s, RPM=%lld\n",
+                count, elapsed, rpm_round(rpm));
         fprintf(stderr, "  Pulses per revolution: %d\n", pulses_per_rev);
-        fprintf(stderr, "  Revolutions: %.2f\n", revs);
+        fprintf(stderr, "  Revolutions: %.2f\n", (double)count / pulses_per_rev);
         fprintf(stderr, "  Frequency: %.2f Hz\n", count / elapsed);
     }
 
     return rpm;
 }
 
+rpm_value_t gpio_measure_rpm_period(gpio_context_t *ctx, period_tracker_t *tracker, int pulses_per_rev,
+                                    int64_t duration_ns, int64_t warmup_ns, int debug) {
+    if (!ctx || !tracker) return 0;
+
+    if (warmup_ns > 0) {
+        timed_loop_result_t warmup_result = timed_event_loop(ctx, warmup_ns, NULL, NULL, NULL, debug, "Warmup");
+        if (warmup_result != TIMED_LOOP_COMPLETED) {
+            return -1;
+        }
+    }
+
+    int64_t start_ns = gpio_monotonic_ns();
+
+    // Capture periods until the tracker is full or the window ends
+    period_reset(tracker);
+    unsigned int count = 0;
+    timed_loop_result_t measure_result = timed_event_loop(ctx, duration_ns - warmup_ns, &count, tracker,
+                                                          NULL, debug, "Period capture");
+    if (measure_result != TIMED_LOOP_COMPLETED) {
+        return -1;
+    }
+
+    size_t captured = tracker->count;
+    rpm_value_t rpm = period_rpm(tracker, pulses_per_rev);
+
+    ctx->last_pulses = count;
+    ctx->last_elapsed_ns = gpio_monotonic_ns() - start_ns;
+
+    if (debug) {
+        fprintf(stderr, "Captured %zu/%zu periods in %.3f s, RPM=%lld\n",
+                captured, tracker->capacity, (double)ctx->last_elapsed_ns / 1e9, rpm_round(rpm));
+        if (captured > 0) {
+            fprintf(stderr, "  Median period: %.3f ms\n",
+                    (double)tracker->periods[captured / 2] / 1e6);
+        }
+    }
+
+    return rpm;
+}
+
+rpm_value_t gpio_measure_rpm_adaptive(gpio_context_t *ctx, adaptive_tracker_t *tracker, int pulses_per_rev,
+                                      int64_t duration_ns, int64_t warmup_ns, int debug) {
+    if (!ctx || !tracker) return 0;
+
+    if (warmup_ns > 0) {
+        timed_loop_result_t warmup_result = timed_event_loop(ctx, warmup_ns, NULL, NULL, NULL, debug, "Warmup");
+        if (warmup_result != TIMED_LOOP_COMPLETED) {
+            return -1;
+        }
+    }
+
+    // Time edges until the target is reached or the window ends
+    adaptive_reset(tracker);
+    timed_loop_result_t measure_result = timed_event_loop(ctx, duration_ns - warmup_ns, NULL, NULL,
+                                                          tracker, debug, "Adaptive capture");
+    if (measure_result != TIMED_LOOP_COMPLETED) {
+        return -1;
+    }
+
+    rpm_value_t rpm = adaptive_rpm(tracker, pulses_per_rev);
+    ctx->last_pulses = tracker->complete;
+    ctx->last_elapsed_ns = adaptive_span_ns(tracker);
+
+    if (debug) {
+        fprintf(stderr, "Timed %u/%u pulses over %.3f s, RPM=%lld\n",
+                tracker->complete, tracker->target, (double)ctx->last_elapsed_ns / 1e9, rpm_round(rpm));
+    }
+
+    return rpm;
+}
+
+void gpio_counters(const gpio_context_t *ctx, size_t line, rpm_counters_t *counters) {
+    if (!counters) return;
+
+    memset(counters, 0, sizeof(*counters));
+    if (!ctx || line >= ctx->num_lines) return;
+
+    counters->events = ctx->line_counters[line].events;
+    counters->lost = ctx->line_counters[line].lost;
+    counters->reads = ctx->reads;
+    counters->max_batch = ctx->max_batch;
+    counters->wakeups = ctx->wakeups;
+    counters->overruns = ctx->overruns;
+}
+
+int64_t gpio_monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+int gpio_warmup(gpio_context_t *ctx, int64_t warmup_ns, int debug) {
+    if (!ctx) return -1;
+    if (warmup_ns <= 0) return 0;
+
+    timed_loop_result_t result = timed_event_loop(ctx, warmup_ns, NULL, NULL, NULL, debug, "Warmup");
+    return result == TIMED_LOOP_COMPLETED ? 0 : -1;
+}
+
+rpm_value_t gpio_measure_rpm_sliding(gpio_context_t *ctx, sliding_window_t *window, int pulses_per_rev,
+                                     int64_t interval_ns, int debug) {
+    if (!ctx || !window) return 0;
+
+    unsigned int count = 0;
+    timed_loop_result_t result = timed_event_loop(ctx, interval_ns, &count, NULL, NULL, 0, NULL);
+    if (result != TIMED_LOOP_COMPLETED) {
+        return -1;
+    }
+
+    // Buckets end on the interval schedule
+    int64_t now = ctx->phase_end_ns ? ctx->phase_end_ns : gpio_monotonic_ns();
+
+    sliding_add(window, count);
+    rpm_value_t rpm = sliding_rotate(window, now, pulses_per_rev);
+    ctx->last_pulses = window->sum;
+    ctx->last_elapsed_ns = sliding_span_ns(window);
+
+    if (debug) {
+        fprintf(stderr, "Counted %u pulses in bucket, %lu pulses in %zu/%zu buckets, RPM=%lld\n",
+                count, window->sum, window->filled, window->nbuckets, rpm_round(rpm));
+    }
+
+    return rpm;
+}
+
 void* gpio_thread_fn(void *arg) {
     thread_args_t *a = arg;
     gpio_context_t *ctx;
+    int stop_measuring = 0;
     
     // Initialize GPIO context
     ctx = gpio_init(a->gpio, a->chipname);
@@ -325,11 +784,12 @@ void* gpio_thread_fn(void *arg) {
         free(a);
         return NULL;
     }
+    ctx->capture = a->capture;
     
     // Request edge events (include PID for unique identification)
     char consumer[32];
     snprintf(consumer, sizeof(consumer), "gpio-fan-rpm-%d", (int)getpid());
-    if (gpio_request_events(ctx, consumer, a->edge) < 0) {
+    if (gpio_request_events(ctx, consumer, a->edge, a->event_batch, a->debounce_ns) < 0) {
         pthread_mutex_lock(&print_mutex);
         fprintf(stderr, "Error: cannot request events for GPIO %d\n", a->gpio);
         pthread_mutex_unlock(&print_mutex);
@@ -337,68 +797,113 @@ void* gpio_thread_fn(void *arg) {
         free(a);
         return NULL;
     }
+    if (a->debug && ctx->debounce_ns > 0) {
+        pthread_mutex_lock(&print_mutex);
+        fprintf(stderr, "GPIO%d: no hardware debounce, using software glitch filter (%.0f us)\n",
+                a->gpio, (double)ctx->debounce_ns / NSEC_PER_USEC);
+        pthread_mutex_unlock(&print_mutex);
+    }
     
-    // Warmup once for watch mode
-    if (a->watch) {
-        gpio_measure_rpm(ctx, a->pulses, a->duration, a->warmup, a->debug);
+    // Period storage for METHOD_PERIOD
+    uint64_t *periods = NULL;
+    period_tracker_t tracker;
+    if (a->method == METHOD_PERIOD) {
+        periods = rpm_aligned_calloc(a->periods, sizeof(*periods));
+        if (!periods) {
+            fprintf(stderr, "Error: memory allocation failed\n");
+            gpio_cleanup(ctx);
+            free(a);
+            return NULL;
+        }
+        period_init(&tracker, periods, a->periods, a->edge);
+    }
+
+    adaptive_tracker_t adaptive;
+    if (a->method == METHOD_ADAPTIVE) {
+        adaptive_init(&adaptive, a->target_pulses, a->edge);
+    }
+
+    // Bucket storage for METHOD_SLIDING
+    unsigned int *bucket_counts = NULL;
+    int64_t *bucket_starts = NULL;
+    sliding_window_t window;
+    if (a->method == METHOD_SLIDING) {
+        size_t nbuckets = (size_t)(a->window_ns / a->interval_ns);
+        bucket_counts = rpm_aligned_calloc(nbuckets, sizeof(*bucket_counts));
+        bucket_starts = rpm_aligned_calloc(nbuckets, sizeof(*bucket_starts));
+        if (!bucket_counts || !bucket_starts) {
+            fprintf(stderr, "Error: memory allocation failed\n");
+            free(bucket_counts);
+            free(bucket_starts);
+            free(periods);
+            gpio_cleanup(ctx);
+            free(a);
+            return NULL;
+        }
+        sliding_init(&window, bucket_counts, bucket_starts, nbuckets);
+    }
+
+    // A staggered fan ignores its edges until its phase offset has passed
+    if (a->start_delay_ns > 0 && gpio_warmup(ctx, a->start_delay_ns, a->debug) < 0) {
+        stop_measuring = 1;
+    }
+
+    // Then the method's own warmup follows
+    if (!stop_measuring && a->method == METHOD_SLIDING) {
+        // Warmup runs once, then edges are counted continuously
+        if (gpio_warmup(ctx, a->warmup_ns, a->debug) < 0) {
+            stop_measuring = 1;
+        }
+    } else if (!stop_measuring && a->watch) {
+        // Warmup once for watch mode
+        gpio_measure_rpm(ctx, a->pulses, a->duration_ns, a->warmup_ns, a->debug);
+    }
+
+    // The first bucket starts where the delay and warmup phases ended
+    if (!stop_measuring && a->method == METHOD_SLIDING) {
+        sliding_reset(&window, ctx->phase_end_ns ? ctx->phase_end_ns : gpio_monotonic_ns());
     }
     
     // Measurement loop
-    do {
-        double rpm = gpio_measure_rpm(ctx, a->pulses, a->duration, a->warmup, a->debug);
+    while (!stop_measuring) {
+        rpm_value_t rpm;
+        if (a->method == METHOD_PERIOD) {
+            rpm = gpio_measure_rpm_period(ctx, &tracker, a->pulses, a->duration_ns, a->warmup_ns, a->debug);
+        } else if (a->method == METHOD_ADAPTIVE) {
+            rpm = gpio_measure_rpm_adaptive(ctx, &adaptive, a->pulses, a->duration_ns, a->warmup_ns,
+                                            a->debug);
+        } else if (a->method == METHOD_SLIDING) {
+            rpm = gpio_measure_rpm_sliding(ctx, &window, a->pulses, a->interval_ns, a->debug);
+        } else {
+            rpm = gpio_measure_rpm(ctx, a->pulses, a->duration_ns, a->warmup_ns, a->debug);
+        }
         
         // Don't output interrupted measurements
-        if (rpm < 0.0) {
+        if (rpm < 0) {
             // Interrupted during measurement, exit cleanly
             break;
         }
-        
-        // For multiple GPIOs, store result and signal completion
-        if (a->total_threads > 1 && a->results && a->finished &&
-            a->results_mutex && a->all_finished) {
-            pthread_mutex_lock(a->results_mutex);
-
-            // Store result
-            a->results[a->thread_index] = rpm;
-            a->finished[a->thread_index] = 1;
-
-            // Check if all threads finished and signal if so
-            if (measurement_all_done(a->finished, a->total_threads)) {
-                int ret = pthread_cond_signal(a->all_finished);
-                if (ret != 0) {
-                    fprintf(stderr, "Warning: pthread_cond_signal failed: %s\n", strerror(ret));
-                }
-            }
 
-            pthread_mutex_unlock(a->results_mutex);
-        } else {
-            // Single GPIO - store result for main thread to output
-            // This prevents double output in single measurement mode
-            if (a->results && a->finished) {
-                pthread_mutex_lock(a->results_mutex);
-                a->results[a->thread_index] = rpm;
-                a->finished[a->thread_index] = 1;
-                pthread_mutex_unlock(a->results_mutex);
-            } else {
-                // Fallback: direct output if no synchronization primitives available
-                pthread_mutex_lock(&print_mutex);
-                char *output = format_output(a->gpio, rpm, NULL, a->mode, a->duration);
-                if (output) {
-                    printf("%s", output);
-                    free(output);
-                }
-                fflush(stdout);
-                pthread_mutex_unlock(&print_mutex);
-            }
+        // A single sliding measurement reports once the window is full
+        if (a->method == METHOD_SLIDING && !a->watch && window.filled < window.nbuckets) {
+            continue;
         }
         
+        // Publish without waiting for readers or other GPIOs
+        rpm_counters_t counters;
+        gpio_counters(ctx, 0, &counters);
+        measurement_push(a->snapshot, a->queue, a->notify_fd, rpm, ctx->last_pulses, ctx->last_elapsed_ns,
+                         &counters);
+
         // For single measurement mode, only run once
-        if (!a->watch) {
+        if (!a->watch || stop) {
             break;
         }
-        
-    } while (a->watch && !stop);
+    }
     
+    free(bucket_counts);
+    free(bucket_starts);
+    free(periods);
     gpio_cleanup(ctx);
     free(a);
 
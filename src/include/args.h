@@ -15,6 +15,12 @@ extern "C" {
 
 #include "gpio.h"
 #include "line.h"  // For edge_type_t
+#include "measurement_common.h"
+
+/**
+ * Maximum number of --gpio options
+ */
+#define MAX_GPIOS 64
 
 /**
  * Print usage information
@@ -26,35 +32,32 @@ void print_usage(const char *prog);
 /**
  * Parse command-line arguments
  *
+ * The caller initializes params with defaults; parsed values overwrite
+ * them. params->gpios is allocated here (caller must free).
+ *
  * @param argc Argument count
  * @param argv Argument vector
- * @param gpios Output array for GPIO numbers
- * @param ngpio Output number of GPIOs
+ * @param params Input defaults, output parsed parameters
  * @param chipname Output GPIO chip name
- * @param duration Output measurement duration
- * @param pulses Output pulses per revolution
- * @param warmup Output warmup duration
- * @param edge Output edge detection type
- * @param debug Output debug flag
- * @param watch Output watch flag
- * @param mode Output format mode
  * @return int 0 on success, -1 on error, 1 for help/version
  */
-int parse_arguments(int argc, char **argv, int **gpios, size_t *ngpio,
-                   char **chipname, int *duration, int *pulses, int *warmup,
-                   edge_type_t *edge, int *debug, int *watch, output_mode_t *mode);
+int parse_arguments(int argc, char **argv, measurement_params_t *params, char **chipname);
 
 /**
  * Validate parsed arguments
  *
- * @param gpios Array of GPIO numbers
- * @param ngpio Number of GPIOs
- * @param duration Measurement duration
- * @param warmup Warmup duration
+ * @param params Parsed measurement parameters
  * @param prog Program name for error messages
  * @return int 0 on success, -1 on error
  */
-int validate_arguments(int *gpios, size_t ngpio, int duration, int warmup, const char *prog);
+int validate_arguments(const measurement_params_t *params, const char *prog);
+
+/**
+ * Free the GPIO lists allocated by parse_arguments()
+ *
+ * @param params Parsed measurement parameters
+ */
+void free_arguments(measurement_params_t *params);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,40 @@
+/**
+ * This module provides cache line aligned allocation for per-fan and
+ * per-thread state written by different threads.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef CACHELINE_H
+#define CACHELINE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Cache line size used to keep state of different threads apart
+ */
+#define RPM_CACHE_LINE 64
+
+/**
+ * Allocate zeroed memory that shares no cache line with other allocations
+ *
+ * Per-fan state written by different threads must not be placed next to
+ * each other by malloc, or every store invalidates the neighbour's line
+ * (false sharing). Free with free().
+ *
+ * @param count Number of elements
+ * @param size Element size
+ * @return void* Memory aligned to and padded to RPM_CACHE_LINE, or NULL
+ */
+void* rpm_aligned_calloc(size_t count, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CACHELINE_H
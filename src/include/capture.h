@@ -0,0 +1,129 @@
+/**
+ * This module records the raw edge events of a measurement to a file and
+ * loads such a capture for replay through the measurement engine.
+ *
+ * A capture file is a 16-byte header followed by 16-byte records, all
+ * fields little-endian:
+ *
+ *   header: char magic[8] "GFRPMCAP", u16 version, u16 record size, u32 reserved
+ *   record: u64 timestamp_ns, u32 offset, u8 type, u8 reserved[3]
+ *
+ * Timestamps are the kernel edge timestamps (CLOCK_MONOTONIC). Besides
+ * rising and falling edges, marker records note when the capture was
+ * started and stopped, so a replay knows how long the capture ran after
+ * the last edge.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gpio.h"  // For gpio_edge_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAPTURE_MAGIC "GFRPMCAP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_SIZE 16
+#define CAPTURE_RECORD_SIZE 16
+
+/**
+ * Records buffered before a write (one write() per batch)
+ */
+#define CAPTURE_BATCH_RECORDS 4096
+
+/**
+ * Longest time records stay buffered before they are written
+ */
+#define CAPTURE_FLUSH_NS NSEC_PER_SEC
+
+/**
+ * Record types
+ */
+typedef enum {
+    CAPTURE_FALLING = 0,   /**< Falling edge */
+    CAPTURE_RISING = 1,    /**< Rising edge */
+    CAPTURE_START = 0x80,  /**< Capture started (offset unused) */
+    CAPTURE_STOP = 0x81    /**< Capture stopped (offset unused) */
+} capture_type_t;
+
+/**
+ * Capture file writer shared by all line requests of a measurement
+ */
+typedef struct capture capture_t;
+
+/**
+ * Edges loaded from a capture file, sorted by timestamp
+ */
+typedef struct {
+    gpio_edge_t *edges;          /**< Edge records */
+    size_t count;                /**< Number of edges */
+    int64_t start_ns;            /**< Capture start (first edge if not recorded) */
+    int64_t stop_ns;             /**< Capture stop (last edge if not recorded) */
+} capture_replay_t;
+
+/**
+ * Create (or truncate) a capture file and write its header
+ *
+ * @param path File path
+ * @return capture_t* Capture writer or NULL on error
+ */
+capture_t* capture_open(const char *path);
+
+/**
+ * Append edges to the capture
+ *
+ * Records are batched and written with a single append, so several
+ * threads may record into the same capture.
+ *
+ * @param cap Capture writer (NULL is ignored)
+ * @param edges Edges as read from the event buffer
+ * @param count Number of edges
+ */
+void capture_edges(capture_t *cap, const gpio_edge_t *edges, size_t count);
+
+/**
+ * Write the stop marker and all buffered records and close the capture
+ *
+ * @param cap Capture writer (NULL is ignored)
+ * @return int 0 on success, -1 if records were lost
+ */
+int capture_close(capture_t *cap);
+
+/**
+ * Load a capture file for replay
+ *
+ * @param path File path
+ * @param replay Output for the loaded edges (free with capture_replay_free())
+ * @return int 0 on success, -1 on error
+ */
+int capture_load(const char *path, capture_replay_t *replay);
+
+/**
+ * List the line offsets occurring in a loaded capture
+ *
+ * @param replay Loaded capture
+ * @param gpios Output for the offsets in ascending order
+ * @param max Capacity of gpios
+ * @return size_t Number of offsets stored (at most max)
+ */
+size_t capture_offsets(const capture_replay_t *replay, int *gpios, size_t max);
+
+/**
+ * Free the edges of a loaded capture
+ *
+ * @param replay Loaded capture (NULL is ignored)
+ */
+void capture_replay_free(capture_replay_t *replay);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAPTURE_H
@@ -29,9 +29,29 @@ struct gpiod_chip* chip_open_by_name(const char *name);
  */
 void chip_close(struct gpiod_chip *chip);
 
+/**
+ * List the GPIO chips in /dev
+ *
+ * @param names_out Output array of chip names sorted by chip number
+ *                  (free with chip_list_free())
+ * @return int Number of chips or -1 on error
+ */
+int chip_list(char ***names_out);
+
+/**
+ * Free a chip list returned by chip_list()
+ *
+ * @param names Chip names (NULL is ignored)
+ * @param count Number of names
+ */
+void chip_list_free(char **names, size_t count);
+
 /**
  * Auto-detect available GPIO chip for given line
  *
+ * Chips are tried in chip number order; the first one with enough lines
+ * wins. Use line names or --chip on boards with several expanders.
+ *
  * @param gpio GPIO line number
  * @param chipname_out Output parameter for chip name (caller must free)
  * @return struct gpiod_chip* Chip object or NULL on error
@@ -0,0 +1,58 @@
+/**
+ * This module maps the requested GPIO lines to a chip: it probes all
+ * chips in /dev in parallel, resolves line names and remembers the result
+ * in a small on-disk index keyed by chip label, so later runs only have
+ * to confirm the cached entry.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef CHIPMAP_H
+#define CHIPMAP_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Default location of the chip index (a tmpfs, so it never outlives the
+ * device numbering of a boot)
+ */
+#define CHIPMAP_DEFAULT_CACHE "/run/gpio-fan-rpm.chips"
+
+/**
+ * Environment variable overriding the index location (empty: no index)
+ */
+#define CHIPMAP_CACHE_ENV "GPIO_FAN_RPM_CHIP_CACHE"
+
+/**
+ * Maximum length of a line name (including the terminator)
+ */
+#define CHIPMAP_LINE_MAX 64
+
+/**
+ * Find the chip holding all requested lines and resolve line names
+ *
+ * Lines given by name are resolved to their offset on the chip; lines
+ * given by number must exist on it. Without a chip, the first chip (in
+ * chip number order) satisfying every line is used. A chip given by the
+ * user may be a name ("gpiochip2"), or a label looked up in the index.
+ *
+ * @param names Line name per GPIO (NULL array or entries: given by number)
+ * @param gpios GPIO offsets (entries with a name are overwritten)
+ * @param ngpio Number of GPIOs
+ * @param chipname In: chip requested by the user or NULL, out: chip name
+ *                 (caller must free)
+ * @param debug Print discovery details to stderr
+ * @return int 0 on success, -1 on error
+ */
+int chipmap_resolve(char *const *names, int *gpios, size_t ngpio, char **chipname, int debug);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CHIPMAP_H
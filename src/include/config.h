@@ -0,0 +1,184 @@
+/**
+ * This module reads the fan configuration file and watches it for
+ * changes, so a running watch mode can apply a new fan set without a
+ * restart.
+ *
+ * Every non-empty line describes one fan: a name followed by KEY=VALUE
+ * settings, '#' starts a comment:
+ *
+ *   # NAME  offset=N [chip=CHIP] [pulses=N] [edge=TYPE] [window=TIME]
+ *   cpu     chip=gpiochip0 offset=17 pulses=2 edge=falling window=1s
+ *   case    offset=18
+ *
+ * Settings left out default to the command-line options (--chip,
+ * --pulses, --edge, and --duration or --window for --method=sliding).
+ * A fan is identified by its chip and offset.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "line.h"                // For edge_type_t
+#include "measurement_common.h"  // For measurement_params_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum number of fans in a config file (the --gpio limit)
+ */
+#define CONFIG_MAX_FANS 64
+
+/**
+ * Maximum length of a fan name and a chip name (including the terminator)
+ */
+#define CONFIG_NAME_MAX FORMAT_NAME_MAX
+#define CONFIG_CHIP_MAX 32
+
+/**
+ * Maximum length of a config file line
+ */
+#define CONFIG_LINE_MAX 256
+
+/**
+ * Settings of one fan
+ */
+typedef struct {
+    char name[CONFIG_NAME_MAX];  /**< Fan name (letters, digits, '_', '-' and '.'), its label in the outputs */
+    char chip[CONFIG_CHIP_MAX];  /**< Chip name (empty: --chip or auto-detect) */
+    int offset;                  /**< Line offset on the chip */
+    int pulses;                  /**< Pulses per revolution */
+    edge_type_t edge;            /**< Edge detection type */
+    int64_t window_ns;           /**< Measurement duration (sliding window length for METHOD_SLIDING) */
+} fan_config_t;
+
+/**
+ * All fans of a config file, in file order
+ */
+typedef struct fan_config_list {
+    fan_config_t fans[CONFIG_MAX_FANS];  /**< Fans */
+    size_t count;                        /**< Number of fans */
+} fan_config_list_t;
+
+/**
+ * Config file watcher (SIGHUP and inotify)
+ */
+typedef struct config_watch config_watch_t;
+
+/**
+ * Safely convert a string to an integer
+ *
+ * @param str String to convert
+ * @param result Pointer to store result
+ * @return int 0 on success, -1 on error
+ */
+int config_parse_int(const char *str, int *result);
+
+/**
+ * Safely convert a time string to nanoseconds
+ *
+ * Accepts a decimal number with an optional unit suffix: s, ms, us or ns.
+ * A number without suffix is interpreted as seconds (e.g., "2", "0.5",
+ * "250ms").
+ *
+ * @param str String to convert
+ * @param result_ns Pointer to store result in nanoseconds
+ * @return int 0 on success, -1 on error
+ */
+int config_parse_time(const char *str, int64_t *result_ns);
+
+/**
+ * Read and validate a config file
+ *
+ * Errors are reported with file name and line number. An empty file is
+ * valid (no fans). Whether two fans use the same line is only known once
+ * their chips are, see config_resolve_chips().
+ *
+ * @param path Config file
+ * @param params Parsed options (defaults and window limits)
+ * @param list Output fans
+ * @return int 0 on success, -1 on error
+ */
+int config_load(const char *path, const measurement_params_t *params, fan_config_list_t *list);
+
+/**
+ * Set the chip of the fans without chip= and check that no two fans use
+ * the same line
+ *
+ * @param list Fans
+ * @param chipname Chip of the fans without chip= (--chip or discovered;
+ *                 NULL: left empty, compared as given)
+ * @param path Config file (for error messages)
+ * @return int 0 on success, -1 if two fans use the same line (reported)
+ */
+int config_resolve_chips(fan_config_list_t *list, const char *chipname, const char *path);
+
+/**
+ * Check that all fans are on one chip (after config_resolve_chips())
+ *
+ * A capture records line offsets only, so fans on two chips would merge
+ * into one line of the capture file.
+ *
+ * @param list Fans
+ * @param path Config file (for error messages)
+ * @return int 0 if all fans share a chip, -1 otherwise (reported)
+ */
+int config_check_single_chip(const fan_config_list_t *list, const char *path);
+
+/**
+ * Check whether two fans are measured the same way
+ *
+ * The name is only a label and not compared.
+ *
+ * @param a First fan
+ * @param b Second fan
+ * @return int 1 if chip, offset, pulses, edge and window match, 0 otherwise
+ */
+int config_fan_same(const fan_config_t *a, const fan_config_t *b);
+
+/**
+ * Start watching a config file for reload requests
+ *
+ * Installs a SIGHUP handler and watches the file's directory with
+ * inotify, so both editing in place and replacing the file (rename)
+ * are seen. Without inotify only SIGHUP reloads.
+ *
+ * @param path Config file
+ * @return config_watch_t* Watcher or NULL on error
+ */
+config_watch_t* config_watch_start(const char *path);
+
+/**
+ * Get the descriptor of a watcher for a poll or epoll set
+ *
+ * @param watch Watcher
+ * @return int Descriptor readable while a reload request is pending
+ */
+int config_watch_fd(const config_watch_t *watch);
+
+/**
+ * Consume the pending reload requests of a watcher
+ *
+ * @param watch Watcher
+ * @return int 1 if the config file should be read again, 0 otherwise
+ */
+int config_watch_check(config_watch_t *watch);
+
+/**
+ * Stop watching (SIGHUP stays handled and is then ignored)
+ *
+ * @param watch Watcher (NULL is ignored)
+ */
+void config_watch_stop(config_watch_t *watch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONFIG_H
@@ -0,0 +1,35 @@
+/**
+ * This module implements the single-threaded measurement engine that
+ * multiplexes all GPIO lines and one shared timer in a single epoll set.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "measurement_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Start the epoll engine thread for all GPIOs in the context
+ *
+ * Lines are requested in the calling thread so setup errors are reported
+ * before measurement starts. The engine thread handle is stored in
+ * ctx->threads[0] and is joined by measurement_join_threads().
+ *
+ * @param ctx Initialized measurement context
+ * @param params Measurement parameters
+ * @return int 0 on success, -1 on error
+ */
+int engine_start(measurement_ctx_t *ctx, const measurement_params_t *params);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENGINE_H
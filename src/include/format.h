@@ -1,6 +1,8 @@
 /**
  * This module provides functions to format RPM measurements in various
- * output formats including human-readable, JSON, numeric, and collectd.
+ * output formats including human-readable, JSON, numeric, collectd (text
+ * and network protocol), InfluxDB line protocol and a fixed-size binary
+ * record stream, and packs formatted rounds into datagrams.
  *
  * @author  CSoellinger
  * @license LGPL-3.0-or-later
@@ -10,7 +12,10 @@
 #define FORMAT_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 #include "stats.h"
+#include "queue.h"  // For rpm_counters_t
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,16 +25,114 @@ typedef enum {
     MODE_DEFAULT,
     MODE_NUMERIC,
     MODE_JSON,
-    MODE_COLLECTD
+    MODE_COLLECTD,
+    MODE_BINARY,
+    MODE_INFLUX,
+    MODE_COLLECTD_NET
 } output_mode_t;
 
+/**
+ * Maximum length of a fan name (including the terminator)
+ */
+#define FORMAT_NAME_MAX 32
+
+/**
+ * Longest text label of a fan (see format_label_into())
+ */
+#define FORMAT_LABEL_MAX (FORMAT_NAME_MAX + 20)
+
+/**
+ * Fan a result belongs to, as labeled in the outputs
+ *
+ * A named fan (from --config) is labeled by its name in addition to the
+ * GPIO, which fans on different chips may share.
+ */
+typedef struct {
+    int gpio;                    /**< GPIO line offset (-1: no fan) */
+    int pulses;                  /**< Pulses per revolution */
+    char name[FORMAT_NAME_MAX];  /**< Fan name (empty: labeled by the GPIO alone) */
+} format_fan_t;
+
+/**
+ * Binary record stream (--format=binary)
+ *
+ * One record per GPIO and report, back to back without separators; fan
+ * names are not part of it. All fields are little-endian:
+ *
+ *   offset  size  field
+ *        0     2  length        record size in bytes (FORMAT_BINARY_RECORD_SIZE)
+ *        2     1  version       FORMAT_BINARY_VERSION
+ *        3     1  flags         FORMAT_BINARY_FLAG_* bits
+ *        4     4  gpio          int32 GPIO line offset
+ *        8     8  timestamp_ns  uint64 CLOCK_REALTIME of the result, ns since the epoch
+ *       16     8  interval_ns   uint64 length of the measurement window
+ *       24     8  rpm           IEEE 754 double
+ *       32     4  pulses        uint32 edges counted in the window
+ *       36     4  reserved      0
+ *
+ * Readers skip 'length' bytes per record, so later versions may append
+ * fields without breaking them.
+ */
+#define FORMAT_BINARY_RECORD_SIZE 40
+#define FORMAT_BINARY_VERSION 1
+
+/**
+ * collectd binary network protocol (--format=collectd-net)
+ *
+ * Every value is a complete value list: the parts host, time, interval,
+ * plugin "gpio-fan", plugin instance (the fan name or GPIO), type "gauge", type
+ * instance "rpm" and one gauge value. Each part is a big-endian u16 type
+ * and u16 length followed by a NUL-terminated string, a big-endian u64
+ * (times in 2^-30 s) or the values. format_packer_next() drops the parts
+ * a packet already carries, as collectd's network plugin does.
+ */
+#define FORMAT_COLLECTD_NET_PARTS 10   /**< Part types below the values part tracked while packing */
+
+/**
+ * Binary record flags
+ */
+#define FORMAT_BINARY_FLAG_STALLED 0x01  /**< No edge within the stall timeout (--stall-rpm) */
+
+/**
+ * Reusable output buffer for one round of results
+ *
+ * A round is appended line by line and emitted with a single write().
+ */
+/**
+ * Splits a formatted round into datagrams (see format_packer_next())
+ */
+typedef struct {
+    output_mode_t mode;          /**< Format of the round */
+    const unsigned char *data;   /**< Round */
+    size_t len;                  /**< Round length */
+    size_t pos;                  /**< Offset of the first record not packed yet */
+    const unsigned char *parts[FORMAT_COLLECTD_NET_PARTS];  /**< Latest part of each type (collectd-net) */
+} format_packer_t;
+
+typedef struct {
+    char *data;     /**< Buffer storage */
+    size_t len;     /**< Bytes appended since the last write */
+    size_t cap;     /**< Buffer capacity */
+    int64_t now_ns; /**< Wall-clock time of the round in nanoseconds (collectd, influx) */
+    int64_t realtime_offset_ns;  /**< CLOCK_REALTIME - CLOCK_MONOTONIC at the round (binary) */
+} format_buffer_t;
+
+/**
+ * Look up an output format by name
+ *
+ * @param name Format name (default, numeric, json, collectd, binary, influx, collectd-net)
+ * @param mode Output for the format
+ * @return int 0 on success, -1 if the name is unknown
+ */
+int format_parse_mode(const char *name, output_mode_t *mode);
+
 /**
  * Format RPM as numeric string
  *
  * @param rpm RPM value to format
  * @return char* Formatted string (caller must free), NULL on error
  */
-char* format_numeric(double rpm);
+char* format_numeric(rpm_value_t rpm);
 
 /**
  * Format RPM and GPIO as JSON string
@@ -39,17 +142,17 @@ char* format_numeric(double rpm);
  * @param stats Optional statistics (NULL for basic output)
  * @return char* Formatted string (caller must free), NULL on error
  */
-char* format_json(int gpio, double rpm, const rpm_stats_t *stats);
+char* format_json(int gpio, rpm_value_t rpm, const rpm_summary_t *stats);
 
 /**
  * Format RPM and GPIO as collectd PUTVAL string
  *
  * @param gpio GPIO number
  * @param rpm RPM value to format
- * @param duration Measurement duration
+ * @param interval_ns Report interval in nanoseconds
  * @return char* Formatted string (caller must free), NULL on error
  */
-char* format_collectd(int gpio, double rpm, int duration);
+char* format_collectd(int gpio, rpm_value_t rpm, int64_t interval_ns);
 
 /**
  * Format human-readable output
@@ -59,7 +162,7 @@ char* format_collectd(int gpio, double rpm, int duration);
  * @param stats Optional statistics (NULL for basic output)
  * @return char* Formatted string (caller must free), NULL on error
  */
-char* format_human_readable(int gpio, double rpm, const rpm_stats_t *stats);
+char* format_human_readable(int gpio, rpm_value_t rpm, const rpm_summary_t *stats);
 
 /**
  * Format RPM output according to specified mode
@@ -68,21 +171,313 @@ char* format_human_readable(int gpio, double rpm, const rpm_stats_t *stats);
  * @param rpm RPM value to format
  * @param stats Optional statistics (NULL for basic output)
  * @param mode Output format mode
- * @param duration Measurement duration (for collectd)
+ * @param interval_ns Report interval in nanoseconds (for collectd)
  * @return char* Formatted string (caller must free), NULL on error
  */
-char* format_output(int gpio, double rpm, const rpm_stats_t *stats, output_mode_t mode, int duration);
+char* format_output(int gpio, rpm_value_t rpm, const rpm_summary_t *stats, output_mode_t mode, int64_t interval_ns);
 
 /**
  * Format multiple GPIOs as JSON array
  *
- * @param gpios Array of GPIO numbers
+ * @param fans Array of fans
  * @param results Array of RPM values
  * @param stats Optional array of statistics (NULL for basic output)
  * @param ngpio Number of GPIOs
  * @return char* Formatted JSON array string (caller must free), NULL on error
  */
-char* format_json_array(const int *gpios, const double *results, const rpm_stats_t *stats, size_t ngpio);
+char* format_json_array(const format_fan_t *fans, const rpm_value_t *results, const rpm_summary_t *stats, size_t ngpio);
+
+/**
+ * Format RPM as numeric string into a caller-provided buffer
+ *
+ * All *_into functions write a NUL-terminated string and never allocate.
+ *
+ * @param buf Output buffer
+ * @param cap Output buffer capacity
+ * @param rpm RPM value to format
+ * @return int Length written (without NUL), -1 if it does not fit
+ */
+int format_numeric_into(char *buf, size_t cap, rpm_value_t rpm);
+
+/**
+ * Format an integer scaled by 10^-digits as a decimal number into a
+ * caller-provided buffer, without trailing zeros (e.g. 1500, 3: "1.5")
+ *
+ * @param buf Output buffer
+ * @param cap Output buffer capacity
+ * @param value Scaled value
+ * @param digits Decimal digits of the scale (at most 18)
+ * @return int Length written (without NUL), -1 if it does not fit
+ */
+int format_decimal_into(char *buf, size_t cap, int64_t value, unsigned int digits);
+
+/**
+ * Format the text label of a fan into a caller-provided buffer
+ *
+ * "GPIO17", or "cpu (GPIO17)" for a named fan.
+ *
+ * @param buf Output buffer (FORMAT_LABEL_MAX always fits)
+ * @param cap Output buffer capacity
+ * @param fan Fan
+ * @return int Length written (without NUL), -1 if it does not fit
+ */
+int format_label_into(char *buf, size_t cap, const format_fan_t *fan);
+
+/**
+ * Format RPM and GPIO as JSON into a caller-provided buffer
+ *
+ * A named fan also carries "name". With statistics the object also
+ * carries min, max, avg, ewma, p50, p95, p99, window_min and window_max;
+ * with counters a nested "counters" object, and "stalled":true for a
+ * stalled result.
+ *
+ * @param buf Output buffer
+ * @param cap Output buffer capacity
+ * @param fan Fan
+ * @param rpm RPM value to format
+ * @param stats Optional statistics (NULL for basic output)
+ * @param counters Optional measurement loop counters (NULL: left out)
+ * @return int Length written (without NUL), -1 if it does not fit
+ */
+int format_json_into(char *buf, size_t cap, const format_fan_t *fan, rpm_value_t rpm, const rpm_summary_t *stats,
+                     const rpm_counters_t *counters);
+
+/**
+ * Format RPM and GPIO as collectd PUTVAL into a caller-provided buffer
+ *
+ * The plugin instance is the fan name, or the GPIO of an unnamed fan.
+ * The hostname is resolved once per process.
+ *
+ * @param buf Output buffer
+ * @param cap Output buffer capacity
+ * @param fan Fan
+ * @param rpm RPM value to format
+ * @param interval_ns Report interval in nanoseconds
+ * @param now Wall-clock timestamp of the value
+ * @return int Length written (without NUL), -1 if it does not fit
+ */
+int format_collectd_into(char *buf, size_t cap, const format_fan_t *fan, rpm_value_t rpm, int64_t interval_ns,
+                         time_t now);
+
+/**
+ * Format RPM and GPIO as InfluxDB line protocol into a caller-provided buffer
+ *
+ * One point of measurement gpio_fan tagged with host, gpio and the name
+ * of a named fan (fan), with the fields rpm and, with counters, stalled.
+ *
+ * @param buf Output buffer
+ * @param cap Output buffer capacity
+ * @param fan Fan
+ * @param rpm RPM value to format
+ * @param counters Optional measurement loop counters (NULL: no stalled field)
+ * @param now_ns Wall-clock time of the value in nanoseconds
+ * @return int Length written (without NUL), -1 if it does not fit
+ */
+int format_influx_into(char *buf, size_t cap, const format_fan_t *fan, rpm_value_t rpm,
+                       const rpm_counters_t *counters, int64_t now_ns);
+
+/**
+ * Encode one value list of the collectd network protocol into a caller-provided buffer
+ *
+ * @param buf Output buffer
+ * @param cap Output buffer capacity
+ * @param fan Fan
+ * @param rpm RPM value
+ * @param interval_ns Report interval in nanoseconds
+ * @param now_ns Wall-clock time of the value in nanoseconds
+ * @return int Length written, -1 if it does not fit
+ */
+int format_collectd_net_into(unsigned char *buf, size_t cap, const format_fan_t *fan, rpm_value_t rpm,
+                             int64_t interval_ns, int64_t now_ns);
+
+/**
+ * Format human-readable output into a caller-provided buffer
+ *
+ * @param buf Output buffer
+ * @param cap Output buffer capacity
+ * @param fan Fan
+ * @param rpm RPM value to format
+ * @param stats Optional statistics (NULL for basic output)
+ * @return int Length written (without NUL), -1 if it does not fit
+ */
+int format_human_readable_into(char *buf, size_t cap, const format_fan_t *fan, rpm_value_t rpm,
+                               const rpm_summary_t *stats);
+
+/**
+ * Format RPM output according to specified mode into a caller-provided buffer
+ *
+ * @param buf Output buffer
+ * @param cap Output buffer capacity
+ * @param fan Fan
+ * @param rpm RPM value to format
+ * @param stats Optional statistics (NULL for basic output)
+ * @param counters Optional measurement loop counters (NULL: left out); a
+ *                 stalled result is marked in JSON and human-readable output
+ * @param mode Output format mode
+ * @param interval_ns Report interval in nanoseconds (for collectd)
+ * @param now_ns Wall-clock time of the value in nanoseconds (for collectd and influx)
+ * @return int Length written (without NUL), -1 if it does not fit
+ */
+int format_output_into(char *buf, size_t cap, const format_fan_t *fan, rpm_value_t rpm, const rpm_summary_t *stats,
+                       const rpm_counters_t *counters, output_mode_t mode, int64_t interval_ns,
+                       int64_t now_ns);
+
+/**
+ * Encode one binary record into a caller-provided buffer
+ *
+ * @param buf Output buffer
+ * @param cap Output buffer capacity
+ * @param gpio GPIO number
+ * @param rpm RPM value
+ * @param pulses Edges counted in the window
+ * @param flags FORMAT_BINARY_FLAG_* bits
+ * @param interval_ns Measurement window length in nanoseconds
+ * @param timestamp_ns Wall-clock time of the result in nanoseconds
+ * @return int FORMAT_BINARY_RECORD_SIZE, -1 if it does not fit
+ */
+int format_binary_into(unsigned char *buf, size_t cap, int gpio, rpm_value_t rpm, unsigned long pulses,
+                       unsigned int flags, int64_t interval_ns, int64_t timestamp_ns);
+
+/**
+ * Format multiple GPIO results as JSON array into a caller-provided buffer
+ *
+ * @param buf Output buffer
+ * @param cap Output buffer capacity
+ * @param fans Array of fans
+ * @param results Array of RPM results (negative values are skipped)
+ * @param stats Optional array of statistics (NULL for basic output)
+ * @param counters Optional array of measurement loop counters (NULL: left out)
+ * @param ngpio Number of GPIOs
+ * @return int Length written (without NUL), -1 if it does not fit
+ */
+int format_json_array_into(char *buf, size_t cap, const format_fan_t *fans, const rpm_value_t *results,
+                           const rpm_summary_t *stats, const rpm_counters_t *counters, size_t ngpio);
+
+/**
+ * Start splitting a formatted round into datagrams
+ *
+ * @param packer Packer to initialize
+ * @param mode Format of the round
+ * @param data Round (must stay valid while packing)
+ * @param len Round length
+ */
+void format_packer_init(format_packer_t *packer, output_mode_t mode, const void *data, size_t len);
+
+/**
+ * Take the next datagram of a round
+ *
+ * Whole records (lines, binary records, collectd value lists) are packed
+ * until the next one would exceed max. A record larger than max on its
+ * own is returned alone, pointing into the round.
+ *
+ * @param packer Packer
+ * @param dgram Buffer of at least max bytes for packed datagrams
+ * @param max Largest datagram to pack
+ * @param out Output for the datagram (dgram or a record in the round)
+ * @return size_t Datagram length, 0 when the round is exhausted
+ */
+size_t format_packer_next(format_packer_t *packer, unsigned char *dgram, size_t max,
+                          const unsigned char **out);
+
+/**
+ * Allocate an output buffer
+ *
+ * @param out Buffer to initialize
+ * @param cap Initial capacity (grows on demand)
+ * @return int 0 on success, -1 on error
+ */
+int format_buffer_init(format_buffer_t *out, size_t cap);
+
+/**
+ * Free an output buffer
+ *
+ * @param out Buffer to free
+ */
+void format_buffer_free(format_buffer_t *out);
+
+/**
+ * Start a new round (discards pending output, takes the round timestamp)
+ *
+ * @param out Output buffer
+ */
+void format_buffer_reset(format_buffer_t *out);
+
+/**
+ * Append one formatted result to the round
+ *
+ * MODE_BINARY records carry no pulse count here; use
+ * format_buffer_append_binary() where the sample is known.
+ *
+ * @param out Output buffer
+ * @param fan Fan
+ * @param rpm RPM value to format
+ * @param stats Optional statistics (NULL for basic output)
+ * @param counters Optional measurement loop counters (NULL: left out)
+ * @param mode Output format mode
+ * @param interval_ns Report interval in nanoseconds (for collectd)
+ * @return int 0 on success, -1 on error
+ */
+int format_buffer_append_output(format_buffer_t *out, const format_fan_t *fan, rpm_value_t rpm,
+                                const rpm_summary_t *stats,
+                                const rpm_counters_t *counters, output_mode_t mode, int64_t interval_ns);
+
+/**
+ * Append one binary record to the round
+ *
+ * @param out Output buffer
+ * @param gpio GPIO number
+ * @param rpm RPM value
+ * @param pulses Edges counted in the window
+ * @param flags FORMAT_BINARY_FLAG_* bits
+ * @param interval_ns Measurement window length in nanoseconds
+ * @param published_ns CLOCK_MONOTONIC time the result was published
+ * @return int 0 on success, -1 on error
+ */
+int format_buffer_append_binary(format_buffer_t *out, int gpio, rpm_value_t rpm, unsigned long pulses,
+                                unsigned int flags, int64_t interval_ns, int64_t published_ns);
+
+/**
+ * Append one measured sample to the round
+ *
+ * MODE_BINARY records carry the pulse count, window and publish time of
+ * the sample; every other format is appended as with
+ * format_buffer_append_output().
+ *
+ * @param out Output buffer
+ * @param fan Fan
+ * @param sample Measured sample
+ * @param stats Optional statistics (NULL for basic output)
+ * @param counters Optional measurement loop counters (NULL: left out)
+ * @param mode Output format mode
+ * @param interval_ns Report interval in nanoseconds (for collectd)
+ * @return int 0 on success, -1 on error
+ */
+int format_buffer_append_sample(format_buffer_t *out, const format_fan_t *fan, const rpm_sample_t *sample,
+                                const rpm_summary_t *stats, const rpm_counters_t *counters,
+                                output_mode_t mode, int64_t interval_ns);
+
+/**
+ * Append a JSON array of results to the round
+ *
+ * @param out Output buffer
+ * @param fans Array of fans
+ * @param results Array of RPM results (negative values are skipped)
+ * @param stats Optional array of statistics (NULL for basic output)
+ * @param counters Optional array of measurement loop counters (NULL: left out)
+ * @param ngpio Number of GPIOs
+ * @return int 0 on success, -1 on error
+ */
+int format_buffer_append_json_array(format_buffer_t *out, const format_fan_t *fans, const rpm_value_t *results,
+                                    const rpm_summary_t *stats, const rpm_counters_t *counters, size_t ngpio);
+
+/**
+ * Write the round with a single write() (retried on partial writes)
+ *
+ * @param out Output buffer (emptied on success)
+ * @param fd File descriptor to write to
+ * @return int 0 on success, -1 on error
+ */
+int format_buffer_write(format_buffer_t *out, int fd);
 
 #ifdef __cplusplus
 }
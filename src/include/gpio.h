@@ -11,35 +11,74 @@
 #include <gpiod.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <poll.h>
 #include <signal.h>  // For sig_atomic_t
 #include "format.h"  // For output_mode_t
 #include "line.h"    // For edge_type_t
+#include "rpm.h"     // For rpm_method_t
+#include "queue.h"   // For rpm_queue_t
+#include "snapshot.h" // For fan_snapshot_t
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct capture;  // Capture file writer (capture.h)
+
 /**
  * Thread arguments structure
  */
 typedef struct {
     int gpio;                    /**< GPIO number to measure */
     char *chipname;              /**< GPIO chip name (NULL for auto-detect) */
-    int duration;                /**< Total measurement duration in seconds */
+    int64_t duration_ns;         /**< Total measurement duration in nanoseconds */
     int pulses;                  /**< Pulses per revolution */
-    int warmup;                  /**< Warmup duration in seconds */
+    int64_t warmup_ns;           /**< Warmup duration in nanoseconds */
     edge_type_t edge;            /**< Edge detection type */
+    size_t event_batch;          /**< Maximum edge events per read */
+    int64_t debounce_ns;         /**< Glitch filter period in nanoseconds (0 = off) */
+    rpm_method_t method;         /**< Measurement method */
+    size_t periods;              /**< Periods to capture for METHOD_PERIOD */
+    unsigned int target_pulses;  /**< Edge intervals per window for METHOD_ADAPTIVE */
+    int64_t window_ns;           /**< Sliding window length in nanoseconds (METHOD_SLIDING) */
+    int64_t interval_ns;         /**< Sliding window report interval in nanoseconds */
     int debug;                   /**< Enable debug output */
     int watch;                   /**< Continuous monitoring mode */
+    int64_t start_delay_ns;      /**< Delay of the first window (--stagger, 0: none) */
     output_mode_t mode;          /**< Output format mode */
-    size_t thread_index;         /**< Thread index for ordering */
-    size_t total_threads;        /**< Total number of threads */
-    double *results;             /**< Array to store measurement results */
-    int *finished;               /**< Array to track which threads finished */
-    pthread_mutex_t *results_mutex; /**< Mutex for results array */
-    pthread_cond_t *all_finished;   /**< Condition variable for all threads finished */
+    fan_snapshot_t *snapshot;    /**< Published state of this GPIO */
+    rpm_queue_t *queue;          /**< Result queue (NULL: snapshot only) */
+    int notify_fd;               /**< eventfd signalled on every queued result (-1 if none) */
+    struct capture *capture;     /**< Raw edge capture (NULL: off) */
 } thread_args_t;
 
+/**
+ * Edge event copied out of the libgpiod event buffer
+ */
+typedef struct {
+    uint64_t timestamp_ns;       /**< Kernel timestamp (CLOCK_MONOTONIC) */
+    unsigned int offset;         /**< Line offset */
+    int rising;                  /**< 1 for rising edge, 0 for falling edge */
+} gpio_edge_t;
+
+/**
+ * Event counters of one line
+ */
+typedef struct {
+    unsigned long events;        /**< Edge events read (before the glitch filter) */
+    unsigned long lost;          /**< Edges the kernel dropped (line sequence number gaps) */
+    unsigned long seqno;         /**< Last line sequence number seen (0: none yet) */
+} gpio_line_counters_t;
+
+/**
+ * Software glitch filter state of one line
+ */
+typedef struct {
+    uint64_t last_ns;            /**< Timestamp of the last accepted edge */
+    int last_rising;             /**< Type of the last accepted edge */
+    int valid;                   /**< Whether an edge was accepted yet */
+} gpio_filter_t;
+
 /**
  * GPIO context structure for version compatibility
  */
@@ -47,11 +86,54 @@ typedef struct gpio_context {
     struct gpiod_chip *chip;
     struct gpiod_line_request *request;
     struct gpiod_edge_event_buffer *event_buffer;  /**< Reusable event buffer */
+    gpio_edge_t *edges;                            /**< Events of the last read */
+    size_t event_batch;                            /**< Event buffer capacity */
+    edge_type_t edge;                              /**< Requested edge detection */
     int event_fd;
-    int gpio;
+    int gpio;                                      /**< First (or only) GPIO line */
+    unsigned int *offsets;                         /**< All GPIO lines of the request */
+    size_t num_lines;                              /**< Number of lines in offsets */
     char *chipname;
+    int64_t debounce_ns;                           /**< Software glitch filter period (0: off) */
+    gpio_filter_t *filter;                         /**< Filter state per line in offsets (NULL: off) */
+    unsigned long filtered;                        /**< Edges dropped by the glitch filter */
+    gpio_line_counters_t *line_counters;           /**< Event counters per line in offsets */
+    unsigned long reads;                           /**< Event reads that returned edges */
+    unsigned long max_batch;                       /**< Most edges returned by one read */
+    unsigned long wakeups;                         /**< Poll wakeups of the timed event loop */
+    unsigned long overruns;                        /**< Phases that ended a whole phase or more late */
+    unsigned long last_pulses;                     /**< Edges counted by the last measurement */
+    int64_t last_elapsed_ns;                       /**< Window length of the last measurement */
+    int timer_fd;                                  /**< Phase timer, created on first use (-1: none) */
+    struct pollfd pfds[3];                         /**< Poll set: events, phase timer, shutdown */
+    int64_t timer_interval_ns;                     /**< Repeat interval the timer is armed with (0: none) */
+    int64_t phase_start_ns;                        /**< Scheduled start of the current phase */
+    int64_t phase_deadline_ns;                     /**< Scheduled end of the current phase */
+    int64_t phase_end_ns;                          /**< End of the last phase completed by the timer (0: none) */
+    struct capture *capture;                       /**< Raw edges are recorded here (NULL: off) */
+    const gpio_edge_t *replay;                     /**< Recorded edges read instead of the chip (NULL: live) */
+    size_t replay_count;                           /**< Number of recorded edges */
+    size_t replay_pos;                             /**< Next recorded edge to read */
 } gpio_context_t;
 
+/**
+ * Time unit conversions (all durations are carried in nanoseconds)
+ */
+#define NSEC_PER_SEC 1000000000LL
+#define NSEC_PER_MSEC 1000000LL
+#define NSEC_PER_USEC 1000LL
+
+/**
+ * Default and maximum number of edge events drained per read
+ */
+#define GPIO_EVENT_BATCH_DEFAULT 64
+#define GPIO_EVENT_BATCH_MAX 1024
+
+/**
+ * Maximum glitch filter (debounce) period
+ */
+#define GPIO_DEBOUNCE_MAX_NS (100 * NSEC_PER_MSEC)
+
 // Global variables (extern declarations)
 extern volatile sig_atomic_t stop;
 extern pthread_mutex_t print_mutex;
@@ -69,6 +151,43 @@ extern pthread_mutex_t print_mutex;
  */
 gpio_context_t* gpio_init(int gpio, const char *chipname);
 
+/**
+ * Initialize GPIO context for several GPIOs on the same chip
+ *
+ * The chip is opened once and gpio_request_events() requests all lines
+ * in a single line request. Events of all lines share one file
+ * descriptor; use gpio_edge_t.offset to tell them apart.
+ *
+ * @param gpios GPIO numbers to measure
+ * @param ngpio Number of GPIOs
+ * @param chipname GPIO chip name (NULL for auto-detect)
+ * @return gpio_context_t* Initialized context or NULL on error
+ *
+ * @note The returned context must be freed with gpio_cleanup()
+ */
+gpio_context_t* gpio_init_lines(const int *gpios, size_t ngpio, const char *chipname);
+
+/**
+ * Initialize a GPIO context reading recorded edges instead of a chip
+ *
+ * gpio_read_event() returns the recorded edges of the given lines and
+ * edge type in order, through the software glitch filter if debounce_ns
+ * is set; it returns 0 once all edges were read. No chip is opened.
+ *
+ * @param gpios GPIO numbers to replay
+ * @param ngpio Number of GPIOs
+ * @param edges Recorded edges sorted by timestamp (must outlive the context)
+ * @param count Number of recorded edges
+ * @param edge Edge detection type to replay
+ * @param event_batch Maximum edges returned per read (0 for default)
+ * @param debounce_ns Glitch filter period in nanoseconds (0 to disable)
+ * @return gpio_context_t* Initialized context or NULL on error
+ *
+ * @note The returned context must be freed with gpio_cleanup()
+ */
+gpio_context_t* gpio_init_replay(const int *gpios, size_t ngpio, const gpio_edge_t *edges, size_t count,
+                                 edge_type_t edge, size_t event_batch, int64_t debounce_ns);
+
 /**
  * Clean up GPIO context
  *
@@ -79,43 +198,140 @@ gpio_context_t* gpio_init(int gpio, const char *chipname);
 void gpio_cleanup(gpio_context_t *ctx);
 
 /**
- * Request edge events on GPIO line
+ * Request edge events on all GPIO lines of the context
  *
  * @param ctx GPIO context
  * @param consumer Consumer name for the request
  * @param edge Edge detection type
+ * @param event_batch Maximum edge events drained per read (0 for default)
+ * @param debounce_ns Glitch filter period in nanoseconds (0 to disable)
  * @return int 0 on success, -1 on error
+ *
+ * @note The period is requested as hardware debounce first. Lines whose
+ *       chip does not apply it are filtered in software on the kernel edge
+ *       timestamps by gpio_read_event() (ctx->debounce_ns is set then).
  */
-int gpio_request_events(gpio_context_t *ctx, const char *consumer, edge_type_t edge);
+int gpio_request_events(gpio_context_t *ctx, const char *consumer, edge_type_t edge, size_t event_batch,
+                        int64_t debounce_ns);
 
 /**
  * Wait for edge event with timeout
  *
+ * A shutdown request (stop_request()) ends the wait early.
+ *
  * @param ctx GPIO context
- * @param timeout_ns Timeout in nanoseconds
- * @return int 0 on timeout, 1 on event, -1 on error
+ * @param timeout_ns Timeout in nanoseconds (negative: no timeout)
+ * @return int 0 on timeout or shutdown, 1 on event, -1 on error
  */
 int gpio_wait_event(gpio_context_t *ctx, int64_t timeout_ns);
 
 /**
- * Read edge event
+ * Read pending edge events
+ *
+ * Drains up to ctx->event_batch events in a single call. The events are
+ * available in ctx->edges until the next read. With the software glitch
+ * filter active, an edge closer than ctx->debounce_ns to the last accepted
+ * edge of its line (or, for EDGE_BOTH, of the same type) is dropped.
+ * With ctx->capture set, all events are recorded before filtering.
+ * Every read updates the event counters of the context and its lines.
  *
  * @param ctx GPIO context
- * @return int Number of events read, 0 if none, -1 on error
+ * @return int Number of events kept, 0 if none, -1 on error
  */
 int gpio_read_event(gpio_context_t *ctx);
 
+/**
+ * Collect the counters of one line of the context
+ *
+ * @param ctx GPIO context
+ * @param line Index of the line in ctx->offsets
+ * @param counters Output (dropped is left 0, it is counted by the queue)
+ */
+void gpio_counters(const gpio_context_t *ctx, size_t line, rpm_counters_t *counters);
+
 /**
  * Measure RPM on a GPIO line
  *
  * @param ctx GPIO context
  * @param pulses_per_rev Pulses per revolution
- * @param duration Total measurement duration in seconds
- * @param warmup Warmup duration in seconds
+ * @param duration_ns Total measurement duration in nanoseconds
+ * @param warmup_ns Warmup duration in nanoseconds
+ * @param debug Enable debug output
+ * @return rpm_value_t RPM value, -1 if interrupted, 0 if no pulses
+ */
+rpm_value_t gpio_measure_rpm(gpio_context_t *ctx, int pulses_per_rev, int64_t duration_ns, int64_t warmup_ns,
+                             int debug);
+
+/**
+ * Measure RPM on a GPIO line from edge periods
+ *
+ * After the warmup phase, edge timestamps are captured until the tracker
+ * holds its capacity of periods or the measurement window ends, whichever
+ * comes first. The RPM is derived from the median period.
+ *
+ * @param ctx GPIO context
+ * @param tracker Period tracker (reset by this function)
+ * @param pulses_per_rev Pulses per revolution
+ * @param duration_ns Total measurement duration in nanoseconds (upper bound)
+ * @param warmup_ns Warmup duration in nanoseconds
+ * @param debug Enable debug output
+ * @return rpm_value_t RPM value, -1 if interrupted, 0 if no period captured
+ */
+rpm_value_t gpio_measure_rpm_period(gpio_context_t *ctx, period_tracker_t *tracker, int pulses_per_rev,
+                                    int64_t duration_ns, int64_t warmup_ns, int debug);
+
+/**
+ * Measure RPM on a GPIO line over an adaptive window
+ *
+ * After the warmup phase, edges are timed from the first edge until the
+ * tracker's target number of edge intervals is reached or the measurement
+ * window ends, whichever comes first. The RPM is derived from the whole
+ * periods timed.
+ *
+ * @param ctx GPIO context
+ * @param tracker Adaptive tracker (reset by this function)
+ * @param pulses_per_rev Pulses per revolution
+ * @param duration_ns Total measurement duration in nanoseconds (upper bound)
+ * @param warmup_ns Warmup duration in nanoseconds
+ * @param debug Enable debug output
+ * @return rpm_value_t RPM value, -1 if interrupted, 0 if no period timed
+ */
+rpm_value_t gpio_measure_rpm_adaptive(gpio_context_t *ctx, adaptive_tracker_t *tracker, int pulses_per_rev,
+                                      int64_t duration_ns, int64_t warmup_ns, int debug);
+
+/**
+ * Run the warmup phase only, discarding all edges
+ *
+ * @param ctx GPIO context
+ * @param warmup_ns Warmup duration in nanoseconds
+ * @param debug Enable debug output
+ * @return int 0 on success, -1 if interrupted or on error
+ */
+int gpio_warmup(gpio_context_t *ctx, int64_t warmup_ns, int debug);
+
+/**
+ * Count edges for one interval of a sliding window measurement
+ *
+ * Edges are counted into the window's current bucket for one interval,
+ * then the bucket is completed and the RPM over the whole window returned.
+ * The window must have been reset after warmup with sliding_reset().
+ *
+ * @param ctx GPIO context
+ * @param window Sliding window state
+ * @param pulses_per_rev Pulses per revolution
+ * @param interval_ns Bucket length in nanoseconds
  * @param debug Enable debug output
- * @return double RPM value, -1.0 if interrupted, 0.0 if no pulses
+ * @return rpm_value_t RPM value, -1 if interrupted
+ */
+rpm_value_t gpio_measure_rpm_sliding(gpio_context_t *ctx, sliding_window_t *window, int pulses_per_rev,
+                                     int64_t interval_ns, int debug);
+
+/**
+ * Get the current CLOCK_MONOTONIC time
+ *
+ * @return int64_t Monotonic time in nanoseconds (same clock as edge timestamps)
  */
-double gpio_measure_rpm(gpio_context_t *ctx, int pulses_per_rev, int duration, int warmup, int debug);
+int64_t gpio_monotonic_ns(void);
 
 /**
  * Thread function for GPIO measurement
@@ -30,19 +30,40 @@ typedef enum {
 typedef struct line_request {
     struct gpiod_line_request *request;
     int event_fd;
-    int gpio;
+    size_t num_lines;
 } line_request_t;
 
 /**
- * Request line for edge events
+ * Request lines for edge events
+ *
+ * All lines are requested with the same settings in a single request, so
+ * their edge events are delivered through one file descriptor and must be
+ * demultiplexed by line offset.
  *
  * @param chip GPIO chip
- * @param gpio GPIO line number
+ * @param offsets GPIO line offsets
+ * @param num_lines Number of offsets
  * @param consumer Consumer name
  * @param edge Edge detection type
+ * @param event_buffer_size Kernel edge event buffer size (0 for kernel default)
+ * @param debounce_us Hardware debounce period in microseconds (0 to disable)
  * @return line_request_t* Line request context or NULL on error
+ *
+ * @note Chips without debounce support accept the request but ignore the
+ *       period; read it back with line_debounce_us()
+ */
+line_request_t* line_request_events(struct gpiod_chip *chip, const unsigned int *offsets, size_t num_lines,
+                                    const char *consumer, edge_type_t edge, size_t event_buffer_size,
+                                    unsigned long debounce_us);
+
+/**
+ * Get the debounce period the kernel applies to a requested line
+ *
+ * @param chip GPIO chip
+ * @param offset GPIO line offset
+ * @return unsigned long Debounce period in microseconds (0 if none or on error)
  */
-line_request_t* line_request_events(struct gpiod_chip *chip, int gpio, const char *consumer, edge_type_t edge);
+unsigned long line_debounce_us(struct gpiod_chip *chip, unsigned int offset);
 
 #ifdef __cplusplus
 }
@@ -14,23 +14,46 @@
 #include "gpio.h"
 #include "format.h"
 #include "line.h"
+#include "queue.h"
+#include "snapshot.h"
+#include "capture.h"
+#include "sink.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct fan_config_list;  // Fans of a config file (config.h)
+
+/**
+ * Measurement engine type (ENGINE_EPOLL is default for zero-initialized structs)
+ */
+typedef enum {
+    ENGINE_EPOLL = 0,    /**< Single thread multiplexing all lines in one epoll set (default) */
+    ENGINE_THREADS       /**< One measurement thread per GPIO line */
+} engine_type_t;
+
+/**
+ * Watch mode publication (PUBLISH_TICK is default for zero-initialized structs)
+ */
+typedef enum {
+    PUBLISH_TICK = 0,    /**< Print all fans in order on a fixed wall-clock tick (default) */
+    PUBLISH_IMMEDIATE    /**< Print each fan's result as soon as it is measured */
+} publish_mode_t;
+
 /**
  * Measurement context for shared state between threads
  */
 typedef struct {
-    double *results;              /**< Array of measurement results */
-    int *finished;                /**< Array tracking thread completion */
+    rpm_value_t *results;         /**< Latest RPM per GPIO for output (owned by the caller) */
+    fan_snapshot_t *snapshots;    /**< Published state per GPIO (lock-free readers) */
     pthread_t *threads;           /**< Array of thread handles */
-    pthread_mutex_t results_mutex; /**< Mutex for results synchronization */
-    pthread_cond_t all_finished;  /**< Condition for all threads done */
     char *chipname;               /**< GPIO chip name */
     int chipname_allocated;       /**< Whether chipname was allocated by us */
     size_t ngpio;                 /**< Number of GPIOs */
+    rpm_queue_t *queues;          /**< Per-GPIO result queues (NULL: store in results) */
+    int notify_fd;                /**< eventfd signalled on every queued result (-1 if none) */
+    capture_t *capture;           /**< Raw edge capture (NULL: off) */
 } measurement_ctx_t;
 
 /**
@@ -38,14 +61,38 @@ typedef struct {
  */
 typedef struct {
     int *gpios;                   /**< Array of GPIO numbers */
+    char **gpio_names;            /**< Line name per GPIO (NULL: given by number) */
     size_t ngpio;                 /**< Number of GPIOs */
-    int duration;                 /**< Measurement duration */
+    int64_t duration_ns;          /**< Measurement duration in nanoseconds */
     int pulses;                   /**< Pulses per revolution */
-    int warmup;                   /**< Warmup duration */
+    int64_t warmup_ns;            /**< Warmup duration in nanoseconds */
     edge_type_t edge;             /**< Edge detection type */
+    size_t event_batch;           /**< Maximum edge events per read */
+    int64_t debounce_ns;          /**< Glitch filter period in nanoseconds (0 = off) */
+    rpm_method_t method;          /**< Measurement method */
+    size_t periods;               /**< Periods to capture for METHOD_PERIOD */
+    unsigned int target_pulses;   /**< Edge intervals per window for METHOD_ADAPTIVE */
+    int64_t window_ns;            /**< Sliding window length in nanoseconds (0 = duration - warmup) */
+    int64_t interval_ns;          /**< Sliding window report interval in nanoseconds */
     int debug;                    /**< Debug flag */
     int watch;                    /**< Watch mode flag */
     output_mode_t mode;           /**< Output mode */
+    engine_type_t engine;         /**< Measurement engine */
+    publish_mode_t publish;       /**< Watch mode publication */
+    const char *listen;           /**< Prometheus listen address (NULL: disabled) */
+    const char *daemon_socket;    /**< Daemon mode query socket (NULL: not a daemon) */
+    const char *query_socket;     /**< Socket of a daemon to query (NULL: measure) */
+    const char *capture_path;     /**< File recording the raw edges (NULL: off) */
+    const char *replay_path;      /**< Capture replayed instead of measuring (NULL: live) */
+    const char *config_path;      /**< Config file describing the fans (NULL: --gpio) */
+    const struct fan_config_list *config; /**< Fans loaded from config_path, in gpios order (NULL: none) */
+    int rt_priority;              /**< SCHED_FIFO priority of measurement threads (0: default) */
+    const char *cpu_list;         /**< CPUs for measurement threads (NULL: no pinning) */
+    int mlock;                    /**< Lock all memory before measuring */
+    int stall_rpm;                /**< Minimum expected RPM for stall detection (0: off) */
+    int stagger;                  /**< Spread the first windows of all fans over one round */
+    const char *outputs[SINK_MAX]; /**< Output specifications (none: stdout unless a daemon) */
+    size_t noutputs;              /**< Number of outputs */
 } measurement_params_t;
 
 /**
@@ -54,14 +101,51 @@ typedef struct {
  * @param ctx Context to initialize
  * @param gpios Array of GPIO numbers
  * @param ngpio Number of GPIOs
- * @param chipname GPIO chip name (NULL for auto-detect)
+ * @param chipname GPIO chip name (NULL: auto-detected per line request)
  * @return int 0 on success, -1 on error
  */
 int measurement_ctx_init(measurement_ctx_t *ctx, int *gpios, size_t ngpio, char *chipname);
 
+/**
+ * Publish results through per-GPIO SPSC queues instead of the results array
+ *
+ * Every measurement thread (or the engine) becomes the single producer
+ * of its GPIO's queue; the caller is the single consumer. Must be called
+ * before measurement_create_threads().
+ *
+ * @param ctx Initialized measurement context
+ * @param notify Create an eventfd signalled on every queued result
+ * @return int 0 on success, -1 on error
+ */
+int measurement_enable_queues(measurement_ctx_t *ctx, int notify);
+
+/**
+ * Publish a measurement result of one GPIO (called by its only writer)
+ *
+ * Updates the GPIO's snapshot, then queues the result and signals the
+ * consumer if a queue is given. Never blocks.
+ *
+ * @param snapshot Snapshot of the GPIO
+ * @param queue Result queue of the GPIO (NULL for none)
+ * @param notify_fd eventfd to signal (-1 for none)
+ * @param rpm Measured RPM
+ * @param pulses Edges counted for this result
+ * @param elapsed_ns Measurement window length in nanoseconds
+ * @param counters Measurement loop counters (dropped is filled in from the queue,
+ *                 stalled marks the result as stalled)
+ */
+void measurement_push(fan_snapshot_t *snapshot, rpm_queue_t *queue, int notify_fd, rpm_value_t rpm,
+                      unsigned long pulses, int64_t elapsed_ns, const rpm_counters_t *counters);
+
 /**
  * Create measurement threads for all GPIOs
  *
+ * With ENGINE_EPOLL a single engine thread is started for all lines
+ * (stored in threads[0]); if that fails the thread-per-GPIO path is
+ * used as a fallback. A replay always runs in the engine. With a capture
+ * path, the capture is opened here and closed by measurement_ctx_cleanup().
+ * Measurement threads are named and get the real-time options of params.
+ *
  * @param ctx Initialized measurement context
  * @param params Measurement parameters
  * @return int 0 on success, -1 on error
@@ -83,13 +167,52 @@ void measurement_join_threads(measurement_ctx_t *ctx);
 void measurement_ctx_cleanup(measurement_ctx_t *ctx);
 
 /**
- * Check if all threads have finished their current measurement
+ * Publish a measurement result via measurement_push()
  *
- * @param finished Array of finished flags
- * @param count Number of elements in array
- * @return int 1 if all done, 0 otherwise
+ * @param ctx Measurement context
+ * @param index GPIO index
+ * @param rpm Measured RPM
+ * @param pulses Edges counted for this result
+ * @param elapsed_ns Measurement window length in nanoseconds
+ * @param counters Measurement loop counters
+ */
+void measurement_publish(measurement_ctx_t *ctx, size_t index, rpm_value_t rpm, unsigned long pulses,
+                         int64_t elapsed_ns, const rpm_counters_t *counters);
+
+/**
+ * Copy the latest measurement loop counters of every GPIO
+ *
+ * @param ctx Measurement context
+ * @param counters Output, one entry per GPIO (zero without a result)
+ */
+void measurement_collect_counters(const measurement_ctx_t *ctx, rpm_counters_t *counters);
+
+/**
+ * Print the measurement loop counters of every GPIO to stderr (--debug)
+ *
+ * @param ctx Measurement context
+ * @param fans Fan of every GPIO
+ */
+void measurement_print_counters(const measurement_ctx_t *ctx, const format_fan_t *fans);
+
+/**
+ * Describe the fans of the measurement for the outputs
+ *
+ * @param params Measurement parameters (the config file's fans, or every --gpio)
+ * @param fans Output, one entry per slot
+ * @param nfans Number of slots (those without a fan get GPIO -1)
+ */
+void measurement_fans(const measurement_params_t *params, format_fan_t *fans, size_t nfans);
+
+/**
+ * Copy the latest published RPM of every GPIO into ctx->results
+ *
+ * GPIOs without a result (interrupted or failed) are set to -1, which
+ * the formatters skip.
+ *
+ * @param ctx Measurement context
  */
-int measurement_all_done(const int *finished, size_t count);
+void measurement_collect_results(measurement_ctx_t *ctx);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,98 @@
+/**
+ * This module implements a minimal Prometheus exporter serving the
+ * watch mode results on /metrics.
+ *
+ * The metrics page is rendered once per output round into the back half
+ * of a double buffer and then published; scrapes only send the current
+ * front buffer, without formatting or locking.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef PROMETHEUS_H
+#define PROMETHEUS_H
+
+#include <stddef.h>
+#include "queue.h"  // For rpm_sample_t
+#include "stats.h"
+#include "format.h"  // For format_fan_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Default listen port
+ */
+#define PROMETHEUS_DEFAULT_PORT 9101
+
+/**
+ * Opaque exporter state
+ */
+typedef struct prometheus prometheus_t;
+
+/**
+ * Validate a listen address
+ *
+ * @param address Address as [HOST]:PORT (e.g. ":9101", "127.0.0.1:9101")
+ * @return int 0 if valid, -1 otherwise
+ */
+int prometheus_parse_listen(const char *address);
+
+/**
+ * Bind the listen socket and start the server thread
+ *
+ * Samples are labeled with the GPIO and, for a named fan, its name (fan).
+ *
+ * @param address Address as [HOST]:PORT
+ * @param fans Fan of every GPIO, with the pulses per revolution exported
+ *             as info (must stay valid until prometheus_stop(), may be
+ *             changed by the thread that calls prometheus_publish())
+ * @param ngpio Number of GPIOs
+ * @return prometheus_t* Exporter or NULL on error
+ */
+prometheus_t* prometheus_start(const char *address, const format_fan_t *fans, size_t ngpio);
+
+/**
+ * Account a measurement result of one GPIO
+ *
+ * Must be called from the thread that calls prometheus_publish().
+ *
+ * @param prom Exporter
+ * @param index GPIO index
+ * @param sample Measurement result
+ */
+void prometheus_add_sample(prometheus_t *prom, size_t index, const rpm_sample_t *sample);
+
+/**
+ * Forget the result of one GPIO until its next one (its fan was replaced)
+ *
+ * Must be called from the thread that calls prometheus_publish().
+ *
+ * @param prom Exporter (NULL is ignored)
+ * @param index GPIO index
+ */
+void prometheus_remove(prometheus_t *prom, size_t index);
+
+/**
+ * Render the metrics page and make it visible to scrapers
+ *
+ * @param prom Exporter
+ * @param stats Per-GPIO statistics
+ * @param counters Per-GPIO measurement loop counters (NULL: exported as 0)
+ */
+void prometheus_publish(prometheus_t *prom, const rpm_summary_t *stats, const rpm_counters_t *counters);
+
+/**
+ * Stop the server thread and free the exporter
+ *
+ * @param prom Exporter (NULL is ignored)
+ */
+void prometheus_stop(prometheus_t *prom);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROMETHEUS_H
@@ -0,0 +1,91 @@
+/**
+ * This module implements the daemon mode query socket: a Unix stream
+ * socket answering with the latest results of a running watch loop, and
+ * the matching client for --query.
+ *
+ * The answers for every output format are rendered once per output round
+ * into the back half of a double buffer and then published; queries only
+ * copy the current front buffer to the socket, without measuring,
+ * formatting or locking.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "format.h"  // For output_mode_t, format_fan_t
+#include "stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Default socket path of --daemon and --query
+ */
+#define QUERY_DEFAULT_SOCKET "/run/gpio-fan-rpm.sock"
+
+/**
+ * Opaque query server state
+ */
+typedef struct query_server query_server_t;
+
+/**
+ * Validate a socket path
+ *
+ * @param path Socket path
+ * @return int 0 if valid, -1 otherwise (empty or too long for sun_path)
+ */
+int query_parse_path(const char *path);
+
+/**
+ * Bind the socket and start the server thread
+ *
+ * A stale socket left at path by a previous instance is replaced.
+ *
+ * @param path Socket path
+ * @param fans Fan of every GPIO (must stay valid until query_stop(), may be
+ *             changed by the thread that calls query_publish())
+ * @param ngpio Number of GPIOs
+ * @return query_server_t* Server or NULL on error
+ */
+query_server_t* query_start(const char *path, const format_fan_t *fans, size_t ngpio);
+
+/**
+ * Render the answers for the latest results and make them visible
+ *
+ * @param server Query server (NULL is ignored)
+ * @param results Latest RPM per GPIO (negative: no result yet)
+ * @param stats Per-GPIO statistics
+ * @param counters Per-GPIO measurement loop counters (NULL: left out)
+ * @param interval_ns Reporting interval (for collectd output)
+ */
+void query_publish(query_server_t *server, const rpm_value_t *results, const rpm_summary_t *stats,
+                   const rpm_counters_t *counters,
+                   int64_t interval_ns);
+
+/**
+ * Stop the server thread, remove the socket and free the server
+ *
+ * @param server Query server (NULL is ignored)
+ */
+void query_stop(query_server_t *server);
+
+/**
+ * Ask a running daemon for its latest results and print them to stdout
+ *
+ * @param path Socket path
+ * @param mode Output format to request
+ * @return int 0 on success, -1 on error
+ */
+int query_client(const char *path, output_mode_t mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // QUERY_H
@@ -0,0 +1,109 @@
+/**
+ * This module provides a lock-free single-producer/single-consumer queue
+ * used to hand per-fan measurement results to the output thread.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "rpmval.h"
+#include "cacheline.h"  // For RPM_CACHE_LINE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Queue capacity (power of two)
+ */
+#define RPM_QUEUE_CAPACITY 64
+
+/**
+ * Measurement result of one fan
+ */
+typedef struct {
+    rpm_value_t rpm;         /**< Measured RPM */
+    int64_t timestamp_ns;    /**< Monotonic time the result was published */
+    unsigned long pulses;    /**< Edges counted for this result */
+    int64_t elapsed_ns;      /**< Measurement window length */
+    int stalled;             /**< No edge within the stall timeout (--stall-rpm) */
+    unsigned int generation; /**< Fan of the slot the result belongs to (see snapshot_reset()) */
+} rpm_sample_t;
+
+/**
+ * Self-instrumentation of one fan's measurement loop (totals since start)
+ *
+ * reads, max_batch and wakeups belong to the line request and event loop
+ * the fan is measured in, so GPIOs sharing the epoll engine report the
+ * same values. stalled is not a total but the stall state of the result
+ * published with the counters.
+ */
+typedef struct {
+    unsigned long events;    /**< Edge events read for this line (before the glitch filter) */
+    unsigned long reads;     /**< Event reads that returned edges */
+    unsigned long max_batch; /**< Most edges returned by one read */
+    unsigned long wakeups;   /**< Event loop wakeups */
+    unsigned long lost;      /**< Edges the kernel dropped (line sequence number gaps) */
+    unsigned long overruns;  /**< Windows that ended a whole window or more late */
+    unsigned long dropped;   /**< Results dropped because the consumer fell behind */
+    unsigned long stalls;    /**< Stalls detected (--stall-rpm) */
+    int stalled;             /**< The fan was stalled when the result was published */
+} rpm_counters_t;
+
+/**
+ * SPSC ring of measurement results
+ *
+ * head is only written by the producer, tail only by the consumer. The
+ * queue must be allocated with RPM_CACHE_LINE alignment.
+ */
+typedef struct {
+    _Alignas(RPM_CACHE_LINE) atomic_size_t head;  /**< Next slot to write */
+    unsigned long dropped;                        /**< Results dropped on a full queue (producer) */
+    _Alignas(RPM_CACHE_LINE) atomic_size_t tail;  /**< Next slot to read */
+    rpm_sample_t slots[RPM_QUEUE_CAPACITY];       /**< Ring storage */
+} rpm_queue_t;
+
+/**
+ * Initialize an empty queue
+ *
+ * @param queue Queue to initialize
+ */
+void rpm_queue_init(rpm_queue_t *queue);
+
+/**
+ * Append a result (producer side)
+ *
+ * @param queue Queue
+ * @param sample Result to append
+ * @return int 0 on success, -1 if the queue is full (result dropped)
+ */
+int rpm_queue_push(rpm_queue_t *queue, const rpm_sample_t *sample);
+
+/**
+ * Check whether the next push would fail (producer side)
+ *
+ * @param queue Queue
+ * @return int 1 if the queue is full, 0 otherwise
+ */
+int rpm_queue_full(rpm_queue_t *queue);
+
+/**
+ * Remove the oldest result (consumer side)
+ *
+ * @param queue Queue
+ * @param sample Output result
+ * @return int 1 if a result was removed, 0 if the queue is empty
+ */
+int rpm_queue_pop(rpm_queue_t *queue, rpm_sample_t *sample);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // QUEUE_H
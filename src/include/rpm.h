@@ -0,0 +1,278 @@
+/**
+ * This module provides the RPM arithmetic shared by all measurement
+ * engines: pulse counting over a window, period (inter-edge interval)
+ * estimation from kernel edge timestamps, sliding-window counting and
+ * adaptive windows that end after a target number of edges.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef RPM_H
+#define RPM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "line.h"  // For edge_type_t
+#include "rpmval.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Measurement method (METHOD_COUNT is default for zero-initialized structs)
+ */
+typedef enum {
+    METHOD_COUNT = 0,    /**< Count edges over a fixed window (default) */
+    METHOD_PERIOD,       /**< Median inter-edge period from edge timestamps */
+    METHOD_SLIDING,      /**< Continuous counting over a sliding window of buckets */
+    METHOD_ADAPTIVE      /**< Per-line window ending after a target number of edges */
+} rpm_method_t;
+
+/**
+ * Default and maximum number of periods captured by METHOD_PERIOD
+ */
+#define RPM_PERIODS_DEFAULT 8
+#define RPM_PERIODS_MAX 1024
+
+/**
+ * Edge intervals at the minimum RPM without any edge before a line counts
+ * as stalled (a whole tach period with EDGE_BOTH at any duty cycle, plus
+ * margin for jitter)
+ */
+#define RPM_STALL_EDGES 3
+
+/**
+ * Highest minimum RPM accepted for stall detection
+ */
+#define RPM_STALL_MAX 100000
+
+/**
+ * Period tracker for METHOD_PERIOD
+ *
+ * With EDGE_BOTH a period spans two edges (e.g. rising to rising), so an
+ * uneven tach duty cycle does not skew the result.
+ */
+typedef struct {
+    uint64_t *periods;     /**< Captured periods in nanoseconds (caller-owned storage) */
+    size_t capacity;       /**< Number of periods to capture */
+    size_t count;          /**< Number of periods captured */
+    uint64_t history[2];   /**< Timestamps of the most recent edges */
+    size_t nhistory;       /**< Valid entries in history */
+    unsigned int stride;   /**< Edges per period (2 for EDGE_BOTH, else 1) */
+} period_tracker_t;
+
+/**
+ * Default and maximum edge count targeted by METHOD_ADAPTIVE
+ */
+#define RPM_TARGET_PULSES_DEFAULT 100
+#define RPM_TARGET_PULSES_MAX 1000000
+
+/**
+ * Edge interval tracker for METHOD_ADAPTIVE
+ *
+ * The window runs from the first edge to the edge completing the target
+ * number of intervals, so slow fans get long windows and fast fans finish
+ * early. Timing edges instead of a fixed gate removes the +-1 edge
+ * quantization of METHOD_COUNT; one missed or extra edge still moves the
+ * result by 1/target, which is the relative error the target stands for.
+ */
+typedef struct {
+    unsigned int target;     /**< Edge intervals to capture (multiple of stride) */
+    unsigned int stride;     /**< Edges per period (2 for EDGE_BOTH, else 1) */
+    unsigned int intervals;  /**< Edge intervals since the first edge */
+    unsigned int complete;   /**< Intervals up to the last whole period */
+    uint64_t first_ns;       /**< Timestamp of the first edge */
+    uint64_t last_ns;        /**< Timestamp of the edge completing the last whole period */
+    int started;             /**< Whether the first edge was seen */
+} adaptive_tracker_t;
+
+/**
+ * Sliding window of per-interval edge counts for METHOD_SLIDING
+ *
+ * Edges are counted into the current bucket; every interval the bucket is
+ * pushed into a ring of completed buckets and the RPM is calculated over
+ * all buckets in the ring.
+ */
+typedef struct {
+    unsigned int *counts;    /**< Edge count of each completed bucket (caller-owned) */
+    int64_t *starts;         /**< Start time of each completed bucket (caller-owned) */
+    size_t nbuckets;         /**< Ring capacity */
+    size_t head;             /**< Next ring slot to write */
+    size_t filled;           /**< Completed buckets in the ring */
+    unsigned long sum;       /**< Edge count over all completed buckets */
+    unsigned int current;    /**< Edge count of the bucket in progress */
+    int64_t current_start;   /**< Start time of the bucket in progress */
+} sliding_window_t;
+
+/**
+ * Calculate RPM from an edge count
+ *
+ * @param count Number of edges counted
+ * @param pulses_per_rev Edges per revolution
+ * @param elapsed_ns Window length in nanoseconds
+ * @return rpm_value_t RPM value, 0 if elapsed_ns is not positive
+ */
+rpm_value_t rpm_from_count(unsigned int count, int pulses_per_rev, int64_t elapsed_ns);
+
+/**
+ * Calculate the stall timeout for a minimum expected RPM
+ *
+ * @param min_rpm Lowest RPM the fan is expected to run at
+ * @param pulses_per_rev Edges per revolution
+ * @return int64_t Time without edges after which the fan counts as stalled
+ *                 in nanoseconds, 0 if min_rpm or pulses_per_rev is not positive
+ */
+int64_t rpm_stall_timeout_ns(int min_rpm, int pulses_per_rev);
+
+/**
+ * Calculate the phase offset of a fan whose windows are staggered
+ *
+ * The first windows of count fans are spread evenly over one round, so
+ * their results fall due one after another instead of all at once.
+ *
+ * @param round_ns Time between two results of the fan
+ * @param index Position of the fan (0 .. count - 1)
+ * @param count Number of fans sharing the round
+ * @return int64_t Delay of the fan's first window in nanoseconds, 0 for
+ *                 the first fan or if count is 0
+ */
+int64_t rpm_stagger_ns(int64_t round_ns, size_t index, size_t count);
+
+/**
+ * Initialize period tracker
+ *
+ * @param tracker Tracker to initialize
+ * @param storage Storage for at least capacity periods
+ * @param capacity Number of periods to capture
+ * @param edge Edge detection type of the line
+ */
+void period_init(period_tracker_t *tracker, uint64_t *storage, size_t capacity, edge_type_t edge);
+
+/**
+ * Discard captured periods and edge history
+ *
+ * @param tracker Period tracker
+ */
+void period_reset(period_tracker_t *tracker);
+
+/**
+ * Add an edge timestamp
+ *
+ * @param tracker Period tracker
+ * @param timestamp_ns Edge timestamp in nanoseconds
+ * @return int 1 if capacity periods have been captured, 0 otherwise
+ */
+int period_add(period_tracker_t *tracker, uint64_t timestamp_ns);
+
+/**
+ * Calculate RPM from the median captured period
+ *
+ * Sorts the captured periods in place.
+ *
+ * @param tracker Period tracker
+ * @param pulses_per_rev Edges per revolution
+ * @return rpm_value_t RPM value, 0 if no period was captured
+ */
+rpm_value_t period_rpm(period_tracker_t *tracker, int pulses_per_rev);
+
+/**
+ * Convert a relative error target to an edge count target
+ *
+ * @param rel_error Acceptable relative error (e.g., 0.01 for 1%)
+ * @return unsigned int Edge intervals needed (at least 2)
+ */
+unsigned int rpm_target_from_error(double rel_error);
+
+/**
+ * Initialize adaptive tracker
+ *
+ * @param tracker Tracker to initialize
+ * @param target Edge intervals to capture (rounded up to whole periods)
+ * @param edge Edge detection type of the line
+ */
+void adaptive_init(adaptive_tracker_t *tracker, unsigned int target, edge_type_t edge);
+
+/**
+ * Discard captured edges
+ *
+ * @param tracker Adaptive tracker
+ */
+void adaptive_reset(adaptive_tracker_t *tracker);
+
+/**
+ * Add an edge timestamp
+ *
+ * @param tracker Adaptive tracker
+ * @param timestamp_ns Edge timestamp in nanoseconds
+ * @return int 1 if the target has been reached, 0 otherwise
+ */
+int adaptive_add(adaptive_tracker_t *tracker, uint64_t timestamp_ns);
+
+/**
+ * Calculate RPM over the whole periods captured so far
+ *
+ * @param tracker Adaptive tracker
+ * @param pulses_per_rev Edges per revolution
+ * @return rpm_value_t RPM value, 0 if no whole period was captured
+ */
+rpm_value_t adaptive_rpm(const adaptive_tracker_t *tracker, int pulses_per_rev);
+
+/**
+ * Get the time span of the whole periods captured so far
+ *
+ * @param tracker Adaptive tracker
+ * @return int64_t Span in nanoseconds, 0 if no whole period was captured
+ */
+int64_t adaptive_span_ns(const adaptive_tracker_t *tracker);
+
+/**
+ * Initialize sliding window
+ *
+ * @param window Window to initialize
+ * @param counts Storage for nbuckets counts
+ * @param starts Storage for nbuckets start times
+ * @param nbuckets Number of buckets in the window
+ */
+void sliding_init(sliding_window_t *window, unsigned int *counts, int64_t *starts, size_t nbuckets);
+
+/**
+ * Discard all buckets and start a new bucket
+ *
+ * @param window Sliding window
+ * @param now_ns Current monotonic time in nanoseconds
+ */
+void sliding_reset(sliding_window_t *window, int64_t now_ns);
+
+/**
+ * Add edges to the bucket in progress
+ *
+ * @param window Sliding window
+ * @param count Number of edges
+ */
+void sliding_add(sliding_window_t *window, unsigned int count);
+
+/**
+ * Complete the bucket in progress and calculate RPM over the window
+ *
+ * @param window Sliding window
+ * @param now_ns Current monotonic time in nanoseconds
+ * @param pulses_per_rev Edges per revolution
+ * @return rpm_value_t RPM value over all completed buckets
+ */
+rpm_value_t sliding_rotate(sliding_window_t *window, int64_t now_ns, int pulses_per_rev);
+
+/**
+ * Get the time span covered by the completed buckets
+ *
+ * @param window Sliding window
+ * @return int64_t Span in nanoseconds, 0 if no bucket is completed
+ */
+int64_t sliding_span_ns(const sliding_window_t *window);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RPM_H
@@ -0,0 +1,70 @@
+/**
+ * This module defines the type RPM values are carried in from the
+ * measurement through the statistics to the formatters. By default it
+ * is a double; builds with -DRPM_FIXED_POINT=ON (for targets without an
+ * FPU, where double math is emulated) use integer milli-RPM instead, so
+ * the measurement path needs no floating point at all.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef RPMVAL_H
+#define RPMVAL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef RPM_FIXED_POINT
+/**
+ * RPM value in milli-RPM
+ */
+typedef int64_t rpm_value_t;
+
+/**
+ * Units of rpm_value_t per RPM
+ */
+#define RPM_SCALE 1000
+#else
+/**
+ * RPM value
+ */
+typedef double rpm_value_t;
+
+/**
+ * Units of rpm_value_t per RPM
+ */
+#define RPM_SCALE 1
+#endif
+
+/**
+ * Whole RPM as an rpm_value_t
+ */
+#define RPM_VALUE(rpm) ((rpm_value_t)(rpm) * RPM_SCALE)
+
+/**
+ * Round an RPM value to whole RPM (half away from zero)
+ *
+ * @param rpm RPM value
+ * @return long long Whole RPM
+ */
+long long rpm_round(rpm_value_t rpm);
+
+/**
+ * IEEE 754 binary64 bit pattern of an RPM value in RPM
+ *
+ * Fixed-point builds convert with integer arithmetic only.
+ *
+ * @param rpm RPM value
+ * @return uint64_t Bits of the double holding the RPM
+ */
+uint64_t rpm_f64_bits(rpm_value_t rpm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RPMVAL_H
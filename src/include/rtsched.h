@@ -0,0 +1,90 @@
+/**
+ * This module applies the real-time options to threads: SCHED_FIFO
+ * priority, CPU affinity from a CPU list, thread names for profiling and
+ * locking the process memory.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef RTSCHED_H
+#define RTSCHED_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Highest CPU number accepted in a CPU list
+ */
+#define RTSCHED_CPU_MAX 1023
+
+/**
+ * Most entries in a CPU list (CPUs may repeat, ranges count every CPU)
+ */
+#define RTSCHED_CPUS_MAX (RTSCHED_CPU_MAX + 1)
+
+/**
+ * Valid SCHED_FIFO priorities
+ */
+#define RTSCHED_PRIORITY_MIN 1
+#define RTSCHED_PRIORITY_MAX 99
+
+/**
+ * Thread stack size once memory is locked (every stack is locked in full)
+ */
+#define RTSCHED_STACK_SIZE (256 * 1024)
+
+/**
+ * Kernel limit for thread names (including the terminator)
+ */
+#define RTSCHED_NAME_MAX 16
+
+/**
+ * Parse a CPU list such as "3", "2,3" or "0,2-3"
+ *
+ * @param list CPU list
+ * @param cpus Output for the CPUs in list order (NULL: only validate)
+ * @param max Capacity of cpus
+ * @return int Number of CPUs in the list, -1 if it is invalid or has more
+ *             than RTSCHED_CPUS_MAX entries
+ */
+int rtsched_parse_cpus(const char *list, int *cpus, size_t max);
+
+/**
+ * Name a thread and apply the real-time options to it
+ *
+ * With an index the thread is pinned to the index-th CPU of the list
+ * (wrapping around), with a negative index to all CPUs of the list.
+ * Failures are reported as warnings; the thread keeps running with the
+ * default settings.
+ *
+ * @param thread Thread to configure
+ * @param name Thread name (truncated to RTSCHED_NAME_MAX - 1 characters)
+ * @param priority SCHED_FIFO priority (0: keep the default policy)
+ * @param cpu_list CPU list (NULL: no pinning)
+ * @param index Thread index for the CPU assignment
+ * @param debug Print the applied settings to stderr
+ */
+void rtsched_thread(pthread_t thread, const char *name, int priority, const char *cpu_list,
+                    long index, int debug);
+
+/**
+ * Lock all current and future memory of the process
+ *
+ * Also shrinks the default stack of threads created afterwards to
+ * RTSCHED_STACK_SIZE. Must be called before the measurement threads
+ * are created.
+ *
+ * @return int 0 on success, -1 on error
+ */
+int rtsched_lock_memory(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTSCHED_H
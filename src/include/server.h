@@ -0,0 +1,146 @@
+/**
+ * This module provides what the Prometheus exporter and the daemon query
+ * socket share: a double buffer of pre-rendered answers and a server
+ * thread accepting one client at a time.
+ *
+ * The publisher renders into the back buffer once no reader uses it any
+ * more and then swaps it to the front; readers register on the front
+ * buffer while sending from it, without locks. The server thread hands
+ * every accepted connection to a callback and exits on server_stop() or
+ * a stop request.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Send and receive timeout per client in seconds
+ */
+#define SERVER_IO_TIMEOUT_SEC 1
+
+/**
+ * Reader accounting of a double buffer (the buffers belong to the caller)
+ */
+typedef struct {
+    atomic_int current;     /**< Index of the front buffer */
+    atomic_int readers[2];  /**< Readers currently using each buffer */
+} server_buffers_t;
+
+/**
+ * Serve one accepted client
+ *
+ * @param arg Argument given to server_start()
+ * @param fd Connected socket (closed by the server thread afterwards)
+ */
+typedef void (*server_client_fn)(void *arg, int fd);
+
+/**
+ * Server thread state
+ */
+typedef struct {
+    int listen_fd;            /**< Listening socket (-1: none) */
+    int wake_fd;              /**< eventfd waking the thread to exit (-1: none) */
+    pthread_t thread;         /**< Server thread */
+    int thread_started;       /**< Whether thread must be joined */
+    atomic_int quit;          /**< Ask the server thread to exit */
+    server_client_fn serve;   /**< Client callback */
+    void *arg;                /**< Client callback argument */
+} server_t;
+
+/**
+ * Initialize a double buffer with buffer 0 in front and no readers
+ *
+ * @param buffers Reader accounting
+ */
+void server_buffers_init(server_buffers_t *buffers);
+
+/**
+ * Wait until no reader uses the back buffer (publisher side)
+ *
+ * @param buffers Reader accounting
+ * @return int Index of the back buffer, free to render into
+ */
+int server_buffers_back(server_buffers_t *buffers);
+
+/**
+ * Make the back buffer the front one (publisher side)
+ *
+ * @param buffers Reader accounting
+ * @param back Index returned by server_buffers_back()
+ */
+void server_buffers_publish(server_buffers_t *buffers, int back);
+
+/**
+ * Register as a reader of the front buffer
+ *
+ * @param buffers Reader accounting
+ * @return int Index of the buffer to read, until server_buffers_release()
+ */
+int server_buffers_acquire(server_buffers_t *buffers);
+
+/**
+ * Stop reading a buffer
+ *
+ * @param buffers Reader accounting
+ * @param index Index returned by server_buffers_acquire()
+ */
+void server_buffers_release(server_buffers_t *buffers, int index);
+
+/**
+ * Send a whole buffer on a socket (without SIGPIPE)
+ *
+ * @param fd Socket
+ * @param data Data
+ * @param len Data length
+ * @return int 0 on success, -1 on error
+ */
+int server_send_all(int fd, const char *data, size_t len);
+
+/**
+ * Prepare a server that owns no descriptors yet
+ *
+ * server_stop() is safe from here on, whether server_start() ran or not.
+ *
+ * @param server Server
+ */
+void server_init(server_t *server);
+
+/**
+ * Start the server thread
+ *
+ * Every client gets SERVER_IO_TIMEOUT_SEC send and receive timeouts
+ * before it is handed to serve.
+ *
+ * @param server Initialized server
+ * @param listen_fd Listening socket (owned by the server from now on,
+ *                  also on error)
+ * @param serve Client callback, called on the server thread
+ * @param arg Client callback argument
+ * @param name Thread name
+ * @return int 0 on success, -1 on error
+ */
+int server_start(server_t *server, int listen_fd, server_client_fn serve, void *arg, const char *name);
+
+/**
+ * Stop the server thread and close its descriptors
+ *
+ * @param server Server
+ */
+void server_stop(server_t *server);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVER_H
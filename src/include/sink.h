@@ -0,0 +1,166 @@
+/**
+ * This module fans the formatted results out to one or more outputs:
+ * stdout, files, UDP and Unix sockets (--output).
+ *
+ * Every output formats the rounds in its own format into a bounded ring
+ * and has a writer thread draining the ring, so a slow or unreachable
+ * consumer delays neither the measurement nor the other outputs. When a
+ * ring is full the oldest rounds are dropped.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef SINK_H
+#define SINK_H
+
+#include <stddef.h>
+#include "format.h"  // For output_mode_t and format_buffer_t
+#include "gpio.h"    // For NSEC_PER_SEC
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum number of --output options
+ */
+#define SINK_MAX 8
+
+/**
+ * Ring capacity of one output in bytes (formatted rounds waiting for the writer)
+ */
+#define SINK_RING_SIZE (256 * 1024)
+
+/**
+ * Size at which a batch of independent results is queued as a round of
+ * its own (keeps a replay's backlog from exceeding the ring)
+ */
+#define SINK_ROUND_MAX (16 * 1024)
+
+/**
+ * Largest datagram packed by UDP outputs (the 1500-byte Ethernet MTU
+ * minus IPv6 and UDP headers, also collectd's default packet size)
+ */
+#define SINK_DATAGRAM_MAX 1452
+
+/**
+ * Datagrams sent per sendmmsg() call
+ */
+#define SINK_UDP_BATCH 16
+
+/**
+ * Shortest time between two connection attempts to a Unix socket
+ */
+#define SINK_RETRY_NS NSEC_PER_SEC
+
+/**
+ * Output destination
+ */
+typedef enum {
+    SINK_STDOUT,  /**< Standard output ("stdout" or "-") */
+    SINK_FILE,    /**< File, appended to ("file:PATH") */
+    SINK_UDP,     /**< UDP datagrams of whole records ("udp:HOST:PORT") */
+    SINK_UNIX     /**< Unix stream or datagram socket ("unix:PATH") */
+} sink_kind_t;
+
+/**
+ * One output with its ring and writer thread
+ */
+typedef struct sink sink_t;
+
+/**
+ * The outputs of a measurement
+ */
+typedef struct {
+    sink_t *sinks[SINK_MAX];     /**< Open outputs */
+    size_t count;                /**< Number of outputs */
+} sink_list_t;
+
+/**
+ * Validate an output specification
+ *
+ * The specification is a destination optionally followed by a comma and
+ * a format name, e.g. "udp:10.0.0.5:8089,influx" or "file:/var/log/fans,json".
+ *
+ * @param spec Output specification
+ * @param mode Output for the format (left unchanged without a format, may be NULL)
+ * @return int 0 on success, -1 on error
+ */
+int sink_parse(const char *spec, output_mode_t *mode);
+
+/**
+ * Open an output and start its writer thread
+ *
+ * @param spec Output specification (see sink_parse())
+ * @param mode Format used unless the specification names one
+ * @param lossless Let sink_commit() wait for room instead of dropping rounds
+ * @param debug Print connection changes to stderr
+ * @return sink_t* Output or NULL on error
+ */
+sink_t* sink_open(const char *spec, output_mode_t mode, int lossless, int debug);
+
+/**
+ * Get the format of an output
+ *
+ * @param sink Output
+ * @return output_mode_t Format the rounds must be formatted in
+ */
+output_mode_t sink_mode(const sink_t *sink);
+
+/**
+ * Start formatting a round for an output
+ *
+ * @param sink Output
+ * @return format_buffer_t* Empty buffer for the round (owned by the output)
+ */
+format_buffer_t* sink_begin(sink_t *sink);
+
+/**
+ * Queue the round formatted since sink_begin() for the writer
+ *
+ * Never waits for the writer: if the ring is full, the oldest queued
+ * rounds are dropped to make room (lossless outputs wait instead).
+ * Empty rounds are not queued.
+ *
+ * @param sink Output
+ */
+void sink_commit(sink_t *sink);
+
+/**
+ * Write the queued rounds, stop the writer thread and close the output
+ *
+ * Dropped rounds are reported as a warning.
+ *
+ * @param sink Output (NULL is ignored)
+ * @return int 0 on success, -1 if rounds could not be written
+ */
+int sink_close(sink_t *sink);
+
+/**
+ * Open all outputs of a measurement
+ *
+ * @param list Output for the opened outputs
+ * @param specs Output specifications
+ * @param nspecs Number of specifications (at most SINK_MAX)
+ * @param mode Format of outputs whose specification names none
+ * @param lossless Wait for room instead of dropping rounds (replays)
+ * @param debug Print connection changes to stderr
+ * @return int 0 on success, -1 on error (nothing is left open)
+ */
+int sink_list_open(sink_list_t *list, const char *const *specs, size_t nspecs, output_mode_t mode,
+                   int lossless, int debug);
+
+/**
+ * Close all outputs of a measurement
+ *
+ * @param list Outputs (emptied)
+ * @return int 0 on success, -1 if any output could not be written
+ */
+int sink_list_close(sink_list_t *list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SINK_H
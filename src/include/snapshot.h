@@ -0,0 +1,113 @@
+/**
+ * This module provides a per-fan seqlock holding the latest measurement
+ * result and a summary of its running statistics.
+ *
+ * Every fan has exactly one writer (its measurement thread or the
+ * engine), which never waits for readers; any number of reader threads
+ * take consistent copies without locks and retry only if they raced
+ * with an update. The full statistics stay with the writer, only their
+ * summary is copied under the seqlock.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "cacheline.h"
+#include "queue.h"  // For rpm_sample_t
+#include "stats.h"
+#include "format.h"  // For format_fan_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Published state of one fan
+ */
+typedef struct {
+    rpm_sample_t sample;     /**< Latest measurement result */
+    rpm_summary_t summary;   /**< Statistics over all published results */
+    rpm_counters_t counters; /**< Measurement loop counters at the latest result */
+    format_fan_t fan;        /**< Fan set by snapshot_reset() (gpio -1: unused slot) */
+} fan_record_t;
+
+/**
+ * Record size in 64-bit words
+ */
+#define FAN_RECORD_WORDS ((sizeof(fan_record_t) + sizeof(uint64_t) - 1) / sizeof(uint64_t))
+
+/**
+ * Seqlock protected fan record
+ *
+ * seq is odd while an update is in progress. The record is stored as
+ * atomic words so readers racing with the writer are well defined. The
+ * writer's own state follows on separate cache lines, so its updates do
+ * not disturb readers. Must be allocated with RPM_CACHE_LINE alignment.
+ */
+typedef struct {
+    _Alignas(RPM_CACHE_LINE) atomic_uint seq;       /**< Update sequence number */
+    atomic_uint_least64_t words[FAN_RECORD_WORDS];  /**< fan_record_t storage */
+    _Alignas(RPM_CACHE_LINE) fan_record_t record;   /**< Writer's copy of the published record */
+    rpm_stats_t stats;                              /**< Statistics behind record.summary (writer only) */
+} fan_snapshot_t;
+
+/**
+ * Initialize a snapshot without a result
+ *
+ * @param snap Snapshot
+ */
+void snapshot_init(fan_snapshot_t *snap);
+
+/**
+ * Start over with another fan in the same slot (writer side)
+ *
+ * Drops the result and statistics, and marks the slot with a new
+ * generation so readers notice the change even before the first result
+ * (used when a config reload replaces or renames a fan).
+ *
+ * @param snap Snapshot
+ * @param fan The new fan (NULL: the slot is unused now)
+ * @param generation Generation of the new fan, stamped on all its results
+ */
+void snapshot_reset(fan_snapshot_t *snap, const format_fan_t *fan, unsigned int generation);
+
+/**
+ * Publish a result and fold it into the statistics (writer side)
+ *
+ * @param snap Snapshot
+ * @param sample Measurement result (its generation is ignored)
+ * @param counters Measurement loop counters (NULL: keep the previous ones)
+ * @return unsigned int Generation the result was published with
+ */
+unsigned int snapshot_publish(fan_snapshot_t *snap, const rpm_sample_t *sample, const rpm_counters_t *counters);
+
+/**
+ * Take a consistent copy (reader side, any thread)
+ *
+ * @param snap Snapshot
+ * @param record Output record
+ * @return int 1 if a result has been published, 0 otherwise
+ */
+int snapshot_read(const fan_snapshot_t *snap, fan_record_t *record);
+
+/**
+ * Get the update sequence number
+ *
+ * Changes with every snapshot_publish(); cheaper than snapshot_read() to
+ * find out whether a fan has a new result.
+ *
+ * @param snap Snapshot
+ * @return unsigned int Sequence number
+ */
+unsigned int snapshot_seq(const fan_snapshot_t *snap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SNAPSHOT_H
@@ -1,6 +1,9 @@
 /**
- * This module provides structures and functions for tracking
- * min/max/average RPM statistics in continuous monitoring mode.
+ * This module provides structures and functions for tracking RPM
+ * statistics in continuous monitoring mode: min/max/average since start,
+ * an exponentially weighted moving average, min/max over the last rounds
+ * and percentiles from a fixed-bin sketch. All estimators are updated in
+ * O(1) time and use constant memory.
  *
  * @author  CSoellinger
  * @license LGPL-3.0-or-later
@@ -9,20 +12,79 @@
 #ifndef STATS_H
 #define STATS_H
 
+#include <stdint.h>
+#include "rpmval.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 /**
- * RPM statistics structure for tracking min/max/average
+ * Measurements covered by the windowed min/max (and the EWMA span)
+ */
+#define STATS_WINDOW 16
+
+/**
+ * EWMA smoothing factor (span of STATS_WINDOW measurements) as a fraction
+ */
+#define STATS_EWMA_NUM 2
+#define STATS_EWMA_DEN (STATS_WINDOW + 1)
+
+/**
+ * Percentile sketch: logarithmic bins between STATS_SKETCH_MIN and
+ * STATS_SKETCH_MAX RPM (about 1.8% relative error), bin 0 collects
+ * everything below the range, including stopped fans
+ */
+#define STATS_SKETCH_BINS 256
+#define STATS_SKETCH_MIN 10
+#define STATS_SKETCH_MAX 100000
+
+/**
+ * Monotonic deque of the recent measurements that can still become the
+ * window minimum (or maximum)
  */
 typedef struct {
-    double min;           /**< Minimum RPM value observed */
-    double max;           /**< Maximum RPM value observed */
-    double sum;           /**< Sum of all RPM values (for average calculation) */
+    rpm_value_t value[STATS_WINDOW];     /**< Candidate values */
+    unsigned long seq[STATS_WINDOW];     /**< Measurement number of each candidate */
+    unsigned int head;                   /**< Index of the oldest candidate */
+    unsigned int len;                    /**< Number of candidates */
+} stats_deque_t;
+
+/**
+ * RPM statistics structure
+ */
+typedef struct {
+    rpm_value_t min;      /**< Minimum RPM value observed */
+    rpm_value_t max;      /**< Maximum RPM value observed */
+#ifdef RPM_FIXED_POINT
+    int64_t sum;          /**< Sum of all RPM values (exact in integers) */
+#else
+    double mean;          /**< Running average of all RPM values */
+#endif
+    rpm_value_t ewma;     /**< Exponentially weighted moving average */
     unsigned long count;  /**< Number of measurements */
+    stats_deque_t window_min;            /**< Minimum over the last STATS_WINDOW measurements */
+    stats_deque_t window_max;            /**< Maximum over the last STATS_WINDOW measurements */
+    uint32_t bins[STATS_SKETCH_BINS];    /**< Percentile sketch */
 } rpm_stats_t;
 
+/**
+ * Statistics derived from rpm_stats_t, small enough to copy with every
+ * result (all 0 if no measurements)
+ */
+typedef struct {
+    rpm_value_t min;         /**< Minimum RPM value observed */
+    rpm_value_t max;         /**< Maximum RPM value observed */
+    rpm_value_t avg;         /**< Average of all RPM values */
+    rpm_value_t ewma;        /**< Exponentially weighted moving average */
+    rpm_value_t window_min;  /**< Minimum over the last STATS_WINDOW measurements */
+    rpm_value_t window_max;  /**< Maximum over the last STATS_WINDOW measurements */
+    rpm_value_t p50;         /**< Estimated median */
+    rpm_value_t p95;         /**< Estimated 95th percentile */
+    rpm_value_t p99;         /**< Estimated 99th percentile */
+    unsigned long count;     /**< Number of measurements */
+} rpm_summary_t;
+
 /**
  * Initialize statistics structure
  *
@@ -36,15 +98,62 @@ void stats_init(rpm_stats_t *stats);
  * @param stats Pointer to statistics structure
  * @param rpm New RPM value to incorporate
  */
-void stats_update(rpm_stats_t *stats, double rpm);
+void stats_update(rpm_stats_t *stats, rpm_value_t rpm);
 
 /**
  * Calculate average RPM from statistics
  *
  * @param stats Pointer to statistics structure
- * @return double Average RPM, or 0.0 if no measurements
+ * @return rpm_value_t Average RPM, or 0 if no measurements
+ */
+rpm_value_t stats_avg(const rpm_stats_t *stats);
+
+/**
+ * Exponentially weighted moving average
+ *
+ * @param stats Pointer to statistics structure
+ * @return rpm_value_t EWMA, or 0 if no measurements
+ */
+rpm_value_t stats_ewma(const rpm_stats_t *stats);
+
+/**
+ * Minimum over the last STATS_WINDOW measurements
+ *
+ * @param stats Pointer to statistics structure
+ * @return rpm_value_t Window minimum, or 0 if no measurements
+ */
+rpm_value_t stats_window_min(const rpm_stats_t *stats);
+
+/**
+ * Maximum over the last STATS_WINDOW measurements
+ *
+ * @param stats Pointer to statistics structure
+ * @return rpm_value_t Window maximum, or 0 if no measurements
+ */
+rpm_value_t stats_window_max(const rpm_stats_t *stats);
+
+/**
+ * Estimate a percentile of all measurements from the sketch
+ *
+ * The estimate is the geometric center of the bin holding the requested
+ * rank, clamped to the observed min/max.
+ *
+ * @param stats Pointer to statistics structure
+ * @param permille Quantile in thousandths between 0 and 1000 (e.g. 950)
+ * @return rpm_value_t Estimated percentile, or 0 if no measurements
+ */
+rpm_value_t stats_percentile(const rpm_stats_t *stats, unsigned int permille);
+
+/**
+ * Derive the summary of the statistics
+ *
+ * Same values as the accessors above, with the three percentiles taken
+ * in one pass over the sketch.
+ *
+ * @param stats Pointer to statistics structure (NULL: no measurements)
+ * @param summary Output summary
  */
-double stats_avg(const rpm_stats_t *stats);
+void stats_summarize(const rpm_stats_t *stats, rpm_summary_t *summary);
 
 #ifdef __cplusplus
 }
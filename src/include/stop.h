@@ -0,0 +1,46 @@
+/**
+ * This module turns shutdown requests (SIGINT, SIGTERM, 'q' in watch mode)
+ * into an eventfd that every event loop polls next to its own
+ * descriptors, so no loop needs a timeout to notice the stop flag.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef STOP_H
+#define STOP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Create the shutdown eventfd and install the SIGINT/SIGTERM handlers
+ *
+ * Must be called before any measurement thread is started.
+ *
+ * @return int 0 on success, -1 on error
+ */
+int stop_init(void);
+
+/**
+ * Request a shutdown: set the global stop flag and wake all event loops
+ *
+ * Async-signal-safe. The eventfd is never read, so it stays readable and
+ * every loop polling it wakes up.
+ */
+void stop_request(void);
+
+/**
+ * Get the shutdown eventfd for a poll or epoll set
+ *
+ * @return int Descriptor readable once a shutdown was requested, -1 if
+ *             stop_init() was not called (loops then only see the flag)
+ */
+int stop_fd(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STOP_H
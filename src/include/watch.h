@@ -14,23 +14,16 @@ extern "C" {
 #endif
 
 #include "gpio.h"
+#include "measurement_common.h"
 
 /**
  * Run continuous monitoring mode for multiple GPIO pins
  *
- * @param gpios Array of GPIO numbers
- * @param ngpio Number of GPIOs
- * @param chipname GPIO chip name
- * @param duration Measurement duration
- * @param pulses Pulses per revolution
- * @param warmup Warmup duration
- * @param edge Edge detection type
- * @param debug Debug flag
- * @param mode Output mode
+ * @param params Measurement parameters (GPIOs, timing, output mode, engine)
+ * @param chipname GPIO chip name (NULL for auto-detect)
  * @return int 0 on success, -1 on error
  */
-int run_watch_mode(int *gpios, size_t ngpio, char *chipname,
-                   int duration, int pulses, int warmup, edge_type_t edge, int debug, output_mode_t mode);
+int run_watch_mode(const measurement_params_t *params, char *chipname);
 
 #ifdef __cplusplus
 }
@@ -10,13 +10,15 @@
 #include <string.h>
 #include "line.h"
 
-line_request_t* line_request_events(struct gpiod_chip *chip, int gpio, const char *consumer, edge_type_t edge) {
-    if (!chip || !consumer) return NULL;
+line_request_t* line_request_events(struct gpiod_chip *chip, const unsigned int *offsets, size_t num_lines,
+                                    const char *consumer, edge_type_t edge, size_t event_buffer_size,
+                                    unsigned long debounce_us) {
+    if (!chip || !offsets || num_lines == 0 || !consumer) return NULL;
 
     line_request_t *req = calloc(1, sizeof(*req));
     if (!req) return NULL;
 
-    req->gpio = gpio;
+    req->num_lines = num_lines;
 
     // Create request configuration
     struct gpiod_request_config *req_cfg = gpiod_request_config_new();
@@ -27,6 +29,11 @@ line_request_t* line_request_events(struct gpiod_chip *chip, int gpio, const cha
 
     gpiod_request_config_set_consumer(req_cfg, consumer);
 
+    // Size the kernel kfifo to hold at least one full read batch
+    if (event_buffer_size > 0) {
+        gpiod_request_config_set_event_buffer_size(req_cfg, event_buffer_size);
+    }
+
     // Create line configuration
     struct gpiod_line_config *line_cfg = gpiod_line_config_new();
     if (!line_cfg) {
@@ -61,11 +68,14 @@ line_request_t* line_request_events(struct gpiod_chip *chip, int gpio, const cha
 
     gpiod_line_settings_set_direction(settings, GPIOD_LINE_DIRECTION_INPUT);
     gpiod_line_settings_set_edge_detection(settings, gpiod_edge);
-    // Note: Clock setting is not needed for basic edge detection
-    
-    // Add line to configuration
-    unsigned int gpio_offset = (unsigned int)gpio;
-    if (gpiod_line_config_add_line_settings(line_cfg, &gpio_offset, 1, settings) < 0) {
+
+    // Let the kernel drop glitches before they reach the event buffer
+    if (debounce_us > 0) {
+        gpiod_line_settings_set_debounce_period_us(settings, debounce_us);
+    }
+
+    // Add all lines with the same settings (one request, one fd)
+    if (gpiod_line_config_add_line_settings(line_cfg, offsets, num_lines, settings) < 0) {
         gpiod_line_settings_free(settings);
         gpiod_line_config_free(line_cfg);
         gpiod_request_config_free(req_cfg);
@@ -93,3 +103,14 @@ line_request_t* line_request_events(struct gpiod_chip *chip, int gpio, const cha
 
     return req;
 }
+
+unsigned long line_debounce_us(struct gpiod_chip *chip, unsigned int offset) {
+    if (!chip) return 0;
+
+    struct gpiod_line_info *info = gpiod_chip_get_line_info(chip, offset);
+    if (!info) return 0;
+
+    unsigned long period = gpiod_line_info_get_debounce_period_us(info);
+    gpiod_line_info_free(info);
+    return period;
+}
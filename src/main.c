@@ -14,19 +14,89 @@
 #include "args.h"
 #include "watch.h"
 #include "measure.h"
+#include "query.h"
+#include "chipmap.h"
+#include "capture.h"
+#include "stop.h"
+#include "rtsched.h"
+#include "config.h"
 
 // Global variables
 volatile sig_atomic_t stop = 0;
 pthread_mutex_t print_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /**
- * Signal handler for graceful shutdown
- * 
- * @param sig Signal number
+ * Measure all lines recorded in the replayed capture
+ *
+ * @param params Parameters (gpios and ngpio are set)
+ * @return int 0 on success, -1 on error
  */
-static void signal_handler(int sig) {
-    (void)sig;
-    stop = 1;
+static int replay_gpios(measurement_params_t *params) {
+    capture_replay_t replay;
+    if (capture_load(params->replay_path, &replay) < 0) return -1;
+
+    params->gpios = calloc(MAX_GPIOS, sizeof(*params->gpios));
+    if (!params->gpios) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        capture_replay_free(&replay);
+        return -1;
+    }
+    params->ngpio = capture_offsets(&replay, params->gpios, MAX_GPIOS);
+    capture_replay_free(&replay);
+
+    if (params->ngpio == 0) {
+        fprintf(stderr, "Error: capture '%s' holds no edges\n", params->replay_path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Measure the fans described in the config file
+ *
+ * @param params Parameters (gpios, ngpio and config are set)
+ * @param list Storage for the fans
+ * @param chipname In: chip given by --chip or NULL, out: chip of the fans
+ *                 without chip= (caller must free)
+ * @return int 0 on success, -1 on error
+ */
+static int config_gpios(measurement_params_t *params, fan_config_list_t *list, char **chipname) {
+    if (params->ngpio > 0 || params->replay_path) {
+        fprintf(stderr, "\nError: --config cannot be combined with %s\n\n",
+                params->replay_path ? "--replay" : "--gpio");
+        return -1;
+    }
+
+    if (config_load(params->config_path, params, list) < 0) return -1;
+    if (list->count == 0) {
+        fprintf(stderr, "Error: config '%s' describes no fans\n", params->config_path);
+        return -1;
+    }
+
+    params->gpios = calloc(list->count, sizeof(*params->gpios));
+    if (!params->gpios) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        return -1;
+    }
+
+    int chipless[CONFIG_MAX_FANS];
+    size_t nchipless = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        params->gpios[i] = list->fans[i].offset;
+        if (list->fans[i].chip[0] == '\0') {
+            chipless[nchipless++] = list->fans[i].offset;
+        }
+    }
+    params->ngpio = list->count;
+    params->config = list;
+
+    // Fans without chip= share the chip given by --chip or discovered for them
+    if (nchipless > 0 && chipmap_resolve(NULL, chipless, nchipless, chipname, params->debug) < 0) {
+        return -1;
+    }
+    if (config_resolve_chips(list, *chipname, params->config_path) < 0) return -1;
+    if (params->capture_path && config_check_single_chip(list, params->config_path) < 0) return -1;
+    return 0;
 }
 
 /**
@@ -37,58 +107,131 @@ static void signal_handler(int sig) {
  * @return int Exit code
  */
 int main(int argc, char **argv) {
-    edge_type_t edge = EDGE_BOTH;
-    output_mode_t mode = MODE_DEFAULT;
-    size_t ngpio = 0;
+    measurement_params_t params = {
+        .gpios = NULL,
+        .gpio_names = NULL,
+        .ngpio = 0,
+        .duration_ns = 2 * NSEC_PER_SEC,
+        .pulses = 4,
+        .warmup_ns = 1 * NSEC_PER_SEC,
+        .edge = EDGE_BOTH,
+        .event_batch = GPIO_EVENT_BATCH_DEFAULT,
+        .debounce_ns = 0,
+        .method = METHOD_COUNT,
+        .periods = RPM_PERIODS_DEFAULT,
+        .target_pulses = RPM_TARGET_PULSES_DEFAULT,
+        .window_ns = 0,
+        .interval_ns = 1 * NSEC_PER_SEC,
+        .debug = 0,
+        .watch = 0,
+        .mode = MODE_DEFAULT,
+        .engine = ENGINE_EPOLL,
+        .publish = PUBLISH_TICK,
+        .listen = NULL,
+        .daemon_socket = NULL,
+        .query_socket = NULL,
+        .capture_path = NULL,
+        .replay_path = NULL,
+        .rt_priority = 0,
+        .cpu_list = NULL,
+        .mlock = 0,
+        .stall_rpm = 0,
+        .stagger = 0,
+        .noutputs = 0,
+        .config_path = NULL,
+        .config = NULL
+    };
+    fan_config_list_t config;
     char *chipname = NULL;
-    int duration = 2, pulses = 4, warmup = 1;
-    int debug = 0, watch = 0, exit_code = 0;
-    int *gpios = NULL;
+    int exit_code = 0;
 
     // Parse command-line arguments
-    int parse_result = parse_arguments(argc, argv, &gpios, &ngpio, &chipname,
-                                     &duration, &pulses, &warmup, &edge, &debug, &watch, &mode);
+    int parse_result = parse_arguments(argc, argv, &params, &chipname);
     if (parse_result != 0) {
-        free(gpios);
+        free_arguments(&params);
         if (chipname) free(chipname);
         return parse_result > 0 ? 0 : 1; // Help/version return 0, error return 1
     }
 
+    // Answer from a running daemon instead of measuring
+    if (params.query_socket) {
+        int query_result = query_client(params.query_socket, params.mode);
+        free_arguments(&params);
+        if (chipname) free(chipname);
+        return query_result == 0 ? 0 : 1;
+    }
+
+    if (params.config_path) {
+        if (config_gpios(&params, &config, &chipname) < 0) {
+            free_arguments(&params);
+            if (chipname) free(chipname);
+            return 1;
+        }
+    } else if (params.replay_path) {
+        // A replay needs no chip; line names cannot be resolved without one
+        for (size_t i = 0; params.gpio_names && i < params.ngpio; i++) {
+            if (params.gpio_names[i]) {
+                fprintf(stderr, "\nError: --replay needs GPIO numbers, got '%s'\n\n", params.gpio_names[i]);
+                free_arguments(&params);
+                if (chipname) free(chipname);
+                return 1;
+            }
+        }
+        if (params.ngpio == 0 && replay_gpios(&params) < 0) {
+            free_arguments(&params);
+            if (chipname) free(chipname);
+            return 1;
+        }
+    } else if (params.ngpio > 0) {
+        // Pick the chip and resolve line names (before duplicate checks)
+        if (chipmap_resolve(params.gpio_names, params.gpios, params.ngpio, &chipname, params.debug) < 0) {
+            free_arguments(&params);
+            if (chipname) free(chipname);
+            return 1;
+        }
+    }
+
     // Validate arguments
-    if (validate_arguments(gpios, ngpio, duration, warmup, argv[0]) != 0) {
-        free(gpios);
+    if (validate_arguments(&params, argv[0]) != 0) {
+        free_arguments(&params);
         if (chipname) free(chipname);
         return 1;
     }
     
-    // Set up signal handlers for graceful shutdown
-    if (signal(SIGINT, signal_handler) == SIG_ERR) {
-        fprintf(stderr, "Warning: failed to set up SIGINT handler\n");
+    // Set up signal handlers and the shutdown eventfd for graceful shutdown
+    if (stop_init() < 0) {
+        free_arguments(&params);
+        if (chipname) free(chipname);
+        return 1;
     }
-    if (signal(SIGTERM, signal_handler) == SIG_ERR) {
-        fprintf(stderr, "Warning: failed to set up SIGTERM handler\n");
+
+    // Lock memory before any measurement thread (and its stack) exists
+    if (params.mlock && rtsched_lock_memory() < 0) {
+        free_arguments(&params);
+        if (chipname) free(chipname);
+        return 1;
     }
     
     // Run appropriate measurement mode
     int measurement_result;
-    if (watch) {
+    if (params.watch) {
         // Continuous monitoring mode
-        measurement_result = run_watch_mode(gpios, ngpio, chipname, duration,
-                                          pulses, warmup, edge, debug, mode);
+        measurement_result = run_watch_mode(&params, chipname);
     } else {
         // Single measurement mode
-        measurement_result = run_single_measurement(gpios, ngpio, chipname, duration,
-                                                  pulses, warmup, edge, debug, mode);
+        measurement_result = run_single_measurement(&params, chipname);
     }
     
     // Cleanup
-    free(gpios);
+    free_arguments(&params);
     if (chipname) free(chipname);
     
     // Set appropriate exit code
-    if (measurement_result != 0) {
+    if (measurement_result == MEASURE_STALLED) {
+        exit_code = MEASURE_STALLED;
+    } else if (measurement_result != 0) {
         exit_code = 1;
-        if (!debug) {
+        if (!params.debug) {
             fprintf(stderr, "Error: measurement failed (use --debug for details)\n");
         }
     }
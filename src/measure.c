@@ -8,69 +8,101 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "measure.h"
 #include "measurement_common.h"
 #include "format.h"
+#include "sink.h"
 
-int run_single_measurement(int *gpios, size_t ngpio, char *chipname,
-                          int duration, int pulses, int warmup, edge_type_t edge, int debug, output_mode_t mode) {
+int run_single_measurement(const measurement_params_t *params, char *chipname) {
     measurement_ctx_t ctx;
+    int *gpios = params->gpios;
+    size_t ngpio = params->ngpio;
+    int64_t duration_ns = params->duration_ns;
 
-    if (debug) {
+    if (params->debug) {
         fprintf(stderr, "DEBUG: Starting measurement for %zu GPIOs\n", ngpio);
     }
 
-    // Initialize context (allocates arrays, mutex/cond, auto-detects chip)
+    // Initialize context (allocates arrays, mutex/cond)
     if (measurement_ctx_init(&ctx, gpios, ngpio, chipname) < 0) {
         return -1;
     }
 
-    // Set up parameters and create threads
-    measurement_params_t params = {
-        .gpios = gpios,
-        .ngpio = ngpio,
-        .duration = duration,
-        .pulses = pulses,
-        .warmup = warmup,
-        .edge = edge,
-        .debug = debug,
-        .watch = 0,  // Single measurement
-        .mode = mode
-    };
+    // Open the outputs first, an unusable one fails before measuring
+    sink_list_t outputs;
+    const char *const stdout_spec[] = { "stdout" };
+    const char *const *specs = params->noutputs > 0 ? params->outputs : stdout_spec;
+    size_t nspecs = params->noutputs > 0 ? params->noutputs : 1;
+    if (sink_list_open(&outputs, specs, nspecs, params->mode, 1, params->debug) < 0) {
+        measurement_ctx_cleanup(&ctx);
+        return -1;
+    }
+
+    // Create threads for a single measurement
+    measurement_params_t single = *params;
+    single.watch = 0;
 
-    if (measurement_create_threads(&ctx, &params) < 0) {
+    if (measurement_create_threads(&ctx, &single) < 0) {
+        sink_list_close(&outputs);
         measurement_ctx_cleanup(&ctx);
         return -1;
     }
 
     // Wait for all threads to finish
     measurement_join_threads(&ctx);
+    measurement_collect_results(&ctx);
 
-    // Output results in order
-    if (mode == MODE_JSON && ngpio > 1) {
-        // Output as JSON array
-        char *output = format_json_array(gpios, ctx.results, NULL, ngpio);
-        if (output) {
-            printf("%s", output);
-            free(output);
-        }
-    } else {
-        // Output individual results in order
-        for (size_t i = 0; i < ngpio; i++) {
-            // Skip interrupted measurements (negative values indicate interruption)
-            if (ctx.results[i] < 0.0) {
-                continue;
-            }
+    rpm_counters_t *counters = calloc(ngpio, sizeof(*counters));
+    format_fan_t *fans = calloc(ngpio, sizeof(*fans));
+    if (!counters || !fans) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        free(counters);
+        free(fans);
+        sink_list_close(&outputs);
+        measurement_ctx_cleanup(&ctx);
+        return -1;
+    }
+    measurement_collect_counters(&ctx, counters);
+    measurement_fans(params, fans, ngpio);
+
+    if (params->debug) {
+        measurement_print_counters(&ctx, fans);
+    }
+
+    // Output results in order, the whole round as one chunk per output
+    for (size_t s = 0; s < outputs.count; s++) {
+        sink_t *sink = outputs.sinks[s];
+        output_mode_t mode = sink_mode(sink);
+        format_buffer_t *out = sink_begin(sink);
 
-            char *output = format_output(gpios[i], ctx.results[i], NULL, mode, duration);
-            if (output) {
-                printf("%s", output);
-                free(output);
+        if (mode == MODE_JSON && ngpio > 1) {
+            // Output as JSON array
+            format_buffer_append_json_array(out, fans, ctx.results, NULL, counters, ngpio);
+        } else {
+            // Output individual results in order
+            for (size_t i = 0; i < ngpio; i++) {
+                // Skip interrupted measurements (negative values indicate interruption)
+                fan_record_t record;
+                if (ctx.results[i] < 0 || !snapshot_read(&ctx.snapshots[i], &record)) {
+                    continue;
+                }
+
+                format_buffer_append_sample(out, &fans[i], &record.sample, NULL, &counters[i], mode,
+                                            duration_ns);
             }
         }
+        sink_commit(sink);
+    }
+    sink_list_close(&outputs);
+
+    int ret = 0;
+    for (size_t i = 0; i < ngpio; i++) {
+        if (ctx.results[i] >= 0 && counters[i].stalled) ret = MEASURE_STALLED;
     }
-    fflush(stdout);
+    free(counters);
+    free(fans);
 
     measurement_ctx_cleanup(&ctx);
-    return 0;
+    return ret;
 }
@@ -10,8 +10,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include "measurement_common.h"
-#include "chip.h"
+#include "engine.h"
+#include "rtsched.h"
+#include "cacheline.h"
+#include "config.h"
 
 int measurement_ctx_init(measurement_ctx_t *ctx, int *gpios, size_t ngpio, char *chipname) {
     if (!ctx || !gpios || ngpio == 0) return -1;
@@ -19,55 +24,111 @@ int measurement_ctx_init(measurement_ctx_t *ctx, int *gpios, size_t ngpio, char
     // Zero-initialize context
     memset(ctx, 0, sizeof(*ctx));
     ctx->ngpio = ngpio;
+    ctx->notify_fd = -1;
 
-    // Allocate arrays
+    // Allocate arrays (one cache line aligned snapshot per GPIO)
     ctx->results = calloc(ngpio, sizeof(*ctx->results));
-    ctx->finished = calloc(ngpio, sizeof(*ctx->finished));
+    ctx->snapshots = rpm_aligned_calloc(ngpio, sizeof(*ctx->snapshots));
     ctx->threads = calloc(ngpio, sizeof(*ctx->threads));
 
-    if (!ctx->results || !ctx->finished || !ctx->threads) {
+    if (!ctx->results || !ctx->snapshots || !ctx->threads) {
         fprintf(stderr, "Error: memory allocation failed\n");
         measurement_ctx_cleanup(ctx);
         return -1;
     }
 
-    // Initialize synchronization primitives
-    if (pthread_mutex_init(&ctx->results_mutex, NULL) != 0) {
-        fprintf(stderr, "Error: mutex init failed\n");
-        measurement_ctx_cleanup(ctx);
-        return -1;
+    for (size_t i = 0; i < ngpio; i++) {
+        snapshot_init(&ctx->snapshots[i]);
     }
 
-    if (pthread_cond_init(&ctx->all_finished, NULL) != 0) {
-        fprintf(stderr, "Error: cond init failed\n");
-        pthread_mutex_destroy(&ctx->results_mutex);
-        measurement_ctx_cleanup(ctx);
+    // Without a chip (a replay, or a caller skipping chipmap_resolve())
+    // every line request auto-detects its own
+    ctx->chipname = chipname;
+    ctx->chipname_allocated = 0;
+
+    return 0;
+}
+
+int measurement_enable_queues(measurement_ctx_t *ctx, int notify) {
+    if (!ctx || ctx->ngpio == 0) return -1;
+
+    ctx->queues = rpm_aligned_calloc(ctx->ngpio, sizeof(*ctx->queues));
+    if (!ctx->queues) {
+        fprintf(stderr, "Error: memory allocation failed\n");
         return -1;
     }
+    for (size_t i = 0; i < ctx->ngpio; i++) {
+        rpm_queue_init(&ctx->queues[i]);
+    }
 
-    // Auto-detect chip if not specified
-    if (!chipname) {
-        if (chip_auto_detect_for_name(gpios[0], &ctx->chipname) < 0) {
-            fprintf(stderr, "Error: cannot auto-detect GPIO chip\n");
-            pthread_mutex_destroy(&ctx->results_mutex);
-            pthread_cond_destroy(&ctx->all_finished);
-            measurement_ctx_cleanup(ctx);
+    if (notify) {
+        ctx->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (ctx->notify_fd < 0) {
+            fprintf(stderr, "Error: cannot create eventfd: %s\n", strerror(errno));
+            free(ctx->queues);
+            ctx->queues = NULL;
             return -1;
         }
-        ctx->chipname_allocated = 1;
-    } else {
-        ctx->chipname = chipname;
-        ctx->chipname_allocated = 0;
     }
 
     return 0;
 }
 
+void measurement_push(fan_snapshot_t *snapshot, rpm_queue_t *queue, int notify_fd, rpm_value_t rpm,
+                      unsigned long pulses, int64_t elapsed_ns, const rpm_counters_t *counters) {
+    rpm_sample_t sample = {
+        .rpm = rpm,
+        .timestamp_ns = gpio_monotonic_ns(),
+        .pulses = pulses,
+        .elapsed_ns = elapsed_ns,
+        .stalled = counters && counters->stalled
+    };
+
+    rpm_counters_t published = {0};
+    if (counters) published = *counters;
+    published.dropped = queue ? queue->dropped : 0;
+    sample.generation = snapshot_publish(snapshot, &sample, &published);
+
+    if (!queue) return;
+    if (rpm_queue_push(queue, &sample) < 0) return;  // Consumer fell behind, result dropped
+
+    if (notify_fd >= 0) {
+        uint64_t one = 1;
+        ssize_t n = write(notify_fd, &one, sizeof(one));
+        (void)n;  // Counter overflow is impossible, EAGAIN only means already signalled
+    }
+}
+
 int measurement_create_threads(measurement_ctx_t *ctx, const measurement_params_t *params) {
     if (!ctx || !params) return -1;
 
+    if (params->capture_path) {
+        ctx->capture = capture_open(params->capture_path);
+        if (!ctx->capture) return -1;
+    }
+
+    if (params->replay_path) {
+        // Only the engine can run on the recorded timeline
+        return engine_start(ctx, params);
+    }
+
+    if (params->engine == ENGINE_EPOLL) {
+        if (engine_start(ctx, params) == 0) {
+            return 0;
+        }
+        if (params->config) {
+            // Threads know neither per-fan settings nor the config's slots
+            fprintf(stderr, "Error: cannot start epoll engine, --config requires it\n");
+            return -1;
+        }
+        fprintf(stderr, "Warning: cannot start epoll engine, using one thread per GPIO\n");
+        if (params->stall_rpm > 0) {
+            fprintf(stderr, "Warning: stall detection needs the epoll engine, --stall-rpm is ignored\n");
+        }
+    }
+
     for (size_t i = 0; i < ctx->ngpio; i++) {
-        thread_args_t *a = calloc(1, sizeof(*a));
+        thread_args_t *a = rpm_aligned_calloc(1, sizeof(*a));
         if (!a) {
             fprintf(stderr, "Error: memory allocation failed\n");
             continue;
@@ -75,19 +136,29 @@ int measurement_create_threads(measurement_ctx_t *ctx, const measurement_params_
 
         a->gpio = params->gpios[i];
         a->chipname = ctx->chipname;
-        a->duration = params->duration;
+        a->duration_ns = params->duration_ns;
         a->pulses = params->pulses;
-        a->warmup = params->warmup;
+        a->warmup_ns = params->warmup_ns;
         a->edge = params->edge;
+        a->event_batch = params->event_batch;
+        a->debounce_ns = params->debounce_ns;
+        a->method = params->method;
+        a->periods = params->periods;
+        a->target_pulses = params->target_pulses;
+        a->window_ns = params->window_ns;
+        a->interval_ns = params->interval_ns;
         a->debug = params->debug;
         a->watch = params->watch;
+        if (params->stagger) {
+            // One result per duration, or per interval for sliding windows
+            int64_t round_ns = params->method == METHOD_SLIDING ? params->interval_ns : params->duration_ns;
+            a->start_delay_ns = rpm_stagger_ns(round_ns, i, ctx->ngpio);
+        }
         a->mode = params->mode;
-        a->thread_index = i;
-        a->total_threads = ctx->ngpio;
-        a->results = ctx->results;
-        a->finished = ctx->finished;
-        a->results_mutex = &ctx->results_mutex;
-        a->all_finished = &ctx->all_finished;
+        a->snapshot = &ctx->snapshots[i];
+        a->queue = ctx->queues ? &ctx->queues[i] : NULL;
+        a->notify_fd = ctx->notify_fd;
+        a->capture = ctx->capture;
 
         int ret = pthread_create(&ctx->threads[i], NULL, gpio_thread_fn, a);
         if (ret) {
@@ -95,7 +166,12 @@ int measurement_create_threads(measurement_ctx_t *ctx, const measurement_params_
                     a->gpio, strerror(ret));
             free(a);
             ctx->threads[i] = 0;
+            continue;
         }
+
+        char name[RTSCHED_NAME_MAX];
+        snprintf(name, sizeof(name), "fan-gpio%d", params->gpios[i]);
+        rtsched_thread(ctx->threads[i], name, params->rt_priority, params->cpu_list, (long)i, params->debug);
     }
 
     return 0;
@@ -114,12 +190,16 @@ void measurement_join_threads(measurement_ctx_t *ctx) {
 void measurement_ctx_cleanup(measurement_ctx_t *ctx) {
     if (!ctx) return;
 
-    pthread_mutex_destroy(&ctx->results_mutex);
-    pthread_cond_destroy(&ctx->all_finished);
-
     free(ctx->threads);
     free(ctx->results);
-    free(ctx->finished);
+    free(ctx->snapshots);
+    free(ctx->queues);
+    if (ctx->notify_fd >= 0) {
+        close(ctx->notify_fd);
+    }
+    if (capture_close(ctx->capture) < 0) {
+        fprintf(stderr, "Error: capture is incomplete\n");
+    }
 
     if (ctx->chipname_allocated && ctx->chipname) {
         free(ctx->chipname);
@@ -129,13 +209,64 @@ void measurement_ctx_cleanup(measurement_ctx_t *ctx) {
     memset(ctx, 0, sizeof(*ctx));
 }
 
-int measurement_all_done(const int *finished, size_t count) {
-    if (!finished || count == 0) return 0;
+void measurement_publish(measurement_ctx_t *ctx, size_t index, rpm_value_t rpm, unsigned long pulses,
+                         int64_t elapsed_ns, const rpm_counters_t *counters) {
+    if (!ctx || index >= ctx->ngpio) return;
 
-    for (size_t i = 0; i < count; i++) {
-        if (!finished[i]) {
-            return 0;
+    measurement_push(&ctx->snapshots[index], ctx->queues ? &ctx->queues[index] : NULL, ctx->notify_fd,
+                     rpm, pulses, elapsed_ns, counters);
+}
+
+void measurement_collect_results(measurement_ctx_t *ctx) {
+    if (!ctx) return;
+
+    for (size_t i = 0; i < ctx->ngpio; i++) {
+        fan_record_t record;
+        ctx->results[i] = snapshot_read(&ctx->snapshots[i], &record) ? record.sample.rpm : -1;
+    }
+}
+
+void measurement_collect_counters(const measurement_ctx_t *ctx, rpm_counters_t *counters) {
+    if (!ctx || !counters) return;
+
+    for (size_t i = 0; i < ctx->ngpio; i++) {
+        fan_record_t record;
+        snapshot_read(&ctx->snapshots[i], &record);
+        counters[i] = record.counters;
+    }
+}
+
+void measurement_print_counters(const measurement_ctx_t *ctx, const format_fan_t *fans) {
+    if (!ctx || !fans) return;
+
+    for (size_t i = 0; i < ctx->ngpio; i++) {
+        fan_record_t record;
+        if (!snapshot_read(&ctx->snapshots[i], &record)) continue;
+
+        char label[FORMAT_LABEL_MAX];
+        format_label_into(label, sizeof(label), &fans[i]);
+        const rpm_counters_t *c = &record.counters;
+        fprintf(stderr, "%s: %lu events in %lu reads (%.1f per read, max %lu), %lu wakeups, "
+                "%lu lost, %lu overruns, %lu results dropped, %lu stalls\n",
+                label, c->events, c->reads, c->reads ? (double)c->events / (double)c->reads : 0.0,
+                c->max_batch, c->wakeups, c->lost, c->overruns, c->dropped, c->stalls);
+    }
+}
+
+void measurement_fans(const measurement_params_t *params, format_fan_t *fans, size_t nfans) {
+    if (!params || !fans) return;
+
+    for (size_t i = 0; i < nfans; i++) {
+        memset(&fans[i], 0, sizeof(fans[i]));
+        fans[i].gpio = -1;
+        if (params->config && i < params->config->count) {
+            const fan_config_t *fan = &params->config->fans[i];
+            fans[i].gpio = fan->offset;
+            fans[i].pulses = fan->pulses;
+            memcpy(fans[i].name, fan->name, sizeof(fans[i].name));
+        } else if (!params->config && i < params->ngpio) {
+            fans[i].gpio = params->gpios[i];
+            fans[i].pulses = params->pulses;
         }
     }
-    return 1;
 }
@@ -0,0 +1,484 @@
+/**
+ * This module implements a minimal Prometheus exporter serving the
+ * watch mode results on /metrics.
+ *
+ * The metrics page is rendered once per output round into the back half
+ * of a double buffer and then published; scrapes only send the current
+ * front buffer, without formatting or locking.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include "prometheus.h"
+#include "gpio.h"
+#include "format.h"
+#include "server.h"
+
+// Room reserved in front of the body for the HTTP response header
+#define PROM_HEADER_RESERVE 128
+#define PROM_PAGE_INITIAL 4096
+#define PROM_PAGE_MAX (1024 * 1024)
+#define PROM_REQUEST_MAX 1024
+
+#define PROM_STR(x) #x
+#define PROM_XSTR(x) PROM_STR(x)
+#define STATS_WINDOW_STR PROM_XSTR(STATS_WINDOW)
+
+// Sample values; fixed-point builds render millionths without floating point
+#ifdef RPM_FIXED_POINT
+typedef int64_t prom_value_t;
+#define PROM_VALUE_DIGITS 6
+#define PROM_VALUE_COUNT(n) ((int64_t)(n) * 1000000)
+#define PROM_VALUE_SECONDS(ns) ((int64_t)(ns) / 1000)
+#define PROM_VALUE_RPM(rpm) ((int64_t)(rpm) * (1000000 / RPM_SCALE))
+#else
+typedef double prom_value_t;
+#define PROM_VALUE_COUNT(n) ((double)(n))
+#define PROM_VALUE_SECONDS(ns) ((double)(ns) / 1e9)
+#define PROM_VALUE_RPM(rpm) (rpm)
+#endif
+#define PROM_VALUE_TEXT 32
+#define PROM_LABELS_TEXT (FORMAT_NAME_MAX + 32)
+
+static const char prom_not_found[] =
+    "HTTP/1.0 404 Not Found\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 10\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "Not Found\n";
+
+/**
+ * Pre-rendered HTTP response
+ */
+typedef struct {
+    char *data;              /**< Header reserve followed by the body */
+    size_t cap;              /**< Buffer capacity */
+    size_t start;            /**< Offset of the response (header start) */
+    size_t len;              /**< Response length from start */
+} prom_page_t;
+
+/**
+ * Per-GPIO metric rendered by render_family()
+ */
+typedef enum {
+    PROM_RPM,
+    PROM_RPM_MIN,
+    PROM_RPM_MAX,
+    PROM_RPM_AVG,
+    PROM_RPM_EWMA,
+    PROM_RPM_WINDOW_MIN,
+    PROM_RPM_WINDOW_MAX,
+    PROM_MEASUREMENTS,
+    PROM_PULSES,
+    PROM_WINDOW,
+    PROM_LATENCY,
+    PROM_EVENTS,
+    PROM_READS,
+    PROM_MAX_BATCH,
+    PROM_WAKEUPS,
+    PROM_LOST,
+    PROM_OVERRUNS,
+    PROM_DROPPED,
+    PROM_STALLED,
+    PROM_STALLS,
+    PROM_PULSES_PER_REV
+} prom_field_t;
+
+/**
+ * Latest result of one GPIO
+ */
+typedef struct {
+    rpm_sample_t last;       /**< Latest measurement result */
+    int valid;               /**< Whether last holds a result */
+} prom_gpio_t;
+
+struct prometheus {
+    server_t server;               /**< Server thread on the listening TCP socket */
+    const format_fan_t *labels;    /**< Fan of every GPIO */
+    size_t ngpio;                  /**< Number of GPIOs */
+    prom_gpio_t *fans;             /**< Per-GPIO state (publisher only) */
+    prom_page_t pages[2];          /**< Front and back page */
+    server_buffers_t buffers;      /**< Readers of the pages */
+    atomic_ulong scrapes;          /**< Scrapes served */
+};
+
+/**
+ * Split [HOST]:PORT into host (NULL for any) and port strings
+ *
+ * @return int 0 on success, -1 on error
+ */
+static int split_listen(const char *address, char *host, size_t host_size, char *port, size_t port_size) {
+    if (!address) return -1;
+
+    const char *colon = strrchr(address, ':');
+    if (!colon || colon[1] == '\0') return -1;
+
+    const char *h = address;
+    size_t hlen = (size_t)(colon - address);
+    // Strip brackets of IPv6 literals ("[::1]:9101")
+    if (hlen >= 2 && h[0] == '[' && h[hlen - 1] == ']') {
+        h++;
+        hlen -= 2;
+    }
+    if (hlen >= host_size || strlen(colon + 1) >= port_size) return -1;
+
+    memcpy(host, h, hlen);
+    host[hlen] = '\0';
+    strcpy(port, colon + 1);
+
+    char *endptr;
+    long val = strtol(port, &endptr, 10);
+    if (*endptr != '\0' || val < 1 || val > 65535) return -1;
+
+    return 0;
+}
+
+int prometheus_parse_listen(const char *address) {
+    char host[256];
+    char port[8];
+    return split_listen(address, host, sizeof(host), port, sizeof(port));
+}
+
+static int open_listen_socket(const char *address) {
+    char host[256];
+    char port[8];
+    if (split_listen(address, host, sizeof(host), port, sizeof(port)) < 0) {
+        fprintf(stderr, "Error: invalid listen address '%s'\n", address);
+        return -1;
+    }
+
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    struct addrinfo *res;
+    int gai = getaddrinfo(host[0] ? host : NULL, port, &hints, &res);
+    if (gai != 0) {
+        fprintf(stderr, "Error: cannot resolve listen address '%s': %s\n", address, gai_strerror(gai));
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 16) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot listen on '%s': %s\n", address, strerror(errno));
+    }
+    return fd;
+}
+
+/**
+ * Append formatted text to a page body, growing the page as needed
+ *
+ * Only called on the back page, which no scrape is reading.
+ */
+static int page_printf(prom_page_t *page, size_t *pos, const char *fmt, ...) {
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(page->data + *pos, page->cap - *pos, fmt, ap);
+        va_end(ap);
+        if (n < 0) return -1;
+        if ((size_t)n < page->cap - *pos) {
+            *pos += (size_t)n;
+            return 0;
+        }
+        if (page->cap >= PROM_PAGE_MAX) return -1;
+
+        char *data = realloc(page->data, page->cap * 2);
+        if (!data) return -1;
+        page->data = data;
+        page->cap *= 2;
+    }
+}
+
+/**
+ * Render a sample value into a PROM_VALUE_TEXT buffer
+ */
+static const char *value_text(char *text, prom_value_t value) {
+#ifdef RPM_FIXED_POINT
+    format_decimal_into(text, PROM_VALUE_TEXT, value, PROM_VALUE_DIGITS);
+#else
+    snprintf(text, PROM_VALUE_TEXT, "%.9g", value);
+#endif
+    return text;
+}
+
+/**
+ * Render the label set of a GPIO's samples (without braces)
+ */
+static const char *label_text(char *text, size_t size, const format_fan_t *fan) {
+    if (fan->name[0] != '\0') {
+        snprintf(text, size, "gpio=\"%d\",fan=\"%s\"", fan->gpio, fan->name);
+    } else {
+        snprintf(text, size, "gpio=\"%d\"", fan->gpio);
+    }
+    return text;
+}
+
+/**
+ * Append one metric family with a sample for every GPIO that has a result
+ */
+static void render_family(prometheus_t *prom, prom_page_t *page, size_t *pos, const rpm_summary_t *stats,
+                          const rpm_counters_t *counters, const char *name, const char *type,
+                          const char *help, prom_field_t field) {
+    page_printf(page, pos, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+
+    int64_t now = gpio_monotonic_ns();
+    for (size_t i = 0; i < prom->ngpio; i++) {
+        const prom_gpio_t *fan = &prom->fans[i];
+        if (!fan->valid) continue;
+
+        rpm_value_t last = fan->last.rpm;
+        prom_value_t value;
+        switch (field) {
+            case PROM_RPM: value = PROM_VALUE_RPM(fan->last.rpm); break;
+            case PROM_RPM_MIN: value = PROM_VALUE_RPM(stats ? stats[i].min : last); break;
+            case PROM_RPM_MAX: value = PROM_VALUE_RPM(stats ? stats[i].max : last); break;
+            case PROM_RPM_AVG: value = PROM_VALUE_RPM(stats ? stats[i].avg : last); break;
+            case PROM_RPM_EWMA: value = PROM_VALUE_RPM(stats ? stats[i].ewma : last); break;
+            case PROM_RPM_WINDOW_MIN: value = PROM_VALUE_RPM(stats ? stats[i].window_min : last); break;
+            case PROM_RPM_WINDOW_MAX: value = PROM_VALUE_RPM(stats ? stats[i].window_max : last); break;
+            case PROM_MEASUREMENTS: value = PROM_VALUE_COUNT(stats ? stats[i].count : 0); break;
+            case PROM_PULSES: value = PROM_VALUE_COUNT(fan->last.pulses); break;
+            case PROM_WINDOW: value = PROM_VALUE_SECONDS(fan->last.elapsed_ns); break;
+            case PROM_EVENTS: value = PROM_VALUE_COUNT(counters ? counters[i].events : 0); break;
+            case PROM_READS: value = PROM_VALUE_COUNT(counters ? counters[i].reads : 0); break;
+            case PROM_MAX_BATCH: value = PROM_VALUE_COUNT(counters ? counters[i].max_batch : 0); break;
+            case PROM_WAKEUPS: value = PROM_VALUE_COUNT(counters ? counters[i].wakeups : 0); break;
+            case PROM_LOST: value = PROM_VALUE_COUNT(counters ? counters[i].lost : 0); break;
+            case PROM_OVERRUNS: value = PROM_VALUE_COUNT(counters ? counters[i].overruns : 0); break;
+            case PROM_DROPPED: value = PROM_VALUE_COUNT(counters ? counters[i].dropped : 0); break;
+            case PROM_STALLED: value = PROM_VALUE_COUNT(counters && counters[i].stalled); break;
+            case PROM_STALLS: value = PROM_VALUE_COUNT(counters ? counters[i].stalls : 0); break;
+            case PROM_PULSES_PER_REV: value = PROM_VALUE_COUNT(prom->labels[i].pulses); break;
+            case PROM_LATENCY:
+            default: value = PROM_VALUE_SECONDS(now - fan->last.timestamp_ns); break;
+        }
+        char labels[PROM_LABELS_TEXT], text[PROM_VALUE_TEXT];
+        page_printf(page, pos, "%s{%s} %s\n", name, label_text(labels, sizeof(labels), &prom->labels[i]),
+                    value_text(text, value));
+    }
+}
+
+/**
+ * Append the percentile estimates with one sample per GPIO and quantile
+ */
+static void render_quantiles(prometheus_t *prom, prom_page_t *page, size_t *pos, const rpm_summary_t *stats) {
+    static const unsigned int quantiles[] = {500, 950, 990};  // Thousandths, as in rpm_summary_t
+    const char *name = "gpio_fan_rpm_quantile";
+
+    page_printf(page, pos, "# HELP %s %s\n# TYPE %s gauge\n", name,
+                "Estimated fan speed percentiles since start.", name);
+
+    for (size_t i = 0; i < prom->ngpio; i++) {
+        const prom_gpio_t *fan = &prom->fans[i];
+        if (!fan->valid) continue;
+
+        rpm_value_t estimates[] = {fan->last.rpm, fan->last.rpm, fan->last.rpm};
+        if (stats) {
+            estimates[0] = stats[i].p50;
+            estimates[1] = stats[i].p95;
+            estimates[2] = stats[i].p99;
+        }
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+            rpm_value_t rpm = estimates[q];
+            char labels[PROM_LABELS_TEXT], quantile[PROM_VALUE_TEXT], text[PROM_VALUE_TEXT];
+            format_decimal_into(quantile, sizeof(quantile), quantiles[q], 3);
+            page_printf(page, pos, "%s{%s,quantile=\"%s\"} %s\n", name,
+                        label_text(labels, sizeof(labels), &prom->labels[i]), quantile,
+                        value_text(text, PROM_VALUE_RPM(rpm)));
+        }
+    }
+}
+
+void prometheus_publish(prometheus_t *prom, const rpm_summary_t *stats, const rpm_counters_t *counters) {
+    if (!prom) return;
+
+    // Wait for scrapes that still send the previous back page
+    int back = server_buffers_back(&prom->buffers);
+    prom_page_t *page = &prom->pages[back];
+
+    size_t pos = PROM_HEADER_RESERVE;
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_rpm", "gauge",
+                  "Fan speed of the latest measurement in revolutions per minute.", PROM_RPM);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_rpm_min", "gauge",
+                  "Lowest fan speed since start.", PROM_RPM_MIN);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_rpm_max", "gauge",
+                  "Highest fan speed since start.", PROM_RPM_MAX);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_rpm_avg", "gauge",
+                  "Average fan speed since start.", PROM_RPM_AVG);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_rpm_ewma", "gauge",
+                  "Exponentially weighted moving average of the fan speed.", PROM_RPM_EWMA);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_rpm_window_min", "gauge",
+                  "Lowest fan speed of the last " STATS_WINDOW_STR " measurements.", PROM_RPM_WINDOW_MIN);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_rpm_window_max", "gauge",
+                  "Highest fan speed of the last " STATS_WINDOW_STR " measurements.", PROM_RPM_WINDOW_MAX);
+    render_quantiles(prom, page, &pos, stats);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_measurements_total", "counter",
+                  "Completed measurements.", PROM_MEASUREMENTS);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_pulses", "gauge",
+                  "Tachometer edges counted in the window of the latest measurement.", PROM_PULSES);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_measurement_window_seconds", "gauge",
+                  "Window length of the latest measurement.", PROM_WINDOW);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_measurement_latency_seconds", "gauge",
+                  "Time from the end of the latest measurement to this page.", PROM_LATENCY);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_events_total", "counter",
+                  "Edge events read from the kernel.", PROM_EVENTS);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_event_reads_total", "counter",
+                  "Event reads that returned edges (shared by lines of one request).", PROM_READS);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_event_batch_max", "gauge",
+                  "Most edges returned by one read.", PROM_MAX_BATCH);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_wakeups_total", "counter",
+                  "Wakeups of the measuring event loop.", PROM_WAKEUPS);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_events_lost_total", "counter",
+                  "Edges dropped by the kernel event buffer (sequence number gaps).", PROM_LOST);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_window_overruns_total", "counter",
+                  "Measurement windows processed a whole window or more late.", PROM_OVERRUNS);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_results_dropped_total", "counter",
+                  "Results dropped because the output fell behind.", PROM_DROPPED);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_stalled", "gauge",
+                  "1 while no edge arrived within the stall timeout (--stall-rpm).", PROM_STALLED);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_stalls_total", "counter",
+                  "Stalls detected (--stall-rpm).", PROM_STALLS);
+    render_family(prom, page, &pos, stats, counters, "gpio_fan_pulses_per_revolution", "gauge",
+                  "Configured tachometer pulses per revolution.", PROM_PULSES_PER_REV);
+    page_printf(page, &pos,
+                "# HELP gpio_fan_scrapes_total Scrapes served by this exporter.\n"
+                "# TYPE gpio_fan_scrapes_total counter\n"
+                "gpio_fan_scrapes_total %lu\n",
+                atomic_load(&prom->scrapes));
+
+    // Place the header directly in front of the body
+    size_t body_len = pos - PROM_HEADER_RESERVE;
+    char header[PROM_HEADER_RESERVE];
+    int hlen = snprintf(header, sizeof(header),
+                        "HTTP/1.0 200 OK\r\n"
+                        "Content-Type: text/plain; version=0.0.4\r\n"
+                        "Content-Length: %zu\r\n"
+                        "Connection: close\r\n"
+                        "\r\n", body_len);
+    if (hlen < 0 || (size_t)hlen >= sizeof(header)) return;
+
+    page->start = PROM_HEADER_RESERVE - (size_t)hlen;
+    memcpy(page->data + page->start, header, (size_t)hlen);
+    page->len = (size_t)hlen + body_len;
+
+    server_buffers_publish(&prom->buffers, back);
+}
+
+void prometheus_add_sample(prometheus_t *prom, size_t index, const rpm_sample_t *sample) {
+    if (!prom || !sample || index >= prom->ngpio) return;
+
+    prom->fans[index].last = *sample;
+    prom->fans[index].valid = 1;
+}
+
+void prometheus_remove(prometheus_t *prom, size_t index) {
+    if (!prom || index >= prom->ngpio) return;
+
+    prom->fans[index].valid = 0;
+}
+
+static void serve_client(void *arg, int fd) {
+    prometheus_t *prom = arg;
+
+    // Read until the end of the request header (the body is ignored)
+    char req[PROM_REQUEST_MAX];
+    size_t len = 0;
+    while (len < sizeof(req) - 1) {
+        ssize_t n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += (size_t)n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+    }
+    req[len] = '\0';
+
+    const char *path = "GET /metrics";
+    size_t plen = strlen(path);
+    if (len > plen && strncmp(req, path, plen) == 0 && (req[plen] == ' ' || req[plen] == '?')) {
+        int i = server_buffers_acquire(&prom->buffers);
+        server_send_all(fd, prom->pages[i].data + prom->pages[i].start, prom->pages[i].len);
+        server_buffers_release(&prom->buffers, i);
+        atomic_fetch_add(&prom->scrapes, 1);
+    } else {
+        server_send_all(fd, prom_not_found, sizeof(prom_not_found) - 1);
+    }
+}
+
+prometheus_t* prometheus_start(const char *address, const format_fan_t *fans, size_t ngpio) {
+    if (!address || !fans || ngpio == 0) return NULL;
+
+    prometheus_t *prom = calloc(1, sizeof(*prom));
+    if (!prom) return NULL;
+
+    server_init(&prom->server);
+    prom->labels = fans;
+    prom->ngpio = ngpio;
+    server_buffers_init(&prom->buffers);
+    atomic_init(&prom->scrapes, 0);
+
+    prom->fans = calloc(ngpio, sizeof(*prom->fans));
+    for (int i = 0; i < 2; i++) {
+        prom->pages[i].data = malloc(PROM_PAGE_INITIAL);
+        prom->pages[i].cap = PROM_PAGE_INITIAL;
+    }
+    if (!prom->fans || !prom->pages[0].data || !prom->pages[1].data) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        prometheus_stop(prom);
+        return NULL;
+    }
+
+    int listen_fd = open_listen_socket(address);
+    if (listen_fd < 0) {
+        prometheus_stop(prom);
+        return NULL;
+    }
+
+    // Serve a page without results until the first round completes
+    prometheus_publish(prom, NULL, NULL);
+
+    if (server_start(&prom->server, listen_fd, serve_client, prom, "fan-metrics") < 0) {
+        prometheus_stop(prom);
+        return NULL;
+    }
+
+    return prom;
+}
+
+void prometheus_stop(prometheus_t *prom) {
+    if (!prom) return;
+
+    server_stop(&prom->server);
+
+    free(prom->pages[0].data);
+    free(prom->pages[1].data);
+    free(prom->fans);
+    free(prom);
+}
@@ -0,0 +1,261 @@
+/**
+ * This module implements the daemon mode query socket: a Unix stream
+ * socket answering with the latest results of a running watch loop, and
+ * the matching client for --query.
+ *
+ * The answers for every output format are rendered once per output round
+ * into the back half of a double buffer and then published; queries only
+ * copy the current front buffer to the socket, without measuring,
+ * formatting or locking.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "query.h"
+#include "server.h"
+
+#define QUERY_MODES 4
+#define QUERY_BUFFER_PER_GPIO 256
+#define QUERY_REQUEST_MAX 64
+
+static const char query_bad_request[] = "error: unknown request (use default, numeric, json or collectd)\n";
+
+/**
+ * Request names, indexed by output_mode_t
+ */
+static const char *const query_mode_names[QUERY_MODES] = {
+    "default", "numeric", "json", "collectd"
+};
+
+/**
+ * Pre-rendered answers of one output round
+ */
+typedef struct {
+    format_buffer_t answers[QUERY_MODES];  /**< One answer per output_mode_t */
+} query_snapshot_t;
+
+struct query_server {
+    server_t server;               /**< Server thread on the listening Unix socket */
+    char *path;                    /**< Socket path (unlinked on stop) */
+    const format_fan_t *fans;      /**< Fan of every GPIO */
+    size_t ngpio;                  /**< Number of GPIOs */
+    query_snapshot_t snapshots[2]; /**< Front and back snapshot */
+    server_buffers_t buffers;      /**< Readers of the snapshots */
+};
+
+int query_parse_path(const char *path) {
+    struct sockaddr_un addr;
+    if (!path || *path == '\0' || strlen(path) >= sizeof(addr.sun_path)) return -1;
+    return 0;
+}
+
+static int open_query_socket(const char *path) {
+    if (query_parse_path(path) < 0) {
+        fprintf(stderr, "Error: invalid socket path '%s'\n", path ? path : "");
+        return -1;
+    }
+
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot create socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // Replace a socket left behind by a previous instance (never other files)
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        fprintf(stderr, "Error: cannot listen on '%s': %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void query_publish(query_server_t *server, const rpm_value_t *results, const rpm_summary_t *stats,
+                   const rpm_counters_t *counters, int64_t interval_ns) {
+    if (!server || !results) return;
+
+    // Wait for queries that still send the previous back snapshot
+    int back = server_buffers_back(&server->buffers);
+    query_snapshot_t *snap = &server->snapshots[back];
+
+    for (int m = 0; m < QUERY_MODES; m++) {
+        format_buffer_t *out = &snap->answers[m];
+        output_mode_t mode = (output_mode_t)m;
+
+        format_buffer_reset(out);
+        if (mode == MODE_JSON && server->ngpio > 1) {
+            format_buffer_append_json_array(out, server->fans, results, stats, counters, server->ngpio);
+        } else {
+            for (size_t i = 0; i < server->ngpio; i++) {
+                if (results[i] < 0) continue;
+                format_buffer_append_output(out, &server->fans[i], results[i], stats ? &stats[i] : NULL,
+                                            counters ? &counters[i] : NULL, mode, interval_ns);
+            }
+        }
+    }
+
+    server_buffers_publish(&server->buffers, back);
+}
+
+static void serve_client(void *arg, int fd) {
+    query_server_t *server = arg;
+
+    // The request is a format name terminated by a newline or end of input
+    char req[QUERY_REQUEST_MAX];
+    size_t len = 0;
+    while (len < sizeof(req) - 1) {
+        ssize_t n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += (size_t)n;
+        if (memchr(req, '\n', len)) break;
+    }
+    req[len] = '\0';
+    req[strcspn(req, "\r\n")] = '\0';
+
+    int mode = -1;
+    if (req[0] == '\0') {
+        mode = MODE_DEFAULT;
+    } else {
+        for (int m = 0; m < QUERY_MODES; m++) {
+            if (strcmp(req, query_mode_names[m]) == 0) mode = m;
+        }
+    }
+    if (mode < 0) {
+        server_send_all(fd, query_bad_request, sizeof(query_bad_request) - 1);
+        return;
+    }
+
+    int i = server_buffers_acquire(&server->buffers);
+    const format_buffer_t *answer = &server->snapshots[i].answers[mode];
+    server_send_all(fd, answer->data, answer->len);
+    server_buffers_release(&server->buffers, i);
+}
+
+query_server_t* query_start(const char *path, const format_fan_t *fans, size_t ngpio) {
+    if (!path || !fans || ngpio == 0) return NULL;
+
+    query_server_t *server = calloc(1, sizeof(*server));
+    if (!server) return NULL;
+
+    server_init(&server->server);
+    server->fans = fans;
+    server->ngpio = ngpio;
+    server_buffers_init(&server->buffers);
+
+    int failed = 0;
+    for (int s = 0; s < 2; s++) {
+        for (int m = 0; m < QUERY_MODES; m++) {
+            if (format_buffer_init(&server->snapshots[s].answers[m], QUERY_BUFFER_PER_GPIO * ngpio) < 0) {
+                failed = 1;
+            }
+        }
+    }
+    server->path = strdup(path);
+    if (failed || !server->path) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        query_stop(server);
+        return NULL;
+    }
+
+    int listen_fd = open_query_socket(path);
+    if (listen_fd < 0) {
+        free(server->path);
+        server->path = NULL;  // Not ours to unlink
+        query_stop(server);
+        return NULL;
+    }
+
+    if (server_start(&server->server, listen_fd, serve_client, server, "fan-query") < 0) {
+        query_stop(server);
+        return NULL;
+    }
+
+    return server;
+}
+
+void query_stop(query_server_t *server) {
+    if (!server) return;
+
+    server_stop(&server->server);
+    if (server->path) {
+        unlink(server->path);
+        free(server->path);
+    }
+
+    for (int s = 0; s < 2; s++) {
+        for (int m = 0; m < QUERY_MODES; m++) {
+            format_buffer_free(&server->snapshots[s].answers[m]);
+        }
+    }
+    free(server);
+}
+
+int query_client(const char *path, output_mode_t mode) {
+    if (query_parse_path(path) < 0) return -1;
+    if ((int)mode < 0 || (int)mode >= QUERY_MODES) {
+        fprintf(stderr, "Error: the daemon only answers default, numeric, json or collectd queries\n");
+        return -1;
+    }
+
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot create socket: %s\n", strerror(errno));
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "Error: cannot connect to daemon at '%s': %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    char req[QUERY_REQUEST_MAX];
+    int len = snprintf(req, sizeof(req), "%s\n", query_mode_names[mode]);
+    if (server_send_all(fd, req, (size_t)len) < 0) {
+        fprintf(stderr, "Error: cannot send query: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    char buf[4096];
+    for (;;) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            fprintf(stderr, "Error: cannot read answer: %s\n", strerror(errno));
+            close(fd);
+            return -1;
+        }
+        if (n == 0) break;
+        if (fwrite(buf, 1, (size_t)n, stdout) != (size_t)n) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    close(fd);
+    return 0;
+}
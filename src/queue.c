@@ -0,0 +1,56 @@
+/**
+ * This module provides a lock-free single-producer/single-consumer queue
+ * used to hand per-fan measurement results to the output thread.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "queue.h"
+
+void rpm_queue_init(rpm_queue_t *queue) {
+    if (!queue) return;
+
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    queue->dropped = 0;
+}
+
+int rpm_queue_push(rpm_queue_t *queue, const rpm_sample_t *sample) {
+    if (!queue || !sample) return -1;
+
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head - tail >= RPM_QUEUE_CAPACITY) {
+        queue->dropped++;
+        return -1;
+    }
+
+    queue->slots[head & (RPM_QUEUE_CAPACITY - 1)] = *sample;
+    // Publish the slot before the new head becomes visible
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return 0;
+}
+
+int rpm_queue_full(rpm_queue_t *queue) {
+    if (!queue) return 0;
+
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    return head - tail >= RPM_QUEUE_CAPACITY;
+}
+
+int rpm_queue_pop(rpm_queue_t *queue, rpm_sample_t *sample) {
+    if (!queue || !sample) return 0;
+
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail == head) return 0;
+
+    *sample = queue->slots[tail & (RPM_QUEUE_CAPACITY - 1)];
+    // Release the slot to the producer only after it has been copied
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return 1;
+}
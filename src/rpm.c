@@ -0,0 +1,297 @@
+/**
+ * This module provides the RPM arithmetic shared by all measurement
+ * engines: pulse counting over a window, period (inter-edge interval)
+ * estimation from kernel edge timestamps, sliding-window counting and
+ * adaptive windows that end after a target number of edges.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rpm.h"
+
+#define RPM_NSEC_PER_MIN 60000000000ULL
+
+/**
+ * RPM of a number of edges over a time span
+ *
+ * The fixed-point build divides in three decimal steps, so neither the
+ * product nor the remainder overflows for any realistic window.
+ *
+ * @param edges Number of edges
+ * @param span_ns Time the edges took in nanoseconds
+ * @param pulses_per_rev Edges per revolution
+ * @return rpm_value_t RPM value, 0 if the span is empty
+ */
+static rpm_value_t rpm_rate(uint64_t edges, uint64_t span_ns, int pulses_per_rev) {
+    if (span_ns == 0 || pulses_per_rev <= 0) return 0;
+
+#ifdef RPM_FIXED_POINT
+    // edges * 60 * RPM_SCALE * 1e9 / (span_ns * pulses_per_rev), rounded
+    uint64_t divisor = span_ns * (uint64_t)pulses_per_rev;
+    uint64_t dividend = edges * 60 * RPM_SCALE;
+    uint64_t quotient = dividend / divisor;
+    uint64_t remainder = dividend % divisor;
+    for (int i = 0; i < 3; i++) {
+        quotient = quotient * 1000 + remainder * 1000 / divisor;
+        remainder = remainder * 1000 % divisor;
+    }
+    if (remainder * 2 >= divisor) quotient++;
+    return (rpm_value_t)quotient;
+#else
+    // Equivalent to: frequency(Hz) * 60 / pulses_per_rev
+    return (double)RPM_NSEC_PER_MIN * (double)edges / ((double)span_ns * pulses_per_rev);
+#endif
+}
+
+rpm_value_t rpm_from_count(unsigned int count, int pulses_per_rev, int64_t elapsed_ns) {
+    if (elapsed_ns <= 0) return 0;
+    return rpm_rate(count, (uint64_t)elapsed_ns, pulses_per_rev);
+}
+
+long long rpm_round(rpm_value_t rpm) {
+#ifdef RPM_FIXED_POINT
+    if (rpm < 0) return -((-rpm + RPM_SCALE / 2) / RPM_SCALE);
+    return (rpm + RPM_SCALE / 2) / RPM_SCALE;
+#else
+    return llround(rpm);
+#endif
+}
+
+uint64_t rpm_f64_bits(rpm_value_t rpm) {
+#ifdef RPM_FIXED_POINT
+    if (rpm == 0) return 0;
+
+    uint64_t sign = rpm < 0 ? 1ULL << 63 : 0;
+    uint64_t milli = rpm < 0 ? (uint64_t)-rpm : (uint64_t)rpm;
+
+    // Long division by RPM_SCALE until the quotient holds 53 bits plus a
+    // rounding bit: value = mantissa * 2^exponent, sticky for the rest
+    uint64_t mantissa = milli / RPM_SCALE;
+    uint64_t remainder = milli % RPM_SCALE;
+    int exponent = 0;
+    int sticky = 0;
+    while (mantissa >= 1ULL << 54) {
+        sticky |= (int)(mantissa & 1);
+        mantissa >>= 1;
+        exponent++;
+    }
+    while (mantissa < 1ULL << 53) {
+        remainder *= 2;
+        mantissa *= 2;
+        if (remainder >= RPM_SCALE) {
+            remainder -= RPM_SCALE;
+            mantissa |= 1;
+        }
+        exponent--;
+    }
+    sticky |= remainder != 0;
+
+    // Round to nearest, ties to even
+    int round = (int)(mantissa & 1);
+    mantissa >>= 1;
+    exponent++;
+    if (round && (sticky || (mantissa & 1))) mantissa++;
+    if (mantissa == 1ULL << 53) {
+        mantissa >>= 1;
+        exponent++;
+    }
+
+    return sign | (uint64_t)(exponent + 52 + 1023) << 52 | (mantissa & ((1ULL << 52) - 1));
+#else
+    uint64_t bits;
+    memcpy(&bits, &rpm, sizeof(bits));
+    return bits;
+#endif
+}
+
+int64_t rpm_stall_timeout_ns(int min_rpm, int pulses_per_rev) {
+    if (min_rpm <= 0 || pulses_per_rev <= 0) return 0;
+
+    // One edge is due every 60 / (RPM * pulses) seconds
+    return RPM_STALL_EDGES * (int64_t)RPM_NSEC_PER_MIN / ((int64_t)min_rpm * pulses_per_rev);
+}
+
+int64_t rpm_stagger_ns(int64_t round_ns, size_t index, size_t count) {
+    if (round_ns <= 0 || count == 0 || index >= count) return 0;
+
+    // Rounds are at most an hour and fans at most 64, the product fits
+    return round_ns * (int64_t)index / (int64_t)count;
+}
+
+void period_init(period_tracker_t *tracker, uint64_t *storage, size_t capacity, edge_type_t edge) {
+    if (!tracker) return;
+
+    tracker->periods = storage;
+    tracker->capacity = capacity;
+    tracker->stride = (edge == EDGE_BOTH) ? 2 : 1;
+    period_reset(tracker);
+}
+
+void period_reset(period_tracker_t *tracker) {
+    if (!tracker) return;
+
+    tracker->count = 0;
+    tracker->nhistory = 0;
+}
+
+int period_add(period_tracker_t *tracker, uint64_t timestamp_ns) {
+    if (!tracker || !tracker->periods) return 0;
+    if (tracker->count >= tracker->capacity) return 1;
+
+    if (tracker->nhistory == tracker->stride) {
+        uint64_t oldest = tracker->history[0];
+        if (timestamp_ns > oldest) {
+            tracker->periods[tracker->count++] = timestamp_ns - oldest;
+        }
+        // Shift history window
+        if (tracker->stride == 2) {
+            tracker->history[0] = tracker->history[1];
+        }
+        tracker->history[tracker->stride - 1] = timestamp_ns;
+    } else {
+        tracker->history[tracker->nhistory++] = timestamp_ns;
+    }
+
+    return tracker->count >= tracker->capacity;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+rpm_value_t period_rpm(period_tracker_t *tracker, int pulses_per_rev) {
+    if (!tracker || tracker->count == 0 || pulses_per_rev <= 0) return 0;
+
+    qsort(tracker->periods, tracker->count, sizeof(*tracker->periods), compare_u64);
+
+    // Twice the median, so an even count needs no halving
+    uint64_t median2;
+    size_t mid = tracker->count / 2;
+    if (tracker->count % 2) {
+        median2 = tracker->periods[mid] * 2;
+    } else {
+        median2 = tracker->periods[mid - 1] + tracker->periods[mid];
+    }
+
+    // One period covers 'stride' edges; a revolution covers pulses_per_rev edges
+    return rpm_rate(2 * tracker->stride, median2, pulses_per_rev);
+}
+
+unsigned int rpm_target_from_error(double rel_error) {
+    if (!(rel_error > 0.0)) return RPM_TARGET_PULSES_MAX;
+
+    double target = ceil(1.0 / rel_error);
+    if (target < 2.0) return 2;
+    if (target > RPM_TARGET_PULSES_MAX) return RPM_TARGET_PULSES_MAX;
+    return (unsigned int)target;
+}
+
+void adaptive_init(adaptive_tracker_t *tracker, unsigned int target, edge_type_t edge) {
+    if (!tracker) return;
+
+    tracker->stride = (edge == EDGE_BOTH) ? 2 : 1;
+    if (target < tracker->stride) target = tracker->stride;
+    // Whole periods only, so an uneven tach duty cycle does not skew the result
+    tracker->target = (target + tracker->stride - 1) / tracker->stride * tracker->stride;
+    adaptive_reset(tracker);
+}
+
+void adaptive_reset(adaptive_tracker_t *tracker) {
+    if (!tracker) return;
+
+    tracker->intervals = 0;
+    tracker->complete = 0;
+    tracker->first_ns = 0;
+    tracker->last_ns = 0;
+    tracker->started = 0;
+}
+
+int adaptive_add(adaptive_tracker_t *tracker, uint64_t timestamp_ns) {
+    if (!tracker) return 0;
+    if (tracker->complete >= tracker->target) return 1;
+
+    if (!tracker->started) {
+        tracker->first_ns = timestamp_ns;
+        tracker->started = 1;
+        return 0;
+    }
+
+    tracker->intervals++;
+    if (tracker->intervals % tracker->stride == 0 && timestamp_ns > tracker->first_ns) {
+        tracker->complete = tracker->intervals;
+        tracker->last_ns = timestamp_ns;
+    }
+
+    return tracker->complete >= tracker->target;
+}
+
+rpm_value_t adaptive_rpm(const adaptive_tracker_t *tracker, int pulses_per_rev) {
+    if (!tracker || tracker->complete == 0) return 0;
+
+    return rpm_from_count(tracker->complete, pulses_per_rev, adaptive_span_ns(tracker));
+}
+
+int64_t adaptive_span_ns(const adaptive_tracker_t *tracker) {
+    if (!tracker || tracker->complete == 0) return 0;
+    return (int64_t)(tracker->last_ns - tracker->first_ns);
+}
+
+void sliding_init(sliding_window_t *window, unsigned int *counts, int64_t *starts, size_t nbuckets) {
+    if (!window) return;
+
+    window->counts = counts;
+    window->starts = starts;
+    window->nbuckets = nbuckets;
+    sliding_reset(window, 0);
+}
+
+void sliding_reset(sliding_window_t *window, int64_t now_ns) {
+    if (!window) return;
+
+    window->head = 0;
+    window->filled = 0;
+    window->sum = 0;
+    window->current = 0;
+    window->current_start = now_ns;
+}
+
+void sliding_add(sliding_window_t *window, unsigned int count) {
+    if (!window) return;
+    window->current += count;
+}
+
+rpm_value_t sliding_rotate(sliding_window_t *window, int64_t now_ns, int pulses_per_rev) {
+    if (!window || !window->counts || window->nbuckets == 0) return 0;
+
+    // Drop the oldest bucket once the ring is full
+    if (window->filled == window->nbuckets) {
+        window->sum -= window->counts[window->head];
+    } else {
+        window->filled++;
+    }
+
+    window->counts[window->head] = window->current;
+    window->starts[window->head] = window->current_start;
+    window->sum += window->current;
+    window->head = (window->head + 1) % window->nbuckets;
+
+    window->current = 0;
+    window->current_start = now_ns;
+
+    return rpm_from_count((unsigned int)window->sum, pulses_per_rev, sliding_span_ns(window));
+}
+
+int64_t sliding_span_ns(const sliding_window_t *window) {
+    if (!window || !window->starts || window->filled == 0) return 0;
+
+    // Oldest bucket is at head when full, at index 0 while filling; the
+    // bucket in progress started when the newest one completed
+    size_t oldest = (window->filled == window->nbuckets) ? window->head : 0;
+    return window->current_start - window->starts[oldest];
+}
@@ -0,0 +1,126 @@
+/**
+ * This module applies the real-time options to threads: SCHED_FIFO
+ * priority, CPU affinity from a CPU list, thread names for profiling and
+ * locking the process memory.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#define _GNU_SOURCE  // For pthread_setaffinity_np, pthread_setname_np, CPU_SET
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "rtsched.h"
+
+/**
+ * Parse a CPU number, advancing the cursor
+ *
+ * @return int 0 on success, -1 if no valid CPU number follows
+ */
+static int parse_cpu(const char **p, int *cpu) {
+    if (**p < '0' || **p > '9') return -1;
+
+    char *end;
+    errno = 0;
+    long val = strtol(*p, &end, 10);
+    if (errno != 0 || val > RTSCHED_CPU_MAX) return -1;
+
+    *cpu = (int)val;
+    *p = end;
+    return 0;
+}
+
+int rtsched_parse_cpus(const char *list, int *cpus, size_t max) {
+    if (!list || *list == '\0') return -1;
+
+    size_t n = 0;
+    const char *p = list;
+    for (;;) {
+        int first, last;
+        if (parse_cpu(&p, &first) < 0) return -1;
+        last = first;
+        if (*p == '-') {
+            p++;
+            if (parse_cpu(&p, &last) < 0 || last < first) return -1;
+        }
+
+        if ((size_t)(last - first) >= RTSCHED_CPUS_MAX - n) return -1;
+        for (int cpu = first; cpu <= last; cpu++) {
+            if (cpus && n < max) cpus[n] = cpu;
+            n++;
+        }
+
+        if (*p == '\0') break;
+        if (*p != ',') return -1;
+        p++;
+    }
+
+    return (int)n;
+}
+
+void rtsched_thread(pthread_t thread, const char *name, int priority, const char *cpu_list,
+                    long index, int debug) {
+    if (name) {
+        char short_name[RTSCHED_NAME_MAX];
+        snprintf(short_name, sizeof(short_name), "%s", name);
+        pthread_setname_np(thread, short_name);  // Cosmetic, errors are ignored
+    }
+
+    if (cpu_list) {
+        int cpus[RTSCHED_CPUS_MAX];
+        int n = rtsched_parse_cpus(cpu_list, cpus, RTSCHED_CPUS_MAX);
+        if (n > RTSCHED_CPUS_MAX) n = RTSCHED_CPUS_MAX;  // Only the stored CPUs
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (n > 0 && index >= 0) {
+            CPU_SET(cpus[index % n], &set);
+        } else {
+            for (int i = 0; i < n; i++) CPU_SET(cpus[i], &set);
+        }
+
+        int ret = n > 0 ? pthread_setaffinity_np(thread, sizeof(set), &set) : EINVAL;
+        if (ret) {
+            fprintf(stderr, "Warning: cannot pin thread %s to CPU %s: %s\n",
+                    name ? name : "", cpu_list, strerror(ret));
+        } else if (debug && index >= 0) {
+            fprintf(stderr, "Thread %s: CPU %d\n", name ? name : "", cpus[index % n]);
+        } else if (debug) {
+            fprintf(stderr, "Thread %s: CPUs %s\n", name ? name : "", cpu_list);
+        }
+    }
+
+    if (priority > 0) {
+        struct sched_param sp = { .sched_priority = priority };
+        int ret = pthread_setschedparam(thread, SCHED_FIFO, &sp);
+        if (ret) {
+            fprintf(stderr, "Warning: cannot set SCHED_FIFO priority %d for thread %s: %s\n",
+                    priority, name ? name : "", strerror(ret));
+        } else if (debug) {
+            fprintf(stderr, "Thread %s: SCHED_FIFO priority %d\n", name ? name : "", priority);
+        }
+    }
+}
+
+int rtsched_lock_memory(void) {
+    // Every thread stack is locked in full, keep them small
+    pthread_attr_t attr;
+    if (pthread_attr_init(&attr) == 0) {
+        if (pthread_attr_setstacksize(&attr, RTSCHED_STACK_SIZE) == 0) {
+            pthread_setattr_default_np(&attr);
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        fprintf(stderr, "Error: cannot lock memory: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+/**
+ * This module implements the double buffer and the server thread shared
+ * by the Prometheus exporter and the daemon query socket.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "server.h"
+#include "gpio.h"
+#include "stop.h"
+#include "rtsched.h"
+
+void server_buffers_init(server_buffers_t *buffers) {
+    atomic_init(&buffers->current, 0);
+    atomic_init(&buffers->readers[0], 0);
+    atomic_init(&buffers->readers[1], 0);
+}
+
+int server_buffers_back(server_buffers_t *buffers) {
+    // Wait for readers that still send the previous back buffer
+    int back = 1 - atomic_load(&buffers->current);
+    while (atomic_load(&buffers->readers[back]) > 0) {
+        sched_yield();
+    }
+    return back;
+}
+
+void server_buffers_publish(server_buffers_t *buffers, int back) {
+    atomic_store(&buffers->current, back);
+}
+
+int server_buffers_acquire(server_buffers_t *buffers) {
+    for (;;) {
+        int i = atomic_load(&buffers->current);
+        atomic_fetch_add(&buffers->readers[i], 1);
+        // The publisher may have swapped buffers before we registered
+        if (atomic_load(&buffers->current) == i) {
+            return i;
+        }
+        atomic_fetch_sub(&buffers->readers[i], 1);
+    }
+}
+
+void server_buffers_release(server_buffers_t *buffers, int index) {
+    atomic_fetch_sub(&buffers->readers[index], 1);
+}
+
+int server_send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void* server_thread_fn(void *arg) {
+    server_t *server = arg;
+    struct pollfd pfds[3] = {
+        { .fd = server->listen_fd, .events = POLLIN },
+        { .fd = server->wake_fd, .events = POLLIN },
+        { .fd = stop_fd(), .events = POLLIN }
+    };
+
+    while (!stop && !atomic_load(&server->quit)) {
+        int ret = poll(pfds, 3, -1);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (!(pfds[0].revents & POLLIN)) continue;
+
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+
+        struct timeval tv = { .tv_sec = SERVER_IO_TIMEOUT_SEC, .tv_usec = 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        server->serve(server->arg, fd);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+void server_init(server_t *server) {
+    memset(server, 0, sizeof(*server));
+    server->listen_fd = -1;
+    server->wake_fd = -1;
+    atomic_init(&server->quit, 0);
+}
+
+int server_start(server_t *server, int listen_fd, server_client_fn serve, void *arg, const char *name) {
+    server->listen_fd = listen_fd;
+    server->serve = serve;
+    server->arg = arg;
+
+    server->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server->wake_fd < 0) {
+        fprintf(stderr, "Error: cannot create eventfd: %s\n", strerror(errno));
+        return -1;
+    }
+
+    int ret = pthread_create(&server->thread, NULL, server_thread_fn, server);
+    if (ret) {
+        fprintf(stderr, "Error: cannot create %s thread: %s\n", name, strerror(ret));
+        return -1;
+    }
+    server->thread_started = 1;
+    rtsched_thread(server->thread, name, 0, NULL, -1, 0);
+
+    return 0;
+}
+
+void server_stop(server_t *server) {
+    if (server->thread_started) {
+        atomic_store(&server->quit, 1);
+        uint64_t one = 1;
+        ssize_t n = write(server->wake_fd, &one, sizeof(one));
+        (void)n;  // Cannot fail on a fresh eventfd
+        pthread_join(server->thread, NULL);
+        server->thread_started = 0;
+    }
+    if (server->wake_fd >= 0) {
+        close(server->wake_fd);
+        server->wake_fd = -1;
+    }
+    if (server->listen_fd >= 0) {
+        close(server->listen_fd);
+        server->listen_fd = -1;
+    }
+}
@@ -0,0 +1,557 @@
+/**
+ * This module fans the formatted results out to one or more outputs:
+ * stdout, files, UDP and Unix sockets (--output).
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#define _GNU_SOURCE  // For sendmmsg
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "sink.h"
+#include "gpio.h"
+#include "rtsched.h"
+
+// Initial size of the round buffer (grows on demand)
+#define SINK_ROUND_INITIAL 4096
+
+// Length prefix of every round in the ring
+#define SINK_CHUNK_HEADER sizeof(uint32_t)
+
+struct sink {
+    sink_kind_t kind;            /**< Destination type */
+    output_mode_t mode;          /**< Format of the rounds */
+    char *dest;                  /**< Path or HOST:PORT */
+    int fd;                      /**< Output descriptor (-1: not connected) */
+    int socktype;                /**< SOCK_STREAM or SOCK_DGRAM (Unix sockets) */
+    int debug;                   /**< Print connection changes */
+    int lossless;                /**< Wait for room instead of dropping rounds */
+    format_buffer_t round;       /**< Round being formatted (measurement side) */
+    pthread_mutex_t lock;        /**< Protects the ring and the fields below */
+    pthread_cond_t ready;        /**< Signalled when a round is queued or on close */
+    pthread_cond_t room;         /**< Signalled when the writer took a round (lossless) */
+    unsigned char *ring;         /**< Queued rounds, each with a length prefix */
+    size_t start;                /**< Ring offset of the oldest round */
+    size_t used;                 /**< Bytes queued */
+    unsigned long dropped;       /**< Rounds dropped on a full ring */
+    int closing;                 /**< Writer drains the ring and exits */
+    unsigned char *chunk;        /**< Rounds being written, with length prefixes (writer side) */
+    unsigned char *dgrams;       /**< Packed datagrams of one sendmmsg() batch (UDP) */
+    int failed;                  /**< A write failed for good (stdout, file) */
+    int64_t retry_ns;            /**< Next connection attempt (Unix sockets) */
+    pthread_t thread;            /**< Writer thread */
+    int thread_started;          /**< Writer thread is running */
+};
+
+/**
+ * Split a specification into destination and format
+ *
+ * @param dest Output for the destination (free with free())
+ * @return int 0 on success, -1 on error
+ */
+static int sink_split(const char *spec, sink_kind_t *kind, char **dest, output_mode_t *mode) {
+    if (!spec || *spec == '\0') return -1;
+
+    // A trailing ",FORMAT" names the format, other commas belong to the path
+    size_t len = strlen(spec);
+    const char *comma = strrchr(spec, ',');
+    output_mode_t named;
+    if (comma && format_parse_mode(comma + 1, &named) == 0) {
+        len = (size_t)(comma - spec);
+        if (mode) *mode = named;
+    }
+
+    const char *arg;
+    if ((len == 6 && strncmp(spec, "stdout", 6) == 0) || (len == 1 && spec[0] == '-')) {
+        *kind = SINK_STDOUT;
+        arg = spec + len;
+    } else if (len > 5 && strncmp(spec, "file:", 5) == 0) {
+        *kind = SINK_FILE;
+        arg = spec + 5;
+    } else if (len > 4 && strncmp(spec, "udp:", 4) == 0) {
+        *kind = SINK_UDP;
+        arg = spec + 4;
+    } else if (len > 5 && strncmp(spec, "unix:", 5) == 0) {
+        *kind = SINK_UNIX;
+        arg = spec + 5;
+    } else {
+        return -1;
+    }
+
+    size_t arg_len = len - (size_t)(arg - spec);
+    if (*kind == SINK_UNIX && arg_len >= sizeof(((struct sockaddr_un *)0)->sun_path)) return -1;
+
+    char *copy = strndup(arg, arg_len);
+    if (!copy) return -1;
+
+    // UDP needs HOST:PORT with a host to send to
+    if (*kind == SINK_UDP) {
+        char *colon = strrchr(copy, ':');
+        char *endptr;
+        long port = colon ? strtol(colon + 1, &endptr, 10) : 0;
+        if (!colon || colon == copy || colon[1] == '\0' || *endptr != '\0' || port < 1 || port > 65535) {
+            free(copy);
+            return -1;
+        }
+    }
+
+    *dest = copy;
+    return 0;
+}
+
+int sink_parse(const char *spec, output_mode_t *mode) {
+    sink_kind_t kind;
+    char *dest;
+    if (sink_split(spec, &kind, &dest, mode) < 0) return -1;
+
+    free(dest);
+    return 0;
+}
+
+/**
+ * Resolve HOST:PORT and connect a UDP socket to it
+ */
+static int open_udp(const char *dest) {
+    char host[256];
+    const char *colon = strrchr(dest, ':');
+    const char *h = dest;
+    size_t hlen = (size_t)(colon - dest);
+    // Strip brackets of IPv6 literals ("[::1]:8089")
+    if (hlen >= 2 && h[0] == '[' && h[hlen - 1] == ']') {
+        h++;
+        hlen -= 2;
+    }
+    if (hlen >= sizeof(host)) {
+        fprintf(stderr, "Error: invalid output address 'udp:%s'\n", dest);
+        return -1;
+    }
+    memcpy(host, h, hlen);
+    host[hlen] = '\0';
+
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    struct addrinfo *res;
+    int gai = getaddrinfo(host, colon + 1, &hints, &res);
+    if (gai != 0) {
+        fprintf(stderr, "Error: cannot resolve output address '%s': %s\n", host, gai_strerror(gai));
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot open output 'udp:%s': %s\n", dest, strerror(errno));
+    }
+    return fd;
+}
+
+/**
+ * Connect to a Unix socket, as a stream or else as datagrams
+ *
+ * Failures are retried by the writer, the receiver may start later.
+ */
+static void connect_unix(sink_t *sink) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sink->dest);  // Length checked by sink_split()
+
+    const int types[2] = { SOCK_STREAM, SOCK_DGRAM };
+    for (int t = 0; t < 2; t++) {
+        int fd = socket(AF_UNIX, types[t] | SOCK_CLOEXEC, 0);
+        if (fd < 0) break;
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            sink->fd = fd;
+            sink->socktype = types[t];
+            if (sink->debug) {
+                fprintf(stderr, "DEBUG: Output unix:%s connected (%s)\n", sink->dest,
+                        types[t] == SOCK_STREAM ? "stream" : "datagram");
+            }
+            return;
+        }
+        int err = errno;
+        close(fd);
+        if (err != EPROTOTYPE) {
+            if (sink->debug) {
+                fprintf(stderr, "DEBUG: Output unix:%s not connected: %s\n", sink->dest, strerror(err));
+            }
+            break;
+        }
+    }
+
+    sink->retry_ns = gpio_monotonic_ns() + SINK_RETRY_NS;
+}
+
+/**
+ * Write one round to a file descriptor (retried on partial writes)
+ */
+static int write_all(int fd, const unsigned char *data, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, data + done, len - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * Send one round to a Unix socket, dropping the connection on errors
+ */
+static int send_unix(sink_t *sink, const unsigned char *data, size_t len) {
+    if (sink->fd < 0) {
+        if (gpio_monotonic_ns() < sink->retry_ns) return -1;
+        connect_unix(sink);
+        if (sink->fd < 0) return -1;
+    }
+
+    // The peer may answer (e.g. collectd's unixsock), keep its replies from piling up
+    char discard[512];
+    while (sink->socktype == SOCK_STREAM && recv(sink->fd, discard, sizeof(discard), MSG_DONTWAIT) > 0) {
+    }
+
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = send(sink->fd, data + done, len - done, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (sink->debug) {
+                fprintf(stderr, "DEBUG: Output unix:%s disconnected: %s\n", sink->dest, strerror(errno));
+            }
+            close(sink->fd);
+            sink->fd = -1;
+            sink->retry_ns = gpio_monotonic_ns() + SINK_RETRY_NS;
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * Write one round to the output (writer thread only)
+ */
+static void sink_write(sink_t *sink, const unsigned char *data, size_t len) {
+    switch (sink->kind) {
+        case SINK_STDOUT:
+        case SINK_FILE:
+            if (sink->failed) return;
+            if (write_all(sink->fd, data, len) < 0) {
+                fprintf(stderr, "Error: cannot write output '%s': %s\n",
+                        sink->kind == SINK_STDOUT ? "stdout" : sink->dest, strerror(errno));
+                sink->failed = 1;
+            }
+            break;
+        case SINK_UDP:
+            break;  // Packed by sink_send_udp()
+        case SINK_UNIX:
+            send_unix(sink, data, len);
+            break;
+    }
+}
+
+static void ring_copy_in(sink_t *sink, size_t pos, const void *src, size_t len) {
+    pos %= SINK_RING_SIZE;
+    size_t first = SINK_RING_SIZE - pos < len ? SINK_RING_SIZE - pos : len;
+    memcpy(sink->ring + pos, src, first);
+    memcpy(sink->ring, (const unsigned char *)src + first, len - first);
+}
+
+static void ring_copy_out(const sink_t *sink, size_t pos, void *dst, size_t len) {
+    pos %= SINK_RING_SIZE;
+    size_t first = SINK_RING_SIZE - pos < len ? SINK_RING_SIZE - pos : len;
+    memcpy(dst, sink->ring + pos, first);
+    memcpy((unsigned char *)dst + first, sink->ring, len - first);
+}
+
+/**
+ * Drop the oldest round from the ring (caller holds the lock)
+ */
+static void ring_drop(sink_t *sink) {
+    uint32_t len;
+    ring_copy_out(sink, sink->start, &len, SINK_CHUNK_HEADER);
+
+    sink->start = (sink->start + SINK_CHUNK_HEADER + len) % SINK_RING_SIZE;
+    sink->used -= SINK_CHUNK_HEADER + len;
+}
+
+/**
+ * Send a batch of datagrams with as few sendmmsg() calls as possible
+ */
+static void udp_flush(sink_t *sink, struct mmsghdr *msgs, unsigned int count) {
+    for (unsigned int done = 0; done < count;) {
+        int sent = sendmmsg(sink->fd, msgs + done, count - done, 0);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            // Nobody listening (ECONNREFUSED) is not an error for a datagram feed
+            if (sink->debug) {
+                fprintf(stderr, "DEBUG: Output udp:%s: %s\n", sink->dest, strerror(errno));
+            }
+            sent = 1;  // Skip the datagram that failed
+        }
+        done += (unsigned int)sent;
+    }
+}
+
+/**
+ * Send queued rounds as datagrams of whole records, batched with sendmmsg()
+ */
+static void sink_send_udp(sink_t *sink, const unsigned char *rounds, size_t len) {
+    struct mmsghdr msgs[SINK_UDP_BATCH];
+    struct iovec iov[SINK_UDP_BATCH];
+    unsigned int count = 0;
+
+    for (size_t pos = 0; pos < len;) {
+        uint32_t round;
+        memcpy(&round, rounds + pos, SINK_CHUNK_HEADER);
+
+        format_packer_t packer;
+        format_packer_init(&packer, sink->mode, rounds + pos + SINK_CHUNK_HEADER, round);
+        pos += SINK_CHUNK_HEADER + round;
+
+        const unsigned char *dgram;
+        size_t n;
+        while ((n = format_packer_next(&packer, sink->dgrams + count * SINK_DATAGRAM_MAX,
+                                       SINK_DATAGRAM_MAX, &dgram)) > 0) {
+            iov[count].iov_base = (void *)dgram;
+            iov[count].iov_len = n;
+            memset(&msgs[count], 0, sizeof(msgs[count]));
+            msgs[count].msg_hdr.msg_iov = &iov[count];
+            msgs[count].msg_hdr.msg_iovlen = 1;
+            if (++count == SINK_UDP_BATCH) {
+                udp_flush(sink, msgs, count);
+                count = 0;
+            }
+        }
+    }
+    udp_flush(sink, msgs, count);
+}
+
+static void* sink_thread_fn(void *arg) {
+    sink_t *sink = (sink_t *)arg;
+
+    pthread_mutex_lock(&sink->lock);
+    for (;;) {
+        while (sink->used == 0 && !sink->closing) {
+            pthread_cond_wait(&sink->ready, &sink->lock);
+        }
+        if (sink->used == 0) break;  // Closing and drained
+
+        // Take every queued round, a backlog goes out in as few calls as possible
+        size_t len = sink->used;
+        ring_copy_out(sink, sink->start, sink->chunk, len);
+        sink->start = (sink->start + len) % SINK_RING_SIZE;
+        sink->used = 0;
+        if (sink->lossless) pthread_cond_signal(&sink->room);
+
+        // Write without the lock, the measurement side keeps queueing
+        pthread_mutex_unlock(&sink->lock);
+        if (sink->kind == SINK_UDP) {
+            sink_send_udp(sink, sink->chunk, len);
+        } else {
+            for (size_t pos = 0; pos < len;) {
+                uint32_t round;
+                memcpy(&round, sink->chunk + pos, SINK_CHUNK_HEADER);
+                sink_write(sink, sink->chunk + pos + SINK_CHUNK_HEADER, round);
+                pos += SINK_CHUNK_HEADER + round;
+            }
+        }
+        pthread_mutex_lock(&sink->lock);
+    }
+    pthread_mutex_unlock(&sink->lock);
+
+    return NULL;
+}
+
+sink_t* sink_open(const char *spec, output_mode_t mode, int lossless, int debug) {
+    sink_t *sink = calloc(1, sizeof(*sink));
+    if (!sink) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        return NULL;
+    }
+
+    sink->mode = mode;
+    if (sink_split(spec, &sink->kind, &sink->dest, &sink->mode) < 0) {
+        fprintf(stderr, "Error: invalid output '%s'\n", spec ? spec : "");
+        free(sink);
+        return NULL;
+    }
+    sink->fd = -1;
+    sink->debug = debug;
+    sink->lossless = lossless;
+
+    sink->ring = malloc(SINK_RING_SIZE);
+    sink->chunk = malloc(SINK_RING_SIZE);
+    sink->dgrams = sink->kind == SINK_UDP ? malloc(SINK_UDP_BATCH * SINK_DATAGRAM_MAX) : NULL;
+    if (!sink->ring || !sink->chunk || (sink->kind == SINK_UDP && !sink->dgrams) ||
+        format_buffer_init(&sink->round, SINK_ROUND_INITIAL) < 0) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        free(sink->ring);
+        free(sink->chunk);
+        free(sink->dgrams);
+        free(sink->dest);
+        free(sink);
+        return NULL;
+    }
+
+    switch (sink->kind) {
+        case SINK_STDOUT:
+            sink->fd = STDOUT_FILENO;
+            break;
+        case SINK_FILE:
+            sink->fd = open(sink->dest, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (sink->fd < 0) {
+                fprintf(stderr, "Error: cannot open output '%s': %s\n", sink->dest, strerror(errno));
+            }
+            break;
+        case SINK_UDP:
+            sink->fd = open_udp(sink->dest);
+            break;
+        case SINK_UNIX:
+            connect_unix(sink);  // Retried by the writer until the receiver is up
+            break;
+    }
+    if (sink->fd < 0 && sink->kind != SINK_UNIX) {
+        format_buffer_free(&sink->round);
+        free(sink->ring);
+        free(sink->chunk);
+        free(sink->dgrams);
+        free(sink->dest);
+        free(sink);
+        return NULL;
+    }
+
+    pthread_mutex_init(&sink->lock, NULL);
+    pthread_cond_init(&sink->ready, NULL);
+    pthread_cond_init(&sink->room, NULL);
+
+    int ret = pthread_create(&sink->thread, NULL, sink_thread_fn, sink);
+    if (ret) {
+        fprintf(stderr, "Error: cannot create output thread: %s\n", strerror(ret));
+        sink_close(sink);
+        return NULL;
+    }
+    sink->thread_started = 1;
+    rtsched_thread(sink->thread, "fan-output", 0, NULL, -1, 0);
+
+    return sink;
+}
+
+output_mode_t sink_mode(const sink_t *sink) {
+    return sink->mode;
+}
+
+format_buffer_t* sink_begin(sink_t *sink) {
+    format_buffer_reset(&sink->round);
+    return &sink->round;
+}
+
+void sink_commit(sink_t *sink) {
+    size_t len = sink->round.len;
+    if (len == 0) return;
+
+    pthread_mutex_lock(&sink->lock);
+
+    if (len > SINK_RING_SIZE - SINK_CHUNK_HEADER) {
+        sink->dropped++;  // Can never fit
+    } else {
+        // Make room by dropping the oldest rounds, the newest results matter most
+        while (SINK_RING_SIZE - sink->used < SINK_CHUNK_HEADER + len) {
+            if (sink->lossless) {
+                pthread_cond_wait(&sink->room, &sink->lock);
+                continue;
+            }
+            ring_drop(sink);
+            sink->dropped++;
+        }
+
+        uint32_t header = (uint32_t)len;
+        size_t end = sink->start + sink->used;
+        ring_copy_in(sink, end, &header, SINK_CHUNK_HEADER);
+        ring_copy_in(sink, end + SINK_CHUNK_HEADER, sink->round.data, len);
+        sink->used += SINK_CHUNK_HEADER + len;
+        pthread_cond_signal(&sink->ready);
+    }
+
+    pthread_mutex_unlock(&sink->lock);
+    sink->round.len = 0;
+}
+
+int sink_close(sink_t *sink) {
+    if (!sink) return 0;
+
+    if (sink->thread_started) {
+        pthread_mutex_lock(&sink->lock);
+        sink->closing = 1;
+        pthread_cond_signal(&sink->ready);
+        pthread_mutex_unlock(&sink->lock);
+        pthread_join(sink->thread, NULL);
+    }
+
+    if (sink->dropped > 0) {
+        fprintf(stderr, "Warning: output '%s' fell behind, %lu rounds dropped\n",
+                sink->kind == SINK_STDOUT ? "stdout" : sink->dest, sink->dropped);
+    }
+
+    int ret = sink->failed ? -1 : 0;
+    if (sink->fd >= 0 && sink->kind != SINK_STDOUT && close(sink->fd) < 0) ret = -1;
+
+    pthread_cond_destroy(&sink->room);
+    pthread_cond_destroy(&sink->ready);
+    pthread_mutex_destroy(&sink->lock);
+    format_buffer_free(&sink->round);
+    free(sink->ring);
+    free(sink->chunk);
+    free(sink->dgrams);
+    free(sink->dest);
+    free(sink);
+    return ret;
+}
+
+int sink_list_open(sink_list_t *list, const char *const *specs, size_t nspecs, output_mode_t mode,
+                   int lossless, int debug) {
+    list->count = 0;
+    if (nspecs > SINK_MAX) return -1;
+
+    for (size_t i = 0; i < nspecs; i++) {
+        sink_t *sink = sink_open(specs[i], mode, lossless, debug);
+        if (!sink) {
+            sink_list_close(list);
+            return -1;
+        }
+        list->sinks[list->count++] = sink;
+    }
+    return 0;
+}
+
+int sink_list_close(sink_list_t *list) {
+    int ret = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        if (sink_close(list->sinks[i]) < 0) ret = -1;
+    }
+    list->count = 0;
+    return ret;
+}
@@ -0,0 +1,102 @@
+/**
+ * This module provides a per-fan seqlock holding the latest measurement
+ * result and a summary of its running statistics.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <string.h>
+#include "snapshot.h"
+
+static void load_words(const fan_snapshot_t *snap, fan_record_t *record) {
+    uint64_t words[FAN_RECORD_WORDS];
+    for (size_t i = 0; i < FAN_RECORD_WORDS; i++) {
+        words[i] = atomic_load_explicit(&snap->words[i], memory_order_relaxed);
+    }
+    memcpy(record, words, sizeof(*record));
+}
+
+static void store_words(fan_snapshot_t *snap, const fan_record_t *record) {
+    uint64_t words[FAN_RECORD_WORDS] = {0};
+    memcpy(words, record, sizeof(*record));
+    for (size_t i = 0; i < FAN_RECORD_WORDS; i++) {
+        atomic_store_explicit(&snap->words[i], words[i], memory_order_relaxed);
+    }
+}
+
+void snapshot_init(fan_snapshot_t *snap) {
+    if (!snap) return;
+
+    memset(&snap->record, 0, sizeof(snap->record));
+    stats_init(&snap->stats);
+
+    atomic_init(&snap->seq, 0);
+    for (size_t i = 0; i < FAN_RECORD_WORDS; i++) {
+        atomic_init(&snap->words[i], 0);
+    }
+    store_words(snap, &snap->record);
+}
+
+/**
+ * Replace the record under the seqlock (writer side)
+ */
+static void store_record(fan_snapshot_t *snap, const fan_record_t *record) {
+    unsigned int seq = atomic_load_explicit(&snap->seq, memory_order_relaxed);
+    atomic_store_explicit(&snap->seq, seq + 1, memory_order_relaxed);
+    // Readers that see any new word must also see the odd sequence number
+    atomic_thread_fence(memory_order_release);
+    store_words(snap, record);
+    atomic_store_explicit(&snap->seq, seq + 2, memory_order_release);
+}
+
+void snapshot_reset(fan_snapshot_t *snap, const format_fan_t *fan, unsigned int generation) {
+    if (!snap) return;
+
+    memset(&snap->record, 0, sizeof(snap->record));
+    stats_init(&snap->stats);
+    if (fan) {
+        snap->record.fan = *fan;
+    } else {
+        snap->record.fan.gpio = -1;
+    }
+    snap->record.sample.generation = generation;
+    store_record(snap, &snap->record);
+}
+
+unsigned int snapshot_publish(fan_snapshot_t *snap, const rpm_sample_t *sample, const rpm_counters_t *counters) {
+    if (!snap || !sample) return 0;
+
+    fan_record_t *record = &snap->record;
+    unsigned int generation = record->sample.generation;
+    record->sample = *sample;
+    record->sample.generation = generation;
+    if (counters) record->counters = *counters;
+    stats_update(&snap->stats, sample->rpm);
+    stats_summarize(&snap->stats, &record->summary);
+
+    store_record(snap, record);
+    return generation;
+}
+
+int snapshot_read(const fan_snapshot_t *snap, fan_record_t *record) {
+    if (!snap || !record) return 0;
+
+    for (;;) {
+        unsigned int before = atomic_load_explicit(&snap->seq, memory_order_acquire);
+        if (before & 1) continue;  // Update in progress
+
+        load_words(snap, record);
+        // Order the word loads before the second sequence check
+        atomic_thread_fence(memory_order_acquire);
+        unsigned int after = atomic_load_explicit(&snap->seq, memory_order_relaxed);
+        if (before == after) break;
+    }
+
+    return record->summary.count > 0;
+}
+
+unsigned int snapshot_seq(const fan_snapshot_t *snap) {
+    if (!snap) return 0;
+    return atomic_load_explicit(&snap->seq, memory_order_acquire);
+}
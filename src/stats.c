@@ -1,36 +1,253 @@
 /**
- * This module provides functions for tracking min/max/average
- * RPM statistics in continuous monitoring mode.
+ * This module provides functions for tracking RPM statistics in
+ * continuous monitoring mode.
  * 
  * @author  CSoellinger
  * @license LGPL-3.0-or-later
  */
 
+#include <string.h>
+#include <math.h>
 #include "stats.h"
 
+/**
+ * Append a measurement to a monotonic deque
+ *
+ * Candidates that can no longer be the extreme (sign 1: max, -1: min)
+ * are dropped from the back, candidates older than the window from the
+ * front, so the front is always the extreme of the window.
+ */
+static void deque_push(stats_deque_t *dq, rpm_value_t value, unsigned long seq, int sign) {
+    while (dq->len > 0) {
+        unsigned int back = (dq->head + dq->len - 1) % STATS_WINDOW;
+        if (sign * (dq->value[back] - value) > 0) break;
+        dq->len--;
+    }
+    while (dq->len > 0 && seq - dq->seq[dq->head] >= STATS_WINDOW) {
+        dq->head = (dq->head + 1) % STATS_WINDOW;
+        dq->len--;
+    }
+
+    unsigned int tail = (dq->head + dq->len) % STATS_WINDOW;
+    dq->value[tail] = value;
+    dq->seq[tail] = seq;
+    dq->len++;
+}
+
+#ifdef RPM_FIXED_POINT
+#if STATS_SKETCH_MIN != 10 || STATS_SKETCH_MAX != 100000 || RPM_SCALE != 1000
+#error "Update the sketch constants below for the new range or scale"
+#endif
+
+/**
+ * Fractional bits of the base 2 logarithms
+ */
+#define LOG2_BITS 20
+
+/**
+ * log2 of RPM_VALUE(STATS_SKETCH_MIN) and of STATS_SKETCH_MAX / STATS_SKETCH_MIN
+ * (both 10000) with LOG2_BITS fractional bits
+ */
+#define SKETCH_LOG2_MIN 13933176
+#define SKETCH_LOG2_RANGE 13933176
+
+/**
+ * 2^(2^-k) for k = 1..LOG2_BITS with 30 fractional bits
+ */
+static const uint32_t exp2_steps[LOG2_BITS] = {
+    1518500250, 1276901417, 1170923762, 1121280436, 1097253708, 1085434106, 1079572136, 1076653033,
+    1075196443, 1074468888, 1074105294, 1073923544, 1073832680, 1073787251, 1073764537, 1073753181,
+    1073747502, 1073744663, 1073743244, 1073742534
+};
+
+/**
+ * log2 of a positive integer with LOG2_BITS fractional bits (bit by bit squaring)
+ */
+static int64_t log2_fixed(uint64_t value) {
+    int exponent = 63 - __builtin_clzll(value);
+    uint64_t y = exponent >= 30 ? value >> (exponent - 30) : value << (30 - exponent);  // [1, 2)
+    int64_t result = (int64_t)exponent << LOG2_BITS;
+
+    for (int64_t bit = 1 << (LOG2_BITS - 1); bit; bit >>= 1) {
+        y = y * y >> 30;
+        if (y >= 2ULL << 30) {
+            y >>= 1;
+            result |= bit;
+        }
+    }
+    return result;
+}
+
+/**
+ * 2 to a non-negative power with LOG2_BITS fractional bits, rounded to an integer
+ */
+static uint64_t exp2_fixed(int64_t power) {
+    uint64_t y = 1ULL << 30;
+    for (int k = 0; k < LOG2_BITS; k++) {
+        if (power & (1 << (LOG2_BITS - 1 - k))) y = y * exp2_steps[k] >> 30;
+    }
+
+    int exponent = (int)(power >> LOG2_BITS);
+    if (exponent >= 30) return y << (exponent - 30);
+    return (y + (1ULL << (29 - exponent))) >> (30 - exponent);
+}
+
+/**
+ * Sketch bin of an RPM value
+ */
+static unsigned int sketch_bin(rpm_value_t rpm) {
+    if (rpm < RPM_VALUE(STATS_SKETCH_MIN)) return 0;
+
+    int64_t pos = log2_fixed((uint64_t)rpm) - SKETCH_LOG2_MIN;
+    int64_t bin = 1 + pos * (STATS_SKETCH_BINS - 1) / SKETCH_LOG2_RANGE;
+    if (bin >= STATS_SKETCH_BINS - 1) return STATS_SKETCH_BINS - 1;
+    return (unsigned int)bin;
+}
+
+/**
+ * Geometric center of a sketch bin
+ */
+static rpm_value_t sketch_value(unsigned int bin) {
+    if (bin == 0) return 0;
+
+    int64_t pos = (((int64_t)bin * 2 - 1) * SKETCH_LOG2_RANGE + STATS_SKETCH_BINS - 1) /
+                  (2 * (STATS_SKETCH_BINS - 1));
+    return (rpm_value_t)exp2_fixed(SKETCH_LOG2_MIN + pos);
+}
+#else
+/**
+ * Sketch bin of an RPM value
+ */
+static unsigned int sketch_bin(double rpm) {
+    if (!(rpm >= STATS_SKETCH_MIN)) return 0;  // Also NaN
+
+    double pos = log(rpm / STATS_SKETCH_MIN) / log((double)STATS_SKETCH_MAX / STATS_SKETCH_MIN);
+    double bin = 1.0 + pos * (STATS_SKETCH_BINS - 1);
+    if (bin >= STATS_SKETCH_BINS - 1) return STATS_SKETCH_BINS - 1;
+    return (unsigned int)bin;
+}
+
+/**
+ * Geometric center of a sketch bin
+ */
+static double sketch_value(unsigned int bin) {
+    if (bin == 0) return 0.0;
+
+    double pos = ((double)bin - 0.5) / (STATS_SKETCH_BINS - 1);
+    return STATS_SKETCH_MIN * pow((double)STATS_SKETCH_MAX / STATS_SKETCH_MIN, pos);
+}
+#endif
+
 void stats_init(rpm_stats_t *stats) {
     if (!stats) return;
-    stats->min = 0.0;
-    stats->max = 0.0;
-    stats->sum = 0.0;
-    stats->count = 0;
+    memset(stats, 0, sizeof(*stats));
 }
 
-void stats_update(rpm_stats_t *stats, double rpm) {
+void stats_update(rpm_stats_t *stats, rpm_value_t rpm) {
     if (!stats) return;
 
     if (stats->count == 0) {
         stats->min = rpm;
         stats->max = rpm;
+        stats->ewma = rpm;
     } else {
         if (rpm < stats->min) stats->min = rpm;
         if (rpm > stats->max) stats->max = rpm;
+        stats->ewma += (rpm - stats->ewma) * STATS_EWMA_NUM / STATS_EWMA_DEN;
     }
-    stats->sum += rpm;
+
+    deque_push(&stats->window_min, rpm, stats->count, -1);
+    deque_push(&stats->window_max, rpm, stats->count, 1);
+
+    unsigned int bin = sketch_bin(rpm);
+    if (stats->bins[bin] < UINT32_MAX) stats->bins[bin]++;
+
     stats->count++;
+#ifdef RPM_FIXED_POINT
+    stats->sum += rpm;
+#else
+    // Running mean instead of a sum, stays exact in long watch sessions
+    stats->mean += (rpm - stats->mean) / (double)stats->count;
+#endif
+}
+
+rpm_value_t stats_avg(const rpm_stats_t *stats) {
+    if (!stats || stats->count == 0) return 0;
+#ifdef RPM_FIXED_POINT
+    return stats->sum / (int64_t)stats->count;
+#else
+    return stats->mean;
+#endif
+}
+
+rpm_value_t stats_ewma(const rpm_stats_t *stats) {
+    if (!stats || stats->count == 0) return 0;
+    return stats->ewma;
 }
 
-double stats_avg(const rpm_stats_t *stats) {
-    if (!stats || stats->count == 0) return 0.0;
-    return stats->sum / (double)stats->count;
+rpm_value_t stats_window_min(const rpm_stats_t *stats) {
+    if (!stats || stats->count == 0) return 0;
+    return stats->window_min.value[stats->window_min.head];
+}
+
+rpm_value_t stats_window_max(const rpm_stats_t *stats) {
+    if (!stats || stats->count == 0) return 0;
+    return stats->window_max.value[stats->window_max.head];
+}
+
+/**
+ * Nearest-rank (1-based) estimates of ascending quantiles, one pass over
+ * the binned counts
+ */
+static void sketch_quantiles(const rpm_stats_t *stats, const unsigned int *permille, rpm_value_t *values, size_t n) {
+    uint64_t total = 0;
+    for (unsigned int i = 0; i < STATS_SKETCH_BINS; i++) total += stats->bins[i];
+
+    uint64_t seen = 0;
+    unsigned int bin = 0;
+    for (size_t q = 0; q < n; q++) {
+        unsigned int p = permille[q] > 1000 ? 1000 : permille[q];
+        uint64_t rank = (p * total + 999) / 1000;
+        if (rank == 0) rank = 1;
+
+        while (bin < STATS_SKETCH_BINS - 1 && seen + stats->bins[bin] < rank) {
+            seen += stats->bins[bin];
+            bin++;
+        }
+
+        rpm_value_t value = sketch_value(bin);
+        if (value < stats->min) value = stats->min;
+        if (value > stats->max) value = stats->max;
+        values[q] = value;
+    }
+}
+
+rpm_value_t stats_percentile(const rpm_stats_t *stats, unsigned int permille) {
+    if (!stats || stats->count == 0) return 0;
+
+    rpm_value_t value;
+    sketch_quantiles(stats, &permille, &value, 1);
+    return value;
+}
+
+void stats_summarize(const rpm_stats_t *stats, rpm_summary_t *summary) {
+    if (!summary) return;
+
+    memset(summary, 0, sizeof(*summary));
+    if (!stats || stats->count == 0) return;
+
+    static const unsigned int permille[] = {500, 950, 990};
+    rpm_value_t quantiles[3];
+    sketch_quantiles(stats, permille, quantiles, 3);
+
+    summary->count = stats->count;
+    summary->min = stats->min;
+    summary->max = stats->max;
+    summary->avg = stats_avg(stats);
+    summary->ewma = stats_ewma(stats);
+    summary->window_min = stats_window_min(stats);
+    summary->window_max = stats_window_max(stats);
+    summary->p50 = quantiles[0];
+    summary->p95 = quantiles[1];
+    summary->p99 = quantiles[2];
 }
@@ -0,0 +1,74 @@
+/**
+ * This module turns shutdown requests (SIGINT, SIGTERM, 'q' in watch mode)
+ * into an eventfd that every event loop polls next to its own
+ * descriptors.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "stop.h"
+
+// Global stop flag (defined by the program)
+extern volatile sig_atomic_t stop;
+
+static int stop_eventfd = -1;
+
+/**
+ * Signal handler for graceful shutdown
+ *
+ * @param sig Signal number
+ */
+static void stop_signal_handler(int sig) {
+    (void)sig;
+    stop_request();
+}
+
+int stop_init(void) {
+    if (stop_eventfd >= 0) return 0;
+
+    stop_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stop_eventfd < 0) {
+        fprintf(stderr, "Error: cannot create eventfd: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // No SA_RESTART: blocking calls return EINTR and re-check the flag
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_signal_handler;
+    sigemptyset(&sa.sa_mask);
+
+    if (sigaction(SIGINT, &sa, NULL) < 0) {
+        fprintf(stderr, "Warning: failed to set up SIGINT handler\n");
+    }
+    if (sigaction(SIGTERM, &sa, NULL) < 0) {
+        fprintf(stderr, "Warning: failed to set up SIGTERM handler\n");
+    }
+
+    return 0;
+}
+
+void stop_request(void) {
+    int saved_errno = errno;
+
+    stop = 1;
+    if (stop_eventfd >= 0) {
+        uint64_t one = 1;
+        ssize_t n = write(stop_eventfd, &one, sizeof(one));
+        (void)n;  // EAGAIN only means already signalled
+    }
+
+    errno = saved_errno;
+}
+
+int stop_fd(void) {
+    return stop_eventfd;
+}
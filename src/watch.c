@@ -1,6 +1,7 @@
 /**
  * This module handles continuous monitoring mode with parallel
- * measurement and ordered output for multiple GPIO pins.
+ * measurement and either ordered output on a wall-clock tick or
+ * immediate per-GPIO output.
  * 
  * @author  CSoellinger
  * @license LGPL-3.0-or-later
@@ -15,10 +16,19 @@
 #include <unistd.h>
 #include <termios.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/timerfd.h>
 #include "watch.h"
 #include "measurement_common.h"
 #include "format.h"
 #include "stats.h"
+#include "prometheus.h"
+#include "query.h"
+#include "stop.h"
+#include "rtsched.h"
+#include "sink.h"
+#include "config.h"
 
 // External variable for signal handling
 extern volatile sig_atomic_t stop;
@@ -33,6 +43,15 @@ typedef struct {
     int old_flags;
 } terminal_cleanup_t;
 
+/**
+ * Fan of every slot as last seen by the output loop
+ */
+typedef struct {
+    format_fan_t *fans;          /**< Fan per slot (gpio -1: unused), the labels of all outputs */
+    unsigned int *generations;   /**< Fan generation per slot (see snapshot_reset()) */
+    rpm_stats_t *totals;         /**< Statistics per slot of immediate output (NULL: read from the snapshots) */
+} watch_slots_t;
+
 static void restore_terminal_atexit(void) {
     if (terminal_modified) {
         tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
@@ -84,15 +103,29 @@ static void* keyboard_monitor_thread(void *arg) {
 
     pthread_cleanup_push(restore_terminal_cleanup, &cleanup_data);
 
+    // Sleep until a key is pressed or a shutdown is requested
+    struct pollfd pfds[2] = {
+        { .fd = STDIN_FILENO, .events = POLLIN },
+        { .fd = stop_fd(), .events = POLLIN }
+    };
+
     while (!stop) {
+        int ret = poll(pfds, 2, -1);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (!(pfds[0].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
         char ch;
-        if (read(STDIN_FILENO, &ch, 1) == 1) {
-            if (ch == 'q' || ch == 'Q') {
-                stop = 1;
-                break;
-            }
+        ssize_t n = read(STDIN_FILENO, &ch, 1);
+        if (n == 1 && (ch == 'q' || ch == 'Q')) {
+            stop_request();
+            break;
+        }
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            pfds[0].fd = -1;  // Terminal hung up, only wait for the shutdown
         }
-        usleep(100000);
     }
 
     pthread_cleanup_pop(1);
@@ -100,121 +133,360 @@ static void* keyboard_monitor_thread(void *arg) {
     return NULL;
 }
 
-int run_watch_mode(int *gpios, size_t ngpio, char *chipname,
-                   int duration, int pulses, int warmup, edge_type_t edge, int debug, output_mode_t mode) {
-    measurement_ctx_t ctx;
+/**
+ * Follow a config reload that put another fan (or none) into a slot
+ *
+ * The slot's results and statistics start over with the new fan; an
+ * unused slot drops out of all outputs.
+ */
+static void watch_replace_fan(watch_slots_t *slots, size_t i, const fan_record_t *record, rpm_value_t *latest,
+                              rpm_summary_t *stats, rpm_counters_t *counters, prometheus_t *prom) {
+    slots->generations[i] = record->sample.generation;
+    slots->fans[i] = record->fan;
+    latest[i] = -1;
+    if (slots->totals) stats_init(&slots->totals[i]);
+    memset(&stats[i], 0, sizeof(stats[i]));
+    memset(&counters[i], 0, sizeof(counters[i]));
+    prometheus_remove(prom, i);
+}
+
+/**
+ * Output and account all queued results, one round per output
+ */
+static void watch_drain(measurement_ctx_t *ctx, watch_slots_t *slots,
+                        rpm_summary_t *stats, rpm_counters_t *counters, sink_list_t *outputs,
+                        prometheus_t *prom, query_server_t *query, int64_t interval_ns) {
+    rpm_value_t *latest = ctx->results;
+    format_buffer_t *out[SINK_MAX];
+
+    for (size_t i = 0; i < ctx->ngpio; i++) {
+        fan_record_t record;
+        snapshot_read(&ctx->snapshots[i], &record);
+        if (record.sample.generation != slots->generations[i]) {
+            watch_replace_fan(slots, i, &record, latest, stats, counters, prom);
+        }
+        counters[i] = record.counters;
+    }
+    for (size_t s = 0; s < outputs->count; s++) {
+        out[s] = sink_begin(outputs->sinks[s]);
+    }
+    for (size_t i = 0; i < ctx->ngpio; i++) {
+        rpm_sample_t sample;
+        while (rpm_queue_pop(&ctx->queues[i], &sample)) {
+            // Results of the slot's previous fan (or of a newer one, seen next round)
+            if (sample.generation != slots->generations[i]) continue;
+            stats_update(&slots->totals[i], sample.rpm);
+            stats_summarize(&slots->totals[i], &stats[i]);
+            prometheus_add_sample(prom, i, &sample);
+            latest[i] = sample.rpm;
+            counters[i].stalled = sample.stalled;  // The snapshot may be newer than the queued result
+            for (size_t s = 0; s < outputs->count; s++) {
+                format_buffer_append_sample(out[s], &slots->fans[i], &sample, &stats[i], &counters[i],
+                                            sink_mode(outputs->sinks[s]), interval_ns);
+                if (out[s]->len >= SINK_ROUND_MAX) {
+                    sink_commit(outputs->sinks[s]);
+                    out[s] = sink_begin(outputs->sinks[s]);
+                }
+            }
+        }
+    }
+    for (size_t s = 0; s < outputs->count; s++) {
+        sink_commit(outputs->sinks[s]);
+    }
+    prometheus_publish(prom, stats, counters);
+    query_publish(query, latest, stats, counters, interval_ns);
+}
 
-    fprintf(stderr, "\nWatch mode started. Press 'q' to quit or Ctrl+C to interrupt.\n\n");
+/**
+ * Print every queued result as soon as it is measured
+ *
+ * Each GPIO is reported on its own schedule; JSON output is one object
+ * per line.
+ */
+static void watch_immediate(measurement_ctx_t *ctx, watch_slots_t *slots,
+                            rpm_summary_t *stats, rpm_counters_t *counters, sink_list_t *outputs,
+                            prometheus_t *prom, query_server_t *query, int64_t interval_ns) {
+    struct pollfd pfds[2] = {
+        { .fd = ctx->notify_fd, .events = POLLIN },
+        { .fd = stop_fd(), .events = POLLIN }
+    };
 
-    // Initialize context (allocates arrays, mutex/cond, auto-detects chip)
-    if (measurement_ctx_init(&ctx, gpios, ngpio, chipname) < 0) {
-        return -1;
+    for (size_t i = 0; i < ctx->ngpio; i++) {
+        ctx->results[i] = -1;  // Negative values are skipped by the formatters
+    }
+
+    while (!stop) {
+        int ret = poll(pfds, 2, -1);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (!(pfds[0].revents & POLLIN)) continue;
+
+        uint64_t pending;
+        ssize_t n = read(ctx->notify_fd, &pending, sizeof(pending));
+        (void)n;  // Only used as a wakeup, the queues hold the results
+
+        watch_drain(ctx, slots, stats, counters, outputs, prom, query, interval_ns);
     }
+}
 
-    // Allocate statistics array (watch-mode specific)
-    rpm_stats_t *stats = calloc(ngpio, sizeof(*stats));
-    if (!stats) {
+/**
+ * Print the latest result of all GPIOs in order on a wall-clock tick
+ *
+ * Ticks fall on multiples of the interval in CLOCK_REALTIME, so several
+ * instances report aligned. Results and statistics are read from the
+ * per-GPIO snapshots, so the measurement side never waits for this loop.
+ * A slow or stalled GPIO does not delay the others; GPIOs without any
+ * result yet are left out.
+ */
+static int watch_ticked(measurement_ctx_t *ctx, watch_slots_t *slots,
+                        rpm_summary_t *stats, rpm_counters_t *counters, sink_list_t *outputs,
+                        prometheus_t *prom, query_server_t *query, int64_t interval_ns) {
+    size_t ngpio = ctx->ngpio;
+    rpm_value_t *latest = ctx->results;
+
+    // Snapshot sequence numbers already reported, and the latest samples
+    unsigned int *seen = calloc(ngpio, sizeof(*seen));
+    rpm_sample_t *samples = calloc(ngpio, sizeof(*samples));
+    if (!seen || !samples) {
         fprintf(stderr, "Error: memory allocation failed\n");
-        measurement_ctx_cleanup(&ctx);
+        free(seen);
+        free(samples);
         return -1;
     }
 
     for (size_t i = 0; i < ngpio; i++) {
-        stats_init(&stats[i]);
+        latest[i] = -1;  // Negative values are skipped by the formatters
+        seen[i] = snapshot_seq(&ctx->snapshots[i]);
     }
 
-    // Create keyboard monitor thread
-    pthread_t keyboard_thread;
-    int keyboard_ret = pthread_create(&keyboard_thread, NULL, keyboard_monitor_thread, NULL);
-    if (keyboard_ret) {
-        fprintf(stderr, "Warning: cannot create keyboard monitor thread: %s\n", strerror(keyboard_ret));
-        fprintf(stderr, "Use Ctrl+C to quit watch mode\n");
-    }
-
-    // Set up parameters and create threads
-    measurement_params_t params = {
-        .gpios = gpios,
-        .ngpio = ngpio,
-        .duration = duration,
-        .pulses = pulses,
-        .warmup = warmup,
-        .edge = edge,
-        .debug = debug,
-        .watch = 1,  // Watch mode
-        .mode = mode
-    };
+    int timerfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerfd < 0) {
+        fprintf(stderr, "Error: cannot create output timer: %s\n", strerror(errno));
+        free(seen);
+        free(samples);
+        return -1;
+    }
 
-    if (measurement_create_threads(&ctx, &params) < 0) {
-        free(stats);
-        measurement_ctx_cleanup(&ctx);
+    struct timespec now_ts;
+    clock_gettime(CLOCK_REALTIME, &now_ts);
+    int64_t now = (int64_t)now_ts.tv_sec * NSEC_PER_SEC + now_ts.tv_nsec;
+    int64_t first = (now / interval_ns + 1) * interval_ns;
+
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = (time_t)(first / NSEC_PER_SEC);
+    spec.it_value.tv_nsec = (long)(first % NSEC_PER_SEC);
+    spec.it_interval.tv_sec = (time_t)(interval_ns / NSEC_PER_SEC);
+    spec.it_interval.tv_nsec = (long)(interval_ns % NSEC_PER_SEC);
+    if (timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        fprintf(stderr, "Error: cannot arm output timer: %s\n", strerror(errno));
+        close(timerfd);
+        free(seen);
+        free(samples);
         return -1;
     }
 
-    // Main loop for watch mode
+    struct pollfd pfds[2] = {
+        { .fd = timerfd, .events = POLLIN },
+        { .fd = stop_fd(), .events = POLLIN }
+    };
+
     while (!stop) {
-        // Wait for all threads to complete one measurement round
-        pthread_mutex_lock(&ctx.results_mutex);
-        while (!stop) {
-            if (measurement_all_done(ctx.finished, ngpio)) break;
-
-            // Use timed wait to check stop flag periodically
-            struct timespec ts;
-            clock_gettime(CLOCK_REALTIME, &ts);
-            ts.tv_sec += 1;
-            int wait_ret = pthread_cond_timedwait(&ctx.all_finished, &ctx.results_mutex, &ts);
-            if (wait_ret != 0 && wait_ret != ETIMEDOUT) {
-                if (debug) {
-                    fprintf(stderr, "Warning: pthread_cond_timedwait failed: %s\n",
-                            strerror(wait_ret));
-                }
+        int ret = poll(pfds, 2, -1);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (!(pfds[0].revents & POLLIN)) continue;
+
+        uint64_t expirations;
+        ssize_t n = read(timerfd, &expirations, sizeof(expirations));
+        (void)n;  // Intentionally ignoring read result (just consuming timer)
+
+        // Take the GPIOs that published since the last tick
+        int fresh = 0;
+        for (size_t i = 0; i < ngpio; i++) {
+            unsigned int seq = snapshot_seq(&ctx->snapshots[i]);
+            if (seq == seen[i]) continue;
+
+            fan_record_t record;
+            int has_result = snapshot_read(&ctx->snapshots[i], &record);
+            if (record.sample.generation != slots->generations[i]) {
+                watch_replace_fan(slots, i, &record, latest, stats, counters, prom);
+                fresh = 1;  // A removed fan disappears from the outputs
             }
+            if (!has_result) continue;
+            seen[i] = seq;
+            stats[i] = record.summary;
+            counters[i] = record.counters;
+            prometheus_add_sample(prom, i, &record.sample);
+            samples[i] = record.sample;
+            latest[i] = record.sample.rpm;
+            fresh = 1;
         }
+        if (!fresh) continue;
 
-        // Only output if we weren't interrupted
-        if (!stop) {
-            // Update statistics for each GPIO
-            for (size_t i = 0; i < ngpio; i++) {
-                stats_update(&stats[i], ctx.results[i]);
-            }
+        prometheus_publish(prom, stats, counters);
+        query_publish(query, latest, stats, counters, interval_ns);
+
+        // Output results in order, the whole round as one chunk per output
+        for (size_t s = 0; s < outputs->count; s++) {
+            sink_t *sink = outputs->sinks[s];
+            output_mode_t mode = sink_mode(sink);
+            format_buffer_t *out = sink_begin(sink);
 
-            // Output results in order
             if (mode == MODE_JSON && ngpio > 1) {
                 // Output as JSON array with stats
-                char *output = format_json_array(gpios, ctx.results, stats, ngpio);
-                if (output) {
-                    printf("%s", output);
-                    free(output);
-                }
+                format_buffer_append_json_array(out, slots->fans, latest, stats, counters, ngpio);
             } else {
                 // Output individual results in order with stats
                 for (size_t i = 0; i < ngpio; i++) {
-                    char *output = format_output(gpios[i], ctx.results[i], &stats[i], mode, duration);
-                    if (output) {
-                        printf("%s", output);
-                        free(output);
-                    }
+                    if (latest[i] < 0) continue;
+                    format_buffer_append_sample(out, &slots->fans[i], &samples[i], &stats[i], &counters[i],
+                                                mode, interval_ns);
                 }
             }
-            fflush(stdout);
+            sink_commit(sink);
+        }
+    }
+
+    close(timerfd);
+    free(seen);
+    free(samples);
+    return 0;
+}
 
-            // Reset finished flags for next round
-            memset(ctx.finished, 0, ngpio * sizeof(*ctx.finished));
+int run_watch_mode(const measurement_params_t *params, char *chipname) {
+    measurement_ctx_t ctx;
+    // A config file may grow up to its limit on reload, every fan gets its own slot
+    size_t ngpio = params->config ? CONFIG_MAX_FANS : params->ngpio;
+    // Sliding windows report every interval instead of every duration
+    int64_t interval_ns = params->method == METHOD_SLIDING ? params->interval_ns : params->duration_ns;
+
+    if (params->daemon_socket) {
+        fprintf(stderr, "\nDaemon mode started. Send SIGTERM or press Ctrl+C to stop.\n\n");
+    } else {
+        fprintf(stderr, "\nWatch mode started. Press 'q' to quit or Ctrl+C to interrupt.\n\n");
+    }
+
+    // Initialize context (allocates arrays, mutex/cond)
+    if (measurement_ctx_init(&ctx, params->gpios, ngpio, chipname) < 0) {
+        return -1;
+    }
+
+    // Everything below is released once, at cleanup (in reverse order)
+    int ret = -1;
+    rpm_summary_t *stats = NULL;
+    rpm_counters_t *counters = NULL;
+    watch_slots_t slots = {0};
+    sink_list_t outputs = {0};
+    prometheus_t *prom = NULL;
+    query_server_t *query = NULL;
+    pthread_t keyboard_thread;
+    int keyboard_ret = -1;
+
+    // Immediate output needs every result: each GPIO publishes into its own queue
+    if (params->publish == PUBLISH_IMMEDIATE && measurement_enable_queues(&ctx, 1) < 0) {
+        goto cleanup;
+    }
+
+    // Allocate statistics and counter arrays (watch-mode specific)
+    stats = calloc(ngpio, sizeof(*stats));
+    counters = calloc(ngpio, sizeof(*counters));
+    slots.fans = calloc(ngpio, sizeof(*slots.fans));
+    slots.generations = calloc(ngpio, sizeof(*slots.generations));
+    // Immediate output sees every result, so it keeps the statistics itself
+    if (params->publish == PUBLISH_IMMEDIATE) {
+        slots.totals = calloc(ngpio, sizeof(*slots.totals));
+    }
+    if (!stats || !counters || !slots.fans || !slots.generations ||
+        (params->publish == PUBLISH_IMMEDIATE && !slots.totals)) {
+        fprintf(stderr, "Error: memory allocation failed\n");
+        goto cleanup;
+    }
+
+    measurement_fans(params, slots.fans, ngpio);
+    for (size_t i = 0; i < ngpio && slots.totals; i++) {
+        stats_init(&slots.totals[i]);
+    }
+
+    // Outputs with their writer threads (a daemon only serves its socket by default)
+    const char *const stdout_spec[] = { "stdout" };
+    const char *const *specs = params->noutputs > 0 ? params->outputs : stdout_spec;
+    size_t nspecs = params->noutputs > 0 ? params->noutputs : (params->daemon_socket ? 0 : 1);
+    if (sink_list_open(&outputs, specs, nspecs, params->mode, params->replay_path != NULL, params->debug) < 0) {
+        goto cleanup;
+    }
+
+    // Serve /metrics, rebuilt once per output round
+    if (params->listen) {
+        prom = prometheus_start(params->listen, slots.fans, ngpio);
+        if (!prom) goto cleanup;
+        fprintf(stderr, "Serving Prometheus metrics on %s/metrics\n\n", params->listen);
+    }
+
+    // Answer queries from the latest results, rebuilt once per output round
+    if (params->daemon_socket) {
+        query = query_start(params->daemon_socket, slots.fans, ngpio);
+        if (!query) goto cleanup;
+        fprintf(stderr, "Answering queries on %s\n\n", params->daemon_socket);
+    }
+
+    // Create keyboard monitor thread (a daemon has no terminal to watch)
+    if (!params->daemon_socket) {
+        keyboard_ret = pthread_create(&keyboard_thread, NULL, keyboard_monitor_thread, NULL);
+        if (keyboard_ret) {
+            fprintf(stderr, "Warning: cannot create keyboard monitor thread: %s\n", strerror(keyboard_ret));
+            fprintf(stderr, "Use Ctrl+C to quit watch mode\n");
+        } else {
+            rtsched_thread(keyboard_thread, "fan-keyboard", 0, NULL, -1, 0);
         }
+    }
+
+    // Create threads for continuous measurement
+    measurement_params_t watch = *params;
+    watch.watch = 1;
 
-        pthread_mutex_unlock(&ctx.results_mutex);
+    if (measurement_create_threads(&ctx, &watch) < 0) {
+        stop_request();
+        goto cleanup;
+    }
+
+    ret = 0;
+    if (params->publish == PUBLISH_IMMEDIATE) {
+        watch_immediate(&ctx, &slots, stats, counters, &outputs, prom, query, interval_ns);
+    } else if (watch_ticked(&ctx, &slots, stats, counters, &outputs, prom, query, interval_ns) < 0) {
+        stop_request();
+        ret = -1;
     }
 
     // Wait for all measurement threads to finish
     measurement_join_threads(&ctx);
 
+    // A replay stops right after its last results, print them too
+    if (params->publish == PUBLISH_IMMEDIATE && params->replay_path) {
+        watch_drain(&ctx, &slots, stats, counters, &outputs, prom, query, interval_ns);
+    }
+
+    if (params->debug) {
+        measurement_print_counters(&ctx, slots.fans);
+    }
+
+cleanup:
     // Wait for keyboard monitor thread
     if (keyboard_ret == 0) {
         pthread_join(keyboard_thread, NULL);
     }
-
-    // Cleanup
+    query_stop(query);
+    prometheus_stop(prom);
+    sink_list_close(&outputs);
+    free(slots.totals);
+    free(slots.generations);
+    free(slots.fans);
+    free(counters);
     free(stats);
     measurement_ctx_cleanup(&ctx);
 
-    return 0;
+    return ret;
 }
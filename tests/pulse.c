@@ -0,0 +1,58 @@
+/**
+ * This module generates synthetic tach signals for the unit tests.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include "pulse.h"
+
+#define PULSE_GLITCH_NS 2000
+
+void pulse_rng_seed(pulse_rng_t *rng, uint64_t seed) {
+    // splitmix64 step, so nearby seeds give unrelated sequences
+    uint64_t z = seed + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    rng->state = z ? z : 1;
+}
+
+double pulse_rng_uniform(pulse_rng_t *rng) {
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    uint64_t value = rng->state * 0x2545f4914f6cdd1dULL;
+    return (double)(value >> 11) / (double)(1ULL << 53);
+}
+
+double pulse_interval_ns(const pulse_train_t *train) {
+    return 60e9 / (train->rpm * train->pulses);
+}
+
+size_t pulse_generate(const pulse_train_t *train, pulse_rng_t *rng, uint64_t start_ns, uint64_t span_ns,
+                      uint64_t *edges, size_t max) {
+    double interval = pulse_interval_ns(train);
+    double phase = pulse_rng_uniform(rng) * interval;
+    size_t n = 0;
+
+    for (uint64_t k = 0; n < max; k++) {
+        double ideal = phase + (double)k * interval;
+        double offset = train->jitter * interval * (2.0 * pulse_rng_uniform(rng) - 1.0);
+        double t = ideal + offset;
+        if (ideal - train->jitter * interval >= (double)span_ns) break;
+        if (t < 0.0 || t >= (double)span_ns) continue;
+
+        uint64_t ts = start_ns + (uint64_t)t;
+        if (n > 0 && ts <= edges[n - 1]) ts = edges[n - 1] + 1;  // Timestamps stay strictly ascending
+        edges[n++] = ts;
+
+        // The line bounces back and forth once, as ringing on a long cable does
+        if (train->glitch > 0.0 && pulse_rng_uniform(rng) < train->glitch) {
+            for (int g = 1; g <= 2 && n < max; g++) {
+                edges[n++] = ts + (uint64_t)g * PULSE_GLITCH_NS;
+            }
+        }
+    }
+    return n;
+}
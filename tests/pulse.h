@@ -0,0 +1,83 @@
+/**
+ * This module generates synthetic tach signals for the unit tests: edge
+ * timestamps of a fan at a known RPM, with timing jitter and glitches,
+ * from a seeded pseudo-random generator so every run is reproducible.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef PULSE_H
+#define PULSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Pseudo-random generator (xorshift64*)
+ */
+typedef struct {
+    uint64_t state;  /**< Generator state (never 0) */
+} pulse_rng_t;
+
+/**
+ * Synthetic tach signal
+ */
+typedef struct {
+    double rpm;        /**< True fan speed */
+    int pulses;        /**< Edges per revolution */
+    double jitter;     /**< Largest displacement of an edge as a fraction of the edge interval (< 0.5) */
+    double glitch;     /**< Chance per edge of a glitch: two extra edges 2 us and 4 us later */
+} pulse_train_t;
+
+/**
+ * Seed a generator
+ *
+ * @param rng Generator
+ * @param seed Seed (any value)
+ */
+void pulse_rng_seed(pulse_rng_t *rng, uint64_t seed);
+
+/**
+ * Draw a uniform number in [0, 1)
+ *
+ * @param rng Generator
+ * @return double Random number
+ */
+double pulse_rng_uniform(pulse_rng_t *rng);
+
+/**
+ * Get the ideal time between two edges of a signal
+ *
+ * @param train Signal
+ * @return double Edge interval in nanoseconds
+ */
+double pulse_interval_ns(const pulse_train_t *train);
+
+/**
+ * Generate the edges of a signal in a time span
+ *
+ * The first ideal edge falls at a random phase within one edge interval
+ * after start_ns. Jitter moves every edge on its own, so errors do not
+ * accumulate; glitch edges are not part of the true RPM.
+ *
+ * @param train Signal
+ * @param rng Generator for phase, jitter and glitches
+ * @param start_ns Start of the span
+ * @param span_ns Length of the span
+ * @param edges Output timestamps, ascending
+ * @param max Capacity of edges
+ * @return size_t Number of edges generated (at most max)
+ */
+size_t pulse_generate(const pulse_train_t *train, pulse_rng_t *rng, uint64_t start_ns, uint64_t span_ns,
+                      uint64_t *edges, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PULSE_H
@@ -0,0 +1,100 @@
+/**
+ * This module provides the checks shared by the unit tests.
+ *
+ * A failed check reports file, line and the values involved and lets the
+ * suite carry on, so one run shows every failure. Every suite is a
+ * function listed in test_main.c and runs as its own ctest test.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <string.h>
+#include "rpmval.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Report a failed check
+ *
+ * @param file Source file of the check
+ * @param line Source line of the check
+ * @param fmt printf format of the failure
+ */
+void test_fail(const char *file, int line, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+/**
+ * Number of checks run so far
+ */
+extern unsigned long test_checks;
+
+/**
+ * Check a condition
+ */
+#define TEST_CHECK(cond) do { \
+    test_checks++; \
+    if (!(cond)) test_fail(__FILE__, __LINE__, "%s", #cond); \
+} while (0)
+
+/**
+ * Check two integers for equality
+ */
+#define TEST_CHECK_INT(actual, expected) do { \
+    long long test_a_ = (long long)(actual), test_e_ = (long long)(expected); \
+    test_checks++; \
+    if (test_a_ != test_e_) { \
+        test_fail(__FILE__, __LINE__, "%s == %lld, expected %lld", #actual, test_a_, test_e_); \
+    } \
+} while (0)
+
+/**
+ * Check two strings for equality
+ */
+#define TEST_CHECK_STR(actual, expected) do { \
+    const char *test_a_ = (actual), *test_e_ = (expected); \
+    test_checks++; \
+    if (!test_a_ || strcmp(test_a_, test_e_) != 0) { \
+        test_fail(__FILE__, __LINE__, "%s == \"%s\", expected \"%s\"", #actual, \
+                  test_a_ ? test_a_ : "(null)", test_e_); \
+    } \
+} while (0)
+
+/**
+ * Check a value against an expected value within a relative tolerance
+ */
+#define TEST_CHECK_NEAR(actual, expected, rel) do { \
+    double test_a_ = (double)(actual), test_e_ = (double)(expected); \
+    double test_d_ = test_a_ > test_e_ ? test_a_ - test_e_ : test_e_ - test_a_; \
+    test_checks++; \
+    if (!(test_d_ <= (double)(rel) * (test_e_ < 0 ? -test_e_ : test_e_))) { \
+        test_fail(__FILE__, __LINE__, "%s == %.6g, expected %.6g within %.4g%%", #actual, test_a_, test_e_, \
+                  (double)(rel) * 100.0); \
+    } \
+} while (0)
+
+/**
+ * RPM of an rpm_value_t as a double (any build)
+ */
+static inline double test_rpm(rpm_value_t rpm) {
+    return (double)rpm / RPM_SCALE;
+}
+
+// Suites (one file each)
+void test_stats(void);
+void test_format(void);
+void test_rpm_math(void);
+void test_methods(void);
+void test_report(void);
+void test_engines(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TEST_H
@@ -0,0 +1,115 @@
+/**
+ * This module runs the measurement engines against the simulated chip of
+ * the benchmark harness (bench/sim_gpiod.c): real threads, timers and
+ * event reads, with edges at a known rate instead of GPIO hardware.
+ *
+ * Staggered sliding windows: every fan's first result covers the one
+ * bucket measured after its phase offset and warmup, in both engines.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include "test.h"
+#include "measurement_common.h"
+#include "stop.h"
+#include "sim_gpiod.h"
+
+#define TEST_ENGINE_FANS 4
+#define TEST_EDGE_RATE 5000.0          // Edges per second of every simulated line
+#define TEST_PULSES 2
+#define TEST_INTERVAL_NS 50000000LL    // Sliding window bucket
+#define TEST_BUCKETS 4
+#define TEST_WARMUP_NS 10000000LL
+#define TEST_TIMEOUT_NS 2000000000LL
+
+volatile sig_atomic_t stop = 0;
+pthread_mutex_t print_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Take back a stop request so the next run measures again
+ */
+static void stop_clear(void) {
+    uint64_t value;
+    ssize_t n = read(stop_fd(), &value, sizeof(value));
+    (void)n;  // EAGAIN only means not signalled
+    stop = 0;
+}
+
+static void test_staggered_sliding(engine_type_t engine) {
+    int gpios[TEST_ENGINE_FANS];
+    for (size_t i = 0; i < TEST_ENGINE_FANS; i++) {
+        gpios[i] = (int)i;
+    }
+
+    measurement_params_t params = {
+        .gpios = gpios,
+        .ngpio = TEST_ENGINE_FANS,
+        .duration_ns = TEST_WARMUP_NS + TEST_INTERVAL_NS * TEST_BUCKETS,
+        .pulses = TEST_PULSES,
+        .warmup_ns = TEST_WARMUP_NS,
+        .edge = EDGE_BOTH,
+        .event_batch = GPIO_EVENT_BATCH_DEFAULT,
+        .method = METHOD_SLIDING,
+        .window_ns = TEST_INTERVAL_NS * TEST_BUCKETS,
+        .interval_ns = TEST_INTERVAL_NS,
+        .watch = 1,
+        .stagger = 1,
+        .engine = engine
+    };
+
+    measurement_ctx_t ctx;
+    char chipname[] = "gpiochip0";
+    TEST_CHECK_INT(measurement_ctx_init(&ctx, gpios, TEST_ENGINE_FANS, chipname), 0);
+    TEST_CHECK_INT(measurement_enable_queues(&ctx, 0), 0);
+    TEST_CHECK_INT(measurement_create_threads(&ctx, &params), 0);
+
+    // The first result of every fan
+    rpm_sample_t first[TEST_ENGINE_FANS];
+    int seen[TEST_ENGINE_FANS] = {0};
+    size_t nseen = 0;
+    int64_t deadline = monotonic_ns() + TEST_TIMEOUT_NS;
+    while (nseen < TEST_ENGINE_FANS && monotonic_ns() < deadline) {
+        for (size_t i = 0; i < TEST_ENGINE_FANS; i++) {
+            if (!seen[i] && rpm_queue_pop(&ctx.queues[i], &first[i])) {
+                seen[i] = 1;
+                nseen++;
+            }
+        }
+        usleep(1000);
+    }
+    stop_request();
+    measurement_join_threads(&ctx);
+
+    TEST_CHECK_INT(nseen, TEST_ENGINE_FANS);
+    double rpm = TEST_EDGE_RATE * 60.0 / TEST_PULSES;
+    for (size_t i = 0; i < TEST_ENGINE_FANS && nseen == TEST_ENGINE_FANS; i++) {
+        // One bucket; a window that never started spans the time since boot
+        TEST_CHECK_NEAR(first[i].elapsed_ns, TEST_INTERVAL_NS, 0.05);
+        TEST_CHECK_NEAR(test_rpm(first[i].rpm), rpm, 0.05);
+    }
+
+    measurement_ctx_cleanup(&ctx);
+    stop_clear();
+}
+
+void test_engines(void) {
+    if (stop_init() < 0) {
+        TEST_CHECK(!"stop_init");
+        return;
+    }
+    sim_set_rate(TEST_EDGE_RATE);
+
+    test_staggered_sliding(ENGINE_THREADS);
+    test_staggered_sliding(ENGINE_EPOLL);
+}
@@ -0,0 +1,256 @@
+/**
+ * This module tests the output formatters: the exact text of every
+ * format, the binary record layout, truncation and the buffer size
+ * format_json_array() allocates for the longest possible entries.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include "test.h"
+#include "format.h"
+
+#define TEST_FANS 64
+
+static uint64_t get_le(const unsigned char *p, size_t bytes) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+static void test_text(void) {
+    char buf[512];
+
+    rpm_stats_t totals;
+    stats_init(&totals);
+    stats_update(&totals, RPM_VALUE(1000));
+    stats_update(&totals, RPM_VALUE(2000));
+    rpm_summary_t stats;
+    stats_summarize(&totals, &stats);
+
+    format_fan_t gpio4 = { .gpio = 4 }, gpio17 = { .gpio = 17 }, gpio18 = { .gpio = 18 };
+    format_fan_t cpu = { .gpio = 18, .name = "cpu" };
+
+    TEST_CHECK_INT(format_numeric_into(buf, sizeof(buf), RPM_VALUE(1234)), 5);
+    TEST_CHECK_STR(buf, "1234\n");
+
+    // Half an RPM rounds away from zero in both builds
+    format_numeric_into(buf, sizeof(buf), RPM_VALUE(2401) / 2);
+    TEST_CHECK_STR(buf, "1201\n");
+
+    format_human_readable_into(buf, sizeof(buf), &gpio17, RPM_VALUE(1500), NULL);
+    TEST_CHECK_STR(buf, "GPIO17: RPM: 1500\n");
+    format_human_readable_into(buf, sizeof(buf), &gpio17, RPM_VALUE(2000), &stats);
+    TEST_CHECK_STR(buf, "GPIO17: RPM: 2000 (min: 1000, max: 2000, avg: 1500)\n");
+
+    format_human_readable_into(buf, sizeof(buf), &cpu, RPM_VALUE(1500), NULL);
+    TEST_CHECK_STR(buf, "cpu (GPIO18): RPM: 1500\n");
+
+    format_json_into(buf, sizeof(buf), &gpio18, RPM_VALUE(900), NULL, NULL);
+    TEST_CHECK_STR(buf, "{\"gpio\":18,\"rpm\":900}\n");
+    format_json_into(buf, sizeof(buf), &cpu, RPM_VALUE(900), NULL, NULL);
+    TEST_CHECK_STR(buf, "{\"gpio\":18,\"name\":\"cpu\",\"rpm\":900}\n");
+
+    rpm_counters_t counters = {
+        .events = 1, .reads = 2, .max_batch = 3, .wakeups = 4,
+        .lost = 5, .overruns = 6, .dropped = 7, .stalls = 8, .stalled = 1
+    };
+    format_json_into(buf, sizeof(buf), &gpio18, 0, NULL, &counters);
+    TEST_CHECK_STR(buf, "{\"gpio\":18,\"rpm\":0,\"stalled\":true,\"counters\":{\"events\":1,\"reads\":2,"
+                        "\"max_batch\":3,\"wakeups\":4,\"lost\":5,\"overruns\":6,\"dropped\":7,\"stalls\":8}}\n");
+
+    format_output_into(buf, sizeof(buf), &gpio18, 0, NULL, &counters, MODE_DEFAULT, 0, 0);
+    TEST_CHECK_STR(buf, "GPIO18: RPM: 0 (stalled)\n");
+    format_output_into(buf, sizeof(buf), &cpu, 0, NULL, &counters, MODE_DEFAULT, 0, 0);
+    TEST_CHECK_STR(buf, "cpu (GPIO18): RPM: 0 (stalled)\n");
+
+    char host[256] = "unknown";
+    if (gethostname(host, sizeof(host) - 1) < 0) strcpy(host, "unknown");
+    host[sizeof(host) - 1] = '\0';
+    char expected[512];
+
+    format_collectd_into(buf, sizeof(buf), &gpio4, RPM_VALUE(3000), 1500000000LL, 1700000000);
+    snprintf(expected, sizeof(expected), "PUTVAL \"%s/gpio-fan-4/gauge-rpm\" interval=1.5 1700000000:3000\n", host);
+    TEST_CHECK_STR(buf, expected);
+    format_collectd_into(buf, sizeof(buf), &cpu, RPM_VALUE(3000), 1500000000LL, 1700000000);
+    snprintf(expected, sizeof(expected), "PUTVAL \"%s/gpio-fan-cpu/gauge-rpm\" interval=1.5 1700000000:3000\n", host);
+    TEST_CHECK_STR(buf, expected);
+
+    counters.stalled = 0;
+    format_influx_into(buf, sizeof(buf), &gpio4, RPM_VALUE(3000), &counters, 1700000000123456789LL);
+    snprintf(expected, sizeof(expected), "gpio_fan,host=%s,gpio=4 rpm=3000,stalled=false 1700000000123456789\n", host);
+    TEST_CHECK_STR(buf, expected);
+    format_influx_into(buf, sizeof(buf), &cpu, RPM_VALUE(3000), &counters, 1700000000123456789LL);
+    snprintf(expected, sizeof(expected), "gpio_fan,host=%s,gpio=18,fan=cpu rpm=3000,stalled=false 1700000000123456789\n",
+             host);
+    TEST_CHECK_STR(buf, expected);
+}
+
+static void test_decimal(void) {
+    char buf[32];
+
+    format_decimal_into(buf, sizeof(buf), 1500, 3);
+    TEST_CHECK_STR(buf, "1.5");
+    format_decimal_into(buf, sizeof(buf), 2000000000, 9);
+    TEST_CHECK_STR(buf, "2");
+    format_decimal_into(buf, sizeof(buf), -1005, 3);
+    TEST_CHECK_STR(buf, "-1.005");
+    format_decimal_into(buf, sizeof(buf), 7, 0);
+    TEST_CHECK_STR(buf, "7");
+    TEST_CHECK_INT(format_decimal_into(buf, sizeof(buf), 1, 19), -1);
+}
+
+static void test_binary(void) {
+    unsigned char rec[FORMAT_BINARY_RECORD_SIZE];
+
+    TEST_CHECK_INT(format_binary_into(rec, sizeof(rec) - 1, 1, 0, 0, 0, 0, 0), -1);
+    TEST_CHECK_INT(format_binary_into(rec, sizeof(rec), -2, RPM_VALUE(1500), 0x123456789ULL,
+                                      FORMAT_BINARY_FLAG_STALLED, 1000000000LL, 1700000000000000000LL),
+                   FORMAT_BINARY_RECORD_SIZE);
+
+    TEST_CHECK_INT(get_le(rec, 2), FORMAT_BINARY_RECORD_SIZE);
+    TEST_CHECK_INT(rec[2], FORMAT_BINARY_VERSION);
+    TEST_CHECK_INT(rec[3], FORMAT_BINARY_FLAG_STALLED);
+    TEST_CHECK_INT((int32_t)get_le(rec + 4, 4), -2);
+    TEST_CHECK_INT(get_le(rec + 8, 8), 1700000000000000000LL);
+    TEST_CHECK_INT(get_le(rec + 16, 8), 1000000000LL);
+    TEST_CHECK(get_le(rec + 24, 8) == 0x4097700000000000ULL);  // 1500.0
+    TEST_CHECK_INT(get_le(rec + 32, 4), UINT32_MAX);            // Saturated
+    TEST_CHECK_INT(get_le(rec + 36, 4), 0);
+}
+
+static void test_json_array(void) {
+    char buf[4096];
+    format_fan_t fans[3] = {{ .gpio = 17 }, { .gpio = 18 }, { .gpio = 27, .name = "case" }};
+    rpm_value_t results[3] = {RPM_VALUE(1200), -1, RPM_VALUE(0)};
+
+    // Interrupted measurements are left out
+    format_json_array_into(buf, sizeof(buf), fans, results, NULL, NULL, 3);
+    TEST_CHECK_STR(buf, "[{\"gpio\":17,\"rpm\":1200},{\"gpio\":27,\"name\":\"case\",\"rpm\":0}]\n");
+
+    char *json = format_json_array(fans, results, NULL, 3);
+    TEST_CHECK_STR(json, buf);
+    free(json);
+
+    // Truncation fails instead of writing a partial array
+    size_t len = strlen(buf);
+    TEST_CHECK_INT(format_json_array_into(buf, len, fans, results, NULL, NULL, 3), -1);
+    TEST_CHECK_INT(format_json_array_into(buf, len + 1, fans, results, NULL, NULL, 3), (int)len);
+
+    TEST_CHECK(format_json_array(fans, results, NULL, 0) == NULL);
+}
+
+/**
+ * format_json_array() sizes its buffer from the longest entry; every
+ * field at its widest must still fit
+ */
+static void test_json_array_worst_case(void) {
+    static format_fan_t fans[TEST_FANS];
+    static rpm_value_t results[TEST_FANS];
+    static rpm_summary_t stats[TEST_FANS];
+    static char expected[TEST_FANS * 512];
+
+    for (size_t i = 0; i < TEST_FANS; i++) {
+        fans[i].gpio = INT_MIN;
+        memset(fans[i].name, 'n', sizeof(fans[i].name) - 1);  // Longest name
+        results[i] = RPM_VALUE(INT_MAX);  // Negative results are skipped
+        // One negative value puts every statistic at INT_MIN
+        rpm_stats_t totals;
+        stats_init(&totals);
+        stats_update(&totals, RPM_VALUE(INT_MIN));
+        stats_summarize(&totals, &stats[i]);
+    }
+
+    for (size_t n = 1; n <= TEST_FANS; n++) {
+        for (int with_stats = 0; with_stats <= 1; with_stats++) {
+            const rpm_summary_t *s = with_stats ? stats : NULL;
+            int len = format_json_array_into(expected, sizeof(expected), fans, results, s, NULL, n);
+            TEST_CHECK(len > 0);
+
+            char *json = format_json_array(fans, results, s, n);
+            TEST_CHECK(json != NULL);
+            if (json && len > 0) {
+                TEST_CHECK_STR(json, expected);
+            }
+            free(json);
+        }
+    }
+
+    format_json_array_into(expected, sizeof(expected), fans, results, stats, NULL, 1);
+    TEST_CHECK(strstr(expected, "\"window_max\":-2147483648}") != NULL);
+}
+
+static void test_parse_mode(void) {
+    static const struct {
+        const char *name;
+        output_mode_t mode;
+    } modes[] = {
+        {"default", MODE_DEFAULT}, {"numeric", MODE_NUMERIC}, {"json", MODE_JSON},
+        {"collectd", MODE_COLLECTD}, {"binary", MODE_BINARY}, {"influx", MODE_INFLUX},
+        {"collectd-net", MODE_COLLECTD_NET}
+    };
+
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        output_mode_t mode = MODE_DEFAULT;
+        TEST_CHECK_INT(format_parse_mode(modes[i].name, &mode), 0);
+        TEST_CHECK_INT(mode, modes[i].mode);
+    }
+
+    output_mode_t mode = MODE_JSON;
+    TEST_CHECK_INT(format_parse_mode("xml", &mode), -1);
+    TEST_CHECK_INT(mode, MODE_JSON);
+    TEST_CHECK_INT(format_parse_mode(NULL, &mode), -1);
+}
+
+static void test_buffer(void) {
+    format_buffer_t out;
+    TEST_CHECK_INT(format_buffer_init(&out, 8), 0);
+    format_buffer_reset(&out);
+
+    // Appends grow the buffer instead of truncating
+    for (int i = 0; i < 100; i++) {
+        format_fan_t fan = { .gpio = i };
+        TEST_CHECK_INT(format_buffer_append_output(&out, &fan, RPM_VALUE(1000 + i), NULL, NULL, MODE_NUMERIC, 0), 0);
+    }
+    TEST_CHECK(out.cap >= out.len);
+
+    char expected[16];
+    size_t pos = 0;
+    for (int i = 0; i < 100; i++) {
+        int n = snprintf(expected, sizeof(expected), "%d\n", 1000 + i);
+        TEST_CHECK(pos + (size_t)n <= out.len && memcmp(out.data + pos, expected, (size_t)n) == 0);
+        pos += (size_t)n;
+    }
+    TEST_CHECK_INT(out.len, pos);
+
+    // Datagrams carry whole lines only
+    format_packer_t packer;
+    format_packer_init(&packer, MODE_NUMERIC, out.data, out.len);
+    unsigned char dgram[32];
+    const unsigned char *data;
+    size_t total = 0, len;
+    while ((len = format_packer_next(&packer, dgram, sizeof(dgram), &data)) > 0) {
+        TEST_CHECK(len <= sizeof(dgram));
+        TEST_CHECK(data[len - 1] == '\n');
+        TEST_CHECK(memcmp(data, out.data + total, len) == 0);
+        total += len;
+    }
+    TEST_CHECK_INT(total, out.len);
+
+    format_buffer_free(&out);
+}
+
+void test_format(void) {
+    test_text();
+    test_decimal();
+    test_binary();
+    test_json_array();
+    test_json_array_worst_case();
+    test_parse_mode();
+    test_buffer();
+}
@@ -0,0 +1,84 @@
+/**
+ * This module runs the unit test suites.
+ *
+ * Without arguments every suite runs; otherwise only the named ones
+ * (ctest runs each suite as a test of its own). The exit status is 0 if
+ * all checks passed.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "test.h"
+
+unsigned long test_checks = 0;
+static unsigned long test_failures = 0;
+
+static const struct {
+    const char *name;
+    void (*run)(void);
+} suites[] = {
+    {"stats", test_stats},
+    {"format", test_format},
+    {"rpm", test_rpm_math},
+    {"methods", test_methods},
+    {"report", test_report},
+    {"engines", test_engines}
+};
+
+#define NSUITES (sizeof(suites) / sizeof(suites[0]))
+
+void test_fail(const char *file, int line, const char *fmt, ...) {
+    test_failures++;
+    fprintf(stderr, "%s:%d: ", file, line);
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [SUITE...]\n\n", prog);
+    printf("Run the unit tests (default: all suites).\n\n");
+    printf("Suites:");
+    for (size_t s = 0; s < NSUITES; s++) {
+        printf(" %s", suites[s].name);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    int selected[NSUITES] = {0};
+    int any = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        }
+        size_t s = 0;
+        while (s < NSUITES && strcmp(argv[i], suites[s].name) != 0) s++;
+        if (s == NSUITES) {
+            fprintf(stderr, "\nError: unknown suite '%s'\n\n", argv[i]);
+            fprintf(stderr, "Try: %s --help\n\n", argv[0]);
+            return 1;
+        }
+        selected[s] = 1;
+        any = 1;
+    }
+
+    for (size_t s = 0; s < NSUITES; s++) {
+        if (any && !selected[s]) continue;
+
+        unsigned long checks = test_checks, failures = test_failures;
+        suites[s].run();
+        printf("%-8s %6lu checks, %lu failed\n", suites[s].name, test_checks - checks, test_failures - failures);
+    }
+
+    return test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,372 @@
+/**
+ * This module checks every measurement method against synthetic tach
+ * signals of known RPM and reports accuracy against cost.
+ *
+ * The drivers below feed generated edge timestamps through the same
+ * trackers in rpm.c the engines use, window by window as the engines do,
+ * so the results are those a fan with that signal would get (without
+ * the kernel's event delivery).
+ *
+ * Property checks draw random fans (300 - 20000 RPM, 1, 2 or 4 pulses
+ * per revolution) and timing jitter and hold every result to the error
+ * bound of its method:
+ *
+ *   count, sliding  fewer than 1 edge off over the window, 3 with jitter
+ *                   (an edge near either boundary may cross it)
+ *   period          exact on a clean signal; jitter j moves a period by
+ *                   at most 2j of the edge interval
+ *   adaptive        as period, spread over the target number of edges
+ *
+ * The report suite prints mean/max error, latency to the first result,
+ * result interval and CPU time per edge for every method on a clean, a
+ * jittery and a glitching signal. CPU time is reported but never checked,
+ * so loaded CI machines do not fail the suite.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include "test.h"
+#include "rpm.h"
+#include "pulse.h"
+
+#define NSEC_PER_SEC 1000000000LL
+#define RESULTS_MAX 4096
+#define SLIDING_MAX 64
+
+// Match the period and adaptive results of the fixed-point build
+#define EXACT_TOLERANCE 1e-4
+
+/**
+ * Measurement method under test
+ */
+typedef enum {
+    TEST_COUNT,
+    TEST_PERIOD,
+    TEST_SLIDING,
+    TEST_ADAPTIVE,
+    TEST_METHODS
+} test_method_t;
+
+static const char *const method_names[TEST_METHODS] = {"count", "period", "sliding", "adaptive"};
+
+/**
+ * Method parameters (as set by --duration, --periods, --interval/--window
+ * and --target-pulses)
+ */
+typedef struct {
+    int64_t window_ns;       /**< Count window */
+    unsigned int periods;    /**< Periods per period result */
+    size_t buckets;          /**< Sliding window buckets */
+    int64_t bucket_ns;       /**< Sliding window bucket length (report interval) */
+    unsigned int target;     /**< Adaptive edge intervals per result */
+} method_config_t;
+
+/**
+ * One result of a method
+ */
+typedef struct {
+    double rpm;        /**< Measured RPM */
+    uint64_t at_ns;    /**< Time the result was available */
+} method_result_t;
+
+static const method_config_t default_config = {
+    .window_ns = NSEC_PER_SEC,
+    .periods = RPM_PERIODS_DEFAULT,
+    .buckets = 4,
+    .bucket_ns = NSEC_PER_SEC / 4,
+    .target = RPM_TARGET_PULSES_DEFAULT
+};
+
+/**
+ * Count the edges before a time, from *pos on, and advance *pos past them
+ */
+static unsigned int count_until(const uint64_t *edges, size_t n, size_t *pos, uint64_t to) {
+    unsigned int count = 0;
+    while (*pos < n && edges[*pos] < to) {
+        (*pos)++;
+        count++;
+    }
+    return count;
+}
+
+static size_t run_count(const method_config_t *cfg, const uint64_t *edges, size_t n, uint64_t span_ns, int pulses,
+                        method_result_t *out, size_t max) {
+    size_t pos = 0, nresults = 0;
+    for (uint64_t end = (uint64_t)cfg->window_ns; end <= span_ns && nresults < max; end += (uint64_t)cfg->window_ns) {
+        unsigned int count = count_until(edges, n, &pos, end);
+        out[nresults].rpm = test_rpm(rpm_from_count(count, pulses, cfg->window_ns));
+        out[nresults++].at_ns = end;
+    }
+    return nresults;
+}
+
+static size_t run_period(const method_config_t *cfg, const uint64_t *edges, size_t n, uint64_t span_ns, int pulses,
+                         method_result_t *out, size_t max) {
+    (void)span_ns;
+    uint64_t storage[RPM_PERIODS_MAX];
+    period_tracker_t tracker;
+    period_init(&tracker, storage, cfg->periods, EDGE_RISING);
+
+    size_t nresults = 0;
+    for (size_t i = 0; i < n && nresults < max; i++) {
+        if (period_add(&tracker, edges[i])) {
+            out[nresults].rpm = test_rpm(period_rpm(&tracker, pulses));
+            out[nresults++].at_ns = edges[i];
+            period_reset(&tracker);
+        }
+    }
+    return nresults;
+}
+
+static size_t run_sliding(const method_config_t *cfg, const uint64_t *edges, size_t n, uint64_t span_ns, int pulses,
+                          method_result_t *out, size_t max) {
+    unsigned int counts[SLIDING_MAX];
+    int64_t starts[SLIDING_MAX];
+    sliding_window_t window;
+    sliding_init(&window, counts, starts, cfg->buckets);
+    sliding_reset(&window, 0);
+
+    size_t pos = 0, nresults = 0;
+    for (uint64_t end = (uint64_t)cfg->bucket_ns; end <= span_ns && nresults < max; end += (uint64_t)cfg->bucket_ns) {
+        sliding_add(&window, count_until(edges, n, &pos, end));
+        rpm_value_t rpm = sliding_rotate(&window, (int64_t)end, pulses);
+        // Results are only reported once the window covers its full length
+        if (window.filled == window.nbuckets) {
+            out[nresults].rpm = test_rpm(rpm);
+            out[nresults++].at_ns = end;
+        }
+    }
+    return nresults;
+}
+
+static size_t run_adaptive(const method_config_t *cfg, const uint64_t *edges, size_t n, uint64_t span_ns, int pulses,
+                           method_result_t *out, size_t max) {
+    (void)span_ns;
+    adaptive_tracker_t tracker;
+    adaptive_init(&tracker, cfg->target, EDGE_RISING);
+
+    size_t nresults = 0;
+    for (size_t i = 0; i < n && nresults < max; i++) {
+        if (adaptive_add(&tracker, edges[i])) {
+            out[nresults].rpm = test_rpm(adaptive_rpm(&tracker, pulses));
+            out[nresults++].at_ns = edges[i];
+            // The completing edge starts the next window
+            adaptive_reset(&tracker);
+            adaptive_add(&tracker, edges[i]);
+        }
+    }
+    return nresults;
+}
+
+typedef size_t (*method_run_fn)(const method_config_t *cfg, const uint64_t *edges, size_t n, uint64_t span_ns,
+                                int pulses, method_result_t *out, size_t max);
+
+static const method_run_fn method_runs[TEST_METHODS] = {run_count, run_period, run_sliding, run_adaptive};
+
+/**
+ * Signal length giving a method a few results
+ */
+static uint64_t method_span_ns(test_method_t method, const method_config_t *cfg, const pulse_train_t *train) {
+    double interval = pulse_interval_ns(train);
+    switch (method) {
+        case TEST_COUNT:
+            return 4 * (uint64_t)cfg->window_ns;
+        case TEST_SLIDING:
+            return (cfg->buckets + 4) * (uint64_t)cfg->bucket_ns;
+        case TEST_PERIOD:
+            return (uint64_t)(4.0 * (cfg->periods + 2) * interval);
+        case TEST_ADAPTIVE:
+        default:
+            return (uint64_t)(4.0 * (cfg->target + 2) * interval);
+    }
+}
+
+/**
+ * Largest relative error a method may show on a signal without glitches
+ */
+static double method_bound(test_method_t method, const method_config_t *cfg, const pulse_train_t *train) {
+    double interval = pulse_interval_ns(train);
+    double j = train->jitter;
+    switch (method) {
+        case TEST_COUNT:
+        case TEST_SLIDING: {
+            double window = method == TEST_COUNT ? (double)cfg->window_ns : (double)(cfg->buckets * cfg->bucket_ns);
+            double edges = j > 0.0 ? 3.0 : 1.0;
+            return edges * interval / window + 1e-6;
+        }
+        case TEST_PERIOD:
+            return 2.0 * j / (1.0 - 2.0 * j) + EXACT_TOLERANCE;
+        case TEST_ADAPTIVE:
+        default: {
+            double spread = 2.0 * j / cfg->target;
+            return spread / (1.0 - spread) + EXACT_TOLERANCE;
+        }
+    }
+}
+
+/**
+ * Accuracy and cost of a method over a number of runs
+ */
+typedef struct {
+    unsigned long runs;        /**< Signals measured */
+    unsigned long results;     /**< Results over all runs */
+    double error_sum;          /**< Sum of relative errors */
+    double error_max;          /**< Largest relative error */
+    double latency_sum;        /**< Sum of times to the first result in ns */
+    double interval_sum;       /**< Sum of mean times between results in ns */
+    unsigned long intervals;   /**< Runs with at least two results */
+    double cpu_ns;             /**< CPU time of all runs */
+    unsigned long edges;       /**< Edges processed over all runs */
+} method_summary_t;
+
+static double cpu_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * Measure one signal with one method and fold the results into a summary
+ *
+ * @param reps Repetitions timed for the CPU figure (results of the first run are used)
+ * @return int 0 if every result kept to the method's bound (glitch-free signals only), -1 otherwise
+ */
+static int measure_train(test_method_t method, const method_config_t *cfg, const pulse_train_t *train,
+                         uint64_t seed, int reps, method_summary_t *summary) {
+    static method_result_t results[RESULTS_MAX];
+    pulse_rng_t rng;
+    pulse_rng_seed(&rng, seed);
+
+    uint64_t span = method_span_ns(method, cfg, train);
+    size_t max = (size_t)((double)span / pulse_interval_ns(train) * (1.0 + 2.0 * train->glitch)) + 64;
+    uint64_t *edges = malloc(max * sizeof(*edges));
+    if (!edges) {
+        TEST_CHECK(edges != NULL);
+        return -1;
+    }
+    size_t n = pulse_generate(train, &rng, 0, span, edges, max);
+
+    double cpu_start = cpu_now_ns();
+    size_t nresults = 0;
+    for (int r = 0; r < reps; r++) {
+        nresults = method_runs[method](cfg, edges, n, span, train->pulses, results, RESULTS_MAX);
+    }
+    summary->cpu_ns += cpu_now_ns() - cpu_start;
+    summary->edges += (unsigned long)n * (unsigned long)reps;
+    free(edges);
+
+    summary->runs++;
+    TEST_CHECK(nresults > 0);
+    if (nresults == 0) return -1;
+
+    double bound = method_bound(method, cfg, train);
+    int ok = 0;
+    for (size_t i = 0; i < nresults; i++) {
+        double error = results[i].rpm > train->rpm ? results[i].rpm - train->rpm : train->rpm - results[i].rpm;
+        error /= train->rpm;
+        summary->error_sum += error;
+        if (error > summary->error_max) summary->error_max = error;
+        if (train->glitch == 0.0 && !(error <= bound)) {
+            test_fail(__FILE__, __LINE__, "%s: %.3f RPM measured %.3f (error %.4g%%, bound %.4g%%, %d pulses, jitter %.3f)",
+                      method_names[method], train->rpm, results[i].rpm, error * 100.0, bound * 100.0,
+                      train->pulses, train->jitter);
+            ok = -1;
+        }
+    }
+    summary->results += nresults;
+    summary->latency_sum += (double)results[0].at_ns;
+    if (nresults > 1) {
+        summary->interval_sum += (double)(results[nresults - 1].at_ns - results[0].at_ns) / (double)(nresults - 1);
+        summary->intervals++;
+    }
+    return ok;
+}
+
+/**
+ * Random fans and jitter: every result of every method within its bound
+ */
+void test_methods(void) {
+    static const int pulse_choices[] = {1, 2, 4};
+    pulse_rng_t rng;
+    pulse_rng_seed(&rng, 2024);
+
+    for (uint64_t seed = 1; seed <= 200; seed++) {
+        pulse_train_t train = {
+            .rpm = 300.0 + pulse_rng_uniform(&rng) * 19700.0,
+            .pulses = pulse_choices[(size_t)(pulse_rng_uniform(&rng) * 3)],
+            .jitter = seed % 2 ? 0.0 : pulse_rng_uniform(&rng) * 0.2,
+            .glitch = 0.0
+        };
+
+        for (int m = 0; m < TEST_METHODS; m++) {
+            method_summary_t summary = {0};
+            measure_train((test_method_t)m, &default_config, &train, seed, 1, &summary);
+        }
+    }
+
+    // Short windows and few periods keep to the same bounds
+    static const method_config_t short_config = {
+        .window_ns = NSEC_PER_SEC / 10,
+        .periods = 1,
+        .buckets = 10,
+        .bucket_ns = NSEC_PER_SEC / 100,
+        .target = 2
+    };
+    for (uint64_t seed = 1; seed <= 50; seed++) {
+        pulse_train_t train = {.rpm = 1000.0 + 400.0 * (double)seed, .pulses = 2, .jitter = 0.1, .glitch = 0.0};
+        for (int m = 0; m < TEST_METHODS; m++) {
+            method_summary_t summary = {0};
+            measure_train((test_method_t)m, &short_config, &train, seed, 1, &summary);
+        }
+    }
+}
+
+/**
+ * Accuracy-vs-cost table of every method on three signals
+ */
+void test_report(void) {
+    static const struct {
+        const char *name;
+        double jitter;
+        double glitch;
+    } scenarios[] = {
+        {"clean", 0.0, 0.0},
+        {"jitter 5%", 0.05, 0.0},
+        {"glitch 1%", 0.0, 0.01}
+    };
+    const int runs = 20, reps = 20;
+    const pulse_train_t base = {.rpm = 3000.0, .pulses = 2};
+
+    printf("\nMethods at %.0f RPM, %d pulses/rev: count %lld ms, period %u periods, "
+           "sliding %zu x %lld ms, adaptive %u edges\n",
+           base.rpm, base.pulses, (long long)(default_config.window_ns / 1000000), default_config.periods,
+           default_config.buckets, (long long)(default_config.bucket_ns / 1000000), default_config.target);
+    printf("CPU is the tracker arithmetic per edge on this host (no kernel event delivery)\n");
+
+    for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+        printf("\n%-10s  %10s  %10s  %12s  %12s  %10s\n", scenarios[s].name, "mean err", "max err",
+               "latency ms", "interval ms", "cpu ns/edge");
+
+        for (int m = 0; m < TEST_METHODS; m++) {
+            pulse_train_t train = base;
+            train.jitter = scenarios[s].jitter;
+            train.glitch = scenarios[s].glitch;
+
+            method_summary_t summary = {0};
+            for (int r = 0; r < runs; r++) {
+                measure_train((test_method_t)m, &default_config, &train, (uint64_t)(r + 1), reps, &summary);
+            }
+
+            printf("%-10s  %9.4f%%  %9.4f%%  %12.1f  %12.1f  %10.1f\n", method_names[m],
+                   summary.results ? summary.error_sum / (double)summary.results * 100.0 : 0.0,
+                   summary.error_max * 100.0,
+                   summary.runs ? summary.latency_sum / (double)summary.runs / 1e6 : 0.0,
+                   summary.intervals ? summary.interval_sum / (double)summary.intervals / 1e6 : 0.0,
+                   summary.edges ? summary.cpu_ns / (double)summary.edges : 0.0);
+        }
+    }
+    printf("\n");
+}
@@ -0,0 +1,119 @@
+/**
+ * This module tests the RPM arithmetic shared by the engines: rates,
+ * rounding, the binary64 conversion of the fixed-point build, stall
+ * timeouts, window staggering and the adaptive target.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include "test.h"
+#include "rpm.h"
+#include "pulse.h"
+
+static void test_from_count(void) {
+    // 100 edges of a 2-pulse fan in one second: 50 rev/s
+    TEST_CHECK_NEAR(test_rpm(rpm_from_count(100, 2, 1000000000LL)), 3000.0, 1e-9);
+    TEST_CHECK_NEAR(test_rpm(rpm_from_count(1, 2, 3000000000LL)), 10.0, 1e-9);
+    TEST_CHECK_NEAR(test_rpm(rpm_from_count(7, 3, 1234567LL)), 7 * 60e9 / (1234567.0 * 3), 1e-6);
+
+    TEST_CHECK(rpm_from_count(0, 2, 1000000000LL) == 0);
+    TEST_CHECK(rpm_from_count(100, 2, 0) == 0);
+    TEST_CHECK(rpm_from_count(100, 2, -5) == 0);
+    TEST_CHECK(rpm_from_count(100, 0, 1000000000LL) == 0);
+}
+
+/**
+ * Random counts and spans: the rate matches double arithmetic to 1e-6,
+ * from 1000 RPM on where that is within the milli-RPM resolution of the
+ * fixed-point build
+ */
+static void test_from_count_random(void) {
+    pulse_rng_t rng;
+    pulse_rng_seed(&rng, 42);
+
+    for (int i = 0; i < 10000; i++) {
+        unsigned int count = 1 + (unsigned int)(pulse_rng_uniform(&rng) * 100000);
+        int pulses = 1 + (int)(pulse_rng_uniform(&rng) * 8);
+        int64_t span = 1000000 + (int64_t)(pulse_rng_uniform(&rng) * 60e9);
+        double expected = (double)count * 60e9 / ((double)span * pulses);
+        if (expected < 1000.0) continue;
+        TEST_CHECK_NEAR(test_rpm(rpm_from_count(count, pulses, span)), expected, 1e-6);
+    }
+}
+
+static void test_round(void) {
+    TEST_CHECK_INT(rpm_round(RPM_VALUE(0)), 0);
+    TEST_CHECK_INT(rpm_round(RPM_VALUE(5) / 2), 3);
+    TEST_CHECK_INT(rpm_round(-RPM_VALUE(5) / 2), -3);
+    TEST_CHECK_INT(rpm_round(RPM_VALUE(1234)), 1234);
+    TEST_CHECK_INT(rpm_round(RPM_VALUE(INT64_C(1) << 40)), INT64_C(1) << 40);
+}
+
+static void test_f64_bits(void) {
+    static const struct {
+        int rpm;
+        uint64_t bits;
+    } cases[] = {
+        {0, 0x0000000000000000ULL},
+        {1, 0x3ff0000000000000ULL},
+        {-1, 0xbff0000000000000ULL},
+        {1500, 0x4097700000000000ULL},
+        {100000, 0x40f86a0000000000ULL}
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        TEST_CHECK(rpm_f64_bits(RPM_VALUE(cases[i].rpm)) == cases[i].bits);
+    }
+
+    // Every representable value converts to the nearest double
+    pulse_rng_t rng;
+    pulse_rng_seed(&rng, 7);
+    for (int i = 0; i < 10000; i++) {
+        rpm_value_t rpm = (rpm_value_t)((pulse_rng_uniform(&rng) - 0.25) * 1e6 * RPM_SCALE);
+        double value = (double)rpm / RPM_SCALE;
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        TEST_CHECK(rpm_f64_bits(rpm) == bits);
+    }
+}
+
+static void test_stall_timeout(void) {
+    // Three edges of a 2-pulse fan at 300 RPM: 10 edges/s
+    TEST_CHECK_INT(rpm_stall_timeout_ns(300, 2), 300000000LL);
+    TEST_CHECK_INT(rpm_stall_timeout_ns(1, 1), RPM_STALL_EDGES * 60000000000LL);
+    TEST_CHECK_INT(rpm_stall_timeout_ns(0, 2), 0);
+    TEST_CHECK_INT(rpm_stall_timeout_ns(300, 0), 0);
+}
+
+static void test_stagger(void) {
+    TEST_CHECK_INT(rpm_stagger_ns(1000000000LL, 0, 4), 0);
+    TEST_CHECK_INT(rpm_stagger_ns(1000000000LL, 1, 4), 250000000LL);
+    TEST_CHECK_INT(rpm_stagger_ns(1000000000LL, 3, 4), 750000000LL);
+    TEST_CHECK_INT(rpm_stagger_ns(1000000000LL, 4, 4), 0);
+    TEST_CHECK_INT(rpm_stagger_ns(1000000000LL, 0, 0), 0);
+    TEST_CHECK_INT(rpm_stagger_ns(0, 1, 4), 0);
+
+    // The largest round and fan count still spread evenly without overflow
+    int64_t hour = 3600LL * 1000000000LL;
+    TEST_CHECK_INT(rpm_stagger_ns(hour, 63, 64), hour / 64 * 63);
+}
+
+static void test_target_from_error(void) {
+    TEST_CHECK_INT(rpm_target_from_error(0.01), 100);
+    TEST_CHECK_INT(rpm_target_from_error(0.003), 334);
+    TEST_CHECK_INT(rpm_target_from_error(1.0), 2);
+    TEST_CHECK_INT(rpm_target_from_error(0.0), RPM_TARGET_PULSES_MAX);
+    TEST_CHECK_INT(rpm_target_from_error(-1.0), RPM_TARGET_PULSES_MAX);
+    TEST_CHECK_INT(rpm_target_from_error(1e-9), RPM_TARGET_PULSES_MAX);
+}
+
+void test_rpm_math(void) {
+    test_from_count();
+    test_from_count_random();
+    test_round();
+    test_f64_bits();
+    test_stall_timeout();
+    test_stagger();
+    test_target_from_error();
+}
@@ -0,0 +1,155 @@
+/**
+ * This module tests the streaming statistics against exact results
+ * computed from the whole series: min/max/avg, the EWMA, the window
+ * extremes, the percentile sketch and the summary derived from them.
+ *
+ * @author  CSoellinger
+ * @license LGPL-3.0-or-later
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include "test.h"
+#include "stats.h"
+#include "pulse.h"
+
+#define SERIES_MAX 2000
+
+static int compare_rpm(const void *a, const void *b) {
+    rpm_value_t x = *(const rpm_value_t *)a;
+    rpm_value_t y = *(const rpm_value_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void test_empty(void) {
+    rpm_stats_t stats;
+    stats_init(&stats);
+
+    TEST_CHECK_INT(stats.count, 0);
+    TEST_CHECK(stats_avg(&stats) == 0);
+    TEST_CHECK(stats_ewma(&stats) == 0);
+    TEST_CHECK(stats_window_min(&stats) == 0);
+    TEST_CHECK(stats_window_max(&stats) == 0);
+    TEST_CHECK(stats_percentile(&stats, 500) == 0);
+    TEST_CHECK(stats_avg(NULL) == 0);
+
+    rpm_summary_t summary;
+    stats_summarize(&stats, &summary);
+    TEST_CHECK_INT(summary.count, 0);
+    TEST_CHECK(summary.min == 0 && summary.max == 0 && summary.p99 == 0);
+}
+
+static void test_basic(void) {
+    rpm_stats_t stats;
+    stats_init(&stats);
+
+    static const int series[] = {1200, 900, 1500, 1300};
+    for (size_t i = 0; i < sizeof(series) / sizeof(series[0]); i++) {
+        stats_update(&stats, RPM_VALUE(series[i]));
+    }
+
+    TEST_CHECK_INT(stats.count, 4);
+    TEST_CHECK_INT(rpm_round(stats.min), 900);
+    TEST_CHECK_INT(rpm_round(stats.max), 1500);
+    TEST_CHECK_INT(rpm_round(stats_avg(&stats)), 1225);
+    TEST_CHECK_INT(rpm_round(stats_window_min(&stats)), 900);
+    TEST_CHECK_INT(rpm_round(stats_window_max(&stats)), 1500);
+
+    // The first value seeds the EWMA, every later one moves it 2/17 of the way
+    double ewma = 1200;
+    for (size_t i = 1; i < 4; i++) {
+        ewma += (series[i] - ewma) * STATS_EWMA_NUM / STATS_EWMA_DEN;
+    }
+    TEST_CHECK_NEAR(test_rpm(stats_ewma(&stats)), ewma, 1e-5);
+}
+
+static void test_constant(void) {
+    rpm_stats_t stats;
+    stats_init(&stats);
+    for (int i = 0; i < 1000; i++) {
+        stats_update(&stats, RPM_VALUE(2400));
+    }
+
+    // Every estimate of a constant series is that constant
+    TEST_CHECK_INT(rpm_round(stats_avg(&stats)), 2400);
+    TEST_CHECK_INT(rpm_round(stats_ewma(&stats)), 2400);
+    TEST_CHECK_INT(rpm_round(stats_percentile(&stats, 500)), 2400);
+    TEST_CHECK_INT(rpm_round(stats_percentile(&stats, 990)), 2400);
+}
+
+/**
+ * Random series: every statistic matches the exact value of the series
+ */
+static void test_random_series(void) {
+    static rpm_value_t series[SERIES_MAX];
+    static rpm_value_t sorted[SERIES_MAX];
+    pulse_rng_t rng;
+
+    for (uint64_t seed = 1; seed <= 50; seed++) {
+        pulse_rng_seed(&rng, seed);
+        size_t n = 1 + (size_t)(pulse_rng_uniform(&rng) * SERIES_MAX);
+        // Spread over the sketch range on a log scale, like fans of all sizes
+        double lo = 20 + pulse_rng_uniform(&rng) * 2000;
+        double hi = lo * (1.0 + pulse_rng_uniform(&rng) * 20);
+
+        rpm_stats_t stats;
+        stats_init(&stats);
+        double sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            double rpm = lo + (hi - lo) * pulse_rng_uniform(&rng);
+            series[i] = (rpm_value_t)(rpm * RPM_SCALE);
+            sum += test_rpm(series[i]);
+            stats_update(&stats, series[i]);
+
+            // Window extremes over the last STATS_WINDOW values, at every step
+            size_t from = i + 1 > STATS_WINDOW ? i + 1 - STATS_WINDOW : 0;
+            rpm_value_t wmin = series[from], wmax = series[from];
+            for (size_t j = from; j <= i; j++) {
+                if (series[j] < wmin) wmin = series[j];
+                if (series[j] > wmax) wmax = series[j];
+            }
+            TEST_CHECK(stats_window_min(&stats) == wmin);
+            TEST_CHECK(stats_window_max(&stats) == wmax);
+        }
+
+        memcpy(sorted, series, n * sizeof(*series));
+        qsort(sorted, n, sizeof(*sorted), compare_rpm);
+
+        TEST_CHECK_INT(stats.count, n);
+        TEST_CHECK(stats.min == sorted[0]);
+        TEST_CHECK(stats.max == sorted[n - 1]);
+        // The fixed-point average is whole milli-RPM
+        double avg_error = test_rpm(stats_avg(&stats)) - sum / (double)n;
+        TEST_CHECK(fabs(avg_error) <= 1.0 / RPM_SCALE * (RPM_SCALE > 1) + 1e-9 * sum / (double)n);
+
+        // The EWMA stays within the range of the series
+        TEST_CHECK(stats_ewma(&stats) >= sorted[0] && stats_ewma(&stats) <= sorted[n - 1]);
+
+        // Nearest-rank percentiles within the sketch's bin width (about 2%)
+        static const unsigned int permille[] = {10, 250, 500, 950, 990, 1000};
+        for (size_t q = 0; q < sizeof(permille) / sizeof(permille[0]); q++) {
+            size_t rank = (permille[q] * n + 999) / 1000;
+            if (rank == 0) rank = 1;
+            TEST_CHECK_NEAR(test_rpm(stats_percentile(&stats, permille[q])), test_rpm(sorted[rank - 1]), 0.02);
+        }
+
+        // The summary carries exactly what the accessors return
+        rpm_summary_t summary;
+        stats_summarize(&stats, &summary);
+        TEST_CHECK_INT(summary.count, n);
+        TEST_CHECK(summary.min == stats.min && summary.max == stats.max);
+        TEST_CHECK(summary.avg == stats_avg(&stats) && summary.ewma == stats_ewma(&stats));
+        TEST_CHECK(summary.window_min == stats_window_min(&stats));
+        TEST_CHECK(summary.window_max == stats_window_max(&stats));
+        TEST_CHECK(summary.p50 == stats_percentile(&stats, 500));
+        TEST_CHECK(summary.p95 == stats_percentile(&stats, 950));
+        TEST_CHECK(summary.p99 == stats_percentile(&stats, 990));
+    }
+}
+
+void test_stats(void) {
+    test_empty();
+    test_basic();
+    test_constant();
+    test_random_series();
+}